@@ -0,0 +1,14 @@
+FIND_PATH(SYSTEM_LZ4_INCLUDE_DIR lz4.h)
+IF (SYSTEM_LZ4_INCLUDE_DIR)
+  MESSAGE(STATUS "Found LZ4 include dir")
+  FIND_LIBRARY(SYSTEM_LZ4_LIBRARY lz4)
+  IF (SYSTEM_LZ4_LIBRARY)
+    MESSAGE(STATUS "Found LZ4 library")
+    SET(LZ4_INCLUDE_DIR ${SYSTEM_LZ4_INCLUDE_DIR})
+    SET(LZ4_LIBRARY ${SYSTEM_LZ4_LIBRARY})
+  ELSE ()
+    MESSAGE(FATAL_ERROR "Found LZ4 headers, but not the library")
+  ENDIF ()
+ELSE ()
+  MESSAGE(STATUS "Did not find system LZ4")
+ENDIF ()
@@ -126,6 +126,16 @@ class Column {
     return is_null() == NULL ? bool_const_ptr(NULL) : is_null() + offset;
   }
 
+  // Returns true if all the values in the column are known to be equal to the
+  // first one, e.g. a literal broadcast to every row. The data is materialized
+  // all the same, so the column can be read like any other; consumers that
+  // care can read just the first value instead. Says nothing about is_null().
+  bool is_constant() const { return is_constant_; }
+
+  // Declares whether all the values in the column are equal. Reset() clears
+  // it; ResetFrom() and ResetFromPlusOffset() copy it from the other column.
+  void set_is_constant(bool is_constant) { is_constant_ = is_constant; }
+
   // Updates the column to point to a new place.
   // Ownership of data and is_null stays with the callee.
   void Reset(VariantConstPointer data, bool_const_ptr is_null) {
@@ -135,6 +145,7 @@ class Column {
         << "'" << attribute().name() << "'";
     data_ = data;
     is_null_ = is_null;
+    is_constant_ = false;
   }
 
   // Updates the column to point to a new place, the same as pointed to by the
@@ -145,6 +156,7 @@ class Column {
         << "Type mismatch; trying to reset " << type_info().name() << " from "
         << other.type_info().name();
     Reset(other.data(), other.is_null());
+    is_constant_ = other.is_constant();
   }
 
   // Updates the column to point to a new place, as pointed to by the specified
@@ -155,6 +167,7 @@ class Column {
         << "Type mismatch; trying to reset " << type_info().name() << " from "
         << other.type_info().name();
     Reset(other.data_plus_offset(offset), other.is_null_plus_offset(offset));
+    is_constant_ = other.is_constant();
   }
 
   // Resets only the is_null vector. If the column is not_nullable, does
@@ -169,7 +182,12 @@ class Column {
  private:
   // Only the view to create an uninitialized Column.
   friend class View;
-  Column() : attribute_(NULL), type_info_(NULL), data_(NULL), is_null_(NULL) {}
+  Column()
+      : attribute_(NULL),
+        type_info_(NULL),
+        data_(NULL),
+        is_null_(NULL),
+        is_constant_(false) {}
 
   // Must be called before use, if the no-arg constructor was used to create.
   // Ownership of the attribute remains with the caller.
@@ -188,6 +206,7 @@ class Column {
 
   VariantConstPointer data_;
   bool_const_ptr is_null_;
+  bool is_constant_;
   DISALLOW_COPY_AND_ASSIGN(Column);
 };
 
@@ -285,13 +304,20 @@ class OwnedColumn {
 
 // Read-only view of a multi-column 'block' of data. The data is usually owned
 // by one or more Blocks (below).
+//
+// A view may carry a selection vector: then its rows are the rows of the
+// columns at the (increasing) positions selection()[0 .. row_count()), and the
+// other rows of the columns are skipped. Such views are only returned by
+// Cursor::NextSelected(), to consumers that read the columns through the
+// selection; everywhere else the selection is NULL and the view is dense.
 class View {
  public:
   // Creates an empty view that can hold data of the specified schema.
   explicit View(const TupleSchema& schema)
       : schema_(schema),
         columns_(new Column[schema.attribute_count()]),
-        row_count_(0) {
+        row_count_(0),
+        selection_(NULL) {
     Init();
   }
 
@@ -299,7 +325,8 @@ class View {
   View(const View& other)
       : schema_(other.schema()),
         columns_(new Column[other.schema().attribute_count()]),
-        row_count_(0) {
+        row_count_(0),
+        selection_(NULL) {
     Init();
     ResetFrom(other);
   }
@@ -308,7 +335,8 @@ class View {
   explicit View(const View& other, rowcount_t offset, rowcount_t row_count)
       : schema_(other.schema()),
         columns_(new Column[other.schema().attribute_count()]),
-        row_count_(0) {
+        row_count_(0),
+        selection_(NULL) {
     Init();
     ResetFromSubRange(other, offset, row_count);
   }
@@ -319,7 +347,8 @@ class View {
                                        column.attribute().type(),
                                        column.attribute().nullability())),
         columns_(new Column[1]),
-        row_count_(row_count) {
+        row_count_(row_count),
+        selection_(NULL) {
     Init();
     mutable_column(0)->ResetFrom(column);
   }
@@ -336,6 +365,20 @@ class View {
   // Sets the row count. Unchecked.
   void set_row_count(const rowcount_t row_count) { row_count_ = row_count; }
 
+  // Returns the positions, in the columns, of the view's row_count() rows; or
+  // NULL if the view is dense (its rows are the first row_count() rows of the
+  // columns).
+  const rowid_t* selection() const { return selection_; }
+
+  // Sets the selection vector; NULL makes the view dense. The vector is not
+  // copied, and must outlive the view's use.
+  void set_selection(const rowid_t* selection) { selection_ = selection; }
+
+  // Returns the position, in the columns, of the view's index-th row.
+  rowid_t row_position(rowid_t index) const {
+    return selection_ == NULL ? index : selection_[index];
+  }
+
   // Returns an immutable reference to the specified column.
   const Column& column(int column_index) const {
     DCHECK_GE(column_index, 0);
@@ -356,17 +399,28 @@ class View {
       mutable_column(i)->ResetFrom(other.column(i));
     }
     set_row_count(other.row_count());
+    set_selection(other.selection());
   }
 
   // Resets View's columns from a sub-range in an another View. Sets the
-  // row_count as well.
+  // row_count (and the selection) as well. If the other view has a selection,
+  // the columns are shared as they are, and the sub-range is taken from the
+  // selection vector.
   void ResetFromSubRange(const View& other,
                          rowcount_t offset,
                          rowcount_t row_count) {
     DCHECK_LE(offset, other.row_count());
     DCHECK_LE(offset + row_count, other.row_count());
-    for (int i = 0; i < column_count(); ++i) {
-      mutable_column(i)->ResetFromPlusOffset(other.column(i), offset);
+    if (other.selection() != NULL) {
+      for (int i = 0; i < column_count(); ++i) {
+        mutable_column(i)->ResetFrom(other.column(i));
+      }
+      set_selection(other.selection() + offset);
+    } else {
+      for (int i = 0; i < column_count(); ++i) {
+        mutable_column(i)->ResetFromPlusOffset(other.column(i), offset);
+      }
+      set_selection(NULL);
     }
     set_row_count(row_count);
   }
@@ -376,9 +430,13 @@ class View {
   // Note: views can only more forward; the offset is unsigned.
   void Advance(rowcount_t offset) {
     DCHECK_LE(offset, row_count());
-    for (int i = 0; i < column_count(); i++) {
-      Column* column = mutable_column(i);
-      column->ResetFromPlusOffset(*column, offset);
+    if (selection_ != NULL) {
+      selection_ += offset;
+    } else {
+      for (int i = 0; i < column_count(); i++) {
+        Column* column = mutable_column(i);
+        column->ResetFromPlusOffset(*column, offset);
+      }
     }
     row_count_ -= (row_count_ < offset ? row_count_ : offset);
   }
@@ -398,6 +456,7 @@ class View {
   const TupleSchema schema_;
   unique_ptr<Column[]> columns_;
   rowcount_t row_count_;
+  const rowid_t* selection_;
   // Views are copyable.
 };
 
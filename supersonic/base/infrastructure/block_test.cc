@@ -181,10 +181,59 @@ TEST_F(ViewTest, SubRangeResetWorks) {
             view.column(1).is_null());
 }
 
+TEST_F(ViewTest, SelectionIsSharedAndAdvanced) {
+  const rowid_t selection[] = { 0, 2, 3 };
+  View view(test_view());
+  view.set_selection(selection);
+  view.set_row_count(3);
+  EXPECT_EQ(2, view.row_position(1));
+
+  View copy(view);
+  EXPECT_EQ(selection, copy.selection());
+  EXPECT_EQ(3, copy.row_count());
+
+  // Sub-ranges and advancing move along the selection, not the columns.
+  View sub_range(view, 1, 2);
+  EXPECT_EQ(selection + 1, sub_range.selection());
+  EXPECT_EQ(2, sub_range.row_count());
+  EXPECT_EQ(test_view().column(0).data(), sub_range.column(0).data());
+  view.Advance(2);
+  EXPECT_EQ(1, view.row_count());
+  EXPECT_EQ(3, view.row_position(0));
+  EXPECT_EQ("raw", view.column(0).typed_data<STRING>()[view.row_position(0)]);
+
+  // A dense sub-range clears the selection.
+  sub_range.ResetFromSubRange(test_view(), 1, 2);
+  EXPECT_TRUE(sub_range.selection() == NULL);
+  EXPECT_EQ(test_view().column(1).typed_data<INT32>() + 1,
+            sub_range.column(1).data());
+}
+
 TEST_F(ViewTest, ConstructFromColumn) {
   View view(test_view().column(1), 3);
   EXPECT_EQ(3, view.row_count());
   EXPECT_EQ(view.column(0).data(), test_view().column(1).data());
 }
 
+TEST_F(ViewTest, ConstantFlagIsCopiedAndCleared) {
+  View view(test_view());
+  EXPECT_FALSE(view.column(1).is_constant());
+  view.mutable_column(1)->set_is_constant(true);
+
+  View copy(view);
+  EXPECT_TRUE(copy.column(1).is_constant());
+  EXPECT_FALSE(copy.column(0).is_constant());
+  View sub_range(view, 1, 2);
+  EXPECT_TRUE(sub_range.column(1).is_constant());
+
+  // Pointing the column at other data clears the flag.
+  copy.mutable_column(1)->Reset(test_view().column(1).data(),
+                                test_view().column(1).is_null());
+  EXPECT_FALSE(copy.column(1).is_constant());
+  copy.ResetFrom(view);
+  EXPECT_TRUE(copy.column(1).is_constant());
+  copy.ResetFrom(test_view());
+  EXPECT_FALSE(copy.column(1).is_constant());
+}
+
 }  // namespace supersonic
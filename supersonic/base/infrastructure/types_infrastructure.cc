@@ -655,6 +655,34 @@ ColumnHasher GetColumnHasher(DataType type, bool update, bool is_not_null) {
                             DefaultColumnHasherResolver>(type, resolver);
 }
 
+template<DataType type, bool update>
+void KeyColumnHashComputerFn(const VariantConstPointer data,
+                             bool_const_ptr is_null,
+                             size_t const row_count,
+                             size_t* hashes) {
+  KeyColumnHashComputer<type, update> hash;
+  hash(data.as<type>(), is_null, row_count, hashes);
+}
+
+struct KeyColumnHasherResolver {
+  explicit KeyColumnHasherResolver(bool update) : update(update) {}
+  template<DataType type>
+  ColumnHasher operator()() const {
+    if (update) {
+      return &KeyColumnHashComputerFn<type, true>;
+    } else {
+      return &KeyColumnHashComputerFn<type, false>;
+    }
+  }
+  bool update;
+};
+
+ColumnHasher GetKeyColumnHasher(DataType type, bool update) {
+  KeyColumnHasherResolver resolver(update);
+  return TypeSpecialization<ColumnHasher,
+                            KeyColumnHasherResolver>(type, resolver);
+}
+
 EqualityComparator GetEqualsComparator(DataType left_type,
                                        DataType right_type,
                                        bool left_not_null,
@@ -16,7 +16,10 @@
 #include "supersonic/base/infrastructure/types_infrastructure.h"
 
 #include <string>
+#include <unordered_set>
+#include <vector>
 namespace supersonic {using std::string; }
+namespace supersonic {using std::vector; }
 
 #include "supersonic/utils/integral_types.h"
 #include "supersonic/base/exception/result.h"
@@ -536,6 +539,106 @@ TEST_F(ColumnHasherTest, ShouldHashNotNullColumns) {
   EXPECT_EQ(reference(data[3]), result[3]);
 }
 
+class KeyColumnHasherTest : public testing::Test {};
+
+TEST_F(KeyColumnHasherTest, ShouldHashColumns) {
+  const int64_t data[] = { -5, 0, 4, 4, 1LL << 40, (1LL << 40) + 1 };
+  small_bool_array is_null;
+  const bool is_null_data[] = { false, false, false, true, false, false };
+  bit_pointer::FillFrom(is_null.mutable_data(), is_null_data, 6);
+  ColumnHasher hasher = GetKeyColumnHasher(INT64, false);
+  size_t result[6];
+  hasher(data, is_null.const_data(), 6, result);
+  EXPECT_EQ(kNullKeyHash, result[3]);
+  std::unordered_set<size_t> distinct(result, result + 6);
+  EXPECT_EQ(6, distinct.size());
+
+  size_t not_null_result[6];
+  hasher(data, bool_ptr(NULL), 6, not_null_result);
+  EXPECT_EQ(result[0], not_null_result[0]);
+  EXPECT_EQ(result[2], not_null_result[2]);
+  EXPECT_EQ(not_null_result[2], not_null_result[3]);
+  EXPECT_EQ(result[5], not_null_result[5]);
+}
+
+TEST_F(KeyColumnHasherTest, ShouldSpreadIntegerBits) {
+  // Consecutive keys differ in the low 7 bits of their hashes (used as tags
+  // by RowHashSet) much more often than not.
+  const int kRowCount = 1024;
+  int32_t data[kRowCount];
+  for (int i = 0; i < kRowCount; ++i) data[i] = i << 16;
+  size_t result[kRowCount];
+  GetKeyColumnHasher(INT32, false)(data, bool_ptr(NULL), kRowCount, result);
+  std::unordered_set<size_t> low_bits;
+  for (int i = 0; i < kRowCount; ++i) low_bits.insert(result[i] & 0x7f);
+  EXPECT_LT(100, low_bits.size());
+}
+
+// Counts the distinct tags (the low 7 bits) and groups (the next 10 bits) that
+// RowHashSet would take from the hashes.
+static void CountTagsAndGroups(const size_t* hashes, int row_count,
+                               size_t* tag_count, size_t* group_count) {
+  std::unordered_set<size_t> tags;
+  std::unordered_set<size_t> groups;
+  for (int i = 0; i < row_count; ++i) {
+    tags.insert(hashes[i] & 0x7f);
+    groups.insert((hashes[i] >> 7) & 0x3ff);
+  }
+  *tag_count = tags.size();
+  *group_count = groups.size();
+}
+
+TEST_F(KeyColumnHasherTest, ShouldSpreadIntegralDoubles) {
+  // Their low mantissa bits are all zero.
+  const int kRowCount = 100000;
+  vector<double> data(kRowCount);
+  for (int i = 0; i < kRowCount; ++i) data[i] = i + 1;
+  vector<size_t> result(kRowCount);
+  GetKeyColumnHasher(DOUBLE, false)(data.data(), bool_ptr(NULL), kRowCount,
+                                    result.data());
+  size_t tag_count;
+  size_t group_count;
+  CountTagsAndGroups(result.data(), kRowCount, &tag_count, &group_count);
+  EXPECT_EQ(128, tag_count);
+  EXPECT_EQ(1024, group_count);
+}
+
+TEST_F(KeyColumnHasherTest, ShouldSpreadHighInt64Bits) {
+  const int kRowCount = 100000;
+  vector<int64_t> data(kRowCount);
+  for (int i = 0; i < kRowCount; ++i) data[i] = static_cast<int64_t>(i) << 40;
+  vector<size_t> result(kRowCount);
+  GetKeyColumnHasher(INT64, false)(data.data(), bool_ptr(NULL), kRowCount,
+                                   result.data());
+  size_t tag_count;
+  size_t group_count;
+  CountTagsAndGroups(result.data(), kRowCount, &tag_count, &group_count);
+  EXPECT_EQ(128, tag_count);
+  EXPECT_EQ(1024, group_count);
+}
+
+TEST_F(KeyColumnHasherTest, ShouldHashUpdateColumns) {
+  const StringPiece data[] = { "bar", "barr", "foo", "foo" };
+  small_bool_array is_null;
+  const bool is_null_data[] = { false, false, true, false };
+  bit_pointer::FillFrom(is_null.mutable_data(), is_null_data, 4);
+  ColumnHasher hasher = GetKeyColumnHasher(STRING, true);
+  size_t result[] = { 1, 2, 3, 4 };
+  hasher(data, is_null.const_data(), 4, result);
+  EXPECT_EQ(1 * 29 + HashString(data[0]), result[0]);
+  EXPECT_EQ(2 * 29 + HashString(data[1]), result[1]);
+  EXPECT_EQ(3 * 29 + kNullKeyHash, result[2]);
+  EXPECT_EQ(4 * 29 + HashString(data[2]), result[3]);
+}
+
+TEST_F(KeyColumnHasherTest, ShouldHashFloatingPointByRepresentation) {
+  const double data[] = { 1.5, 1.5, 2.5 };
+  size_t result[3];
+  GetKeyColumnHasher(DOUBLE, false)(data, bool_ptr(NULL), 3, result);
+  EXPECT_EQ(result[0], result[1]);
+  EXPECT_NE(result[0], result[2]);
+}
+
 struct TestFunctor {
   template<DataType type>
   FailureOr<DataType> operator ()() const {
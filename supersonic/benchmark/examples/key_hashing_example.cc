@@ -0,0 +1,138 @@
+// Copyright 2012 Google Inc. All Rights Reserved.
+//
+// Licensed under the Apache License, Version 2.0 (the "License");
+// you may not use this file except in compliance with the License.
+// You may obtain a copy of the License at
+//
+//     http://www.apache.org/licenses/LICENSE-2.0
+//
+// Unless required by applicable law or agreed to in writing, software
+// distributed under the License is distributed on an "AS IS" BASIS,
+// WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+// See the License for the specific language governing permissions and
+// limitations under the License.
+//
+// Benchmark of the hashing of multi-column keys: the per-type key column
+// hashers used by the row hash sets (GetKeyColumnHasher) against the generic
+// column hashers (GetColumnHasher), and GroupAggregate over keys of the same
+// shapes.
+
+#include <memory>
+#include "supersonic/utils/std_namespace.h"
+#include "supersonic/benchmark/examples/common_utils.h"
+#include "supersonic/supersonic.h"
+#include "supersonic/testing/block_builder.h"
+
+#include "supersonic/utils/file_util.h"
+#include "supersonic/utils/random.h"
+#include "supersonic/utils/walltime.h"
+
+#include <gflags/gflags.h>
+DEFINE_string(output_directory, "", "Directory to which the output files will"
+    " be written.");
+DEFINE_int32(hashing_passes, 20, "Number of passes over the keys when timing"
+    " the column hashers.");
+
+namespace supersonic {
+
+namespace {
+
+const size_t kInputRowCount = 1000000;
+const size_t kGroupNum = 1000;
+
+// Key columns INT32, INT64, STRING, DATE, DOUBLE, and an INT32 value column.
+unique_ptr<Block> CreateKeys() {
+  MTRandom random(0);
+  BlockBuilder<INT32, INT64, STRING, DATE, DOUBLE, INT32> builder;
+  for (int64_t i = 0; i < kInputRowCount; ++i) {
+    const int64_t group = random.Rand32() % kGroupNum;
+    builder.AddRow(group % 7, group * 1000003,
+                   StringPrintf("key_%" PRIi64, group % 13),
+                   15000 + group % 11, group * 0.5, random.Rand32());
+  }
+  return builder.Build();
+}
+
+typedef ColumnHasher (*ColumnHasherFactory)(DataType type, bool update);
+
+ColumnHasher GetNullableColumnHasher(DataType type, bool update) {
+  return GetColumnHasher(type, update, false);
+}
+
+// Hashes the first key_column_count columns of the keys, a view of
+// Cursor::kDefaultRowCount rows at a time, like the row hash sets do. Returns
+// nanoseconds per row.
+double TimeHashing(const View& keys, int key_column_count,
+                   ColumnHasherFactory hasher_factory) {
+  vector<ColumnHasher> hashers;
+  for (int c = 0; c < key_column_count; ++c) {
+    hashers.push_back(
+        hasher_factory(keys.schema().attribute(c).type(), c != 0));
+  }
+  size_t hash[Cursor::kDefaultRowCount];
+  size_t checksum = 0;
+  const int64_t start = GetCurrentTimeMicros();
+  for (int pass = 0; pass < FLAGS_hashing_passes; ++pass) {
+    for (rowcount_t offset = 0; offset < keys.row_count();
+         offset += Cursor::kDefaultRowCount) {
+      const rowcount_t row_count =
+          std::min(keys.row_count() - offset, Cursor::kDefaultRowCount);
+      for (int c = 0; c < key_column_count; ++c) {
+        const Column& column = keys.column(c);
+        hashers[c](column.data_plus_offset(offset),
+                   column.is_null_plus_offset(offset), row_count, hash);
+      }
+      checksum += hash[0];
+    }
+  }
+  const int64_t elapsed = GetCurrentTimeMicros() - start;
+  // Keeps the hashing from being optimized away.
+  VLOG(1) << "Checksum: " << checksum;
+  return elapsed * 1e3 / (FLAGS_hashing_passes * keys.row_count());
+}
+
+unique_ptr<Operation> CreateGroup(int key_column_count) {
+  auto key = make_unique<CompoundSingleSourceProjector>();
+  for (int c = 0; c < key_column_count; ++c) {
+    key->add(ProjectAttributeAt(c));
+  }
+  auto agg = make_unique<AggregationSpecification>();
+  agg->AddAggregation(MAX, "col5", "col5_max");
+  return GroupAggregate(std::move(key), std::move(agg), nullptr,
+                        make_unique<Table>(CreateKeys()));
+}
+
+void Run() {
+  unique_ptr<Block> keys = CreateKeys();
+  for (int key_column_count = 1; key_column_count <= 5; ++key_column_count) {
+    const double generic = TimeHashing(keys->view(), key_column_count,
+                                       &GetNullableColumnHasher);
+    const double key = TimeHashing(keys->view(), key_column_count,
+                                   &GetKeyColumnHasher);
+    LOG(INFO) << key_column_count << " key column(s): "
+              << "GetColumnHasher " << generic << " ns/row, "
+              << "GetKeyColumnHasher " << key << " ns/row";
+  }
+
+  GraphVisualisationOptions options(DOT_FILE);
+  for (int key_column_count = 3; key_column_count <= 5; ++key_column_count) {
+    options.file_name = File::JoinPath(
+        FLAGS_output_directory,
+        StrCat("key_hashing_group_", key_column_count, ".dot"));
+    BenchmarkOperation(
+        CreateGroup(key_column_count),
+        StrCat("GroupAggregate by ", key_column_count, " columns"),
+        options,
+        /* 16KB (optimised for cache size) */ 16 * Cursor::kDefaultRowCount,
+        /* log result? */ false);
+  }
+}
+
+}  // namespace
+
+}  // namespace supersonic
+
+int main(int argc, char *argv[]) {
+  supersonic::SupersonicInit(&argc, &argv);
+  supersonic::Run();
+}
@@ -47,6 +47,8 @@ BenchmarkType GetBenchmarkType(const Cursor& cursor) {
     case VIEW:
     case SELECTION_VECTOR_VIEW:
     case REPEATING_BLOCK:
+    case MORSEL_SCAN:
+    case TABLE_FILE_INPUT:
       return LEAF;
 
     case COMPUTE:
@@ -58,6 +60,7 @@ BenchmarkType GetBenchmarkType(const Cursor& cursor) {
     case COALESCE:
     case FILTER:
     case FOREIGN_FILTER:
+    case JOIN_KEY_FILTER:
     case LIMIT:
     case ROWID_MERGE_JOIN:
       return PASS_SOME;
@@ -75,6 +78,7 @@ BenchmarkType GetBenchmarkType(const Cursor& cursor) {
     case HASH_JOIN:
       return JOIN;
 
+    case PARALLEL_GROUP_AGGREGATE:
     case PARALLEL_UNION:
       return PARALLEL;
 
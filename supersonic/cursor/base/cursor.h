@@ -147,6 +147,14 @@ class Cursor {
   // You typically call this function from some other cursor's Next().
   virtual ResultView Next(rowcount_t max_row_count) = 0;
 
+  // Like Next(), but the returned view may carry a selection vector (see
+  // View::selection()), letting the cursor skip rows without copying the rest,
+  // e.g. the rows rejected by a filter. Only call it if you read the view's
+  // columns through the selection. The default implementation returns Next().
+  virtual ResultView NextSelected(rowcount_t max_row_count) {
+    return Next(max_row_count);
+  }
+
   // Notifies the cursor that its results are no longer required. The cursor
   // is expected to interrupt processing, and should do so at its earliest
   // convenience. The cursor should signal premature termination by returning
@@ -15,6 +15,8 @@
 
 #include "supersonic/cursor/base/lookup_index.h"
 
+#include "supersonic/base/exception/exception.h"
+#include "supersonic/base/exception/exception_macros.h"
 #include "supersonic/base/infrastructure/projector.h"
 #include "supersonic/base/infrastructure/tuple_schema.h"
 
@@ -30,4 +32,9 @@ BoundSingleSourceProjector LookupIndex::value_selector() const {
   return result;
 }
 
+FailureOrOwned<LookupIndexCursor> LookupIndex::UnmatchedRows() const {
+  THROW(new Exception(ERROR_NOT_IMPLEMENTED,
+                      "The lookup index doesn't keep track of the matches"));
+}
+
 }  // namespace supersonic
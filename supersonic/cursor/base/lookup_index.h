@@ -59,6 +59,14 @@ class LookupIndex {
   // Returns true if the index has no items, thus MultiLookup is guaranteed
   // to always return an empty cursor.
   virtual bool empty() const = 0;
+
+  // Returns a cursor over the index rows that haven't matched any query row
+  // in the MultiLookups made so far; the query_ids() of its views are
+  // unspecified. To be called once all the lookups are done, and only on
+  // indexes that keep track of the matches (e.g. the ones built for a
+  // RIGHT_OUTER or FULL_OUTER hash join). The default implementation fails
+  // with ERROR_NOT_IMPLEMENTED.
+  virtual FailureOrOwned<LookupIndexCursor> UnmatchedRows() const;
 };
 
 class LookupIndexBuilder {
@@ -35,11 +35,14 @@ namespace supersonic {using std::string; }
 #include "supersonic/cursor/core/aggregator.h"
 #include "supersonic/cursor/infrastructure/basic_cursor.h"
 #include "supersonic/cursor/infrastructure/basic_operation.h"
+#include "supersonic/cursor/infrastructure/file_io.h"
 #include "supersonic/proto/supersonic.pb.h"
 
 namespace supersonic {
 
 class HybridGroupDebugOptions;
+class ParallelOptions;
+class TemporaryFileFactory;
 
 // Represents a collection of (symbolic) aggregation operations to perform on
 // a group of attributes.
@@ -248,6 +251,39 @@ unique_ptr<Operation> BestEffortGroupAggregate(
     unique_ptr<GroupAggregateOptions> options,
     unique_ptr<Operation> child);
 
+// Creates an operation to group and aggregate rows with the same key, like
+// GroupAggregate, on a number of threads (see ParallelOptions in parallel.h).
+// The input is read in morsels by the workers, each pre-aggregating its rows
+// within a small memory quota. The partial results are partitioned by the hash
+// of the key and then aggregated, partition by partition, in parallel. DISTINCT
+// aggregations aren't pre-aggregated; their input rows are partitioned
+// directly. The order of the result rows is unspecified.
+//
+// The whole input is consumed by the first call to Next(); the child must not
+// return WAITING_ON_BARRIER. The partitions are kept in memory until then, so
+// ERROR_MEMORY_EXCEEDED is returned if they don't fit; see below.
+unique_ptr<Operation> ParallelGroupAggregate(
+    unique_ptr<const SingleSourceProjector> group_by,
+    unique_ptr<const AggregationSpecification> aggregation,
+    unique_ptr<const ParallelOptions> options,
+    unique_ptr<Operation> child);
+
+// As above, with the partitions kept in memory limited to memory_quota bytes.
+// A partition that doesn't fit is written, together with the rows scattered to
+// it later, to a temporary file created by the temporary_file_factory, and
+// compressed as per spill_compression (see file_io.h); it is aggregated as it
+// is read back. The quota doesn't cover the workers' pre-aggregation, nor the
+// results. Doesn't take ownership of the factory, which must outlive the
+// operation's cursors.
+unique_ptr<Operation> ParallelGroupAggregate(
+    unique_ptr<const SingleSourceProjector> group_by,
+    unique_ptr<const AggregationSpecification> aggregation,
+    unique_ptr<const ParallelOptions> options,
+    size_t memory_quota,
+    TemporaryFileFactory* temporary_file_factory,
+    FileCompression spill_compression,
+    unique_ptr<Operation> child);
+
 // Bound version of GroupAggregate*. <original_allocator> is for the original
 // allocator if it was wrapped in MemoryLimit or GuaranteeMemory in <allocator>.
 FailureOrOwned<Cursor>
@@ -306,29 +342,45 @@ unique_ptr<Operation> AggregateClustersWithSpecifiedOutputBlockSize(
     unique_ptr<Operation> child);
 
 // Creates an operation to group and aggregate rows with the same key. Uses disk
-// if there's not enough memory to aggregate input data.
-// TODO(user): (Same as in sort.h) in ptab's words: Instead of directory prefix
-// I wish we use something like:
-//
-// class TemporaryFileFactory {
-//   File* CreateTemporaryFile();
-// }
-//
-// This way transition to d-server or other storage would be easier. Even for
-// testing it might be helpful.
+// if there's not enough memory to aggregate input data, in temporary files
+// created by the DefaultTemporaryFileFactory for the temporary_directory_prefix
+// (see temporary_file_factory.h).
+unique_ptr<Operation> HybridGroupAggregate(
+    unique_ptr<const SingleSourceProjector> group_by_columns,
+    unique_ptr<const AggregationSpecification> aggregation_specification,
+    size_t memory_quota,
+    StringPiece temporary_directory_prefix,
+    unique_ptr<Operation> child);
+
+// As above, with the partitions spilled to disk compressed as per
+// spill_compression (see file_io.h).
 unique_ptr<Operation> HybridGroupAggregate(
     unique_ptr<const SingleSourceProjector> group_by_columns,
     unique_ptr<const AggregationSpecification> aggregation_specification,
     size_t memory_quota,
     StringPiece temporary_directory_prefix,
+    FileCompression spill_compression,
+    unique_ptr<Operation> child);
+
+// As above, with the temporary files created by the temporary_file_factory.
+// Doesn't take ownership of the factory, which must outlive the operation's
+// cursors.
+unique_ptr<Operation> HybridGroupAggregate(
+    unique_ptr<const SingleSourceProjector> group_by_columns,
+    unique_ptr<const AggregationSpecification> aggregation_specification,
+    size_t memory_quota,
+    TemporaryFileFactory* temporary_file_factory,
+    FileCompression spill_compression,
     unique_ptr<Operation> child);
 
 // Bound version of HybridGroupAggregate. Takes ownership of group_by_columns,
-// debug_options and child. For normal use debug_options should be NULL.
+// debug_options and child. For normal use debug_options should be NULL. The
+// temporary_file_factory must outlive the cursor.
 FailureOrOwned<Cursor> BoundHybridGroupAggregate(
     unique_ptr<const SingleSourceProjector> group_by_columns,
     const AggregationSpecification& aggregation_specification,
-    StringPiece temporary_directory_prefix,
+    TemporaryFileFactory* temporary_file_factory,
+    FileCompression spill_compression,
     BufferAllocator* allocator,
     size_t memory_quota,
     const HybridGroupDebugOptions* debug_options,
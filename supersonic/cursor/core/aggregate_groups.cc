@@ -36,6 +36,7 @@ using std::make_unique;
 #include "supersonic/base/infrastructure/block.h"
 #include "supersonic/base/infrastructure/projector.h"
 #include "supersonic/base/infrastructure/types.h"
+#include "supersonic/base/infrastructure/view_copier.h"
 #include "supersonic/base/memory/memory.h"
 #include "supersonic/cursor/base/cursor.h"
 #include "supersonic/cursor/base/operation.h"
@@ -46,10 +47,13 @@ using std::make_unique;
 #include "supersonic/cursor/core/sort.h"
 #include "supersonic/cursor/infrastructure/basic_cursor.h"
 #include "supersonic/cursor/infrastructure/basic_operation.h"
+#include "supersonic/cursor/infrastructure/file_io.h"
+#include "supersonic/cursor/infrastructure/hash_partitioning.h"
 #include "supersonic/cursor/infrastructure/iterators.h"
 #include "supersonic/cursor/infrastructure/ordering.h"
 #include "supersonic/cursor/infrastructure/row_hash_set.h"
 #include "supersonic/cursor/infrastructure/table.h"
+#include "supersonic/cursor/infrastructure/temporary_file_factory.h"
 #include "supersonic/proto/supersonic.pb.h"
 #include "supersonic/utils/strings/join.h"
 #include "supersonic/utils/container_literal.h"
@@ -110,10 +114,25 @@ class GroupKeySet {
   // from input view finds an index of its key in the key block and puts
   // these indexes in the result table.
   // Input view can not have more rows then max_view_row_count_to_insert().
+  // If the view has a selection vector, the selected keys are first gathered
+  // (shallowly) into a block; returns 0 if the block can't be allocated.
   const rowid_t Insert(const View& view, FindResult* result) {
     CHECK_LE(view.row_count(), max_view_row_count_to_insert());
-    key_projector_->Project(view, &child_key_view_);
-    child_key_view_.set_row_count(view.row_count());
+    if (view.selection() != NULL) {
+      if (selected_keys_.row_capacity() == 0 &&
+          !selected_keys_.Reallocate(max_view_row_count_to_insert())) {
+        return 0;
+      }
+      CHECK_EQ(view.row_count(),
+               selected_keys_copier_.Copy(view.row_count(), view,
+                                          view.selection(), 0,
+                                          &selected_keys_));
+      child_key_view_.ResetFromSubRange(selected_keys_.view(), 0,
+                                        view.row_count());
+    } else {
+      key_projector_->Project(view, &child_key_view_);
+      child_key_view_.set_row_count(view.row_count());
+    }
     return key_row_set_.Insert(child_key_view_, result);
   }
 
@@ -127,6 +146,8 @@ class GroupKeySet {
               const int64_t max_unique_keys_in_result)
       : key_projector_(std::move(group_by)),
         child_key_view_(key_projector_->result_schema()),
+        selected_keys_(key_projector_->result_schema(), allocator),
+        selected_keys_copier_(key_projector_.get(), false),
         key_row_set_(key_projector_->result_schema(), allocator,
                      max_unique_keys_in_result) {}
 
@@ -145,6 +166,11 @@ class GroupKeySet {
   // View over an input view from child but with only key columns.
   View child_key_view_;
 
+  // Keys of the rows selected in an input view, gathered for the row hash set,
+  // which takes dense views. Allocated on first use.
+  Block selected_keys_;
+  SelectiveViewCopier selected_keys_copier_;
+
   row_hash_set::RowHashSet key_row_set_;
 
   DISALLOW_COPY_AND_ASSIGN(GroupKeySet);
@@ -271,7 +297,11 @@ class GroupAggregateCursor : public BasicCursor {
         best_effort_(best_effort),
         input_exhausted_(false),
         reset_aggregator_in_processinput_(false),
-        max_unique_keys_in_result_(max_unique_keys_in_result) {}
+        max_unique_keys_in_result_(max_unique_keys_in_result) {
+    // Both the key set and the aggregator read the input through selection
+    // vectors, e.g. from a filter, so no need to compact the input rows.
+    child_.set_accept_selection(true);
+  }
 
  private:
   // Process as many rows from input as can fit into result block. If after the
@@ -492,15 +522,15 @@ class GroupAggregateOperation : public BasicOperation {
 
 // Hybrid group implementation classes and functions.
 
-// Hybrid group aggregate uses disk-based sorting to allow processing more data
-// than would fit in memory.
+// Hybrid group aggregate uses disk-based hash partitioning to allow processing
+// more data than would fit in memory.
 //
 // The key steps of the algorithm are:
 // - DISTINCT aggregation elimination
 // - preaggregation with best-effort GroupAggregate
-// - sorting the preaggregated data
-// - combining preaggregated rows on duplicate keys
-// - final aggregation using AggregateClusters.
+// - partitioning the preaggregated data on disk by the hash of the key
+// - combining preaggregated rows on duplicate keys, partition by partition
+// - final aggregation using GroupAggregate.
 //
 // The motivation for eliminating DISINCT aggregations is threefold:
 // - partial results of DISTINCT aggregations can't be easily combined,
@@ -529,10 +559,17 @@ class GroupAggregateOperation : public BasicOperation {
 // input - in this case sorting and final aggregation is not needed (which
 // improves performance).
 //
-// The preaggregated data is then sorted on the extended key and
-// AggregateClusters is performed to combine rows with equal keys.  In the last
-// step final aggregation is performed with AggregateClusters on the original
-// key.
+// The preaggregated data is then written to temporary files, partitioned by
+// the hash of the original key, so that each partition holds all the rows of
+// its groups. The partitions are read back one at a time, and best-effort
+// GroupAggregate on the extended key combines rows with equal keys within the
+// memory quota. If it succeeds, final aggregation is performed with
+// GroupAggregate on the original key. If it doesn't, the partially combined
+// rows are partitioned again, on the next bits of the hash, and the
+// subpartitions are processed the same way. A partition that can't be split
+// (e.g. a single group, with many distinct values of a DISTINCT aggregated
+// column) is sorted on the extended key instead, and both the combining and the
+// final aggregation are performed with AggregateClusters.
 
 // Analyzes grouping specification and sets up parameters for various stages of
 // hybrid group implementation.
@@ -797,70 +834,175 @@ class HybridGroupSetup {
   DISALLOW_COPY_AND_ASSIGN(HybridGroupSetup);
 };
 
+// The pregroup output is spilled to 2^kHybridGroupSpillPartitionBits
+// partitions, and so is every partition that needs to be split further.
+const int kHybridGroupSpillPartitionBits = 4;
+
+// A partition is split at most this many times; beyond that, it's sorted.
+// Each level takes its own kHybridGroupSpillPartitionBits bits of the hash.
+const int kHybridGroupMaxSpillLevel = 4;
+
+// Appends views to temporary files, one per partition, by the hash of the
+// (original) group-by key, so that all the rows of a group end up in the same
+// partition.
+class HybridGroupSpill {
+ public:
+  // The key is bound to the schema. Level is the level of the partitions being
+  // created; 0 for the partitioning of the pregroup output.
+  static FailureOrOwned<HybridGroupSpill> Create(
+      const TupleSchema& schema,
+      const SingleSourceProjector& key,
+      int level,
+      TemporaryFileFactory* temporary_file_factory,
+      FileCompression spill_compression,
+      BufferAllocator* allocator) {
+    FailureOrOwned<const BoundSingleSourceProjector> bound_key =
+        key.Bind(schema);
+    PROPAGATE_ON_FAILURE(bound_key);
+    unique_ptr<HybridGroupSpill> spill(
+        new HybridGroupSpill(schema, bound_key.move(), level, allocator));
+    if (!spill->block_.Reallocate(Cursor::kDefaultRowCount)) {
+      THROW(new Exception(
+          ERROR_MEMORY_EXCEEDED,
+          "Cannot allocate memory to partition the hybrid group input"));
+    }
+    for (int p = 0; p < (1 << kHybridGroupSpillPartitionBits); ++p) {
+      FailureOrOwned<TemporaryFileBuffer> file =
+          TemporaryFileBuffer::Create(temporary_file_factory,
+                                      spill_compression);
+      PROPAGATE_ON_FAILURE(file);
+      spill->partitions_.push_back(file.move());
+    }
+    return Success(std::move(spill));
+  }
+
+  int level() const { return level_; }
+
+  FailureOrVoid Write(const View& view) {
+    for (rowcount_t offset = 0; offset < view.row_count();
+         offset += Cursor::kDefaultRowCount) {
+      const View chunk(view, offset, std::min(view.row_count() - offset,
+                                              Cursor::kDefaultRowCount));
+      const rowcount_t row_count = chunk.row_count();
+      key_selector_->Project(chunk, &key_);
+      key_.set_row_count(row_count);
+      ComputeHashSubpartitions(key_, kHybridGroupSpillPartitionBits, level_,
+                               hash_, partition_);
+      GroupByPartition(partition_, row_count, partitions_.size(), order_,
+                       partition_offset_.data());
+      // Shallow; the rows are serialized right away.
+      copier_.Copy(row_count, chunk, order_, 0, &block_);
+      for (size_t p = 0; p < partitions_.size(); ++p) {
+        const rowcount_t partition_row_count =
+            partition_offset_[p + 1] - partition_offset_[p];
+        if (partition_row_count == 0) continue;
+        PROPAGATE_ON_FAILURE(partitions_[p]->Write(
+            View(block_.view(), partition_offset_[p], partition_row_count)));
+      }
+    }
+    return Success();
+  }
+
+  // Returns the files of the partitions, NULL for the empty ones. The spill
+  // can't be used afterwards.
+  vector<unique_ptr<TemporaryFileBuffer>> Finish() {
+    for (size_t p = 0; p < partitions_.size(); ++p) {
+      if (partitions_[p]->row_count() == 0) partitions_[p].reset();
+    }
+    return std::move(partitions_);
+  }
+
+ private:
+  HybridGroupSpill(const TupleSchema& schema,
+                   unique_ptr<const BoundSingleSourceProjector> key_selector,
+                   int level,
+                   BufferAllocator* allocator)
+      : key_selector_(std::move(key_selector)),
+        level_(level),
+        block_(schema, allocator),
+        copier_(schema, false),
+        key_(key_selector_->result_schema()),
+        partition_offset_((1 << kHybridGroupSpillPartitionBits) + 1) {}
+
+  std::unique_ptr<const BoundSingleSourceProjector> key_selector_;
+  const int level_;
+  vector<unique_ptr<TemporaryFileBuffer>> partitions_;
+  Block block_;
+  SelectiveViewCopier copier_;
+  View key_;
+  size_t hash_[Cursor::kDefaultRowCount];
+  int partition_[Cursor::kDefaultRowCount];
+  rowid_t order_[Cursor::kDefaultRowCount];
+  vector<rowcount_t> partition_offset_;
+  DISALLOW_COPY_AND_ASSIGN(HybridGroupSpill);
+};
+
 // Combines preaggregated results on repeated (extended) keys and the final
 // aggregation to compute the results for DISTINCT aggregations.
 class HybridGroupFinalAggregationCursor : public BasicCursor {
  public:
-  // Takes ownership of hybrid_group_setup, final_aggregator,
-  // final_group_by_columns and pregroup_cursor.
+  // Takes ownership of hybrid_group_setup and pregroup_cursor.
   HybridGroupFinalAggregationCursor(
       const TupleSchema& result_schema,
       unique_ptr<const HybridGroupSetup> hybrid_group_setup,
-      unique_ptr<Aggregator> final_aggregator,
-      unique_ptr<const BoundSingleSourceProjector> final_group_by_columns,
-      StringPiece temporary_directory_prefix,
+      size_t memory_quota,
+      TemporaryFileFactory* temporary_file_factory,
+      FileCompression spill_compression,
       BufferAllocator* allocator,
       unique_ptr<GroupAggregateCursor> pregroup_cursor)
       : BasicCursor(result_schema),
         is_waiting_on_barrier_supported_(
             pregroup_cursor->IsWaitingOnBarrierSupported()),
         hybrid_group_setup_(std::move(hybrid_group_setup)),
-        final_aggregator_(std::move(final_aggregator)),
-        final_group_by_columns_(std::move(final_group_by_columns)),
-        temporary_directory_prefix_(temporary_directory_prefix.ToString()),
+        memory_quota_(memory_quota),
+        temporary_file_factory_(temporary_file_factory),
+        spill_compression_(spill_compression),
         allocator_(allocator),
-        pregroup_cursor_(std::move(pregroup_cursor)) {
+        pregroup_schema_(pregroup_cursor->schema()),
+        pregroup_cursor_(std::move(pregroup_cursor)),
+        pregrouped_(false) {
   }
 
   virtual ResultView Next(rowcount_t max_row_count) {
-    if (result_cursor_ == NULL && sorter_ == NULL) {
+    if (!pregrouped_) {
       ResultView first_result = pregroup_cursor_->Next(
           numeric_limits<rowcount_t>::max());
       if (first_result.is_eos() || !first_result.has_data()) {
         return first_result;
       }
-      if (!pregroup_cursor_->CanReturnMoreData() &&
-          !hybrid_group_setup_->has_distinct_aggregations()) {
-        pregroup_cursor_->TruncateResultView();
-        // There are no distinct aggregations, so if pregroup fully aggregated
-        // all the data (a single output block), its result can be returned as
-        // final result.
+      pregrouped_ = true;
+      const bool fully_pregrouped = !pregroup_cursor_->CanReturnMoreData();
+      pregroup_cursor_->TruncateResultView();
+      if (fully_pregrouped) {
         LOG(INFO) << "HybridGroupAggregate not using disk.";
-        PROPAGATE_ON_FAILURE(SetResultCursor(std::move(pregroup_cursor_)));
-      } else {
-        // Pregroup best-effort didn't fully aggregate the data. Sorting data to
-        // combine duplicate pregroup keys. The final aggregation will be
-        // performed using AggregateClusters, as the data will also be sorted on
-        // the original key.
-        if (first_result.has_data()) {
-          pregroup_cursor_->TruncateResultView();
+        if (hybrid_group_setup_->has_distinct_aggregations()) {
+          // Pregroup fully aggregated all the data (a single output block) on
+          // the extended key; the final aggregation is done in memory.
+          FailureOrOwned<Cursor> aggregated =
+              CreateFinalAggregation(std::move(pregroup_cursor_));
+          PROPAGATE_ON_FAILURE(aggregated);
+          PROPAGATE_ON_FAILURE(SetResultCursor(aggregated.move()));
+        } else {
+          // There are no distinct aggregations, so if pregroup fully
+          // aggregated all the data, its result can be returned as final
+          // result.
+          PROPAGATE_ON_FAILURE(SetResultCursor(std::move(pregroup_cursor_)));
         }
+      } else {
+        // Pregroup best-effort didn't fully aggregate the data. Spilling it
+        // to partitions, by the original key, to be aggregated one by one.
         LOG(INFO) << "HybridGroupAggregate using disk ("
                   << (hybrid_group_setup_->has_distinct_aggregations()
                       ? "distinct aggregations" : "best-effort failed")
                   << ").";
-        FailureOrOwned<const BoundSingleSourceProjector> bound_group_by_columns(
-            hybrid_group_setup_->pregroup_group_by_columns().Bind(
-                pregroup_cursor_->schema()));
-        PROPAGATE_ON_FAILURE(bound_group_by_columns);
-        sorter_ = CreateUnbufferedSorter(
-            pregroup_cursor_->schema(),
-            make_unique<BoundSortOrder>(bound_group_by_columns.move()),
-            temporary_directory_prefix_,
-            allocator_);
+        FailureOrOwned<HybridGroupSpill> spill = HybridGroupSpill::Create(
+            pregroup_schema_, hybrid_group_setup_->group_by_columns_by_name(),
+            0, temporary_file_factory_, spill_compression_, allocator_);
+        PROPAGATE_ON_FAILURE(spill);
+        spill_ = spill.move();
       }
     }
-    if (result_cursor_ == NULL && sorter_ != NULL) {
+    if (spill_ != NULL) {
       while (true) {
         ResultView result = pregroup_cursor_->Next(
             numeric_limits<rowcount_t>::max());
@@ -871,53 +1013,22 @@ class HybridGroupFinalAggregationCursor : public BasicCursor {
         if (result.is_eos()) {
           break;
         }
-        VLOG(1) << "Writing " << result.view().row_count()
-                << " rows to UnbufferedSorter.";
-        FailureOr<rowcount_t> written = sorter_->Write(result.view());
-        PROPAGATE_ON_FAILURE(written);
-        CHECK_EQ(written.get(), result.view().row_count());
+        VLOG(1) << "Spilling " << result.view().row_count() << " rows.";
+        PROPAGATE_ON_FAILURE(spill_->Write(result.view()));
       }
-      // Aggregate to combine duplicated pregroup keys.
-      FailureOrOwned<Cursor> sorted = sorter_->GetResultCursor();
-      PROPAGATE_ON_FAILURE(sorted);
-      sorter_.reset();
-      FailureOrOwned<Aggregator> aggregator = Aggregator::Create(
-          hybrid_group_setup_->pregroup_combine_aggregation(),
-          sorted.get()->schema(),
-          allocator_,
-          1024);
-      PROPAGATE_ON_FAILURE(aggregator);
-      FailureOrOwned<const BoundSingleSourceProjector> sorted_group_by_columns =
-          hybrid_group_setup_->pregroup_group_by_columns().Bind(
-              sorted.get()->schema());
-      PROPAGATE_ON_FAILURE(sorted_group_by_columns);
-      FailureOrOwned<Cursor> combine_cursor =
-          BoundAggregateClusters(
-              sorted_group_by_columns.move(),
-              aggregator.move(),
-              allocator_,
-              sorted.move());
-      PROPAGATE_ON_FAILURE(combine_cursor);
-      // Restoring COUNT column nullability, so we have exactly the same schema
-      // that final_aggregator was built for.
-      FailureOrOwned<Cursor> combine_cursor_count_nonnullable =
-          hybrid_group_setup_->MakeCountColumnsNotNullable(
-              combine_cursor.move(), allocator_);
-      PROPAGATE_ON_FAILURE(combine_cursor_count_nonnullable);
-      // Final aggregation on the original key using AggregateClusters.
-      FailureOrOwned<Cursor> aggregated = BoundAggregateClusters(
-          std::move(final_group_by_columns_),
-          std::move(final_aggregator_),
-          allocator_,
-          combine_cursor_count_nonnullable.move());
-      PROPAGATE_ON_FAILURE(aggregated);
-      PROPAGATE_ON_FAILURE(SetResultCursor(aggregated.move()));
+      QueuePartitions(spill_.get());
+      spill_.reset();
+    }
+    while (true) {
+      if (result_cursor_ != NULL) {
+        ResultView result = result_cursor_->Next(max_row_count);
+        if (!result.is_eos() || pending_partitions_.empty()) return result;
+        // Releases the memory held by the partition's aggregation first.
+        result_cursor_.reset();
+      }
+      if (pending_partitions_.empty()) return ResultView::EOS();
+      PROPAGATE_ON_FAILURE(AggregateNextPartition());
     }
-    CHECK(sorter_ == NULL);
-    CHECK(result_cursor_ != NULL);
-    ResultView result = result_cursor_->Next(max_row_count);
-    PROPAGATE_ON_FAILURE(result);
-    return result;
   }
 
   virtual bool IsWaitingOnBarrierSupported() const {
@@ -950,6 +1061,205 @@ class HybridGroupFinalAggregationCursor : public BasicCursor {
   }
 
  private:
+  // A spilled partition of the pregroup output, waiting to be aggregated.
+  struct SpilledPartition {
+    std::unique_ptr<TemporaryFileBuffer> file;
+    int level;
+    // Set when splitting the partition didn't separate any of its rows (e.g.
+    // it's a single group, too large because of DISTINCT aggregations).
+    bool unsplittable;
+  };
+
+  // Queues the non-empty partitions of the spill for aggregation.
+  void QueuePartitions(HybridGroupSpill* spill) {
+    const int level = spill->level();
+    vector<unique_ptr<TemporaryFileBuffer>> files = spill->Finish();
+    int non_empty_count = 0;
+    for (size_t p = 0; p < files.size(); ++p) {
+      if (files[p] != NULL) ++non_empty_count;
+    }
+    for (size_t p = 0; p < files.size(); ++p) {
+      if (files[p] == NULL) continue;
+      pending_partitions_.push_back(
+          SpilledPartition{std::move(files[p]), level,
+                           level > 0 && non_empty_count == 1});
+    }
+  }
+
+  // Reads back the next spilled partition and combines its rows in memory.
+  // If they fit in memory_quota_, sets result_cursor_ to the final aggregation
+  // of the combined rows. Otherwise, spills the partially combined rows to
+  // the subpartitions, queued to be aggregated in turn. The partitions that
+  // can't be split any further are sorted and aggregated by clusters instead.
+  FailureOrVoid AggregateNextPartition() {
+    SpilledPartition partition = std::move(pending_partitions_.back());
+    pending_partitions_.pop_back();
+    const rowcount_t row_count = partition.file->row_count();
+    FailureOrOwned<Cursor> input =
+        partition.file->Read(pregroup_schema_, allocator_);
+    partition.file.reset();
+    PROPAGATE_ON_FAILURE(input);
+    if (partition.unsplittable ||
+        partition.level + 1 == kHybridGroupMaxSpillLevel) {
+      LOG(INFO) << "HybridGroupAggregate sorting a partition of " << row_count
+                << " rows.";
+      FailureOrOwned<Cursor> aggregated = SortAndAggregate(input.move());
+      PROPAGATE_ON_FAILURE(aggregated);
+      return SetResultCursor(aggregated.move());
+    }
+    // A single block is combined whatever the quota; the best-effort
+    // aggregation takes a block at a time anyway.
+    FailureOrOwned<GroupAggregateCursor> combine = CreateCombineAggregation(
+        row_count <= Cursor::kDefaultRowCount
+            ? numeric_limits<size_t>::max() : memory_quota_,
+        input.move());
+    PROPAGATE_ON_FAILURE(combine);
+    ResultView first_result = combine->Next(numeric_limits<rowcount_t>::max());
+    PROPAGATE_ON_FAILURE(first_result);
+    if (first_result.is_eos()) return Success();
+    const bool fully_combined = !combine->CanReturnMoreData();
+    combine->TruncateResultView();
+    // Restoring COUNT column nullability, so we have exactly the same schema
+    // as the pregroup output.
+    FailureOrOwned<Cursor> combined =
+        hybrid_group_setup_->MakeCountColumnsNotNullable(combine.move(),
+                                                         allocator_);
+    PROPAGATE_ON_FAILURE(combined);
+    if (fully_combined) {
+      FailureOrOwned<Cursor> aggregated =
+          CreateFinalAggregation(combined.move());
+      PROPAGATE_ON_FAILURE(aggregated);
+      return SetResultCursor(aggregated.move());
+    }
+    VLOG(1) << "Splitting a partition of " << row_count << " rows.";
+    FailureOrOwned<HybridGroupSpill> spill = HybridGroupSpill::Create(
+        pregroup_schema_, hybrid_group_setup_->group_by_columns_by_name(),
+        partition.level + 1, temporary_file_factory_, spill_compression_,
+        allocator_);
+    PROPAGATE_ON_FAILURE(spill);
+    while (true) {
+      ResultView result = combined->Next(numeric_limits<rowcount_t>::max());
+      PROPAGATE_ON_FAILURE(result);
+      if (result.is_eos()) break;
+      CHECK(result.has_data());
+      PROPAGATE_ON_FAILURE(spill->Write(result.view()));
+    }
+    QueuePartitions(spill.get());
+    return Success();
+  }
+
+  // Combines the pregroup results on repeated (extended) keys, within the
+  // quota (best-effort).
+  FailureOrOwned<GroupAggregateCursor> CreateCombineAggregation(
+      size_t quota, unique_ptr<Cursor> input) const {
+    FailureOrOwned<const BoundSingleSourceProjector> group_by_columns =
+        hybrid_group_setup_->pregroup_group_by_columns().Bind(
+            input->schema());
+    PROPAGATE_ON_FAILURE(group_by_columns);
+    auto limit_allocator = make_unique<MemoryLimit>(quota, false, allocator_);
+    FailureOrOwned<Aggregator> aggregator = Aggregator::Create(
+        hybrid_group_setup_->pregroup_combine_aggregation(), input->schema(),
+        limit_allocator.get(), 1024);
+    PROPAGATE_ON_FAILURE(aggregator);
+    return GroupAggregateCursor::Create(
+        group_by_columns.move(), aggregator.move(), std::move(limit_allocator),
+        allocator_,
+        true,  // best effort.
+        INT64_MAX,
+        std::move(input));
+  }
+
+  // Final aggregation on the original key of the fully combined rows. Takes
+  // no more memory than combining them did.
+  FailureOrOwned<Cursor> CreateFinalAggregation(
+      unique_ptr<Cursor> combined) const {
+    FailureOrOwned<const BoundSingleSourceProjector> group_by_columns =
+        hybrid_group_setup_->group_by_columns_by_name().Bind(
+            combined->schema());
+    PROPAGATE_ON_FAILURE(group_by_columns);
+    auto limit_allocator = make_unique<MemoryLimit>(
+        numeric_limits<size_t>::max(), false, allocator_);
+    FailureOrOwned<Aggregator> aggregator = Aggregator::Create(
+        hybrid_group_setup_->final_aggregation(), combined->schema(),
+        limit_allocator.get(), 1024);
+    PROPAGATE_ON_FAILURE(aggregator);
+    return BoundGroupAggregate(
+        group_by_columns.move(), aggregator.move(), std::move(limit_allocator),
+        allocator_,
+        false,  // not best effort.
+        std::move(combined));
+  }
+
+  // Sorts the (partially combined) pregroup results on the extended key, then
+  // combines them and performs the final aggregation using AggregateClusters.
+  FailureOrOwned<Cursor> SortAndAggregate(unique_ptr<Cursor> input) const {
+    FailureOrOwned<const BoundSingleSourceProjector> bound_group_by_columns(
+        hybrid_group_setup_->pregroup_group_by_columns().Bind(
+            input->schema()));
+    PROPAGATE_ON_FAILURE(bound_group_by_columns);
+    unique_ptr<Sorter> sorter = CreateUnbufferedSorter(
+        input->schema(),
+        make_unique<BoundSortOrder>(bound_group_by_columns.move()),
+        memory_quota_,
+        temporary_file_factory_,
+        spill_compression_,
+        allocator_,
+        NULL);
+    while (true) {
+      ResultView result = input->Next(numeric_limits<rowcount_t>::max());
+      PROPAGATE_ON_FAILURE(result);
+      if (result.is_eos()) break;
+      CHECK(result.has_data());
+      VLOG(1) << "Writing " << result.view().row_count()
+              << " rows to UnbufferedSorter.";
+      FailureOr<rowcount_t> written = sorter->Write(result.view());
+      PROPAGATE_ON_FAILURE(written);
+      CHECK_EQ(written.get(), result.view().row_count());
+    }
+    // Aggregate to combine duplicated pregroup keys.
+    FailureOrOwned<Cursor> sorted = sorter->GetResultCursor();
+    PROPAGATE_ON_FAILURE(sorted);
+    FailureOrOwned<Aggregator> aggregator = Aggregator::Create(
+        hybrid_group_setup_->pregroup_combine_aggregation(),
+        sorted.get()->schema(),
+        allocator_,
+        1024);
+    PROPAGATE_ON_FAILURE(aggregator);
+    FailureOrOwned<const BoundSingleSourceProjector> sorted_group_by_columns =
+        hybrid_group_setup_->pregroup_group_by_columns().Bind(
+            sorted.get()->schema());
+    PROPAGATE_ON_FAILURE(sorted_group_by_columns);
+    FailureOrOwned<Cursor> combine_cursor =
+        BoundAggregateClusters(
+            sorted_group_by_columns.move(),
+            aggregator.move(),
+            allocator_,
+            sorted.move());
+    PROPAGATE_ON_FAILURE(combine_cursor);
+    // Restoring COUNT column nullability, so we have exactly the same schema
+    // that the final aggregator is built for.
+    FailureOrOwned<Cursor> combine_cursor_count_nonnullable =
+        hybrid_group_setup_->MakeCountColumnsNotNullable(
+            combine_cursor.move(), allocator_);
+    PROPAGATE_ON_FAILURE(combine_cursor_count_nonnullable);
+    // Final aggregation on the original key using AggregateClusters.
+    FailureOrOwned<Aggregator> final_aggregator = Aggregator::Create(
+        hybrid_group_setup_->final_aggregation(),
+        combine_cursor_count_nonnullable->schema(),
+        allocator_,
+        1024);
+    PROPAGATE_ON_FAILURE(final_aggregator);
+    FailureOrOwned<const BoundSingleSourceProjector> final_group_by_columns =
+        hybrid_group_setup_->group_by_columns_by_name().Bind(
+            combine_cursor_count_nonnullable->schema());
+    PROPAGATE_ON_FAILURE(final_group_by_columns);
+    return BoundAggregateClusters(
+        final_group_by_columns.move(),
+        final_aggregator.move(),
+        allocator_,
+        combine_cursor_count_nonnullable.move());
+  }
+
   FailureOrVoid SetResultCursor(unique_ptr<Cursor> result_cursor) {
     FailureOrOwned<Cursor> result_cursor_fixed_nullability =
         hybrid_group_setup_->MakeCountColumnsNotNullable(
@@ -966,13 +1276,22 @@ class HybridGroupFinalAggregationCursor : public BasicCursor {
 
   bool is_waiting_on_barrier_supported_;
   unique_ptr<const HybridGroupSetup> hybrid_group_setup_;
-  unique_ptr<Aggregator> final_aggregator_;
-  unique_ptr<const BoundSingleSourceProjector> final_group_by_columns_;
+  // Memory for combining the rows of a spilled partition.
   size_t memory_quota_;
-  string temporary_directory_prefix_;
+  TemporaryFileFactory* temporary_file_factory_;
+  FileCompression spill_compression_;
   BufferAllocator* allocator_;
+  const TupleSchema pregroup_schema_;
   unique_ptr<GroupAggregateCursor> pregroup_cursor_;
-  unique_ptr<Sorter> sorter_;
+  // Set once the pregroup returned its first result.
+  bool pregrouped_;
+  // Receives the pregroup output when it's not fully aggregated.
+  unique_ptr<HybridGroupSpill> spill_;
+  // The partitions yet to aggregate; the last one goes first, so that a
+  // partition's subpartitions are aggregated before the other partitions.
+  vector<SpilledPartition> pending_partitions_;
+  // Iterates over the result of the current partition (or over the whole
+  // result, if there was no need to spill).
   unique_ptr<Cursor> result_cursor_;
   DISALLOW_COPY_AND_ASSIGN(HybridGroupFinalAggregationCursor);
 };
@@ -1039,7 +1358,8 @@ FailureOrOwned<Cursor> BoundGroupAggregateWithLimit(
 FailureOrOwned<Cursor> BoundHybridGroupAggregate(
     unique_ptr<const SingleSourceProjector> group_by_columns,
     const AggregationSpecification& aggregation_specification,
-    StringPiece temporary_directory_prefix,
+    TemporaryFileFactory* temporary_file_factory,
+    FileCompression spill_compression,
     BufferAllocator* allocator,
     size_t memory_quota,
     const HybridGroupDebugOptions* debug_options,
@@ -1102,9 +1422,9 @@ FailureOrOwned<Cursor> BoundHybridGroupAggregate(
   return Success(make_unique<HybridGroupFinalAggregationCursor>(
       result_schema.get(),
       hybrid_group_setup.move(),
-      final_aggregator.move(),
-      final_group_by_columns.move(),
-      temporary_directory_prefix,
+      memory_quota,
+      temporary_file_factory,
+      spill_compression,
       allocator,
       pregroup_cursor.move()));
 }
@@ -1115,13 +1435,15 @@ class HybridGroupAggregateOperation : public BasicOperation {
       unique_ptr<const SingleSourceProjector> group_by_columns,
       unique_ptr<const AggregationSpecification> aggregation_specification,
       size_t memory_quota,
-      StringPiece temporary_directory_prefix,
+      TemporaryFileFactory* temporary_file_factory,
+      FileCompression spill_compression,
       unique_ptr<Operation> child)
       : BasicOperation(std::move(child)),
         group_by_columns_(std::move(group_by_columns)),
         aggregation_specification_(std::move(aggregation_specification)),
         memory_quota_(memory_quota),
-        temporary_directory_prefix_(temporary_directory_prefix.ToString()) {}
+        temporary_file_factory_(temporary_file_factory),
+        spill_compression_(spill_compression) {}
 
   virtual ~HybridGroupAggregateOperation() {}
 
@@ -1131,7 +1453,8 @@ class HybridGroupAggregateOperation : public BasicOperation {
     return BoundHybridGroupAggregate(
         group_by_columns_->Clone(),
         *aggregation_specification_,
-        temporary_directory_prefix_,
+        temporary_file_factory_,
+        spill_compression_,
         buffer_allocator(),
         memory_quota_,
         NULL,
@@ -1142,7 +1465,8 @@ class HybridGroupAggregateOperation : public BasicOperation {
   std::unique_ptr<const SingleSourceProjector> group_by_columns_;
   std::unique_ptr<const AggregationSpecification> aggregation_specification_;
   size_t memory_quota_;
-  string temporary_directory_prefix_;
+  TemporaryFileFactory* temporary_file_factory_;
+  FileCompression spill_compression_;
   DISALLOW_COPY_AND_ASSIGN(HybridGroupAggregateOperation);
 };
 
@@ -1153,9 +1477,38 @@ HybridGroupAggregate(
     size_t memory_quota,
     StringPiece temporary_directory_prefix,
     unique_ptr<Operation> child) {
+  return HybridGroupAggregate(
+      std::move(group_by_columns), std::move(aggregation_specification),
+      memory_quota, temporary_directory_prefix, FILE_COMPRESSION_NONE,
+      std::move(child));
+}
+
+unique_ptr<Operation>
+HybridGroupAggregate(
+    unique_ptr<const SingleSourceProjector> group_by_columns,
+    unique_ptr<const AggregationSpecification> aggregation_specification,
+    size_t memory_quota,
+    StringPiece temporary_directory_prefix,
+    FileCompression spill_compression,
+    unique_ptr<Operation> child) {
+  return HybridGroupAggregate(
+      std::move(group_by_columns), std::move(aggregation_specification),
+      memory_quota, DefaultTemporaryFileFactory(temporary_directory_prefix),
+      spill_compression, std::move(child));
+}
+
+unique_ptr<Operation>
+HybridGroupAggregate(
+    unique_ptr<const SingleSourceProjector> group_by_columns,
+    unique_ptr<const AggregationSpecification> aggregation_specification,
+    size_t memory_quota,
+    TemporaryFileFactory* temporary_file_factory,
+    FileCompression spill_compression,
+    unique_ptr<Operation> child) {
   return make_unique<HybridGroupAggregateOperation>(
       std::move(group_by_columns), std::move(aggregation_specification),
-      memory_quota, temporary_directory_prefix, std::move(child));
+      memory_quota, temporary_file_factory, spill_compression,
+      std::move(child));
 }
 
 }  // namespace supersonic
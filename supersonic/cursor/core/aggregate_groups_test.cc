@@ -31,9 +31,15 @@
 #include "supersonic/cursor/base/operation.h"
 #include "supersonic/cursor/core/aggregate.h"
 #include "supersonic/cursor/core/aggregator.h"
+#include "supersonic/cursor/core/filter.h"
+#include "supersonic/cursor/core/ownership_taker.h"
 #include "supersonic/cursor/core/spy.h"
 #include "supersonic/cursor/core/sort.h"
 #include "supersonic/cursor/infrastructure/ordering.h"
+#include "supersonic/cursor/infrastructure/temporary_file_factory.h"
+#include "supersonic/expression/core/comparison_expressions.h"
+#include "supersonic/expression/core/projecting_expressions.h"
+#include "supersonic/expression/infrastructure/terminal_expressions.h"
 #include "supersonic/proto/supersonic.pb.h"
 #include "supersonic/testing/block_builder.h"
 #include "supersonic/testing/comparators.h"
@@ -81,7 +87,8 @@ static unique_ptr<Cursor> Sort(unique_ptr<Cursor> input) {
       std::move(bound_sort_order),
       std::move(bound_result_projector),
       1 << 20,
-      "",
+      DefaultTemporaryFileFactory(""),
+      FILE_COMPRESSION_NONE,
       HeapBufferAllocator::Get(),
       std::move(input))));
 }
@@ -272,6 +279,63 @@ TEST_F(AggregateCursorTest, AggregationWithGroupBy) {
   EXPECT_CURSORS_EQUAL(std::move(expected_output), std::move(aggregate));
 }
 
+TEST_F(AggregateCursorTest, AggregationWithGroupByOnFilteredInput) {
+  auto input = SucceedOrDie(TurnIntoCursor(
+      Filter(Greater(NamedAttribute("col1"), ConstInt32(0)),
+             ProjectAllAttributes(),
+             TestDataBuilder<STRING, INT32>()
+                 .AddRow("a", 1)
+                 .AddRow("b", -2)
+                 .AddRow("a", 3)
+                 .AddRow("c", -1)
+                 .AddRow("b", 5)
+                 .AddRow("a", -7)
+                 .AddRow("c", __)
+                 .Build())));
+  std::unique_ptr<const SingleSourceProjector> group_by_column(
+      ProjectNamedAttribute("col0"));
+  AggregationSpecification aggregator;
+  aggregator.AddAggregation(SUM, "col1", "sum");
+  aggregator.AddDistinctAggregation(COUNT, "col1", "count");
+  auto aggregate = SucceedOrDie(
+      CreateGroupAggregate(*group_by_column, aggregator, std::move(input)));
+
+  std::unique_ptr<Cursor> expected_output(
+      TestDataBuilder<STRING, INT32, UINT64>()
+      .AddRow("a", 4, 2)
+      .AddRow("b", 5, 1)
+      .BuildCursor());
+  EXPECT_CURSORS_EQUAL(std::move(expected_output), Sort(std::move(aggregate)));
+}
+
+TEST_F(AggregateCursorTest, AggregationWithGroupByOnLargeFilteredInput) {
+  TestDataBuilder<INT32, INT32> input_builder;
+  for (int i = 0; i < 3 * Cursor::kDefaultRowCount; ++i) {
+    input_builder.AddRow(i % 5, i % 3);
+  }
+  auto input = SucceedOrDie(TurnIntoCursor(
+      Filter(Greater(NamedAttribute("col1"), ConstInt32(1)),
+             ProjectAllAttributes(),
+             input_builder.Build())));
+  std::unique_ptr<const SingleSourceProjector> group_by_column(
+      ProjectNamedAttribute("col0"));
+  AggregationSpecification aggregator;
+  aggregator.AddAggregation(COUNT, "", "count");
+  auto aggregate = SucceedOrDie(
+      CreateGroupAggregate(*group_by_column, aggregator, std::move(input)));
+
+  TestDataBuilder<INT32, UINT64> expected_builder;
+  for (int key = 0; key < 5; ++key) {
+    int count = 0;
+    for (int i = key; i < 3 * Cursor::kDefaultRowCount; i += 5) {
+      if (i % 3 == 2) ++count;
+    }
+    expected_builder.AddRow(key, count);
+  }
+  EXPECT_CURSORS_EQUAL(expected_builder.BuildCursor(),
+                       Sort(std::move(aggregate)));
+}
+
 TEST_F(AggregateCursorTest, AggregationWithGroupBy_UniqueRowLimit) {
   auto input = TestDataBuilder<INT32, INT32>()
       .AddRow(1, 3)
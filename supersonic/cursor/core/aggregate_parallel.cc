@@ -0,0 +1,529 @@
+// Copyright 2012 Google Inc. All Rights Reserved.
+//
+// Licensed under the Apache License, Version 2.0 (the "License");
+// you may not use this file except in compliance with the License.
+// You may obtain a copy of the License at
+//
+//     http://www.apache.org/licenses/LICENSE-2.0
+//
+// Unless required by applicable law or agreed to in writing, software
+// distributed under the License is distributed on an "AS IS" BASIS,
+// WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+// See the License for the specific language governing permissions and
+// limitations under the License.
+//
+// Parallel group aggregation.
+//
+// The input is read in morsels by a number of workers (see parallel.h). Each
+// worker pre-aggregates its morsels with a best-effort GroupAggregate, whose
+// memory is limited, so that it returns partial results whenever its hash
+// table fills up. The partial results are scattered into partitions by the
+// hash of the key, so that all the partial results of a group end up in a
+// single partition. The partitions are then aggregated, in parallel, by
+// independent GroupAggregates, combining the partial results (e.g. the partial
+// COUNTs are summed up). Finally, the consumer reads the results of the
+// partitions, one after another.
+//
+// The partial results of DISTINCT aggregations can't be combined. If there are
+// any, the workers skip the pre-aggregation and scatter the input rows
+// themselves.
+//
+// The partitions are buffered in memory within a quota. When a partition
+// doesn't fit, it is spilled: its rows, and those scattered to it later, are
+// written to a temporary file, which its final aggregation reads back. The
+// result of every partition is copied out of its aggregation, so that the
+// partition's input, hash table and file are released right away.
+
+#include <algorithm>
+#include <limits>
+#include <memory>
+#include <mutex>
+#include <string>
+#include <vector>
+#include "supersonic/utils/std_namespace.h"
+using std::vector;
+using std::make_unique;
+
+#include <glog/logging.h>
+#include "supersonic/utils/logging-inl.h"
+#include "supersonic/utils/macros.h"
+#include "supersonic/utils/exception/failureor.h"
+#include "supersonic/base/exception/exception.h"
+#include "supersonic/base/exception/exception_macros.h"
+#include "supersonic/base/exception/result.h"
+#include "supersonic/base/infrastructure/block.h"
+#include "supersonic/base/infrastructure/projector.h"
+#include "supersonic/base/infrastructure/tuple_schema.h"
+#include "supersonic/base/infrastructure/types.h"
+#include "supersonic/base/infrastructure/view_copier.h"
+#include "supersonic/base/memory/memory.h"
+#include "supersonic/cursor/base/cursor.h"
+#include "supersonic/cursor/base/operation.h"
+#include "supersonic/cursor/core/aggregate.h"
+#include "supersonic/cursor/core/aggregator.h"
+#include "supersonic/cursor/core/hybrid_group_utils.h"
+#include "supersonic/cursor/core/ownership_taker.h"
+#include "supersonic/cursor/core/parallel.h"
+#include "supersonic/cursor/core/scan_view.h"
+#include "supersonic/cursor/infrastructure/basic_cursor.h"
+#include "supersonic/cursor/infrastructure/file_io.h"
+#include "supersonic/cursor/infrastructure/hash_partitioning.h"
+#include "supersonic/cursor/infrastructure/iterators.h"
+#include "supersonic/cursor/infrastructure/table.h"
+#include "supersonic/cursor/infrastructure/thread_pool.h"
+#include "supersonic/cursor/proto/cursors.pb.h"
+#include "supersonic/proto/supersonic.pb.h"
+
+namespace supersonic {
+
+namespace {
+
+// Memory available to the hash table of a single worker's pre-aggregation.
+// When it fills up, the worker flushes its partial results to the partitions
+// and starts anew.
+const size_t kPreaggregationMemoryQuota = 8 << 20;
+
+// More partitions than workers, so that the final aggregation is balanced
+// even if some partitions are larger than the others.
+const int kPartitionsPerWorker = 4;
+
+// Describes the final aggregation of a partition, i.e. how to combine the
+// partial results of the workers.
+class FinalAggregation {
+ public:
+  // If the aggregation can be split into the partial and final ones, the
+  // partial aggregation (computed by the workers) is set in partial, and
+  // preaggregated() is true. Otherwise, the final aggregation is the original
+  // one.
+  static FailureOrOwned<FinalAggregation> Create(
+      const SingleSourceProjector& group_by,
+      const AggregationSpecification& aggregation,
+      const TupleSchema& input_schema,
+      AggregationSpecification* partial) {
+    unique_ptr<FinalAggregation> final_aggregation(new FinalAggregation);
+    bool has_distinct_aggregations = false;
+    for (int i = 0; i < aggregation.size(); ++i) {
+      has_distinct_aggregations |= aggregation.aggregation(i).is_distinct();
+    }
+    if (has_distinct_aggregations) {
+      final_aggregation->group_by_ = group_by.Clone();
+      final_aggregation->aggregation_ = aggregation;
+      return Success(std::move(final_aggregation));
+    }
+    // The partial results have the (projected) key columns, followed by the
+    // aggregated columns named like in the result; the final aggregation
+    // finds the key columns by name.
+    FailureOrOwned<const BoundSingleSourceProjector> bound_group_by =
+        group_by.Bind(input_schema);
+    PROPAGATE_ON_FAILURE(bound_group_by);
+    const TupleSchema& key_schema = bound_group_by->result_schema();
+    vector<string> key_names;
+    for (int i = 0; i < key_schema.attribute_count(); ++i) {
+      key_names.push_back(key_schema.attribute(i).name());
+    }
+    final_aggregation->group_by_ = ProjectNamedAttributes(key_names);
+    final_aggregation->preaggregated_ = true;
+    for (int i = 0; i < aggregation.size(); ++i) {
+      const AggregationSpecification::Element& element =
+          aggregation.aggregation(i);
+      partial->add(element);
+      AggregationSpecification::Element final_element(element);
+      final_element.set_input(element.output());
+      if (element.aggregation_operator() == COUNT) {
+        // SUM's result is nullable, COUNT's is not.
+        final_element.set_aggregation_operator(SUM);
+        final_aggregation->count_columns_.push_back(element.output());
+      }
+      final_aggregation->aggregation_.add(final_element);
+    }
+    return Success(std::move(final_aggregation));
+  }
+
+  // The key of the final aggregation; also the partitioning key.
+  const SingleSourceProjector& group_by() const { return *group_by_; }
+
+  bool preaggregated() const { return preaggregated_; }
+
+  // Creates the cursor aggregating the partition.
+  FailureOrOwned<Cursor> CreateCursor(unique_ptr<Cursor> partition,
+                                      BufferAllocator* allocator) const {
+    const TupleSchema partition_schema = partition->schema();
+    FailureOrOwned<const BoundSingleSourceProjector> bound_group_by =
+        group_by_->Bind(partition_schema);
+    PROPAGATE_ON_FAILURE(bound_group_by);
+    unique_ptr<BufferAllocator> limit(new MemoryLimit(
+        std::numeric_limits<size_t>::max(), false, allocator));
+    FailureOrOwned<Aggregator> aggregator = Aggregator::Create(
+        aggregation_, partition_schema, limit.get(),
+        GroupAggregateOptions::kDefaultResultEstimatedGroupCount);
+    PROPAGATE_ON_FAILURE(aggregator);
+    FailureOrOwned<Cursor> cursor = BoundGroupAggregate(
+        bound_group_by.move(), aggregator.move(), std::move(limit), allocator,
+        false, std::move(partition));
+    PROPAGATE_ON_FAILURE(cursor);
+    if (count_columns_.empty()) return cursor;
+    return MakeSelectedColumnsNotNullable(ProjectNamedAttributes(count_columns_),
+                                          allocator, cursor.move());
+  }
+
+ private:
+  FinalAggregation() : preaggregated_(false) {}
+
+  unique_ptr<const SingleSourceProjector> group_by_;
+  AggregationSpecification aggregation_;
+  bool preaggregated_;
+  // The COUNT columns, computed as SUMs of the partial COUNTs.
+  vector<string> count_columns_;
+  DISALLOW_COPY_AND_ASSIGN(FinalAggregation);
+};
+
+// The workers (pre-aggregating or not) are the children. The whole input is
+// consumed, on the pool, by the first call to Next(); the calling thread takes
+// part in the work. If the temporary_file_factory is NULL, the partitions
+// aren't spilled, and ERROR_MEMORY_EXCEEDED is returned if they don't fit.
+class ParallelGroupAggregateCursor : public BasicCursor {
+ public:
+  ParallelGroupAggregateCursor(
+      const TupleSchema& result_schema,
+      unique_ptr<const FinalAggregation> final_aggregation,
+      unique_ptr<const BoundSingleSourceProjector> partition_key,
+      int partition_bits,
+      ThreadPool* thread_pool,
+      size_t memory_quota,
+      TemporaryFileFactory* temporary_file_factory,
+      FileCompression spill_compression,
+      BufferAllocator* allocator,
+      vector<unique_ptr<Cursor>> workers)
+      : BasicCursor(result_schema, std::move(workers)),
+        final_aggregation_(std::move(final_aggregation)),
+        partition_key_(std::move(partition_key)),
+        partition_bits_(partition_bits),
+        thread_pool_(thread_pool),
+        temporary_file_factory_(temporary_file_factory),
+        spill_compression_(spill_compression),
+        allocator_(allocator),
+        partition_memory_(memory_quota, true, allocator),
+        spilled_(1 << partition_bits),
+        partition_mutexes_(new std::mutex[1 << partition_bits]),
+        aggregated_(false),
+        current_partition_(0),
+        current_result_(result_schema) {
+    const TupleSchema& partition_schema = child_at(0)->schema();
+    for (int p = 0; p < (1 << partition_bits); ++p) {
+      partitions_.emplace_back(new Table(partition_schema, &partition_memory_));
+    }
+  }
+
+  virtual ResultView Next(rowcount_t max_row_count) {
+    PROPAGATE_ON_FAILURE(ThrowIfInterrupted());
+    if (!aggregated_) {
+      PROPAGATE_ON_FAILURE(Aggregate());
+      aggregated_ = true;
+      if (!results_.empty()) current_result_.reset(results_[0]->view());
+    }
+    while (current_partition_ < results_.size()) {
+      if (current_result_.next(max_row_count)) {
+        return ResultView::Success(&current_result_.view());
+      }
+      results_[current_partition_].reset();
+      if (++current_partition_ < results_.size()) {
+        current_result_.reset(results_[current_partition_]->view());
+      }
+    }
+    return ResultView::EOS();
+  }
+
+  virtual bool IsWaitingOnBarrierSupported() const { return false; }
+
+  virtual CursorId GetCursorId() const { return PARALLEL_GROUP_AGGREGATE; }
+
+ private:
+  FailureOrVoid Aggregate() {
+    const int worker_count = children_count();
+    vector<unique_ptr<Exception>> worker_failures(worker_count);
+    ParallelFor(thread_pool_, worker_count, [&](int worker) {
+      FailureOrVoid scattered = Scatter(child_at(worker));
+      if (scattered.is_failure()) {
+        worker_failures[worker] = scattered.move_exception();
+      }
+    });
+    for (int i = 0; i < worker_count; ++i) {
+      if (worker_failures[i] != NULL) THROW(worker_failures[i].release());
+    }
+
+    const int partition_count = partitions_.size();
+    vector<unique_ptr<Exception>> partition_failures(partition_count);
+    results_.resize(partition_count);
+    ParallelFor(thread_pool_, partition_count, [&](int partition) {
+      FailureOrVoid aggregated = AggregatePartition(partition);
+      if (aggregated.is_failure()) {
+        partition_failures[partition] = aggregated.move_exception();
+      }
+    });
+    for (int i = 0; i < partition_count; ++i) {
+      if (partition_failures[i] != NULL) THROW(partition_failures[i].release());
+    }
+    return Success();
+  }
+
+  // Executed on the pool, one task per worker. Drains the worker, appending
+  // its results to the partitions.
+  FailureOrVoid Scatter(Cursor* worker) {
+    const TupleSchema& schema = worker->schema();
+    const SelectiveViewCopier copier(schema, false);
+    Block scatter_block(schema, allocator_);
+    if (!scatter_block.Reallocate(Cursor::kDefaultRowCount)) {
+      THROW(new Exception(ERROR_MEMORY_EXCEEDED,
+                          "Can't allocate the worker's scatter block"));
+    }
+    View key(partition_key_->result_schema());
+    vector<size_t> hash(Cursor::kDefaultRowCount);
+    vector<int> partition(Cursor::kDefaultRowCount);
+    vector<rowid_t> order(Cursor::kDefaultRowCount);
+    vector<rowcount_t> offset(partitions_.size() + 1);
+    while (true) {
+      ResultView result = worker->Next(Cursor::kDefaultRowCount);
+      PROPAGATE_ON_FAILURE(result);
+      if (result.is_eos()) return Success();
+      if (result.is_waiting_on_barrier()) {
+        THROW(new Exception(
+            ERROR_NOT_IMPLEMENTED,
+            "ParallelGroupAggregate doesn't support WAITING_ON_BARRIER"));
+      }
+      const View& view = result.view();
+      const rowcount_t row_count = view.row_count();
+      partition_key_->Project(view, &key);
+      key.set_row_count(row_count);
+      ComputeHashPartitions(key, partition_bits_, hash.data(),
+                            partition.data());
+      GroupByPartition(partition.data(), row_count, partitions_.size(),
+                       order.data(), offset.data());
+      // Shallow; the rows are deep-copied when appended to the partitions.
+      copier.Copy(row_count, view, order.data(), 0, &scatter_block);
+      for (int p = 0; p < partitions_.size(); ++p) {
+        const rowcount_t partition_row_count = offset[p + 1] - offset[p];
+        if (partition_row_count == 0) continue;
+        std::lock_guard<std::mutex> lock(partition_mutexes_[p]);
+        PROPAGATE_ON_FAILURE(AppendToPartition(
+            p, View(scatter_block.view(), offset[p], partition_row_count)));
+      }
+    }
+  }
+
+  // Appends the rows to the partition; called under the partition's mutex. If
+  // they don't fit in the memory quota, spills the partition.
+  FailureOrVoid AppendToPartition(int partition, const View& rows) {
+    rowcount_t appended = 0;
+    if (spilled_[partition] == NULL) {
+      appended = partitions_[partition]->AppendView(rows);
+      if (appended == rows.row_count()) return Success();
+      if (temporary_file_factory_ == NULL) {
+        THROW(new Exception(ERROR_MEMORY_EXCEEDED,
+                            "Can't append the rows to a partition"));
+      }
+      FailureOrOwned<TemporaryFileBuffer> buffer = TemporaryFileBuffer::Create(
+          temporary_file_factory_, spill_compression_);
+      PROPAGATE_ON_FAILURE(buffer);
+      spilled_[partition] = buffer.move();
+      PROPAGATE_ON_FAILURE(
+          spilled_[partition]->Write(partitions_[partition]->view()));
+      partitions_[partition].reset();
+    }
+    return spilled_[partition]->Write(
+        View(rows, appended, rows.row_count() - appended));
+  }
+
+  // Executed on the pool, one task per partition. Aggregates the partition
+  // entirely (GroupAggregate aggregates all of its input on the first call to
+  // Next()), and copies the result out, so that the aggregation can be
+  // destroyed, releasing the partition's input, whether buffered in memory or
+  // spilled, along with the hash table.
+  FailureOrVoid AggregatePartition(int partition) {
+    unique_ptr<Cursor> input;
+    if (spilled_[partition] != NULL) {
+      FailureOrOwned<Cursor> spilled = spilled_[partition]->Read(
+          child_at(0)->schema(), allocator_);
+      PROPAGATE_ON_FAILURE(spilled);
+      input = spilled.move();
+    } else {
+      input = BoundScanView(partitions_[partition]->view());
+    }
+    FailureOrOwned<Cursor> created = final_aggregation_->CreateCursor(
+        std::move(input), allocator_);
+    PROPAGATE_ON_FAILURE(created);
+    unique_ptr<Cursor> aggregated(created.move());
+    unique_ptr<Table> result(new Table(schema(), allocator_));
+    while (true) {
+      ResultView view =
+          aggregated->Next(std::numeric_limits<rowcount_t>::max());
+      PROPAGATE_ON_FAILURE(view);
+      if (view.is_eos()) break;
+      if (result->AppendView(view.view()) < view.view().row_count()) {
+        THROW(new Exception(ERROR_MEMORY_EXCEEDED,
+                            "Can't copy the result of a partition"));
+      }
+    }
+    aggregated.reset();
+    partitions_[partition].reset();
+    spilled_[partition].reset();
+    results_[partition] = std::move(result);
+    return Success();
+  }
+
+  unique_ptr<const FinalAggregation> final_aggregation_;
+  unique_ptr<const BoundSingleSourceProjector> partition_key_;
+  const int partition_bits_;
+  ThreadPool* const thread_pool_;
+  TemporaryFileFactory* const temporary_file_factory_;
+  const FileCompression spill_compression_;
+  BufferAllocator* const allocator_;
+
+  // Bounds the memory of the partitions kept in memory.
+  ThreadSafeMemoryLimit partition_memory_;
+  // The partial results (or the input rows), by partition. Appended to by the
+  // workers concurrently, each partition under its mutex. A spilled partition
+  // has its rows in spilled_, and NULL in partitions_.
+  vector<unique_ptr<Table>> partitions_;
+  vector<unique_ptr<TemporaryFileBuffer>> spilled_;
+  std::unique_ptr<std::mutex[]> partition_mutexes_;
+
+  bool aggregated_;
+  // The results of the partitions, released as they are consumed.
+  vector<unique_ptr<Table>> results_;
+  int current_partition_;
+  ViewIterator current_result_;
+
+  DISALLOW_COPY_AND_ASSIGN(ParallelGroupAggregateCursor);
+};
+
+class ParallelGroupAggregateOperation : public ParallelOperation {
+ public:
+  ParallelGroupAggregateOperation(
+      unique_ptr<const SingleSourceProjector> group_by,
+      unique_ptr<const AggregationSpecification> aggregation,
+      unique_ptr<const ParallelOptions> options,
+      size_t memory_quota,
+      TemporaryFileFactory* temporary_file_factory,
+      FileCompression spill_compression,
+      unique_ptr<Operation> child)
+      : ParallelOperation(std::move(child)),
+        group_by_(std::move(group_by)),
+        aggregation_(std::move(aggregation)),
+        options_(std::move(options)),
+        memory_quota_(memory_quota),
+        temporary_file_factory_(temporary_file_factory),
+        spill_compression_(spill_compression) {}
+
+  virtual FailureOrOwned<Cursor> CreateCursor() const {
+    FailureOrOwned<Cursor> child_cursor = child()->CreateCursor();
+    PROPAGATE_ON_FAILURE(child_cursor);
+    const TupleSchema input_schema = child_cursor->schema();
+    AggregationSpecification partial;
+    FailureOrOwned<FinalAggregation> final_aggregation =
+        FinalAggregation::Create(*group_by_, *aggregation_, input_schema,
+                                 &partial);
+    PROPAGATE_ON_FAILURE(final_aggregation);
+    unique_ptr<MorselSource> source =
+        CreateCursorMorselSource(child_cursor.move());
+
+    unique_ptr<ThreadPool> owned_thread_pool;
+    ThreadPool* thread_pool = options_->thread_pool();
+    int parallelism = options_->parallelism();
+    if (thread_pool == NULL) {
+      owned_thread_pool.reset(new ThreadPool(
+          parallelism > 0 ? parallelism : ThreadPool::DefaultNumThreads()));
+      thread_pool = owned_thread_pool.get();
+    }
+    if (parallelism <= 0) parallelism = thread_pool->num_threads();
+
+    vector<unique_ptr<Cursor>> workers;
+    for (int i = 0; i < parallelism; ++i) {
+      FailureOrOwned<Cursor> worker = BoundMorselScan(
+          source.get(), options_->morsel_row_count(), buffer_allocator());
+      PROPAGATE_ON_FAILURE(worker);
+      if (final_aggregation->preaggregated()) {
+        worker = CreatePreaggregation(partial, worker.move());
+        PROPAGATE_ON_FAILURE(worker);
+      }
+      workers.push_back(worker.move());
+    }
+    const TupleSchema& partition_schema = workers[0]->schema();
+    FailureOrOwned<const BoundSingleSourceProjector> partition_key =
+        final_aggregation->group_by().Bind(partition_schema);
+    PROPAGATE_ON_FAILURE(partition_key);
+
+    // The result schema is that of the aggregation of any partition.
+    Table empty_partition(partition_schema, buffer_allocator());
+    FailureOrOwned<Cursor> empty_result = final_aggregation->CreateCursor(
+        BoundScanView(empty_partition.view()), buffer_allocator());
+    PROPAGATE_ON_FAILURE(empty_result);
+    const TupleSchema result_schema = empty_result->schema();
+
+    int partition_bits = 0;
+    while ((1 << partition_bits) < parallelism * kPartitionsPerWorker) {
+      ++partition_bits;
+    }
+    unique_ptr<Cursor> cursor(new ParallelGroupAggregateCursor(
+        result_schema, final_aggregation.move(), partition_key.move(),
+        partition_bits, thread_pool, memory_quota_, temporary_file_factory_,
+        spill_compression_, buffer_allocator(), std::move(workers)));
+    // The source and the pool must outlive the workers.
+    return Success(TakeOwnership(std::move(cursor), std::move(source),
+                                 std::move(owned_thread_pool)));
+  }
+
+ private:
+  FailureOrOwned<Cursor> CreatePreaggregation(
+      const AggregationSpecification& partial,
+      unique_ptr<Cursor> input) const {
+    FailureOrOwned<const BoundSingleSourceProjector> bound_group_by =
+        group_by_->Bind(input->schema());
+    PROPAGATE_ON_FAILURE(bound_group_by);
+    unique_ptr<BufferAllocator> limit(new MemoryLimit(
+        kPreaggregationMemoryQuota, false, buffer_allocator()));
+    FailureOrOwned<Aggregator> aggregator = Aggregator::Create(
+        partial, input->schema(), limit.get(), Cursor::kDefaultRowCount);
+    PROPAGATE_ON_FAILURE(aggregator);
+    return BoundGroupAggregate(bound_group_by.move(), aggregator.move(),
+                               std::move(limit), buffer_allocator(),
+                               true,  // best effort.
+                               std::move(input));
+  }
+
+  unique_ptr<const SingleSourceProjector> group_by_;
+  unique_ptr<const AggregationSpecification> aggregation_;
+  unique_ptr<const ParallelOptions> options_;
+  const size_t memory_quota_;
+  TemporaryFileFactory* const temporary_file_factory_;
+  const FileCompression spill_compression_;
+  DISALLOW_COPY_AND_ASSIGN(ParallelGroupAggregateOperation);
+};
+
+}  // namespace
+
+unique_ptr<Operation> ParallelGroupAggregate(
+    unique_ptr<const SingleSourceProjector> group_by,
+    unique_ptr<const AggregationSpecification> aggregation,
+    unique_ptr<const ParallelOptions> options,
+    unique_ptr<Operation> child) {
+  return ParallelGroupAggregate(
+      std::move(group_by), std::move(aggregation), std::move(options),
+      std::numeric_limits<size_t>::max(), NULL, FILE_COMPRESSION_NONE,
+      std::move(child));
+}
+
+unique_ptr<Operation> ParallelGroupAggregate(
+    unique_ptr<const SingleSourceProjector> group_by,
+    unique_ptr<const AggregationSpecification> aggregation,
+    unique_ptr<const ParallelOptions> options,
+    size_t memory_quota,
+    TemporaryFileFactory* temporary_file_factory,
+    FileCompression spill_compression,
+    unique_ptr<Operation> child) {
+  return make_unique<ParallelGroupAggregateOperation>(
+      std::move(group_by), std::move(aggregation), std::move(options),
+      memory_quota, temporary_file_factory, spill_compression,
+      std::move(child));
+}
+
+}  // namespace supersonic
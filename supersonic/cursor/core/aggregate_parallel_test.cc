@@ -0,0 +1,287 @@
+// Copyright 2012 Google Inc. All Rights Reserved.
+//
+// Licensed under the Apache License, Version 2.0 (the "License");
+// you may not use this file except in compliance with the License.
+// You may obtain a copy of the License at
+//
+//     http://www.apache.org/licenses/LICENSE-2.0
+//
+// Unless required by applicable law or agreed to in writing, software
+// distributed under the License is distributed on an "AS IS" BASIS,
+// WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+// See the License for the specific language governing permissions and
+// limitations under the License.
+//
+
+#include <limits>
+#include <memory>
+#include <string>
+#include <vector>
+#include "supersonic/utils/std_namespace.h"
+using std::string;
+using std::vector;
+
+#include "supersonic/base/exception/exception.h"
+#include "supersonic/base/infrastructure/block.h"
+#include "supersonic/base/infrastructure/projector.h"
+#include "supersonic/base/infrastructure/types.h"
+#include "supersonic/base/memory/memory.h"
+#include "supersonic/cursor/base/cursor.h"
+#include "supersonic/cursor/base/operation.h"
+#include "supersonic/cursor/core/aggregate.h"
+#include "supersonic/cursor/core/parallel.h"
+#include "supersonic/cursor/core/scan_view.h"
+#include "supersonic/cursor/infrastructure/file_io.h"
+#include "supersonic/cursor/infrastructure/temporary_file_factory.h"
+#include "supersonic/cursor/infrastructure/thread_pool.h"
+#include "supersonic/proto/supersonic.pb.h"
+#include "supersonic/testing/block_builder.h"
+#include "supersonic/testing/operation_testing.h"
+#include "supersonic/utils/strings/strcat.h"
+#include "gtest/gtest.h"
+
+namespace supersonic {
+
+namespace {
+
+unique_ptr<const ParallelOptions> CreateOptions(int parallelism,
+                                                rowcount_t morsel_row_count) {
+  unique_ptr<ParallelOptions> options(new ParallelOptions);
+  options->set_parallelism(parallelism)
+         ->set_morsel_row_count(morsel_row_count);
+  return std::move(options);
+}
+
+// The parallel aggregation is checked against the serial GroupAggregate over
+// the same input.
+class ParallelGroupAggregateTest : public testing::Test {
+ protected:
+  // Key (col0) with group_count distinct values, repeating; every fifth key
+  // NULL if with_nulls. Values col1 and col2 are i and a string of i % 10, the
+  // latter NULL every seventh row.
+  void CreateInput(int64_t row_count, int64_t group_count, bool with_nulls) {
+    BlockBuilder<INT64, INT32, STRING> builder;
+    for (int64_t i = 0; i < row_count; ++i) {
+      const int64_t key = i % group_count;
+      const string value = StrCat("value_", i % 10);
+      if (with_nulls && key % 5 == 0) {
+        builder.AddRow(__, i, value);
+      } else if (i % 7 == 0) {
+        builder.AddRow(key, i, __);
+      } else {
+        builder.AddRow(key, i, value);
+      }
+    }
+    input_ = builder.Build();
+  }
+
+  void TestAggregation(const SingleSourceProjector& group_by,
+                       const AggregationSpecification& aggregation,
+                       unique_ptr<const ParallelOptions> options) {
+    OperationTest test;
+    test.SetExpectedResult(GroupAggregate(
+        group_by.Clone(), make_unique<AggregationSpecification>(aggregation),
+        nullptr, ScanView(input_->view())));
+    test.SetIgnoreRowOrder(true);
+    test.SkipBarrierHandlingChecks(true);
+    test.Execute(ParallelGroupAggregate(
+        group_by.Clone(), make_unique<AggregationSpecification>(aggregation),
+        std::move(options), ScanView(input_->view())));
+  }
+
+  // As above, with the partitions limited to the memory quota; expects some
+  // of them to be spilled.
+  void TestSpillingAggregation(const SingleSourceProjector& group_by,
+                               const AggregationSpecification& aggregation,
+                               size_t memory_quota) {
+    LocalTemporaryFileFactory factory(vector<string>(1, ""),
+                                      LocalTemporaryFileFactory::kNoDiskQuota);
+    OperationTest test;
+    test.SetExpectedResult(GroupAggregate(
+        group_by.Clone(), make_unique<AggregationSpecification>(aggregation),
+        nullptr, ScanView(input_->view())));
+    test.SetIgnoreRowOrder(true);
+    test.SkipBarrierHandlingChecks(true);
+    test.Execute(ParallelGroupAggregate(
+        group_by.Clone(), make_unique<AggregationSpecification>(aggregation),
+        CreateOptions(4, 500), memory_quota, &factory, FILE_COMPRESSION_NONE,
+        ScanView(input_->view())));
+    EXPECT_LT(0, factory.files_created());
+    EXPECT_EQ(0, factory.disk_usage());
+  }
+
+  static AggregationSpecification AllAggregations() {
+    AggregationSpecification aggregation;
+    aggregation.AddAggregation(COUNT, "", "count");
+    aggregation.AddAggregation(COUNT, "col2", "count_col2");
+    aggregation.AddAggregation(SUM, "col1", "sum");
+    aggregation.AddAggregation(MIN, "col2", "min");
+    aggregation.AddAggregation(MAX, "col1", "max");
+    return aggregation;
+  }
+
+  unique_ptr<Block> input_;
+};
+
+TEST_F(ParallelGroupAggregateTest, AggregatesByKey) {
+  CreateInput(10000, 100, false);
+  TestAggregation(*ProjectAttributeAt(0), AllAggregations(),
+                  CreateOptions(4, 100));
+}
+
+TEST_F(ParallelGroupAggregateTest, NullKeysFormAGroup) {
+  CreateInput(5000, 33, true);
+  TestAggregation(*ProjectAttributeAt(0), AllAggregations(),
+                  CreateOptions(3, 250));
+}
+
+TEST_F(ParallelGroupAggregateTest, MultiColumnKey) {
+  CreateInput(8000, 50, true);
+  unique_ptr<CompoundSingleSourceProjector> key(
+      new CompoundSingleSourceProjector);
+  key->add(ProjectAttributeAt(0));
+  key->add(ProjectAttributeAt(2));
+  TestAggregation(*key, AllAggregations(), CreateOptions(2, 1000));
+}
+
+TEST_F(ParallelGroupAggregateTest, RenamedKey) {
+  CreateInput(3000, 10, false);
+  AggregationSpecification aggregation;
+  aggregation.AddAggregation(SUM, "col1", "sum");
+  TestAggregation(*ProjectNamedAttributeAs("col0", "key"), aggregation,
+                  CreateOptions(2, 100));
+}
+
+TEST_F(ParallelGroupAggregateTest, DistinctAggregationNotPreaggregated) {
+  CreateInput(6000, 40, true);
+  AggregationSpecification aggregation;
+  aggregation.AddDistinctAggregation(COUNT, "col2", "distinct_count");
+  aggregation.AddAggregation(COUNT, "", "count");
+  TestAggregation(*ProjectAttributeAt(0), aggregation, CreateOptions(4, 100));
+}
+
+TEST_F(ParallelGroupAggregateTest, KeysOnly) {
+  CreateInput(4000, 77, true);
+  TestAggregation(*ProjectAttributeAt(0), AggregationSpecification(),
+                  CreateOptions(3, 100));
+}
+
+TEST_F(ParallelGroupAggregateTest, EmptyInput) {
+  CreateInput(0, 1, false);
+  TestAggregation(*ProjectAttributeAt(0), AllAggregations(),
+                  CreateOptions(4, 100));
+}
+
+// The workers' pre-aggregations run out of their memory quota and flush
+// partial results repeatedly. Too large for OperationTest; checks the group
+// count and the total of the counts.
+TEST_F(ParallelGroupAggregateTest, HighCardinality) {
+  const int64_t kRowCount = 1000000;
+  const int64_t kGroupCount = 500000;
+  CreateInput(kRowCount, kGroupCount, false);
+  unique_ptr<AggregationSpecification> aggregation(
+      new AggregationSpecification);
+  aggregation->AddAggregation(COUNT, "", "count");
+  unique_ptr<Operation> aggregate(ParallelGroupAggregate(
+      ProjectAttributeAt(0), std::move(aggregation), CreateOptions(4, 1000),
+      ScanView(input_->view())));
+  unique_ptr<Cursor> cursor(SucceedOrDie(aggregate->CreateCursor()));
+  int64_t group_count = 0;
+  int64_t row_count = 0;
+  while (true) {
+    ResultView result = cursor->Next(Cursor::kDefaultRowCount);
+    ASSERT_FALSE(result.is_failure());
+    if (result.is_eos()) break;
+    const View& view = result.view();
+    group_count += view.row_count();
+    for (rowid_t i = 0; i < view.row_count(); ++i) {
+      row_count += view.column(1).typed_data<UINT64>()[i];
+    }
+  }
+  EXPECT_EQ(kGroupCount, group_count);
+  EXPECT_EQ(kRowCount, row_count);
+}
+
+TEST_F(ParallelGroupAggregateTest, SpillsPartitionsOverQuota) {
+  CreateInput(20000, 5000, true);
+  TestSpillingAggregation(*ProjectAttributeAt(0), AllAggregations(),
+                          64 << 10);
+}
+
+TEST_F(ParallelGroupAggregateTest, SpillsInputRowsOfDistinctAggregations) {
+  CreateInput(20000, 300, true);
+  AggregationSpecification aggregation;
+  aggregation.AddDistinctAggregation(COUNT, "col2", "distinct_count");
+  aggregation.AddAggregation(SUM, "col1", "sum");
+  TestSpillingAggregation(*ProjectAttributeAt(0), aggregation, 64 << 10);
+}
+
+// The input rows of the DISTINCT aggregation, all buffered in the partitions
+// before any is aggregated, don't fit in the memory available; with the
+// partitions limited to a fraction of it, the rest are spilled.
+TEST_F(ParallelGroupAggregateTest, RespectsMemoryQuota) {
+  const size_t kMemoryLimit = 6 << 20;
+  CreateInput(300000, 101, false);
+  for (bool spill : { false, true }) {
+    LocalTemporaryFileFactory factory(vector<string>(1, ""),
+                                      LocalTemporaryFileFactory::kNoDiskQuota);
+    unique_ptr<AggregationSpecification> aggregation(
+        new AggregationSpecification);
+    aggregation->AddDistinctAggregation(COUNT, "col2", "distinct_count");
+    unique_ptr<Operation> aggregate(ParallelGroupAggregate(
+        ProjectAttributeAt(0), std::move(aggregation), CreateOptions(4, 1000),
+        spill ? kMemoryLimit / 4 : std::numeric_limits<size_t>::max(),
+        spill ? &factory : NULL, FILE_COMPRESSION_NONE,
+        ScanView(input_->view())));
+    MemoryLimit memory_limit(kMemoryLimit, true, HeapBufferAllocator::Get());
+    aggregate->SetBufferAllocator(&memory_limit, true);
+    unique_ptr<Cursor> cursor(SucceedOrDie(aggregate->CreateCursor()));
+    ResultView result = cursor->Next(Cursor::kDefaultRowCount);
+    if (!spill) {
+      ASSERT_TRUE(result.is_failure());
+      EXPECT_EQ(ERROR_MEMORY_EXCEEDED, result.exception().return_code());
+      continue;
+    }
+    int64_t group_count = 0;
+    while (!result.is_eos()) {
+      ASSERT_FALSE(result.is_failure()) << result.exception().message();
+      for (rowid_t i = 0; i < result.view().row_count(); ++i) {
+        EXPECT_EQ(10, result.view().column(1).typed_data<UINT64>()[i]);
+      }
+      group_count += result.view().row_count();
+      result = cursor->Next(Cursor::kDefaultRowCount);
+    }
+    EXPECT_EQ(101, group_count);
+    EXPECT_LT(0, factory.files_created());
+  }
+}
+
+TEST_F(ParallelGroupAggregateTest, SharedThreadPool) {
+  CreateInput(10000, 1000, true);
+  ThreadPool thread_pool(2);
+  unique_ptr<ParallelOptions> options(new ParallelOptions);
+  options->set_parallelism(5)
+         ->set_morsel_row_count(100)
+         ->set_thread_pool(&thread_pool);
+  TestAggregation(*ProjectAttributeAt(0), AllAggregations(),
+                  std::move(options));
+}
+
+TEST_F(ParallelGroupAggregateTest, InputFailurePropagated) {
+  unique_ptr<Operation> aggregate(ParallelGroupAggregate(
+      ProjectAttributeAt(0),
+      make_unique<AggregationSpecification>(AllAggregations()),
+      CreateOptions(3, 10),
+      TestDataBuilder<INT64, INT32, STRING>()
+          .AddRow(1, 1, "a").AddRow(2, 2, "b").AddRow(1, 3, "c")
+          .ReturnException(ERROR_GENERAL_IO_ERROR)
+          .Build()));
+  unique_ptr<Cursor> cursor(SucceedOrDie(aggregate->CreateCursor()));
+  ResultView result = cursor->Next(Cursor::kDefaultRowCount);
+  ASSERT_TRUE(result.is_failure());
+  EXPECT_EQ(ERROR_GENERAL_IO_ERROR, result.exception().return_code());
+}
+
+}  // namespace
+
+}  // namespace supersonic
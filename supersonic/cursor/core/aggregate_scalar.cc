@@ -46,6 +46,9 @@ class ScalarAggregateCursor : public BasicCursor {
         eos_(false),
         aggregator_(std::move(aggregator)) {
     std::fill(&zeros_[0], &zeros_[arraysize(zeros_)], 0);
+    // The aggregator reads the input through selection vectors, e.g. from a
+    // filter, so no need to compact the input rows.
+    child_.set_accept_selection(true);
     my_view()->ResetFrom(aggregator_->data());
   }
 
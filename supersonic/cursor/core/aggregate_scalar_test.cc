@@ -18,7 +18,11 @@
 #include "supersonic/cursor/base/cursor.h"
 #include "supersonic/cursor/base/cursor_transformer.h"
 #include "supersonic/cursor/core/aggregate.h"
+#include "supersonic/cursor/core/filter.h"
 #include "supersonic/cursor/core/spy.h"
+#include "supersonic/expression/core/comparison_expressions.h"
+#include "supersonic/expression/core/projecting_expressions.h"
+#include "supersonic/expression/infrastructure/terminal_expressions.h"
 #include "supersonic/proto/supersonic.pb.h"
 #include "supersonic/testing/block_builder.h"
 #include "supersonic/testing/comparators.h"
@@ -70,6 +74,35 @@ TEST_F(ScalarAggregateCursorTest, AggregateIntegers) {
   test.Execute(ScalarAggregate(std::move(agg), test.input()));
 }
 
+TEST_F(ScalarAggregateCursorTest, AggregateFilteredInput) {
+  OperationTest test;
+  test.SetInput(TestDataBuilder<INT32, STRING>()
+                .AddRow(13, "c")
+                .AddRow(-3, "z")
+                .AddRow(3, "a")
+                .AddRow(__, "y")
+                .AddRow(7, "b")
+                .AddRow(3, "a")
+                .AddRow(-1, "x")
+                .Build());
+  test.SetExpectedResult(
+      TestDataBuilder<INT32, INT32, UINT64, UINT64, STRING>()
+      .AddRow(13, 26, 4, 3, "c")
+      .Build());
+  auto agg = make_unique<AggregationSpecification>();
+  agg->AddAggregation(MAX, "col0", "max");
+  agg->AddAggregation(SUM, "col0", "sum");
+  agg->AddAggregation(COUNT, "", "count(*)");
+  agg->AddDistinctAggregation(COUNT, "col0", "count distinct");
+  agg->AddAggregation(MAX, "col1", "max string");
+  // The aggregator reads the rows passing the filter in place.
+  test.Execute(ScalarAggregate(
+      std::move(agg),
+      Filter(Greater(NamedAttribute("col0"), ConstInt32(0)),
+             ProjectAllAttributes(),
+             test.input())));
+}
+
 TEST_F(ScalarAggregateCursorTest, AggregateEmptyInput) {
   OperationTest test;
   test.SetInput(TestDataBuilder<INT32>().Build());
@@ -194,6 +194,10 @@ inline FailureOrVoid UpdateAggregation(
   } else {
     input = NULL;
   }
+  if (view.selection() != NULL) {
+    return column_aggregator->UpdateSelectedAggregation(
+        input, view.selection(), view.row_count(), result_index_map);
+  }
   return column_aggregator->UpdateAggregation(
       input, view.row_count(), result_index_map);
 }
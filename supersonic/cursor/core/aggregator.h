@@ -59,7 +59,8 @@ class Aggregator {
   // Aggregates each row from an input view to the aggregation result block at
   // specified indexes. result_index_map must be of size
   // view.row_count(). Caller must ensure that all values from result_index_map
-  // are lower then aggregation block capacity.
+  // are lower then aggregation block capacity. The view may carry a selection
+  // vector.
   // Update can fail if there is not enough memory to hold a result of an
   // aggregation.
   FailureOrVoid UpdateAggregations(const View& view,
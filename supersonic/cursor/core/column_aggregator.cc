@@ -41,29 +41,34 @@ namespace aggregations {
 ColumnAggregator::ColumnAggregator() {}
 ColumnAggregator::~ColumnAggregator() {}
 
-// Internal interface for updating and reseting result of an aggregation.
-// Extends ColumnAggregator interface with a method needed by
-// DistinctAggregator.
-class ColumnAggregatorInternal : public ColumnAggregator {
+// Positions, in the input column, of the values to aggregate. The i-th one is
+// aggregated into the result value at result_index_map[i].
+class AllInputs {
  public:
-  ColumnAggregatorInternal() {}
-  virtual ~ColumnAggregatorInternal() {}
+  explicit AllInputs(rowcount_t size) : size_(size) {}
+  rowcount_t size() const { return size_; }
+  rowid_t operator[](rowid_t i) const { return i; }
 
-  // Like UpdateAggregation, but takes into account only input values which
-  // indexes are in selected_inputs_indexes.
-  virtual FailureOrVoid UpdateAggregationForSelectedInputs(
-      const Column* input,
-      rowcount_t input_row_count,
-      const rowid_t result_index_map[],
-      const vector<rowid_t>& selected_inputs_indexes) = 0;
+ private:
+  const rowcount_t size_;
+};
+
+class SelectedInputs {
+ public:
+  SelectedInputs(const rowid_t selection[], rowcount_t size)
+      : selection_(selection),
+        size_(size) {}
+  rowcount_t size() const { return size_; }
+  rowid_t operator[](rowid_t i) const { return selection_[i]; }
 
  private:
-  DISALLOW_COPY_AND_ASSIGN(ColumnAggregatorInternal);
+  const rowid_t* const selection_;
+  const rowcount_t size_;
 };
 
 // Generic column aggregator supporting all operators except COUNT.
 template<Aggregation Aggregation, DataType InputType, DataType OutputType>
-class ColumnAggregatorImpl : public ColumnAggregatorInternal {
+class ColumnAggregatorImpl : public ColumnAggregator {
  public:
   typedef typename TypeTraits<InputType>::cpp_type cpp_input_type;
   typedef typename TypeTraits<OutputType>::cpp_type cpp_output_type;
@@ -96,20 +101,16 @@ class ColumnAggregatorImpl : public ColumnAggregatorInternal {
   virtual FailureOrVoid UpdateAggregation(const Column* input,
                                           rowcount_t input_row_count,
                                           const rowid_t result_index_map[]) {
-    bool input_always_not_null = (input->is_null() == NULL);
-    for (rowid_t i = 0; i < input_row_count; ++i) {
-      if (input_always_not_null || !input->is_null()[i]) {
-        if (!UpdateAggregatedValue(
-                input->data().as<InputType>()[i],
-                result_index_map[i])) {
-          THROW(new Exception(
-              ERROR_MEMORY_EXCEEDED,
-              "Aggregator memory exceeded. Not enough memory to aggregate "
-              "variable-length type elements."));
-        }
-      }
-    }
-    return Success();
+    return Update(input, AllInputs(input_row_count), result_index_map);
+  }
+
+  virtual FailureOrVoid UpdateSelectedAggregation(
+      const Column* input,
+      const rowid_t selection[],
+      rowcount_t selection_size,
+      const rowid_t result_index_map[]) {
+    return Update(input, SelectedInputs(selection, selection_size),
+                  result_index_map);
   }
 
   virtual void Reset() {
@@ -119,25 +120,28 @@ class ColumnAggregatorImpl : public ColumnAggregatorInternal {
     Clear(0, result_block_->row_capacity());
   }
 
-  virtual FailureOrVoid UpdateAggregationForSelectedInputs(
-      const Column* input,
-      rowcount_t input_row_count,
-      const rowid_t result_index_map[],
-      const vector<rowid_t>& selected_inputs_indexes) {
-    for (auto selected_inputs_indexe: selected_inputs_indexes) {
-      if (!UpdateAggregatedValue(
-              input->data().as<InputType>()[selected_inputs_indexe],
-              result_index_map[selected_inputs_indexe])) {
-        THROW(new Exception(
-            ERROR_MEMORY_EXCEEDED,
-            "Aggregator memory exceeded. Not enough memory to aggregate "
-            "variable-length type elements."));
+ private:
+  template<typename Inputs>
+  FailureOrVoid Update(const Column* input,
+                       const Inputs& inputs,
+                       const rowid_t result_index_map[]) {
+    bool input_always_not_null = (input->is_null() == NULL);
+    for (rowid_t i = 0; i < inputs.size(); ++i) {
+      const rowid_t position = inputs[i];
+      if (input_always_not_null || !input->is_null()[position]) {
+        if (!UpdateAggregatedValue(
+                input->data().as<InputType>()[position],
+                result_index_map[i])) {
+          THROW(new Exception(
+              ERROR_MEMORY_EXCEEDED,
+              "Aggregator memory exceeded. Not enough memory to aggregate "
+              "variable-length type elements."));
+        }
       }
     }
     return Success();
   }
 
- private:
   bool UpdateAggregatedValue(const cpp_input_type& input_data,
                              rowid_t result_index) {
     if (result_is_null_[result_index]) {
@@ -182,7 +186,7 @@ class ColumnAggregatorImpl : public ColumnAggregatorInternal {
 
 // Column aggregator for COUNT.
 template<DataType OutputType>
-class CountColumnAggregatorImpl : public ColumnAggregatorInternal {
+class CountColumnAggregatorImpl : public ColumnAggregator {
  public:
   COMPILE_ASSERT(TypeTraits<OutputType>::is_integer, output_type_not_integer);
   typedef typename TypeTraits<OutputType>::cpp_type cpp_output_type;
@@ -200,15 +204,16 @@ class CountColumnAggregatorImpl : public ColumnAggregatorInternal {
   virtual FailureOrVoid UpdateAggregation(const Column* input,
                                           rowcount_t input_row_count,
                                           const rowid_t result_index_map[]) {
-    bool check_input_nullability = (input != NULL && input->is_null() != NULL);
-    for (rowid_t i = 0; i < input_row_count; ++i) {
-      // Do not count NULL values.
-      if (check_input_nullability && input->is_null()[i]) {
-        continue;
-      }
-      rowid_t result_index = result_index_map[i];
-      result_data_[result_index] += 1;
-    }
+    Update(input, AllInputs(input_row_count), result_index_map);
+    return Success();
+  }
+
+  virtual FailureOrVoid UpdateSelectedAggregation(
+      const Column* input,
+      const rowid_t selection[],
+      rowcount_t selection_size,
+      const rowid_t result_index_map[]) {
+    Update(input, SelectedInputs(selection, selection_size), result_index_map);
     return Success();
   }
 
@@ -224,19 +229,21 @@ class CountColumnAggregatorImpl : public ColumnAggregatorInternal {
     Clear(0, row_capacity_);
   }
 
-  virtual FailureOrVoid UpdateAggregationForSelectedInputs(
-      const Column* input,
-      rowcount_t input_row_count,
-      const rowid_t result_index_map[],
-      const vector<rowid_t>& selected_inputs_indexes) {
-    for (auto selected_inputs_indexe: selected_inputs_indexes) {
-      size_t result_index = result_index_map[selected_inputs_indexe];
+  template<typename Inputs>
+  void Update(const Column* input,
+              const Inputs& inputs,
+              const rowid_t result_index_map[]) {
+    bool check_input_nullability = (input != NULL && input->is_null() != NULL);
+    for (rowid_t i = 0; i < inputs.size(); ++i) {
+      // Do not count NULL values.
+      if (check_input_nullability && input->is_null()[inputs[i]]) {
+        continue;
+      }
+      rowid_t result_index = result_index_map[i];
       result_data_[result_index] += 1;
     }
-    return Success();
   }
 
- private:
   void Clear(rowcount_t offset, rowcount_t length) {
     memset(&result_data_[offset], 0, sizeof(cpp_output_type) * length);
   }
@@ -295,7 +302,7 @@ class DistinctAggregator : public ColumnAggregator {
  public:
   typedef typename TypeTraits<InputType>::cpp_type cpp_input_type;
 
-  DistinctAggregator(unique_ptr<ColumnAggregatorInternal> aggregator,
+  DistinctAggregator(unique_ptr<ColumnAggregator> aggregator,
                      Block* result_block)
       : aggregator_(std::move(aggregator)) {}
 
@@ -304,15 +311,47 @@ class DistinctAggregator : public ColumnAggregator {
   virtual FailureOrVoid UpdateAggregation(const Column* input,
                                           rowcount_t input_row_count,
                                           const rowid_t result_index_map[]) {
-    vector<rowid_t> selected_inputs_indexes;
+    return Update(input, AllInputs(input_row_count), result_index_map);
+  }
+
+  virtual FailureOrVoid UpdateSelectedAggregation(
+      const Column* input,
+      const rowid_t selection[],
+      rowcount_t selection_size,
+      const rowid_t result_index_map[]) {
+    return Update(input, SelectedInputs(selection, selection_size),
+                  result_index_map);
+  }
+
+  virtual void Rebind(rowcount_t previous_capacity, rowcount_t new_capacity) {
+    aggregator_->Rebind(previous_capacity, new_capacity);
+  }
+
+  virtual void Reset() {
+    for (rowid_t i = 0; i < distinct_values_.size(); ++i) {
+      distinct_values_[i].Reset();
+    }
+    aggregator_->Reset();
+  }
+
+ private:
+  // Passes the values not seen before, for their result values, on to the
+  // aggregator.
+  template<typename Inputs>
+  FailureOrVoid Update(const Column* input,
+                       const Inputs& inputs,
+                       const rowid_t result_index_map[]) {
+    vector<rowid_t> distinct_inputs;
+    vector<rowid_t> distinct_result_indexes;
     CHECK_NOTNULL(input);
     bool check_input_nullability = input->is_null() != NULL;
-    for (rowid_t i = 0; i < input_row_count; ++i) {
+    for (rowid_t i = 0; i < inputs.size(); ++i) {
+      const rowid_t position = inputs[i];
       // NULL values do not count as distinct.
-      if (check_input_nullability && input->is_null()[i]) {
+      if (check_input_nullability && input->is_null()[position]) {
         continue;
       }
-      cpp_input_type input_val = input->data().as<InputType>()[i];
+      cpp_input_type input_val = input->data().as<InputType>()[position];
       rowid_t result_index = result_index_map[i];
 
       if (result_index >= distinct_values_.size()) {
@@ -323,29 +362,17 @@ class DistinctAggregator : public ColumnAggregator {
           &distinct_values_[result_index];
       if (!distinct_values_set->has_value(input_val)) {
         distinct_values_set->insert(input_val);
-        selected_inputs_indexes.push_back(i);
+        distinct_inputs.push_back(position);
+        distinct_result_indexes.push_back(result_index);
       }
     }
-    if (selected_inputs_indexes.size()) {
-      aggregator_->UpdateAggregationForSelectedInputs(
-          input, input_row_count, result_index_map, selected_inputs_indexes);
-    }
-    return Success();
-  }
-
-  virtual void Rebind(rowcount_t previous_capacity, rowcount_t new_capacity) {
-    aggregator_->Rebind(previous_capacity, new_capacity);
-  }
-
-  virtual void Reset() {
-    for (rowid_t i = 0; i < distinct_values_.size(); ++i) {
-      distinct_values_[i].Reset();
-    }
-    aggregator_->Reset();
+    if (distinct_inputs.empty()) return Success();
+    return aggregator_->UpdateSelectedAggregation(
+        input, &distinct_inputs[0], distinct_inputs.size(),
+        &distinct_result_indexes[0]);
   }
 
- private:
-  std::unique_ptr<ColumnAggregatorInternal> aggregator_;
+  std::unique_ptr<ColumnAggregator> aggregator_;
 
   // Vector of sets holding distinct values for each unique key. Not initialized
   // to have as many elements as result_block to avoid possibly unnecessary
@@ -395,7 +422,7 @@ class ColumnAggregatorFactoryImpl {
       int result_column_index);
 
   typedef unique_ptr<ColumnAggregator> (*DistinctAggregatorCreatorFunction)(
-      unique_ptr<ColumnAggregatorInternal> aggregator,
+      unique_ptr<ColumnAggregator> aggregator,
       Block* result_block);
 
   bool IsAggregationSupported(Aggregation aggregation_operator, DataType t1,
@@ -432,7 +459,7 @@ unique_ptr<ColumnAggregator> CountAggregatorCreator(Block* result_block,
 
 template<DataType input_type>
 unique_ptr<ColumnAggregator> DistinctAggregatorCreator(
-    unique_ptr<ColumnAggregatorInternal> aggregator, Block* output_block) {
+    unique_ptr<ColumnAggregator> aggregator, Block* output_block) {
   return make_unique<DistinctAggregator<input_type>>(std::move(aggregator), output_block);
 }
 
@@ -571,7 +598,7 @@ ColumnAggregatorFactoryImpl::CreateDistinctAggregator(
 
   return Success(
       distinct_aggregator_factory_[input_type](
-          down_cast<ColumnAggregatorInternal>(aggregator.move()), result_block));
+          aggregator.move(), result_block));
 }
 
 FailureOrOwned<ColumnAggregator>
@@ -611,7 +638,7 @@ CreateDistinctCountAggregator(
 
   return Success(
       distinct_aggregator_factory_[input_type](
-          down_cast<ColumnAggregatorInternal>(count_aggregator.move()),
+          count_aggregator.move(),
           result_block));
 }
 
@@ -62,6 +62,15 @@ class ColumnAggregator {
                                           rowcount_t input_row_count,
                                           const rowid_t result_index_map[]) = 0;
 
+  // Like UpdateAggregation(), but aggregates only the selected values from the
+  // input column: the value at selection[i] into the result value at
+  // result_index_map[i], for i < selection_size.
+  virtual FailureOrVoid UpdateSelectedAggregation(
+      const Column* input,
+      const rowid_t selection[],
+      rowcount_t selection_size,
+      const rowid_t result_index_map[]) = 0;
+
   // Called after the block that this column aggregator refers to got
   // reallocated. Gives the aggregator an opportunity to re-fetch column
   // pointers, that may have changed as the result of reallocation. The
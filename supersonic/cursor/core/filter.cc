@@ -49,10 +49,10 @@ namespace {
 
 static const int kMinimumFillPercent = 25;
 
-// TODO(user): perhaps this class should be broken in two: a simple
-// shallow-copy filter, and an (optional) compactor. To make this work w/o
-// imposing additional copying, we'd need to add support for selection vectors
-// to views.
+// Next() compacts the passing rows into result_block_, unless all the rows of
+// an input view pass, in which case the view is returned as it is.
+// NextSelected() never copies: it returns the input views, with the ids of the
+// passing rows as their selection vectors.
 //
 // TODO(onufry): At the moment the filter calculates the predicate for all the
 // rows in the input at one go (at PrepareInputRowIds). This means the input
@@ -136,12 +136,44 @@ class FilterCursor : public BasicCursor {
         current_view_ = &result.view();
         PROPAGATE_ON_FAILURE(PrepareInputRowIds());
         read_pointer_ = 0;
+        if (write_pointer_ == 0 && input_row_ids_count_ > 0 &&
+            input_row_ids_count_ == current_view_->row_count() &&
+            input_row_ids_count_ <= effective_max_row_count) {
+          // All the rows pass; no need to copy them.
+          read_pointer_ = input_row_ids_count_;
+          ProjectCurrentView(NULL, input_row_ids_count_);
+          return ResultView::Success(my_view());
+        }
       }
     }
     my_view()->ResetFromSubRange(result_block_.view(), 0, write_pointer_);
     return ResultView::Success(my_view());
   }
 
+  virtual ResultView NextSelected(rowcount_t max_row_count) {
+    while (read_pointer_ >= input_row_ids_count_) {
+      if (eos_) return ResultView::EOS();
+      ResultView result = child()->Next(std::min(result_block_.row_capacity(),
+                                                 predicate_capacity_));
+      PROPAGATE_ON_FAILURE(result);
+      if (!result.has_data()) {
+        eos_ = result.is_eos();
+        return result;
+      }
+      current_view_ = &result.view();
+      PROPAGATE_ON_FAILURE(PrepareInputRowIds());
+      read_pointer_ = 0;
+    }
+    const rowcount_t row_count =
+        std::min(input_row_ids_count_ - read_pointer_, max_row_count);
+    ProjectCurrentView(
+        input_row_ids_.view().column(0).typed_data<kRowidDatatype>() +
+            read_pointer_,
+        row_count);
+    read_pointer_ += row_count;
+    return ResultView::Success(my_view());
+  }
+
   virtual bool IsWaitingOnBarrierSupported() const { return true; }
 
   virtual CursorId GetCursorId() const { return FILTER; }
@@ -193,6 +225,14 @@ class FilterCursor : public BasicCursor {
     return Success();
   }
 
+  // Sets my_view() to the current_view_'s rows at the selection, projected,
+  // without copying them.
+  void ProjectCurrentView(const rowid_t* selection, rowcount_t row_count) {
+    projector_->Project(*current_view_, my_view());
+    my_view()->set_selection(selection);
+    my_view()->set_row_count(row_count);
+  }
+
   bool CopyImpl(rowcount_t max_row_count, rowcount_t rows_to_copy) {
     const rowid_t* ids_pointer =
         input_row_ids_.mutable_column(0)->content().
@@ -241,7 +281,7 @@ class FilterCursor : public BasicCursor {
 
   // Predicate to evaluate on the data.
   unique_ptr<BoundExpressionTree> predicate_;
-  // Not used, only to keep it around (and destroy properly).
+  // Projects the input views that are returned without copying.
   unique_ptr<const BoundSingleSourceProjector> projector_;
   // Cached capacity of the predicate, to avoid recalculation at each call to
   // Next().
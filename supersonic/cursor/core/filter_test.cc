@@ -35,6 +35,8 @@ using std::vector;
 #include "supersonic/base/memory/memory.h"
 #include "supersonic/cursor/base/cursor.h"
 #include "supersonic/cursor/base/operation.h"
+#include "supersonic/cursor/core/ownership_taker.h"
+#include "supersonic/cursor/core/scan_view.h"
 #include "supersonic/cursor/infrastructure/table.h"
 #include "supersonic/expression/base/expression.h"
 #include "supersonic/expression/core/comparison_expressions.h"
@@ -42,6 +44,7 @@ using std::vector;
 #include "supersonic/expression/infrastructure/terminal_expressions.h"
 #include "supersonic/proto/supersonic.pb.h"
 #include "supersonic/testing/block_builder.h"
+#include "supersonic/testing/comparators.h"
 #include "supersonic/testing/expression_test_helper.h"
 #include "supersonic/testing/operation_testing.h"
 #include "gtest/gtest.h"
@@ -342,4 +345,78 @@ TEST(FilterCursorTest, MaxRowCount) {
   filter_result->Next(1);
 }
 
+class FilterCursorSelectionTest : public testing::Test {
+ protected:
+  virtual void SetUp() {
+    block_ = BlockBuilder<INT32, STRING>()
+        .AddRow(-1, "A")
+        .AddRow(2, "B")
+        .AddRow(-3, "C")
+        .AddRow(4, "D")
+        .Build();
+  }
+
+  // Returns col1 of the rows with a positive col0.
+  unique_ptr<Cursor> CreatePositiveFilter() {
+    return SucceedOrDie(TurnIntoCursor(
+        Filter(Greater(NamedAttribute("col0"), ConstInt32(0)),
+               ProjectNamedAttribute("col1"),
+               ScanView(block_->view()))));
+  }
+
+  const StringPiece* input_data() const {
+    return block_->view().column(1).typed_data<STRING>();
+  }
+
+  unique_ptr<Block> block_;
+};
+
+TEST_F(FilterCursorSelectionTest, NextSelectedDoesNotCopy) {
+  unique_ptr<Cursor> filter = CreatePositiveFilter();
+  ResultView result = filter->NextSelected(Cursor::kDefaultRowCount);
+  ASSERT_TRUE(result.has_data());
+  const View& view = result.view();
+  ASSERT_EQ(2, view.row_count());
+  ASSERT_TRUE(view.selection() != NULL);
+  EXPECT_EQ(1, view.selection()[0]);
+  EXPECT_EQ(3, view.selection()[1]);
+  EXPECT_EQ(input_data(), view.column(0).typed_data<STRING>());
+  EXPECT_EQ("D", view.column(0).typed_data<STRING>()[view.row_position(1)]);
+  EXPECT_TRUE(filter->NextSelected(Cursor::kDefaultRowCount).is_eos());
+}
+
+TEST_F(FilterCursorSelectionTest, NextSelectedRespectsMaxRowCount) {
+  unique_ptr<Cursor> filter = CreatePositiveFilter();
+  for (rowid_t position : { 1, 3 }) {
+    ResultView result = filter->NextSelected(1);
+    ASSERT_TRUE(result.has_data());
+    ASSERT_EQ(1, result.view().row_count());
+    EXPECT_EQ(position, result.view().row_position(0));
+  }
+  EXPECT_TRUE(filter->NextSelected(1).is_eos());
+}
+
+TEST_F(FilterCursorSelectionTest, AllPassingNotCopied) {
+  unique_ptr<Cursor> filter = SucceedOrDie(TurnIntoCursor(
+      Filter(Greater(NamedAttribute("col0"), ConstInt32(-10)),
+             ProjectNamedAttribute("col1"),
+             ScanView(block_->view()))));
+  ResultView result = filter->Next(Cursor::kDefaultRowCount);
+  ASSERT_TRUE(result.has_data());
+  EXPECT_EQ(4, result.view().row_count());
+  EXPECT_TRUE(result.view().selection() == NULL);
+  EXPECT_EQ(input_data(), result.view().column(0).typed_data<STRING>());
+  EXPECT_TRUE(filter->Next(Cursor::kDefaultRowCount).is_eos());
+}
+
+TEST_F(FilterCursorSelectionTest, NextCompactsSelectedRows) {
+  unique_ptr<Cursor> filter = CreatePositiveFilter();
+  ResultView result = filter->Next(Cursor::kDefaultRowCount);
+  ASSERT_TRUE(result.has_data());
+  EXPECT_TRUE(result.view().selection() == NULL);
+  unique_ptr<Block> expected(
+      BlockBuilder<STRING>().AddRow("B").AddRow("D").Build());
+  EXPECT_VIEWS_EQUAL(expected->view(), result.view());
+}
+
 }  // namespace supersonic
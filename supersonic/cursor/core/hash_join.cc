@@ -15,6 +15,7 @@
 
 #include "supersonic/cursor/core/hash_join.h"
 
+#include <algorithm>
 #include <memory>
 #include <string>
 #include <utility>
@@ -31,6 +32,7 @@ using std::vector;
 #include "supersonic/utils/exception/failureor.h"
 #include "supersonic/base/exception/exception.h"
 #include "supersonic/base/exception/exception_macros.h"
+#include "supersonic/base/memory/memory.h"
 #include "supersonic/base/infrastructure/bit_pointers.h"
 #include "supersonic/base/infrastructure/block.h"
 #include "supersonic/base/infrastructure/copy_column.h"
@@ -43,8 +45,18 @@ using std::vector;
 #include "supersonic/cursor/base/cursor_transformer.h"
 #include "supersonic/cursor/base/lookup_index.h"
 #include "supersonic/cursor/base/operation.h"
+#include "supersonic/cursor/core/join_key_filter.h"
+#include "supersonic/cursor/infrastructure/basic_cursor.h"
+#include "supersonic/cursor/infrastructure/bloom_filter.h"
+#include "supersonic/cursor/infrastructure/hash_partitioning.h"
+#include "supersonic/cursor/infrastructure/file_io.h"
 #include "supersonic/cursor/infrastructure/row_hash_set.h"
+#include "supersonic/cursor/infrastructure/table.h"
+#include "supersonic/cursor/infrastructure/temporary_file_factory.h"
+#include "supersonic/cursor/infrastructure/thread_pool.h"
+#include "supersonic/cursor/infrastructure/view_cursor.h"
 #include "supersonic/expression/vector/vector_logic.h"
+#include "supersonic/utils/bits.h"
 #include "supersonic/utils/strings/join.h"
 #include "supersonic/utils/container_literal.h"
 #include "supersonic/utils/iterator_adaptors.h"
@@ -75,6 +87,16 @@ void FindNotNullKeys(const View& view, bool_ptr is_not_null) {
   }
 }
 
+// True for the join types that output the lhs rows without a match.
+bool OutputsUnmatchedLhsRows(JoinType join_type) {
+  return join_type == LEFT_OUTER || join_type == FULL_OUTER;
+}
+
+// True for the join types that output the rhs rows without a match.
+bool OutputsUnmatchedRhsRows(JoinType join_type) {
+  return join_type == RIGHT_OUTER || join_type == FULL_OUTER;
+}
+
 TupleSchema WithAllColumnsNullable(const TupleSchema& schema) {
   TupleSchema output;
   for (int i = 0; i < schema.attribute_count(); ++i) {
@@ -86,6 +108,26 @@ TupleSchema WithAllColumnsNullable(const TupleSchema& schema) {
   return output;
 }
 
+// Returns a projector of the same attributes as the given one, but from
+// source_schema, which may differ from the projector's source in nullability.
+BoundSingleSourceProjector RebindProjector(
+    const BoundSingleSourceProjector& projector,
+    const TupleSchema& source_schema) {
+  BoundSingleSourceProjector result(source_schema);
+  for (int i = 0; i < projector.result_schema().attribute_count(); ++i) {
+    result.AddAs(projector.source_attribute_position(i),
+                 projector.result_schema().attribute(i).name());
+  }
+  return result;
+}
+
+// Returns the factory creating the files of the spilled rows.
+TemporaryFileFactory* SpillFileFactory(const HashJoinOptions& options) {
+  return options.temporary_file_factory() != NULL
+      ? options.temporary_file_factory()
+      : DefaultTemporaryFileFactory(options.temporary_directory_prefix());
+}
+
 }  // namespace
 
 // A specific implementation of LookupIndex that adapts a Cursor to this
@@ -94,9 +136,12 @@ TupleSchema WithAllColumnsNullable(const TupleSchema& schema) {
 template <KeyUniqueness key_uniqueness>
 class HashIndexOnMaterializedCursor : public LookupIndex {
  public:
+  // The materialized rows and the index are allocated with allocator, and the
+  // buffers for the lookup results with lookup_allocator.
   HashIndexOnMaterializedCursor(
       JoinType join_type,
       BufferAllocator* const allocator,
+      BufferAllocator* const lookup_allocator,
       unique_ptr<const BoundSingleSourceProjector> key_selector,
       const TupleSchema& schema);
   FailureOrVoid Init();
@@ -111,9 +156,24 @@ class HashIndexOnMaterializedCursor : public LookupIndex {
     return *key_selector_;
   }
 
+  // For RIGHT_OUTER and FULL_OUTER joins, returns the indexed rows that
+  // haven't been matched, followed by the rows with NULL keys.
+  virtual FailureOrOwned<LookupIndexCursor> UnmatchedRows() const;
+
   FailureOr<bool> MaterializeInputAndBuildIndex(Cursor* input);
 
-  bool empty() const { return index_.size() == 0; }
+  // The number of the indexed rows (rows with NULL keys are not indexed).
+  rowcount_t indexed_row_count() const {
+    return index_.indexed_view().row_count();
+  }
+
+  // Adds the keys of the indexed rows to the filter. Once the index is built.
+  void AddKeysToFilter(BloomFilter* filter) const;
+
+  bool empty() const {
+    return index_.size() == 0 &&
+        (null_key_rows_ == NULL || null_key_rows_->row_count() == 0);
+  }
 
  private:
   // Subclass of LookupIndexCursor returned by MultiLookup; implements
@@ -121,6 +181,12 @@ class HashIndexOnMaterializedCursor : public LookupIndex {
   template <JoinType join_type>
   class ResultCursor;
 
+  class UnmatchedRowsCursor;
+
+  // Stores the rows of the view that have NULL keys (and so never match) in
+  // null_key_rows_.
+  FailureOrVoid AppendNullKeyRows(const View& view, bool_const_ptr is_not_null);
+
   JoinType join_type_;
 
   TupleSchema schema_;
@@ -146,22 +212,170 @@ class HashIndexOnMaterializedCursor : public LookupIndex {
   mutable Block result_cursor_block_;
   mutable std::unique_ptr<rowid_t[]> result_cursor_query_ids_;
 
+  // For RIGHT_OUTER and FULL_OUTER joins only (NULL otherwise): a bit per
+  // indexed row, set once the row has matched a query row; and the input rows
+  // with NULL keys, which are not indexed.
+  std::unique_ptr<vector<bool> > matched_;
+  std::unique_ptr<Table> null_key_rows_;
+
   template <JoinType join_type>
   friend class ResultCursor;
 };
 
+// A LookupIndex composed of HashIndexOnMaterializedCursor-s, one per
+// partition. The input rows are scattered by the hash of their keys, and then
+// the partitions' indexes are built independently, in parallel if a thread
+// pool is given. A lookup is split by the same hash into sub-lookups, one per
+// partition; the result cursor returns their results partition by partition.
+//
+// If spilling is enabled, the partitions that don't fit in the allocator are
+// written to temporary files instead (the largest ones first), and their
+// indexes are left empty. The spilled partitions are to be joined separately;
+// lookups must not contain the keys that belong to them.
 template <KeyUniqueness key_uniqueness>
-class HashIndexMaterializer : public LookupIndexBuilder {
+class PartitionedHashIndex : public LookupIndex {
  public:
-
-  HashIndexMaterializer(
-      unique_ptr<Cursor> input,
+  // partition_count must be a power of 2, greater than 1. The input rows and
+  // the indexes are allocated with allocator, the buffers for partitioning and
+  // for the lookup results with lookup_allocator. Doesn't take ownership of
+  // the thread pool (may be NULL), the temporary file factory (may be NULL if
+  // not spilling) nor the allocators.
+  PartitionedHashIndex(
       JoinType join_type,
+      int partition_count,
+      ThreadPool* thread_pool,
+      bool spill,
+      TemporaryFileFactory* temporary_file_factory,
+      FileCompression spill_compression,
       BufferAllocator* const allocator,
-      unique_ptr<const BoundSingleSourceProjector> key_selector)
+      BufferAllocator* const lookup_allocator,
+      unique_ptr<const BoundSingleSourceProjector> key_selector,
+      const TupleSchema& schema);
+  FailureOrVoid Init();
+
+  // Not thread-safe; uses the scratchpads of the partitions' indexes.
+  virtual FailureOrOwned<LookupIndexCursor> MultiLookup(
+      const View* query) const;
+  virtual const TupleSchema& schema() const {
+    return partitions_[0]->schema();
+  }
+  virtual const BoundSingleSourceProjector& key_selector() const {
+    return *key_selector_;
+  }
+
+  // Returns the unmatched rows of all the partitions kept in memory.
+  virtual FailureOrOwned<LookupIndexCursor> UnmatchedRows() const;
+
+  FailureOr<bool> MaterializeInputAndBuildIndex(Cursor* input);
+
+  // As in HashIndexOnMaterializedCursor; the partitions kept in memory only.
+  rowcount_t indexed_row_count() const {
+    rowcount_t row_count = 0;
+    for (int p = 0; p < partitions_.size(); ++p) {
+      row_count += partitions_[p]->indexed_row_count();
+    }
+    return row_count;
+  }
+  void AddKeysToFilter(BloomFilter* filter) const {
+    for (int p = 0; p < partitions_.size(); ++p) {
+      partitions_[p]->AddKeysToFilter(filter);
+    }
+  }
+
+  // False if any partition is spilled; the lhs must be read in full then.
+  bool empty() const {
+    if (spilled_partition_count_ > 0) return false;
+    for (int p = 0; p < partitions_.size(); ++p) {
+      if (!partitions_[p]->empty()) return false;
+    }
+    return true;
+  }
+
+  int partition_bits() const { return partition_bits_; }
+
+  // Returns the files with the rows of the spilled partitions, indexed by
+  // partition (NULL for the partitions kept in memory). Can be called once,
+  // after the index is built.
+  vector<std::unique_ptr<TemporaryFileBuffer> > ReleaseSpilledPartitions() {
+    return std::move(spilled_);
+  }
+
+ private:
+  class ResultCursor;
+  class UnmatchedRowsCursor;
+
+  typedef HashIndexOnMaterializedCursor<key_uniqueness> PartitionIndex;
+
+  FailureOrOwned<PartitionIndex> CreatePartition();
+
+  // Appends the rows of the view to the inputs of their partitions.
+  FailureOrVoid Scatter(const View& view);
+
+  // Appends the rows to the input of the partition, spilling partitions if
+  // they don't fit.
+  FailureOrVoid AppendToPartition(int partition, const View& rows);
+
+  // Writes the input of the partition to a temporary file, and releases it.
+  FailureOrVoid Spill(int partition);
+
+  // Builds the indexes of all the partitions, and releases their inputs.
+  FailureOrVoid BuildPartitions();
+
+  const JoinType join_type_;
+  const int partition_bits_;
+  ThreadPool* const thread_pool_;
+  const bool spill_;
+  TemporaryFileFactory* const temporary_file_factory_;
+  const FileCompression spill_compression_;
+  const TupleSchema input_schema_;
+
+  // Serializes the allocations of the partitions built in parallel.
+  ThreadSafeBufferAllocator<BufferAllocator> allocator_;
+  BufferAllocator* const lookup_allocator_;
+
+  std::unique_ptr<const BoundSingleSourceProjector> key_selector_;
+
+  vector<std::unique_ptr<HashIndexOnMaterializedCursor<key_uniqueness> > >
+      partitions_;
+
+  // The input rows, by partition. Released once the partitions are built.
+  vector<std::unique_ptr<Table> > partition_inputs_;
+
+  // The rows of the spilled partitions; NULL for those kept in memory.
+  vector<std::unique_ptr<TemporaryFileBuffer> > spilled_;
+  int spilled_partition_count_;
+
+  // Input rows arranged by partition, before being appended to the
+  // partition_inputs_.
+  Block scatter_block_;
+  SelectiveViewCopier scatter_copier_;
+  View scatter_key_;
+
+  // Lookup keys arranged by partition. Created on the first lookup, as the
+  // query schema may differ from the key schema in nullability.
+  mutable std::unique_ptr<Block> query_block_;
+  mutable std::unique_ptr<SelectiveViewCopier> query_copier_;
+
+  // Scratchpads for partitioning the input and the queries.
+  mutable std::unique_ptr<size_t[]> hash_;
+  mutable std::unique_ptr<int[]> partition_;
+  mutable vector<rowcount_t> partition_offset_;
+};
+
+// Materializes the input into the index (of HashIndexOnMaterializedCursor or
+// PartitionedHashIndex type) when built.
+template <typename IndexType>
+class HashIndexMaterializer : public LookupIndexBuilder {
+ public:
+  // If key_filter is not NULL, a Bloom filter over the keys of the index,
+  // allocated with allocator, is published in it once the index is built.
+  HashIndexMaterializer(unique_ptr<Cursor> input, unique_ptr<IndexType> index,
+                        JoinKeyFilter* key_filter = NULL,
+                        BufferAllocator* allocator = NULL)
       : input_(std::move(input)),
-        index_(new HashIndexOnMaterializedCursor<key_uniqueness>(
-            join_type, allocator, std::move(key_selector), input_->schema())) {}
+        index_(std::move(index)),
+        key_filter_(key_filter),
+        allocator_(allocator) {}
 
   FailureOrVoid Init() {
     PROPAGATE_ON_FAILURE(index_->Init());
@@ -177,6 +391,7 @@ class HashIndexMaterializer : public LookupIndexBuilder {
     PROPAGATE_ON_FAILURE(materialized);
     if (materialized.get()) {
       input_.reset(NULL);  // Releases resources held by the input.
+      if (key_filter_ != NULL) PublishKeyFilter();
       return Success(std::move(index_));
     } else {
       return Success(unique_ptr<LookupIndex>(nullptr));
@@ -192,22 +407,42 @@ class HashIndexMaterializer : public LookupIndexBuilder {
   }
 
 private:
+  // The filter is only an optimization; if there is no memory for it, the lhs
+  // is left unfiltered.
+  void PublishKeyFilter() {
+    FailureOrOwned<BloomFilter> filter =
+        BloomFilter::Create(index_->indexed_row_count(), allocator_);
+    if (filter.is_failure()) return;
+    index_->AddKeysToFilter(filter.get());
+    key_filter_->Publish(std::shared_ptr<const BloomFilter>(filter.move()));
+  }
+
   std::unique_ptr<Cursor> input_;
-  std::unique_ptr<HashIndexOnMaterializedCursor<key_uniqueness> > index_;
+  std::unique_ptr<IndexType> index_;
+  JoinKeyFilter* const key_filter_;
+  BufferAllocator* const allocator_;
 };
 
 // The actual hash join implementation.
 class HashJoinCursor : public Cursor {
  public:
-  // Takes ownership of lhs_key_selector.
+  // Takes ownership of lhs_key_selector. If coalesce_output is set, the
+  // results of several lookups are gathered into a single output view (see
+  // HashJoinOptions::set_coalesce_output). If key_filter is not NULL, the
+  // filter published in it by rhs is dropped along with the cursor (it may be
+  // allocated with the cursor's allocator).
   HashJoinCursor(
       JoinType join_type,
       BufferAllocator* const allocator,
       unique_ptr<const BoundSingleSourceProjector> lhs_key_selector,
       const BoundMultiSourceProjector& result_projector,
       unique_ptr<LookupIndexBuilder> rhs,
-      unique_ptr<Cursor> lhs);
-  virtual ~HashJoinCursor() { }
+      unique_ptr<Cursor> lhs,
+      bool coalesce_output,
+      JoinKeyFilter* key_filter = NULL);
+  virtual ~HashJoinCursor() {
+    if (key_filter_ != NULL) key_filter_->Reset();
+  }
 
   // Allocates index' internal block and reads input into it.
   FailureOrVoid Init();
@@ -246,7 +481,16 @@ class HashJoinCursor : public Cursor {
       JoinType join_type,
       const BoundMultiSourceProjector& result_projector);
 
+  // Returns the next rhs rows that haven't matched any lhs row, with NULLs on
+  // the lhs side. For RIGHT_OUTER and FULL_OUTER joins, once the lhs is
+  // exhausted.
+  ResultView NextUnmatchedRhsRows(rowcount_t max_row_count);
+
+  // Returns the first row_count rows gathered in lhs_result_ and rhs_result_.
+  ResultView CoalescedResult(rowcount_t row_count);
+
   JoinType join_type_;
+  const bool coalesce_output_;
   unique_ptr<Cursor> lhs_;
   unique_ptr<LookupIndexBuilder> rhs_builder_;
   unique_ptr<const LookupIndex> rhs_;
@@ -255,11 +499,25 @@ class HashJoinCursor : public Cursor {
   // Projector from lhs_ to lhs_result_, see below.
   const BoundSingleSourceProjector lhs_result_projector_;
 
+  // The same projector, bound to the schema of lhs_ (the above one is bound to
+  // a nullable version of it in RIGHT_OUTER and FULL_OUTER joins), and the
+  // lhs view projected by it.
+  const BoundSingleSourceProjector lhs_input_projector_;
+  View lhs_projected_;
+
   // Placeholder for lhs columns projected into the final result.
   Block lhs_result_;
 
-  // Copies matched rows from lhs input into lhs_result_ wrt its projector.
+  // Copies the matched rows from lhs_projected_ into lhs_result_; the deep
+  // one when coalescing the output, as the lhs views don't outlive the next
+  // read from the lhs.
   SelectiveViewCopier lhs_result_copier_;
+  SelectiveViewCopier lhs_result_deep_copier_;
+
+  // When coalescing the output only (NULL otherwise): placeholder for the rhs
+  // rows of the matches, and its copier.
+  std::unique_ptr<Block> rhs_result_;
+  std::unique_ptr<ViewCopier> rhs_result_copier_;
 
   // Projector that sets result_view over final result data from lhs and rhs
   // input - over (lhs_result_, rhs_result.view()) pair; see below.
@@ -282,9 +540,298 @@ class HashJoinCursor : public Cursor {
   // the cursor of matches and hence the subsequent call should resume where
   // the last left off.
   std::unique_ptr<LookupIndexCursor> matches_;
+
+  // Set once the lhs input returns EOS.
+  bool lhs_exhausted_;
+
+  // Cursor over the unmatched rhs rows, for RIGHT_OUTER and FULL_OUTER joins.
+  // Set once the lhs is exhausted.
+  std::unique_ptr<LookupIndexCursor> unmatched_rhs_rows_;
+
+  JoinKeyFilter* const key_filter_;
 };
 
 
+// Hands an already built index over to HashJoinCursor.
+class PrebuiltLookupIndexBuilder : public LookupIndexBuilder {
+ public:
+  explicit PrebuiltLookupIndexBuilder(unique_ptr<LookupIndex> index)
+      : schema_(index->schema()),
+        index_(std::move(index)) {}
+
+  virtual const TupleSchema& schema() const { return schema_; }
+
+  virtual FailureOrOwned<LookupIndex> Build() {
+    CHECK(index_.get() != NULL) << "Already built.";
+    return Success(std::move(index_));
+  }
+
+  virtual void Interrupt() {}
+  virtual void ApplyToChildren(CursorTransformer* transformer) {}
+
+ private:
+  const TupleSchema schema_;
+  std::unique_ptr<LookupIndex> index_;
+};
+
+// Passes through the rows that belong to the partitions kept in memory, and
+// appends the rows of the spilled partitions to their temporary files.
+class PartitionSpillingCursor : public BasicCursor {
+ public:
+  // spilled holds the files of the spilled partitions, indexed by partition
+  // (NULL for the partitions kept in memory); not owned.
+  PartitionSpillingCursor(
+      unique_ptr<Cursor> child,
+      unique_ptr<const BoundSingleSourceProjector> key_selector,
+      int partition_bits,
+      const vector<TemporaryFileBuffer*>& spilled,
+      BufferAllocator* allocator)
+      : BasicCursor(std::move(child)),
+        key_selector_(std::move(key_selector)),
+        partition_bits_(partition_bits),
+        spilled_(spilled),
+        block_(schema(), allocator),
+        copier_(schema(), false),
+        key_(key_selector_->result_schema()),
+        partition_offset_(spilled.size() + 1) {}
+
+  FailureOrVoid Init() {
+    if (!block_.Reallocate(Cursor::kDefaultRowCount)) {
+      THROW(new Exception(
+          ERROR_MEMORY_EXCEEDED,
+          "Cannot allocate memory to partition the hash join input"));
+    }
+    return Success();
+  }
+
+  virtual ResultView Next(rowcount_t max_row_count) {
+    for (;;) {
+      ResultView result = child()->Next(
+          std::min(max_row_count, Cursor::kDefaultRowCount));
+      if (!result.has_data()) return result;
+      const View& view = result.view();
+      const rowcount_t row_count = view.row_count();
+      key_selector_->Project(view, &key_);
+      key_.set_row_count(row_count);
+      ComputeHashPartitions(key_, partition_bits_, hash_, partition_);
+      GroupByPartition(partition_, row_count, spilled_.size(), order_,
+                       partition_offset_.data());
+      // Shallow; the rows kept in memory go first, in their original order.
+      rowcount_t kept_row_count = 0;
+      for (rowid_t i = 0; i < row_count; ++i) {
+        if (spilled_[partition_[i]] == NULL) kept_[kept_row_count++] = i;
+      }
+      copier_.Copy(kept_row_count, view, kept_, 0, &block_);
+      rowcount_t offset = kept_row_count;
+      for (size_t p = 0; p < spilled_.size(); ++p) {
+        const rowcount_t partition_row_count =
+            partition_offset_[p + 1] - partition_offset_[p];
+        if (spilled_[p] == NULL || partition_row_count == 0) continue;
+        copier_.Copy(partition_row_count, view,
+                     order_ + partition_offset_[p], offset, &block_);
+        PROPAGATE_ON_FAILURE(spilled_[p]->Write(
+            View(block_.view(), offset, partition_row_count)));
+        offset += partition_row_count;
+      }
+      if (kept_row_count > 0) {
+        my_view()->ResetFromSubRange(block_.view(), 0, kept_row_count);
+        return ResultView::Success(my_view());
+      }
+    }
+  }
+
+ private:
+  std::unique_ptr<const BoundSingleSourceProjector> key_selector_;
+  const int partition_bits_;
+  const vector<TemporaryFileBuffer*> spilled_;
+  Block block_;
+  SelectiveViewCopier copier_;
+  View key_;
+  size_t hash_[Cursor::kDefaultRowCount];
+  int partition_[Cursor::kDefaultRowCount];
+  rowid_t order_[Cursor::kDefaultRowCount];
+  rowid_t kept_[Cursor::kDefaultRowCount];
+  vector<rowcount_t> partition_offset_;
+  DISALLOW_COPY_AND_ASSIGN(PartitionSpillingCursor);
+};
+
+// Hybrid hash join. The rhs is partitioned, and the partitions that don't fit
+// in the memory quota are spilled to temporary files. The lhs rows of the
+// partitions kept in memory are joined right away; the lhs rows of the spilled
+// partitions are spilled as well. Then the spilled partition pairs are joined
+// one at a time. Every join is done by a HashJoinCursor.
+template <KeyUniqueness key_uniqueness>
+class HybridHashJoinCursor : public Cursor {
+ public:
+  HybridHashJoinCursor(
+      JoinType join_type,
+      int partition_count,
+      const HashJoinOptions& options,
+      BufferAllocator* allocator,
+      unique_ptr<const BoundSingleSourceProjector> lhs_key_selector,
+      unique_ptr<const BoundSingleSourceProjector> rhs_key_selector,
+      unique_ptr<const BoundMultiSourceProjector> result_projector,
+      unique_ptr<Cursor> lhs,
+      unique_ptr<Cursor> rhs)
+      : join_type_(join_type),
+        coalesce_output_(options.coalesce_output()),
+        allocator_(allocator),
+        memory_limit_(options.memory_quota(), true, allocator),
+        lhs_key_selector_(std::move(lhs_key_selector)),
+        rhs_key_selector_(std::move(rhs_key_selector)),
+        result_projector_(std::move(result_projector)),
+        lhs_schema_(lhs->schema()),
+        rhs_schema_(rhs->schema()),
+        lhs_(std::move(lhs)),
+        rhs_(std::move(rhs)),
+        index_(new PartitionedHashIndex<key_uniqueness>(
+            join_type, partition_count, options.thread_pool(), true,
+            SpillFileFactory(options), options.spill_compression(),
+            &memory_limit_, allocator,
+            make_unique<BoundSingleSourceProjector>(*rhs_key_selector_),
+            rhs_schema_)),
+        temporary_file_factory_(SpillFileFactory(options)),
+        spill_compression_(options.spill_compression()),
+        next_spilled_partition_(0) {}
+
+  FailureOrVoid Init() {
+    PROPAGATE_ON_FAILURE(index_->Init());
+    return Success();
+  }
+
+  virtual const TupleSchema& schema() const {
+    return result_projector_->result_schema();
+  }
+
+  virtual ResultView Next(rowcount_t max_row_count) {
+    if (current_ == NULL) {
+      FailureOr<bool> built = index_->MaterializeInputAndBuildIndex(rhs_.get());
+      PROPAGATE_ON_FAILURE(built);
+      if (!built.get()) return ResultView::WaitingOnBarrier();
+      rhs_.reset();
+      PROPAGATE_ON_FAILURE(StartInMemoryJoin());
+    }
+    for (;;) {
+      ResultView result = current_->Next(max_row_count);
+      if (!result.is_eos()) return result;
+      while (next_spilled_partition_ < rhs_spilled_.size() &&
+             rhs_spilled_[next_spilled_partition_] == NULL) {
+        ++next_spilled_partition_;
+      }
+      if (next_spilled_partition_ == rhs_spilled_.size()) return result;
+      PROPAGATE_ON_FAILURE(StartSpilledJoin(next_spilled_partition_++));
+    }
+  }
+
+  virtual bool IsWaitingOnBarrierSupported() const { return true; }
+
+  virtual void Interrupt() {
+    if (lhs_ != NULL) lhs_->Interrupt();
+    if (rhs_ != NULL) rhs_->Interrupt();
+    if (current_ != NULL) current_->Interrupt();
+  }
+
+  virtual void ApplyToChildren(CursorTransformer* transformer) {
+    if (lhs_ == NULL || rhs_ == NULL) {
+      LOG(ERROR) << "Operation run by HybridHashJoinCursor is in progress. "
+                 << "Aborting transformation.";
+      return;
+    }
+    lhs_ = transformer->Transform(std::move(lhs_));
+    rhs_ = transformer->Transform(std::move(rhs_));
+  }
+
+  virtual void AppendDebugDescription(string* target) const {
+    target->append("HybridHashJoinCursor");
+  }
+
+  virtual CursorId GetCursorId() const { return HASH_JOIN; }
+
+ private:
+  // Starts joining the lhs with the partitions kept in memory, spilling the
+  // lhs rows of the other partitions.
+  FailureOrVoid StartInMemoryJoin() {
+    rhs_spilled_ = index_->ReleaseSpilledPartitions();
+    vector<TemporaryFileBuffer*> spilled(rhs_spilled_.size(), NULL);
+    lhs_spilled_.resize(rhs_spilled_.size());
+    for (size_t p = 0; p < rhs_spilled_.size(); ++p) {
+      if (rhs_spilled_[p] == NULL) continue;
+      FailureOrOwned<TemporaryFileBuffer> buffer =
+          TemporaryFileBuffer::Create(temporary_file_factory_,
+                                      spill_compression_);
+      PROPAGATE_ON_FAILURE(buffer);
+      lhs_spilled_[p] = buffer.move();
+      spilled[p] = lhs_spilled_[p].get();
+    }
+    auto lhs = make_unique<PartitionSpillingCursor>(
+        std::move(lhs_),
+        make_unique<BoundSingleSourceProjector>(*lhs_key_selector_),
+        index_->partition_bits(), spilled, allocator_);
+    PROPAGATE_ON_FAILURE(lhs->Init());
+    return StartJoin(make_unique<PrebuiltLookupIndexBuilder>(std::move(index_)),
+                     std::move(lhs));
+  }
+
+  // Starts joining the spilled lhs and rhs rows of the partition.
+  FailureOrVoid StartSpilledJoin(int partition) {
+    // Releases the memory held by the previous join first.
+    current_.reset();
+    FailureOrOwned<Cursor> rhs =
+        rhs_spilled_[partition]->Read(rhs_schema_, allocator_);
+    rhs_spilled_[partition].reset();
+    PROPAGATE_ON_FAILURE(rhs);
+    FailureOrOwned<Cursor> lhs =
+        lhs_spilled_[partition]->Read(lhs_schema_, allocator_);
+    lhs_spilled_[partition].reset();
+    PROPAGATE_ON_FAILURE(lhs);
+    typedef HashIndexOnMaterializedCursor<key_uniqueness> IndexType;
+    auto rhs_builder = make_unique<HashIndexMaterializer<IndexType>>(
+        rhs.move(),
+        make_unique<IndexType>(
+            join_type_, &memory_limit_, allocator_,
+            make_unique<BoundSingleSourceProjector>(*rhs_key_selector_),
+            rhs_schema_));
+    PROPAGATE_ON_FAILURE(rhs_builder->Init());
+    return StartJoin(std::move(rhs_builder), lhs.move());
+  }
+
+  FailureOrVoid StartJoin(unique_ptr<LookupIndexBuilder> rhs,
+                          unique_ptr<Cursor> lhs) {
+    auto join = make_unique<HashJoinCursor>(
+        join_type_, allocator_,
+        make_unique<BoundSingleSourceProjector>(*lhs_key_selector_),
+        *result_projector_, std::move(rhs), std::move(lhs),
+        coalesce_output_);
+    PROPAGATE_ON_FAILURE(join->Init());
+    current_ = std::move(join);
+    return Success();
+  }
+
+  const JoinType join_type_;
+  const bool coalesce_output_;
+  BufferAllocator* const allocator_;
+  // Limits the memory used by the rhs indexes (and their inputs).
+  MemoryLimit memory_limit_;
+  std::unique_ptr<const BoundSingleSourceProjector> lhs_key_selector_;
+  std::unique_ptr<const BoundSingleSourceProjector> rhs_key_selector_;
+  std::unique_ptr<const BoundMultiSourceProjector> result_projector_;
+  const TupleSchema lhs_schema_;
+  const TupleSchema rhs_schema_;
+  // Reset once the in-memory join starts.
+  std::unique_ptr<Cursor> lhs_;
+  std::unique_ptr<Cursor> rhs_;
+  std::unique_ptr<PartitionedHashIndex<key_uniqueness> > index_;
+  TemporaryFileFactory* const temporary_file_factory_;
+  const FileCompression spill_compression_;
+  // The spilled rows, indexed by partition (NULL for in-memory partitions).
+  vector<std::unique_ptr<TemporaryFileBuffer> > lhs_spilled_;
+  vector<std::unique_ptr<TemporaryFileBuffer> > rhs_spilled_;
+  size_t next_spilled_partition_;
+  // The join in progress; NULL until the rhs is partitioned.
+  std::unique_ptr<Cursor> current_;
+  DISALLOW_COPY_AND_ASSIGN(HybridHashJoinCursor);
+};
+
 HashJoinOperation::HashJoinOperation(
     JoinType join_type,
     unique_ptr<const SingleSourceProjector> lhs_key_selector,
@@ -297,13 +844,49 @@ HashJoinOperation::HashJoinOperation(
       lhs_key_selector_(std::move(lhs_key_selector)),
       rhs_key_selector_(std::move(rhs_key_selector)),
       result_projector_(std::move(result_projector)),
-      rhs_key_uniqueness_(rhs_key_uniqueness) {}
+      rhs_key_uniqueness_(rhs_key_uniqueness),
+      options_(new HashJoinOptions) {}
+
+HashJoinOperation::HashJoinOperation(
+    JoinType join_type,
+    unique_ptr<const SingleSourceProjector> lhs_key_selector,
+    unique_ptr<const SingleSourceProjector> rhs_key_selector,
+    unique_ptr<const MultiSourceProjector> result_projector,
+    KeyUniqueness rhs_key_uniqueness,
+    unique_ptr<const HashJoinOptions> options,
+    unique_ptr<Operation> lhs_child, unique_ptr<Operation> rhs_child)
+    : BasicOperation(std::move(lhs_child), std::move(rhs_child)),
+      join_type_(join_type),
+      lhs_key_selector_(std::move(lhs_key_selector)),
+      rhs_key_selector_(std::move(rhs_key_selector)),
+      result_projector_(std::move(result_projector)),
+      rhs_key_uniqueness_(rhs_key_uniqueness),
+      options_(std::move(options)) {}
 
 FailureOrOwned<Cursor> HashJoinOperation::CreateCursor() const {
   Operation* const lhs_operation = child_at(0);
   Operation* const rhs_operation = child_at(1);
   std::unique_ptr<LookupIndex> rhs_lookup_index;
 
+  const int partition_count = options_->partition_count();
+  if (partition_count < 1 || (partition_count & (partition_count - 1)) != 0) {
+    THROW(new Exception(
+        ERROR_INVALID_ARGUMENT_VALUE,
+        StrCat("Hash join partition count must be a power of 2, is ",
+               partition_count)));
+  }
+  JoinKeyFilter* const key_filter = options_->key_filter();
+  if (key_filter != NULL) {
+    if (OutputsUnmatchedLhsRows(join_type_)) {
+      THROW(new Exception(
+          ERROR_INVALID_ARGUMENT_VALUE,
+          "Hash join key filter can't be used when the lhs rows without a "
+          "match are output"));
+    }
+    // Drops the filter published for a previous cursor.
+    key_filter->Reset();
+  }
+
   FailureOrOwned<Cursor> provided_lhs_cursor = lhs_operation->CreateCursor();
   PROPAGATE_ON_FAILURE(provided_lhs_cursor);
 
@@ -316,6 +899,16 @@ FailureOrOwned<Cursor> HashJoinOperation::CreateCursor() const {
       rhs_key_selector_->Bind(provided_rhs_cursor->schema());
   PROPAGATE_ON_FAILURE(bound_rhs_key_selector_result);
 
+  if (options_->spilling_enabled()) {
+    return (rhs_key_uniqueness_ == UNIQUE) ?
+        CreateHybridHashJoinCursor<UNIQUE>(
+            bound_rhs_key_selector_result.move(),
+            provided_lhs_cursor.move(), provided_rhs_cursor.move()) :
+        CreateHybridHashJoinCursor<NOT_UNIQUE>(
+            bound_rhs_key_selector_result.move(),
+            provided_lhs_cursor.move(), provided_rhs_cursor.move());
+  }
+
   FailureOrOwned<LookupIndexBuilder> rhs_builder(
       (rhs_key_uniqueness_ == UNIQUE) ?
           CreateHashIndexMaterializer<UNIQUE>(
@@ -332,13 +925,47 @@ FailureOrOwned<Cursor> HashJoinOperation::CreateCursor() const {
 
   FailureOrOwned<const BoundMultiSourceProjector> bound_result_projector =
       result_projector_->Bind({
-          provided_lhs_cursor->schema(), rhs_builder->schema()});
+          OutputsUnmatchedRhsRows(join_type_)
+              ? WithAllColumnsNullable(provided_lhs_cursor->schema())
+              : provided_lhs_cursor->schema(),
+          rhs_builder->schema()});
   PROPAGATE_ON_FAILURE(bound_result_projector);
 
   auto cursor = make_unique<HashJoinCursor>(
       join_type_, buffer_allocator(), bound_lhs_key_selector.move(),
       *bound_result_projector, rhs_builder.move(),
-      provided_lhs_cursor.move());
+      provided_lhs_cursor.move(), options_->coalesce_output(), key_filter);
+  PROPAGATE_ON_FAILURE(cursor->Init());
+  return Success(std::move(cursor));
+}
+
+template <KeyUniqueness key_uniqueness>
+FailureOrOwned<Cursor> HashJoinOperation::CreateHybridHashJoinCursor(
+    unique_ptr<const BoundSingleSourceProjector> bound_rhs_key_selector,
+    unique_ptr<Cursor> lhs_cursor,
+    unique_ptr<Cursor> rhs_cursor) const {
+  FailureOrOwned<const BoundSingleSourceProjector> bound_lhs_key_selector =
+      lhs_key_selector_->Bind(lhs_cursor->schema());
+  PROPAGATE_ON_FAILURE(bound_lhs_key_selector);
+
+  FailureOrOwned<const BoundMultiSourceProjector> bound_result_projector =
+      result_projector_->Bind({
+          OutputsUnmatchedRhsRows(join_type_)
+              ? WithAllColumnsNullable(lhs_cursor->schema())
+              : lhs_cursor->schema(),
+          OutputsUnmatchedLhsRows(join_type_)
+              ? WithAllColumnsNullable(rhs_cursor->schema())
+              : rhs_cursor->schema()});
+  PROPAGATE_ON_FAILURE(bound_result_projector);
+
+  const int partition_count = options_->partition_count() > 1
+      ? options_->partition_count()
+      : HashJoinOptions::kDefaultSpillPartitionCount;
+  auto cursor = make_unique<HybridHashJoinCursor<key_uniqueness>>(
+      join_type_, partition_count, *options_, buffer_allocator(),
+      bound_lhs_key_selector.move(), std::move(bound_rhs_key_selector),
+      bound_result_projector.move(), std::move(lhs_cursor),
+      std::move(rhs_cursor));
   PROPAGATE_ON_FAILURE(cursor->Init());
   return Success(std::move(cursor));
 }
@@ -350,10 +977,29 @@ HashJoinOperation::CreateHashIndexMaterializer(
     JoinType join_type,
     unique_ptr<const BoundSingleSourceProjector> bound_rhs_key_selector,
     unique_ptr<Cursor> rhs_cursor) const {
+  const int partition_count = options_->partition_count();
+  if (partition_count > 1) {
+    const TupleSchema rhs_schema = rhs_cursor->schema();
+    typedef PartitionedHashIndex<key_uniqueness> IndexType;
+    auto materializer = make_unique<HashIndexMaterializer<IndexType>>(
+        std::move(rhs_cursor),
+        make_unique<IndexType>(
+            join_type, partition_count, options_->thread_pool(), false, nullptr,
+            FILE_COMPRESSION_NONE, buffer_allocator(), buffer_allocator(),
+            std::move(bound_rhs_key_selector),
+            rhs_schema),
+        options_->key_filter(), buffer_allocator());
+    PROPAGATE_ON_FAILURE(materializer->Init());
+    return Success(std::move(materializer));
+  }
 
-  auto materializer = make_unique<HashIndexMaterializer<key_uniqueness>>(
-      std::move(rhs_cursor), join_type, buffer_allocator(),
-      std::move(bound_rhs_key_selector));
+  const TupleSchema rhs_schema = rhs_cursor->schema();
+  typedef HashIndexOnMaterializedCursor<key_uniqueness> IndexType;
+  auto materializer = make_unique<HashIndexMaterializer<IndexType>>(
+      std::move(rhs_cursor),
+      make_unique<IndexType>(join_type, buffer_allocator(), buffer_allocator(),
+                             std::move(bound_rhs_key_selector), rhs_schema),
+      options_->key_filter(), buffer_allocator());
 
   PROPAGATE_ON_FAILURE(materializer->Init());
   return Success(std::move(materializer));
@@ -365,17 +1011,28 @@ HashJoinCursor::HashJoinCursor(
     unique_ptr<const BoundSingleSourceProjector> lhs_key_selector,
     const BoundMultiSourceProjector& result_projector,
     unique_ptr<LookupIndexBuilder> rhs,
-    unique_ptr<Cursor> lhs)
+    unique_ptr<Cursor> lhs,
+    bool coalesce_output,
+    JoinKeyFilter* key_filter)
     : join_type_(join_type),
+      coalesce_output_(coalesce_output),
       lhs_(std::move(lhs)),
       rhs_builder_(std::move(rhs)),
       lhs_key_selector_(std::move(lhs_key_selector)),
       lhs_result_projector_(result_projector.GetSingleSourceProjector(0)),
+      lhs_input_projector_(
+          RebindProjector(lhs_result_projector_, lhs_->schema())),
+      lhs_projected_(lhs_input_projector_.result_schema()),
       lhs_result_(lhs_result_projector_.result_schema(), allocator),
-      lhs_result_copier_(&lhs_result_projector_, false),
+      lhs_result_copier_(lhs_input_projector_.result_schema(),
+                         lhs_result_.schema(), false),
+      lhs_result_deep_copier_(lhs_input_projector_.result_schema(),
+                              lhs_result_.schema(), true),
       result_view_(result_projector.result_schema()),
       lhs_view_(NULL),
-      lookup_query_(lhs_key_selector_->result_schema()) {
+      lookup_query_(lhs_key_selector_->result_schema()),
+      lhs_exhausted_(false),
+      key_filter_(key_filter) {
   DCHECK(lhs_key_selector_->source_schema().EqualByType(lhs_->schema()));
 
   DCHECK_EQ(2, result_projector.source_count());
@@ -383,6 +1040,10 @@ HashJoinCursor::HashJoinCursor(
   DCHECK(result_projector.source_schema(1).EqualByType(rhs_builder_->schema()));
 
   SetUpFinalResultProjector(join_type, result_projector);
+  if (coalesce_output_) {
+    rhs_result_.reset(new Block(rhs_builder_->schema(), allocator));
+    rhs_result_copier_.reset(new ViewCopier(rhs_builder_->schema(), false));
+  }
 }
 
 FailureOrVoid HashJoinCursor::Init() {
@@ -391,6 +1052,11 @@ FailureOrVoid HashJoinCursor::Init() {
     THROW(new Exception(ERROR_MEMORY_EXCEEDED,
                         "Memory exceeded in HashJoinCursor::Init()"));
   }
+  if (rhs_result_ != NULL &&
+      !rhs_result_->Reallocate(lhs_result_.row_capacity())) {
+    THROW(new Exception(ERROR_MEMORY_EXCEEDED,
+                        "Memory exceeded in HashJoinCursor::Init()"));
+  }
   result_view_.set_row_count(lhs_result_.row_capacity());
   return Success();
 }
@@ -406,13 +1072,28 @@ ResultView HashJoinCursor::Next(rowcount_t max_row_count) {
   // rows from the lhs view. The merged lhs rows are are written into result.
   // Rhs rows are projected into result (without actual copying). The matching
   // is done based on query_ids().
+  // When coalescing the output, the matches are appended to lhs_result_ and
+  // rhs_result_ instead, until max_row_count rows are gathered, or there is
+  // nothing more to gather without returning first.
+  // For RIGHT_OUTER and FULL_OUTER joins, the rhs rows without a match are
+  // returned at the end.
+  if (unmatched_rhs_rows_ != NULL) return NextUnmatchedRhsRows(max_row_count);
+  if (lhs_exhausted_ && !OutputsUnmatchedRhsRows(join_type_)) {
+    return ResultView::EOS();
+  }
+  rowcount_t result_row_count = 0;
+  if (coalesce_output_) {
+    max_row_count = std::min(max_row_count, lhs_result_.row_capacity());
+    lhs_result_.ResetArenas();
+  }
   for ( ;; ) {
     if (matches_.get() != NULL) {
       // A case where there are (possibly) some leftover views of matches.
       // This happens every time MultiLookup() returns a non-NULL cursor, as
       // after the first Next() on that cursor it's impossible to tell whether
       // the cursor has been exhausted without calling Next() again.
-      ResultLookupIndexView rhs_result = matches_->Next(max_row_count);
+      ResultLookupIndexView rhs_result =
+          matches_->Next(max_row_count - result_row_count);
       PROPAGATE_ON_FAILURE(rhs_result);
       if (rhs_result.has_data()) {
         // Merge lhs columns (1) with rhs columns (2) from lookup in
@@ -421,21 +1102,35 @@ ResultView HashJoinCursor::Next(rowcount_t max_row_count) {
         // result_view). Relevant rows from lhs input are written into
         // lhs_result_ based on query_ids().
         // This method returns a view to the caller every time a lookup yields
-        // a non-empty view of matches.
-        // TODO(user): Fill the result block with multiple MultiLookups if one
-        // is not enough before returning it to the caller.
+        // a non-empty view of matches, unless the output is coalesced.
+        const rowcount_t row_count = rhs_result.view().row_count();
 
         // Step 1: Project lhs rows selected by lookup result's query_ids() into
         // lhs_result_.
-        const rowcount_t copy_result = lhs_result_copier_.Copy(
-            rhs_result.view().row_count(), *lhs_view_,
-            rhs_result.view().query_ids(), 0,
-            &lhs_result_);
-        if (copy_result < rhs_result.view().row_count()) {
+        lhs_input_projector_.Project(*lhs_view_, &lhs_projected_);
+        lhs_projected_.set_row_count(lhs_view_->row_count());
+        const SelectiveViewCopier& lhs_result_copier =
+            coalesce_output_ ? lhs_result_deep_copier_ : lhs_result_copier_;
+        const rowcount_t copy_result = lhs_result_copier.Copy(
+            row_count, lhs_projected_, rhs_result.view().query_ids(),
+            result_row_count, &lhs_result_);
+        if (copy_result < row_count) {
           return ResultView::Failure(new Exception(
               ERROR_MEMORY_EXCEEDED, "Memory exceeded when copying lhs input"));
         }
 
+        if (coalesce_output_) {
+          // The rhs rows are overwritten by the next lookup; copy them too.
+          // Shallow, as they point to the index.
+          rhs_result_copier_->Copy(row_count, rhs_result.view(),
+                                   result_row_count, rhs_result_.get());
+          result_row_count += row_count;
+          if (result_row_count == max_row_count) {
+            return CoalescedResult(result_row_count);
+          }
+          continue;
+        }
+
         // Step 2: Set up result_view over combined results.
         // TODO(user): Partial Project (only for a selected source) to avoid
         // repetitive copying of fixed Column pointers from lhs_result_ into
@@ -445,7 +1140,7 @@ ResultView HashJoinCursor::Next(rowcount_t max_row_count) {
         final_result_projector_->Project(
             combined_results, combined_results + arraysize(combined_results),
             &result_view_);
-        result_view_.set_row_count(rhs_result.view().row_count());
+        result_view_.set_row_count(row_count);
 
         return ResultView::Success(&result_view_);
       } else if (rhs_result.is_eos()) {
@@ -459,13 +1154,17 @@ ResultView HashJoinCursor::Next(rowcount_t max_row_count) {
       }
     }
 
-    if (lhs_view_ == NULL) {
+    if (lhs_view_ == NULL && !lhs_exhausted_) {
       ResultView lhs_result = lhs_->Next(Cursor::kDefaultRowCount);
       PROPAGATE_ON_FAILURE(lhs_result);
-      // Early termination if lhs is empty.
       if (lhs_result.is_eos()) {
-        return ResultView::EOS();
+        lhs_exhausted_ = true;
+        if (result_row_count > 0) return CoalescedResult(result_row_count);
+        // Early termination if lhs is empty, unless the unmatched rhs rows
+        // are to be returned.
+        if (!OutputsUnmatchedRhsRows(join_type_)) return ResultView::EOS();
       } else if (lhs_result.is_waiting_on_barrier()) {
+        if (result_row_count > 0) return CoalescedResult(result_row_count);
         return ResultView::WaitingOnBarrier();
       } else {
         CHECK(lhs_result.has_data());
@@ -485,13 +1184,27 @@ ResultView HashJoinCursor::Next(rowcount_t max_row_count) {
         rhs_builder_.reset(NULL);
         DCHECK(lhs_key_selector_->result_schema().EqualByType(
             rhs_->key_selector().result_schema()));
-        // Early termination if rhs is empty in the INNER join.
-        if (rhs_->empty() && join_type_ == INNER) {
+        // Early termination if rhs is empty in the INNER or RIGHT_OUTER join.
+        if (rhs_->empty() &&
+            (join_type_ == INNER || join_type_ == RIGHT_OUTER)) {
           return ResultView::EOS();
         }
       }
     }
 
+    if (lhs_exhausted_) {
+      FailureOrOwned<LookupIndexCursor> unmatched = rhs_->UnmatchedRows();
+      PROPAGATE_ON_FAILURE(unmatched);
+      unmatched_rhs_rows_ = unmatched.move();
+      // The lhs columns of the result are NULL from now on.
+      for (int i = 0; i < lhs_result_.column_count(); ++i) {
+        bit_pointer::FillWithTrue(
+            lhs_result_.mutable_column(i)->mutable_is_null(),
+            lhs_result_.row_capacity());
+      }
+      return NextUnmatchedRhsRows(max_row_count);
+    }
+
     // If we got here, we have new data in lhs_view_, and the rhs is
     // materialized.
     DCHECK(lhs_view_ != NULL);
@@ -506,12 +1219,37 @@ ResultView HashJoinCursor::Next(rowcount_t max_row_count) {
     matches_ = multi_lookup_result.move();
     if (matches_.get() == NULL) {
       // Right-hand-side encountered a barrier during materialization.
+      if (result_row_count > 0) return CoalescedResult(result_row_count);
       return ResultView::WaitingOnBarrier();
     }
     // Otherwise, continue the loop, and it'll see new matches.
   }
 }
 
+ResultView HashJoinCursor::CoalescedResult(rowcount_t row_count) {
+  const View* combined_results[] = {
+      &lhs_result_.view(), &rhs_result_->view() };
+  final_result_projector_->Project(
+      combined_results, combined_results + arraysize(combined_results),
+      &result_view_);
+  result_view_.set_row_count(row_count);
+  return ResultView::Success(&result_view_);
+}
+
+ResultView HashJoinCursor::NextUnmatchedRhsRows(rowcount_t max_row_count) {
+  ResultLookupIndexView rhs_result = unmatched_rhs_rows_->Next(
+      std::min(max_row_count, lhs_result_.row_capacity()));
+  PROPAGATE_ON_FAILURE(rhs_result);
+  if (rhs_result.is_eos()) return ResultView::EOS();
+  const View* combined_results[] = {
+      &lhs_result_.view(), &rhs_result.view() };
+  final_result_projector_->Project(
+      combined_results, combined_results + arraysize(combined_results),
+      &result_view_);
+  result_view_.set_row_count(rhs_result.view().row_count());
+  return ResultView::Success(&result_view_);
+}
+
 void HashJoinCursor::AppendDebugDescription(string* target) const {
   target->append("HashJoinCursor");
 }
@@ -557,6 +1295,8 @@ void HashJoinCursor::SetUpFinalResultProjector(
     const string& result_attribute_name = result_schema.attribute(i).name();
     if (source_index == 0) {
       // Attribute in result schema comes from the left-hand side input.
+      DCHECK(!OutputsUnmatchedRhsRows(join_type) ||
+             result_schema.attribute(i).nullability() == NULLABLE);
       // Find the attribute's position in lhs_result_projector's result schema
       // and project the attribute from that position in that schema.
       const int position_in_lhs_result =
@@ -565,7 +1305,7 @@ void HashJoinCursor::SetUpFinalResultProjector(
           0, position_in_lhs_result, result_attribute_name);
     } else {
       // Attribute in result schema comes from the right-hand side input.
-      DCHECK(join_type != LEFT_OUTER ||
+      DCHECK(!OutputsUnmatchedLhsRows(join_type) ||
              result_schema.attribute(i).nullability() == NULLABLE);
       final_result_projector_->AddAs(1, source_position, result_attribute_name);
     }
@@ -576,16 +1316,21 @@ template <KeyUniqueness key_uniqueness>
 HashIndexOnMaterializedCursor<key_uniqueness>::HashIndexOnMaterializedCursor(
     JoinType join_type,
     BufferAllocator* allocator,
+    BufferAllocator* lookup_allocator,
     unique_ptr<const BoundSingleSourceProjector> key_selector,
     const TupleSchema& schema)
     : join_type_(join_type),
-      schema_(join_type == LEFT_OUTER
+      schema_(OutputsUnmatchedLhsRows(join_type)
                 ? WithAllColumnsNullable(schema)
                 : schema),
       key_selector_(key_selector.get()),
       index_(schema, allocator, std::move(key_selector)),
-      result_cursor_block_(schema_, allocator) {
+      result_cursor_block_(schema_, lookup_allocator) {
   DCHECK(key_selector_->source_schema().EqualByType(schema_));
+  if (OutputsUnmatchedRhsRows(join_type)) {
+    matched_.reset(new vector<bool>);
+    null_key_rows_.reset(new Table(schema, allocator));
+  }
 }
 
 template <KeyUniqueness key_uniqueness>
@@ -614,16 +1359,62 @@ MaterializeInputAndBuildIndex(Cursor* input) {
     key_selector_->Project(result.view(), &input_key_columns);
     input_key_columns.set_row_count(result.view().row_count());
     FindNotNullKeys(input_key_columns, is_not_null);
-    if (!index_.Insert(result.view(), is_not_null)) {
+    if (index_.Insert(result.view(), is_not_null) <
+        result.view().row_count()) {
       THROW(new Exception(
           ERROR_MEMORY_EXCEEDED,
           "Memory exceeded at input materialization"));
     }
+    if (null_key_rows_ != NULL) {
+      PROPAGATE_ON_FAILURE(AppendNullKeyRows(result.view(), is_not_null));
+    }
   }
   PROPAGATE_ON_FAILURE(result);
+  if (result.is_eos() && matched_ != NULL) {
+    matched_->assign(index_.size(), false);
+  }
   return Success(result.is_eos());
 }
 
+template <KeyUniqueness key_uniqueness>
+void HashIndexOnMaterializedCursor<key_uniqueness>::AddKeysToFilter(
+    BloomFilter* filter) const {
+  const View& indexed_view = index_.indexed_view();
+  View key(key_selector_->result_schema());
+  size_t hash[Cursor::kDefaultRowCount];
+  for (rowid_t offset = 0; offset < indexed_view.row_count();
+       offset += Cursor::kDefaultRowCount) {
+    const rowcount_t row_count = std::min(
+        Cursor::kDefaultRowCount, indexed_view.row_count() - offset);
+    key_selector_->Project(View(indexed_view, offset, row_count), &key);
+    key.set_row_count(row_count);
+    row_hash_set::HashKeys(key, row_count, hash);
+    filter->InsertMany(hash, bool_const_ptr(), row_count);
+  }
+}
+
+template <KeyUniqueness key_uniqueness>
+FailureOrVoid HashIndexOnMaterializedCursor<key_uniqueness>::AppendNullKeyRows(
+    const View& view, bool_const_ptr is_not_null) {
+  const rowcount_t row_count = view.row_count();
+  rowid_t begin = 0;
+  while (begin < row_count) {
+    // Appends the rows with NULL keys in runs.
+    while (begin < row_count && is_not_null[begin]) ++begin;
+    rowid_t end = begin;
+    while (end < row_count && !is_not_null[end]) ++end;
+    if (end > begin &&
+        null_key_rows_->AppendView(View(view, begin, end - begin)) <
+            end - begin) {
+      THROW(new Exception(
+          ERROR_MEMORY_EXCEEDED,
+          "Memory exceeded at input materialization"));
+    }
+    begin = end;
+  }
+  return Success();
+}
+
 // ResultCursor encapsulates the state of a single MultiLookup to
 // HashIndexOnMaterializedCursor.
 template <KeyUniqueness key_uniqueness>
@@ -635,9 +1426,12 @@ class HashIndexOnMaterializedCursor<key_uniqueness>::ResultCursor
 
  public:
   // result_block and query_ids are placeholders allocated by the caller.
+  // For RIGHT_OUTER and FULL_OUTER joins, the matched index rows are marked
+  // in matched.
   ResultCursor(
       const RowHashSetType& index, const View& query,
-      Block* result_block, rowid_t* query_ids);
+      Block* result_block, rowid_t* query_ids,
+      vector<bool>* matched = NULL);
 
   const TupleSchema& schema() const { return result_block_->schema(); }
   ResultLookupIndexView Next(rowcount_t max_row_count);
@@ -674,8 +1468,15 @@ class HashIndexOnMaterializedCursor<key_uniqueness>::ResultCursor
     dispatch(this);
   }
 
+  // Marks the index row as matched, if the join type needs it.
+  inline void MarkMatched(rowid_t index_row_id) {
+    if (OutputsUnmatchedRhsRows(join_type)) (*matched_)[index_row_id] = true;
+  }
+
   // Reference to parent's index (not specific to a particular lookup).
   const RowHashSetType& index_;
+  // The parent's bitmap of matched rows; not owned.
+  vector<bool>* const matched_;
 
   // Placeholder for result rows, not owned.
   Block* result_block_;
@@ -719,6 +1520,14 @@ FailureOrOwned<LookupIndexCursor> HashIndexOnMaterializedCursor<key_uniqueness>
       return Success(make_unique<ResultCursor<LEFT_OUTER>>(
           index_, *query, &result_cursor_block_,
           result_cursor_query_ids_.get()));
+    case RIGHT_OUTER:
+      return Success(make_unique<ResultCursor<RIGHT_OUTER>>(
+          index_, *query, &result_cursor_block_,
+          result_cursor_query_ids_.get(), matched_.get()));
+    case FULL_OUTER:
+      return Success(make_unique<ResultCursor<FULL_OUTER>>(
+          index_, *query, &result_cursor_block_,
+          result_cursor_query_ids_.get(), matched_.get()));
     default:
       THROW(new Exception(ERROR_NOT_IMPLEMENTED,
                           StrCat("Unsupported join_type in hash_join: ",
@@ -731,8 +1540,9 @@ template <JoinType join_type>
 HashIndexOnMaterializedCursor<key_uniqueness>::ResultCursor<join_type>::
 ResultCursor(
     const RowHashSetType& index, const View& query,
-    Block* result_block, rowid_t* query_ids)
+    Block* result_block, rowid_t* query_ids, vector<bool>* matched)
     : index_(index),
+      matched_(matched),
       result_block_(result_block),
       result_view_(result_block->schema(), query_ids),
       // Shallow copy is safe because index_ outlives ResultCursor.
@@ -742,6 +1552,7 @@ ResultCursor(
       find_result_(Cursor::kDefaultRowCount),
       query_row_id_(0) {
   DCHECK(result_block_->schema().EqualByType(index_.indexed_view().schema()));
+  DCHECK(!OutputsUnmatchedRhsRows(join_type) || matched_ != NULL);
   result_view_.ResetFrom(result_block_->view());
   query_row_count_ = query.row_count();
 
@@ -798,15 +1609,16 @@ ProcessNextResultNonUniqueKey() {
   if (it_find_result_.AtEnd()) {
     // First iteration with this query_row_id; retrieve matching rows if any.
     it_find_result_ = find_result_.Result(query_row_id_);
-    if (join_type == LEFT_OUTER && it_find_result_.AtEnd()) {
+    if (OutputsUnmatchedLhsRows(join_type) && it_find_result_.AtEnd()) {
       // There were no results for this query_row_id - when join_type ==
-      // LEFT_OUTER we output NULLs for the right side of join.
+      // LEFT_OUTER or FULL_OUTER we output NULLs for the right side of join.
       index_matches_.push_back(-1);
       *(query_matches_++) = query_row_id_;
     }
   }
   if (!it_find_result_.AtEnd()) {
     const rowid_t index_row_id = it_find_result_.Get();
+    MarkMatched(index_row_id);
     index_matches_.push_back(index_row_id);
     *(query_matches_++) = query_row_id_;
     it_find_result_.Next();
@@ -821,13 +1633,402 @@ void HashIndexOnMaterializedCursor<key_uniqueness>::ResultCursor<join_type>::
 ProcessNextResultUniqueKey() {
   const rowid_t index_row_id = find_result_.Result(query_row_id_);
   if (index_row_id != row_hash_set::kInvalidRowId) {
+    MarkMatched(index_row_id);
     index_matches_.push_back(index_row_id);
     *(query_matches_++) = query_row_id_;
-  } else if (join_type == LEFT_OUTER) {
+  } else if (OutputsUnmatchedLhsRows(join_type)) {
     index_matches_.push_back(-1);
     *(query_matches_++) = query_row_id_;
   }
   query_row_id_++;
 }
 
+// Returns the rows of the index that are not marked in the bitmap of matched
+// rows, and then the rows with NULL keys.
+template <KeyUniqueness key_uniqueness>
+class HashIndexOnMaterializedCursor<key_uniqueness>::UnmatchedRowsCursor
+    : public LookupIndexCursor {
+ public:
+  // result_block and query_ids are placeholders allocated by the caller.
+  UnmatchedRowsCursor(
+      const View& indexed_view, const vector<bool>& matched,
+      const View& null_key_rows, Block* result_block, rowid_t* query_ids)
+      : indexed_view_(indexed_view),
+        matched_(matched),
+        null_key_rows_(null_key_rows),
+        result_block_(result_block),
+        result_view_(result_block->schema(), query_ids),
+        // Shallow copy is safe because the index outlives the cursor.
+        copier_(indexed_view.schema(), result_block->schema(), false),
+        row_ids_(new rowid_t[result_block->row_capacity()]),
+        next_indexed_row_id_(0),
+        next_null_key_row_id_(0) {}
+
+  const TupleSchema& schema() const { return result_view_.schema(); }
+
+  ResultLookupIndexView Next(rowcount_t max_row_count) {
+    if (max_row_count > result_block_->row_capacity())
+      max_row_count = result_block_->row_capacity();
+    rowcount_t row_count = 0;
+    const View* source = &indexed_view_;
+    while (row_count < max_row_count &&
+           next_indexed_row_id_ < matched_.size()) {
+      if (!matched_[next_indexed_row_id_]) {
+        row_ids_[row_count++] = next_indexed_row_id_;
+      }
+      ++next_indexed_row_id_;
+    }
+    if (row_count == 0) {
+      source = &null_key_rows_;
+      while (row_count < max_row_count &&
+             next_null_key_row_id_ < null_key_rows_.row_count()) {
+        row_ids_[row_count++] = next_null_key_row_id_++;
+      }
+    }
+    if (row_count == 0) return ResultLookupIndexView::EOS();
+    if (copier_.Copy(row_count, *source, row_ids_.get(), 0, result_block_) <
+        row_count) {
+      return ResultLookupIndexView::Failure(new Exception(
+          ERROR_MEMORY_EXCEEDED, "Memory exceeded when copying rhs input"));
+    }
+    result_view_.ResetFromSubRange(result_block_->view(), 0, row_count);
+    return ResultLookupIndexView::Success(&result_view_);
+  }
+
+ private:
+  const View& indexed_view_;
+  const vector<bool>& matched_;
+  const View& null_key_rows_;
+  Block* result_block_;
+  LookupIndexView result_view_;
+  SelectiveViewCopier copier_;
+  std::unique_ptr<rowid_t[]> row_ids_;
+  rowid_t next_indexed_row_id_;
+  rowid_t next_null_key_row_id_;
+  DISALLOW_COPY_AND_ASSIGN(UnmatchedRowsCursor);
+};
+
+template <KeyUniqueness key_uniqueness>
+FailureOrOwned<LookupIndexCursor>
+HashIndexOnMaterializedCursor<key_uniqueness>::UnmatchedRows() const {
+  if (matched_ == NULL) return LookupIndex::UnmatchedRows();
+  return Success(make_unique<UnmatchedRowsCursor>(
+      index_.indexed_view(), *matched_, null_key_rows_->view(),
+      &result_cursor_block_, result_cursor_query_ids_.get()));
+}
+
+template <KeyUniqueness key_uniqueness>
+PartitionedHashIndex<key_uniqueness>::PartitionedHashIndex(
+    JoinType join_type,
+    int partition_count,
+    ThreadPool* thread_pool,
+    bool spill,
+    TemporaryFileFactory* temporary_file_factory,
+    FileCompression spill_compression,
+    BufferAllocator* const allocator,
+    BufferAllocator* const lookup_allocator,
+    unique_ptr<const BoundSingleSourceProjector> key_selector,
+    const TupleSchema& schema)
+    : join_type_(join_type),
+      partition_bits_(Bits::Log2Floor(partition_count)),
+      thread_pool_(thread_pool),
+      spill_(spill),
+      temporary_file_factory_(temporary_file_factory),
+      spill_compression_(spill_compression),
+      input_schema_(schema),
+      allocator_(allocator),
+      lookup_allocator_(lookup_allocator),
+      key_selector_(std::move(key_selector)),
+      partitions_(partition_count),
+      spilled_(partition_count),
+      spilled_partition_count_(0),
+      scatter_block_(schema, lookup_allocator),
+      scatter_copier_(schema, false),
+      scatter_key_(key_selector_->result_schema()),
+      hash_(new size_t[Cursor::kDefaultRowCount]),
+      partition_(new int[Cursor::kDefaultRowCount]),
+      partition_offset_(partition_count + 1) {
+  DCHECK_GT(partition_count, 1);
+  DCHECK_EQ(partition_count, 1 << partition_bits_);
+  for (int p = 0; p < partition_count; ++p) {
+    partition_inputs_.emplace_back(new Table(schema, &allocator_));
+  }
+}
+
+template <KeyUniqueness key_uniqueness>
+FailureOrOwned<HashIndexOnMaterializedCursor<key_uniqueness> >
+PartitionedHashIndex<key_uniqueness>::CreatePartition() {
+  auto partition = make_unique<PartitionIndex>(
+      join_type_, &allocator_, lookup_allocator_,
+      make_unique<BoundSingleSourceProjector>(*key_selector_), input_schema_);
+  PROPAGATE_ON_FAILURE(partition->Init());
+  return Success(std::move(partition));
+}
+
+template <KeyUniqueness key_uniqueness>
+FailureOrVoid PartitionedHashIndex<key_uniqueness>::Init() {
+  for (auto& partition : partitions_) {
+    FailureOrOwned<PartitionIndex> created = CreatePartition();
+    PROPAGATE_ON_FAILURE(created);
+    partition = created.move();
+  }
+  if (!scatter_block_.Reallocate(Cursor::kDefaultRowCount)) {
+    THROW(new Exception(
+        ERROR_MEMORY_EXCEEDED,
+        "Cannot allocate memory to partition the hash join input"));
+  }
+  return Success();
+}
+
+template <KeyUniqueness key_uniqueness>
+FailureOr<bool> PartitionedHashIndex<key_uniqueness>::
+MaterializeInputAndBuildIndex(Cursor* input) {
+  ResultView result = ResultView::EOS();
+  while ((result = input->Next(Cursor::kDefaultRowCount)).has_data()) {
+    PROPAGATE_ON_FAILURE(Scatter(result.view()));
+  }
+  PROPAGATE_ON_FAILURE(result);
+  if (!result.is_eos()) return Success(false);
+  PROPAGATE_ON_FAILURE(BuildPartitions());
+  return Success(true);
+}
+
+template <KeyUniqueness key_uniqueness>
+FailureOrVoid PartitionedHashIndex<key_uniqueness>::Scatter(const View& view) {
+  const rowcount_t row_count = view.row_count();
+  CHECK_GE(Cursor::kDefaultRowCount, row_count);
+  key_selector_->Project(view, &scatter_key_);
+  scatter_key_.set_row_count(row_count);
+  ComputeHashPartitions(scatter_key_, partition_bits_, hash_.get(),
+                        partition_.get());
+  rowid_t order[Cursor::kDefaultRowCount];
+  GroupByPartition(partition_.get(), row_count, partitions_.size(), order,
+                   partition_offset_.data());
+  // Shallow; the rows are deep-copied when appended to the partition inputs.
+  scatter_copier_.Copy(row_count, view, order, 0, &scatter_block_);
+  for (int p = 0; p < partitions_.size(); ++p) {
+    const rowcount_t partition_row_count =
+        partition_offset_[p + 1] - partition_offset_[p];
+    if (partition_row_count == 0) continue;
+    PROPAGATE_ON_FAILURE(AppendToPartition(
+        p, View(scatter_block_.view(), partition_offset_[p],
+                partition_row_count)));
+  }
+  return Success();
+}
+
+template <KeyUniqueness key_uniqueness>
+FailureOrVoid PartitionedHashIndex<key_uniqueness>::AppendToPartition(
+    int partition, const View& rows) {
+  rowcount_t appended = 0;
+  while (spilled_[partition] == NULL) {
+    appended += partition_inputs_[partition]->AppendView(
+        View(rows, appended, rows.row_count() - appended));
+    if (appended == rows.row_count()) return Success();
+    if (!spill_) {
+      THROW(new Exception(ERROR_MEMORY_EXCEEDED,
+                          "Memory exceeded at input materialization"));
+    }
+    // Spill the largest partition kept in memory, possibly this one.
+    int largest = -1;
+    for (int p = 0; p < partitions_.size(); ++p) {
+      if (spilled_[p] == NULL &&
+          (largest == -1 || partition_inputs_[p]->row_count() >
+                            partition_inputs_[largest]->row_count())) {
+        largest = p;
+      }
+    }
+    PROPAGATE_ON_FAILURE(Spill(largest));
+  }
+  return spilled_[partition]->Write(
+      View(rows, appended, rows.row_count() - appended));
+}
+
+template <KeyUniqueness key_uniqueness>
+FailureOrVoid PartitionedHashIndex<key_uniqueness>::Spill(int partition) {
+  FailureOrOwned<TemporaryFileBuffer> buffer =
+      TemporaryFileBuffer::Create(temporary_file_factory_,
+                                  spill_compression_);
+  PROPAGATE_ON_FAILURE(buffer);
+  spilled_[partition] = buffer.move();
+  ++spilled_partition_count_;
+  PROPAGATE_ON_FAILURE(
+      spilled_[partition]->Write(partition_inputs_[partition]->view()));
+  partition_inputs_[partition].reset(new Table(input_schema_, &allocator_));
+  return Success();
+}
+
+template <KeyUniqueness key_uniqueness>
+FailureOrVoid PartitionedHashIndex<key_uniqueness>::BuildPartitions() {
+  vector<std::unique_ptr<Exception> > exceptions(partitions_.size());
+  ParallelFor(thread_pool_, partitions_.size(), [this, &exceptions](int p) {
+    if (spilled_[p] != NULL) return;
+    FailureOr<bool> built = partitions_[p]->MaterializeInputAndBuildIndex(
+        CreateCursorOverView(partition_inputs_[p]->view()).get());
+    if (built.is_failure()) {
+      exceptions[p] = built.move_exception();
+    } else {
+      partition_inputs_[p].reset();
+    }
+  });
+  for (int p = 0; p < partitions_.size(); ++p) {
+    if (exceptions[p] == NULL) continue;
+    if (!spill_ || exceptions[p]->return_code() != ERROR_MEMORY_EXCEEDED) {
+      THROW(exceptions[p].release());
+    }
+    // The partition's index doesn't fit; spill its input instead.
+    partitions_[p].reset();
+    FailureOrOwned<PartitionIndex> created = CreatePartition();
+    PROPAGATE_ON_FAILURE(created);
+    partitions_[p] = created.move();
+    PROPAGATE_ON_FAILURE(Spill(p));
+    partition_inputs_[p].reset();
+  }
+  return Success();
+}
+
+// ResultCursor of a PartitionedHashIndex lookup; returns the results of the
+// sub-lookups, one partition after another, with the query ids translated back
+// to the rows of the original query.
+template <KeyUniqueness key_uniqueness>
+class PartitionedHashIndex<key_uniqueness>::ResultCursor
+    : public LookupIndexCursor {
+ public:
+  explicit ResultCursor(const TupleSchema& schema)
+      : query_ids_(new rowid_t[Cursor::kDefaultRowCount]),
+        result_view_(schema, query_ids_.get()),
+        current_(0) {}
+
+  const TupleSchema& schema() const { return result_view_.schema(); }
+
+  ResultLookupIndexView Next(rowcount_t max_row_count) {
+    for (; current_ < sub_lookups_.size(); ++current_) {
+      SubLookup* sub_lookup = &sub_lookups_[current_];
+      ResultLookupIndexView result = sub_lookup->cursor->Next(max_row_count);
+      if (result.is_eos()) continue;
+      if (result.is_failure()) return result;
+      const LookupIndexView& view = result.view();
+      result_view_.ResetFrom(view);
+      const rowid_t* query_rows = query_rows_ + sub_lookup->offset;
+      for (rowid_t i = 0; i < view.row_count(); ++i) {
+        query_ids_[i] = query_rows[view.query_ids()[i]];
+      }
+      return ResultLookupIndexView::Success(&result_view_);
+    }
+    return ResultLookupIndexView::EOS();
+  }
+
+  // The ids of the query rows, arranged by partition.
+  rowid_t* mutable_query_rows() { return query_rows_; }
+
+  // Adds the cursor of a sub-lookup, whose query consisted of the query rows
+  // starting at offset in query_rows.
+  void AddSubLookup(rowcount_t offset, unique_ptr<LookupIndexCursor> cursor) {
+    sub_lookups_.emplace_back();
+    sub_lookups_.back().offset = offset;
+    sub_lookups_.back().cursor = std::move(cursor);
+  }
+
+ private:
+  struct SubLookup {
+    rowcount_t offset;
+    std::unique_ptr<LookupIndexCursor> cursor;
+  };
+
+  rowid_t query_rows_[Cursor::kDefaultRowCount];
+  std::unique_ptr<rowid_t[]> query_ids_;
+  LookupIndexView result_view_;
+  vector<SubLookup> sub_lookups_;
+  size_t current_;
+};
+
+template <KeyUniqueness key_uniqueness>
+FailureOrOwned<LookupIndexCursor> PartitionedHashIndex<key_uniqueness>
+::MultiLookup(const View* query) const {
+  const rowcount_t row_count = query->row_count();
+  CHECK_GE(Cursor::kDefaultRowCount, row_count);
+  if (query_block_ == NULL ||
+      !TupleSchema::AreEqual(query_block_->schema(), query->schema(), false)) {
+    query_block_ = make_unique<Block>(query->schema(), lookup_allocator_);
+    if (!query_block_->Reallocate(Cursor::kDefaultRowCount)) {
+      THROW(new Exception(
+          ERROR_MEMORY_EXCEEDED,
+          "Cannot allocate memory to partition index lookups"));
+    }
+    query_copier_ = make_unique<SelectiveViewCopier>(query->schema(), false);
+  }
+  auto cursor = make_unique<ResultCursor>(schema());
+  ComputeHashPartitions(*query, partition_bits_, hash_.get(),
+                        partition_.get());
+  GroupByPartition(partition_.get(), row_count, partitions_.size(),
+                   cursor->mutable_query_rows(), partition_offset_.data());
+  query_copier_->Copy(row_count, *query, cursor->mutable_query_rows(), 0,
+                      query_block_.get());
+  for (size_t p = 0; p < partitions_.size(); ++p) {
+    const rowcount_t partition_row_count =
+        partition_offset_[p + 1] - partition_offset_[p];
+    if (partition_row_count == 0) continue;
+    // The sub-query is only used by the partition's MultiLookup itself, so it
+    // doesn't need to outlive the sub-lookup's cursor.
+    const View sub_query(query_block_->view(), partition_offset_[p],
+                         partition_row_count);
+    FailureOrOwned<LookupIndexCursor> sub_lookup =
+        partitions_[p]->MultiLookup(&sub_query);
+    PROPAGATE_ON_FAILURE(sub_lookup);
+    cursor->AddSubLookup(partition_offset_[p], sub_lookup.move());
+  }
+  return Success(std::move(cursor));
+}
+
+// Returns the unmatched rows of the partitions, one partition after another.
+template <KeyUniqueness key_uniqueness>
+class PartitionedHashIndex<key_uniqueness>::UnmatchedRowsCursor
+    : public LookupIndexCursor {
+ public:
+  UnmatchedRowsCursor(
+      const TupleSchema& schema,
+      const vector<std::unique_ptr<PartitionIndex> >& partitions)
+      : schema_(schema),
+        partitions_(partitions),
+        next_partition_(0) {}
+
+  const TupleSchema& schema() const { return schema_; }
+
+  ResultLookupIndexView Next(rowcount_t max_row_count) {
+    for (;;) {
+      if (current_ == NULL) {
+        if (next_partition_ == partitions_.size()) {
+          return ResultLookupIndexView::EOS();
+        }
+        FailureOrOwned<LookupIndexCursor> cursor =
+            partitions_[next_partition_++]->UnmatchedRows();
+        if (cursor.is_failure()) {
+          return ResultLookupIndexView::Failure(
+              cursor.move_exception().release());
+        }
+        current_ = cursor.move();
+      }
+      ResultLookupIndexView result = current_->Next(max_row_count);
+      if (!result.is_eos()) return result;
+      current_.reset();
+    }
+  }
+
+ private:
+  const TupleSchema schema_;
+  const vector<std::unique_ptr<PartitionIndex> >& partitions_;
+  size_t next_partition_;
+  std::unique_ptr<LookupIndexCursor> current_;
+  DISALLOW_COPY_AND_ASSIGN(UnmatchedRowsCursor);
+};
+
+template <KeyUniqueness key_uniqueness>
+FailureOrOwned<LookupIndexCursor>
+PartitionedHashIndex<key_uniqueness>::UnmatchedRows() const {
+  if (!OutputsUnmatchedRhsRows(join_type_)) {
+    return LookupIndex::UnmatchedRows();
+  }
+  return Success(make_unique<UnmatchedRowsCursor>(schema(), partitions_));
+}
+
 }  // namespace supersonic
@@ -16,11 +16,19 @@
 #ifndef SUPERSONIC_CURSOR_CORE_HASH_JOIN_H_
 #define SUPERSONIC_CURSOR_CORE_HASH_JOIN_H_
 
+#include <stddef.h>
+
+#include <limits>
 #include <memory>
+#include <string>
+using std::string;
 
 #include "supersonic/base/exception/result.h"
 #include "supersonic/cursor/infrastructure/basic_operation.h"
+#include "supersonic/cursor/infrastructure/file_io.h"
 #include "supersonic/proto/supersonic.pb.h"
+#include "supersonic/utils/macros.h"
+#include "supersonic/utils/strings/stringpiece.h"
 
 namespace supersonic {
 
@@ -28,13 +36,142 @@ class BoundSingleSourceProjector;
 class MultiSourceProjector;
 class SingleSourceProjector;
 class Cursor;
+class JoinKeyFilter;
 class LookupIndexBuilder;
 class Operation;
+class TemporaryFileFactory;
+class ThreadPool;
+
+class HashJoinOptions {
+ public:
+  // Number of partitions used when spilling is enabled, but the partition
+  // count is not set.
+  static const int kDefaultSpillPartitionCount = 16;
+
+  HashJoinOptions()
+      : partition_count_(1),
+        thread_pool_(NULL),
+        memory_quota_(std::numeric_limits<size_t>::max()),
+        temporary_file_factory_(NULL),
+        spill_compression_(FILE_COMPRESSION_NONE),
+        key_filter_(NULL),
+        coalesce_output_(false) {}
+
+  int partition_count() const { return partition_count_; }
+  ThreadPool* thread_pool() const { return thread_pool_; }
+  size_t memory_quota() const { return memory_quota_; }
+  const string& temporary_directory_prefix() const {
+    return temporary_directory_prefix_;
+  }
+  TemporaryFileFactory* temporary_file_factory() const {
+    return temporary_file_factory_;
+  }
+  FileCompression spill_compression() const { return spill_compression_; }
+  bool spilling_enabled() const {
+    return memory_quota_ != std::numeric_limits<size_t>::max();
+  }
+  JoinKeyFilter* key_filter() const { return key_filter_; }
+  bool coalesce_output() const { return coalesce_output_; }
+
+  // Number of partitions the rhs input is split into, by the bits of the key
+  // hash. Every partition gets its own, smaller hash index, and the lookups
+  // are partitioned the same way, so that a single probe touches a hash table
+  // that is more likely to fit in cache. Must be a power of 2. The default (1)
+  // disables partitioning. With partitioning, the order of the output rows
+  // within a single lhs block is unspecified.
+  HashJoinOptions* set_partition_count(int partition_count) {
+    partition_count_ = partition_count;
+    return this;
+  }
+
+  // If set, the indexes of the partitions are built in parallel, on the
+  // calling thread and on the pool's threads. Doesn't take ownership; the pool
+  // must outlive the cursors. The default (NULL) builds them sequentially.
+  // Has no effect without partitioning.
+  HashJoinOptions* set_thread_pool(ThreadPool* thread_pool) {
+    thread_pool_ = thread_pool;
+    return this;
+  }
+
+  // Memory (in bytes) available for the rhs partitions. If set, the join
+  // becomes a hybrid hash join: when the rhs doesn't fit in the quota, the
+  // largest partitions are written to temporary files, and so are the lhs rows
+  // that belong to them. The partitions kept in memory are joined as the lhs
+  // is read; then the spilled partition pairs are joined one at a time, so a
+  // single partition must fit in the quota. Some memory for the lookup
+  // buffers of every partition is taken from the quota as well. Unlimited by
+  // default (no spilling).
+  HashJoinOptions* set_memory_quota(size_t memory_quota) {
+    memory_quota_ = memory_quota;
+    return this;
+  }
+
+  // Where the spilled rows are written, if there's no temporary_file_factory:
+  // to files created by the DefaultTemporaryFileFactory for the prefix. Empty
+  // (the default) means the default temporary directory.
+  HashJoinOptions* set_temporary_directory_prefix(StringPiece prefix) {
+    temporary_directory_prefix_ = prefix.ToString();
+    return this;
+  }
+
+  // Creates the temporary files when spilling. Doesn't take ownership; the
+  // factory must outlive the cursors. NULL (the default) means the
+  // temporary_directory_prefix is used.
+  HashJoinOptions* set_temporary_file_factory(TemporaryFileFactory* factory) {
+    temporary_file_factory_ = factory;
+    return this;
+  }
+
+  // How the spilled rows are compressed in the temporary files (see
+  // file_io.h). Uncompressed by default.
+  HashJoinOptions* set_spill_compression(FileCompression spill_compression) {
+    spill_compression_ = spill_compression;
+    return this;
+  }
+
+  // If set, once the rhs index is built, a Bloom filter over its keys is
+  // published in key_filter, for a FilterByJoinKeys operation in the lhs input
+  // to drop the lhs rows without a match early (see join_key_filter.h). The
+  // lhs rows read before the index is built are not filtered. Only valid for
+  // INNER and RIGHT_OUTER joins, as the other join types output the lhs rows
+  // without a match. Ignored when spilling is enabled. The filter is dropped
+  // when the cursor is destroyed. Doesn't take ownership; the key filter must
+  // outlive the cursors. NULL by default.
+  HashJoinOptions* set_key_filter(JoinKeyFilter* key_filter) {
+    key_filter_ = key_filter;
+    return this;
+  }
+
+  // If set, the matches of several lhs views are gathered into a single
+  // output view of up to max_row_count rows, rather than returned as soon as
+  // a lookup yields any. Helps with selective joins, whose output would
+  // otherwise come in many small views, at the cost of copying the rhs rows
+  // and deep-copying the lhs rows. Off by default.
+  HashJoinOptions* set_coalesce_output(bool coalesce_output) {
+    coalesce_output_ = coalesce_output;
+    return this;
+  }
+
+ private:
+  int partition_count_;
+  ThreadPool* thread_pool_;
+  size_t memory_quota_;
+  string temporary_directory_prefix_;
+  TemporaryFileFactory* temporary_file_factory_;
+  FileCompression spill_compression_;
+  JoinKeyFilter* key_filter_;
+  bool coalesce_output_;
+  DISALLOW_COPY_AND_ASSIGN(HashJoinOptions);
+};
 
 class HashJoinOperation : public BasicOperation {
  public:
-  // Currently join_type can be INNER or LEFT_OUTER. In the latter case, output
-  // columns corresponding to the rhs input will be nullable.
+  // join_type can be INNER, LEFT_OUTER, RIGHT_OUTER or FULL_OUTER. Output
+  // columns corresponding to the rhs input will be nullable for LEFT_OUTER and
+  // FULL_OUTER, and the ones corresponding to the lhs input for RIGHT_OUTER and
+  // FULL_OUTER. The rhs rows without a match are output after all the lhs rows
+  // have been processed; to that end, the hash index keeps a bitmap of the
+  // matched rows.
   // lhs_ rhs_key_selector indicate columns in respectively left- and right-
   // hand side input to be used as key. Their number and types must match.
   // result_projector describes the projection built into hash join. It is
@@ -51,6 +188,16 @@ class HashJoinOperation : public BasicOperation {
       KeyUniqueness rhs_key_uniqueness,
       unique_ptr<Operation> lhs_child, unique_ptr<Operation> rhs_child);
 
+  // As above, with options (see HashJoinOptions).
+  HashJoinOperation(
+      JoinType join_type,
+      unique_ptr<const SingleSourceProjector> lhs_key_selector,
+      unique_ptr<const SingleSourceProjector> rhs_key_selector,
+      unique_ptr<const MultiSourceProjector> result_projector,
+      KeyUniqueness rhs_key_uniqueness,
+      unique_ptr<const HashJoinOptions> options,
+      unique_ptr<Operation> lhs_child, unique_ptr<Operation> rhs_child);
+
   virtual FailureOrOwned<Cursor> CreateCursor() const;
 
  private:
@@ -60,11 +207,18 @@ class HashJoinOperation : public BasicOperation {
       unique_ptr<const BoundSingleSourceProjector> bound_rhs_key_selector,
       unique_ptr<Cursor> rhs_cursor) const;
 
+  template <KeyUniqueness rhs_key_uniqueness>
+  FailureOrOwned<Cursor> CreateHybridHashJoinCursor(
+      unique_ptr<const BoundSingleSourceProjector> bound_rhs_key_selector,
+      unique_ptr<Cursor> lhs_cursor,
+      unique_ptr<Cursor> rhs_cursor) const;
+
   const JoinType join_type_;
   std::unique_ptr<const SingleSourceProjector> lhs_key_selector_;
   std::unique_ptr<const SingleSourceProjector> rhs_key_selector_;
   std::unique_ptr<const MultiSourceProjector> result_projector_;
   const KeyUniqueness rhs_key_uniqueness_;
+  std::unique_ptr<const HashJoinOptions> options_;
 };
 
 }  // namespace supersonic
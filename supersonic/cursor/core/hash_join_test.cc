@@ -25,7 +25,9 @@
 #include "supersonic/cursor/base/cursor.h"
 #include "supersonic/cursor/base/cursor_transformer.h"
 #include "supersonic/cursor/base/operation.h"
+#include "supersonic/cursor/core/join_key_filter.h"
 #include "supersonic/cursor/core/spy.h"
+#include "supersonic/cursor/infrastructure/thread_pool.h"
 #include "supersonic/testing/block_builder.h"
 #include "supersonic/testing/comparators.h"
 #include "supersonic/testing/operation_testing.h"
@@ -69,6 +71,74 @@ unique_ptr<Operation> CreateOperation(
       std::move(lhs), std::move(rhs));
 }
 
+static
+unique_ptr<Operation> CreateOperationWithOptions(
+    JoinType join_type,
+    KeyUniqueness rhs_key_uniqueness,
+    unique_ptr<const HashJoinOptions> options,
+    unique_ptr<Operation> lhs, unique_ptr<Operation> rhs) {
+  return make_unique<HashJoinOperation>(
+      join_type, column_0_selector(), column_0_selector(),
+      all_columns_projector(), rhs_key_uniqueness,
+      std::move(options), std::move(lhs), std::move(rhs));
+}
+
+static
+unique_ptr<Operation> CreatePartitionedOperation(
+    JoinType join_type,
+    KeyUniqueness rhs_key_uniqueness,
+    int partition_count,
+    ThreadPool* thread_pool,
+    unique_ptr<Operation> lhs, unique_ptr<Operation> rhs) {
+  auto options = make_unique<HashJoinOptions>();
+  options->set_partition_count(partition_count)->set_thread_pool(thread_pool);
+  return CreateOperationWithOptions(
+      join_type, rhs_key_uniqueness, std::move(options),
+      std::move(lhs), std::move(rhs));
+}
+
+static
+unique_ptr<Operation> CreateSpillingOperation(
+    JoinType join_type,
+    KeyUniqueness rhs_key_uniqueness,
+    size_t memory_quota,
+    ThreadPool* thread_pool,
+    unique_ptr<Operation> lhs, unique_ptr<Operation> rhs) {
+  auto options = make_unique<HashJoinOptions>();
+  options->set_memory_quota(memory_quota)->set_thread_pool(thread_pool);
+  return CreateOperationWithOptions(
+      join_type, rhs_key_uniqueness, std::move(options),
+      std::move(lhs), std::move(rhs));
+}
+
+static
+unique_ptr<Operation> CreateCoalescingOperation(
+    JoinType join_type,
+    KeyUniqueness rhs_key_uniqueness,
+    int partition_count,
+    unique_ptr<Operation> lhs, unique_ptr<Operation> rhs) {
+  auto options = make_unique<HashJoinOptions>();
+  options->set_partition_count(partition_count)->set_coalesce_output(true);
+  return CreateOperationWithOptions(
+      join_type, rhs_key_uniqueness, std::move(options),
+      std::move(lhs), std::move(rhs));
+}
+
+// Filters the lhs by the keys of the rhs, published in key_filter.
+static
+unique_ptr<Operation> CreateKeyFilteredOperation(
+    JoinType join_type,
+    KeyUniqueness rhs_key_uniqueness,
+    int partition_count,
+    JoinKeyFilter* key_filter,
+    unique_ptr<Operation> lhs, unique_ptr<Operation> rhs) {
+  auto options = make_unique<HashJoinOptions>();
+  options->set_partition_count(partition_count)->set_key_filter(key_filter);
+  return CreateOperationWithOptions(
+      join_type, rhs_key_uniqueness, std::move(options),
+      FilterByJoinKeys(column_0_selector(), key_filter, std::move(lhs)),
+      std::move(rhs));
+}
 
 class HashJoinTest : public testing::TestWithParam<KeyUniqueness> {
  public:
@@ -236,6 +306,58 @@ TEST_P(HashJoinTest, _654321_LeftOuterJoin_12345) {
                                test.input_at(0), test.input_at(1)));
 }
 
+TEST_P(HashJoinTest, _12345_RightOuterJoin_654321) {
+  OperationTest test;
+  test.AddInput(builder_12345_.Build());
+  test.AddInput(builder_654321_.Build());
+  test.SetExpectedResult(TestDataBuilder<INT64, STRING, INT64, STRING>()
+                         .AddRow(1, "a", 1, "a")
+                         .AddRow(2, "b", 2, "b")
+                         .AddRow(3, "c", 3, "c")
+                         .AddRow(4, "d", 4, "d")
+                         .AddRow(5, "e", 5, "e")
+                         .AddRow(__, __, 6, "f")
+                         .Build());
+  test.Execute(CreateOperation(RIGHT_OUTER, column_0_selector(),
+                               column_0_selector(), all_columns_projector(),
+                               rhs_key_uniqueness(),
+                               test.input_at(0), test.input_at(1)));
+}
+
+TEST_P(HashJoinTest, _1_FullOuterJoin_2) {
+  OperationTest test;
+  test.AddInput(builder_1_.Build());
+  test.AddInput(builder_2_.Build());
+  test.SetExpectedResult(TestDataBuilder<INT64, STRING, INT64, STRING>()
+                         .AddRow(1, "a", __, __)
+                         .AddRow(__, __, 2, "b")
+                         .Build());
+  test.Execute(CreateOperation(FULL_OUTER, column_0_selector(),
+                               column_0_selector(), all_columns_projector(),
+                               rhs_key_uniqueness(),
+                               test.input_at(0), test.input_at(1)));
+}
+
+TEST_F(HashJoinTest, _654321_FullOuterJoin_2b2b2c) {
+  OperationTest test;
+  test.AddInput(builder_654321_.Build());
+  test.AddInput(builder_2b2b2c_.Build());
+  test.SetExpectedResult(TestDataBuilder<INT64, STRING, INT64, STRING>()
+                         .AddRow(6, "f", __, __)
+                         .AddRow(5, "e", __, __)
+                         .AddRow(4, "d", __, __)
+                         .AddRow(3, "c", __, __)
+                         .AddRow(2, "b", 2, "b")
+                         .AddRow(2, "b", 2, "b")
+                         .AddRow(2, "b", 2, "c")
+                         .AddRow(1, "a", __, __)
+                         .Build());
+  test.Execute(CreateOperation(FULL_OUTER, column_0_selector(),
+                               column_0_selector(), all_columns_projector(),
+                               NOT_UNIQUE,
+                               test.input_at(0), test.input_at(1)));
+}
+
 TEST_F(HashJoinTest, _12345_InnerJoin_2b2b2c) {
   OperationTest test;
   test.AddInput(builder_12345_.Build());
@@ -379,6 +501,41 @@ TEST_P(HashJoinTest, _1a1NNaNN_LeftOuterJoin_1a1NNaNN) {
                                test.input_at(0), test.input_at(1)));
 }
 
+TEST_P(HashJoinTest, _1a1NNaNN_RightOuterJoin_1a1NNaNN) {
+  OperationTest test;
+  test.AddInput(builder_1a1NNaNN_.Build());
+  test.AddInput(builder_1a1NNaNN_.Build());
+  test.SetExpectedResult(TestDataBuilder<INT64, STRING, INT64, STRING>()
+                         .AddRow(1, "a", 1, "a")
+                         .AddRow(__, __, 1, __)
+                         .AddRow(__, __, __, "a")
+                         .AddRow(__, __, __, __)
+                         .Build());
+  test.Execute(CreateOperation(RIGHT_OUTER, column_01_selector(),
+                               column_01_selector(), all_columns_projector(),
+                               rhs_key_uniqueness(),
+                               test.input_at(0), test.input_at(1)));
+}
+
+TEST_P(HashJoinTest, _1a1NNaNN_FullOuterJoin_1a1NNaNN) {
+  OperationTest test;
+  test.AddInput(builder_1a1NNaNN_.Build());
+  test.AddInput(builder_1a1NNaNN_.Build());
+  test.SetExpectedResult(TestDataBuilder<INT64, STRING, INT64, STRING>()
+                         .AddRow(1, "a", 1, "a")
+                         .AddRow(1, __, __, __)
+                         .AddRow(__, "a", __, __)
+                         .AddRow(__, __, __, __)
+                         .AddRow(__, __, 1, __)
+                         .AddRow(__, __, __, "a")
+                         .AddRow(__, __, __, __)
+                         .Build());
+  test.Execute(CreateOperation(FULL_OUTER, column_01_selector(),
+                               column_01_selector(), all_columns_projector(),
+                               rhs_key_uniqueness(),
+                               test.input_at(0), test.input_at(1)));
+}
+
 TEST_F(HashJoinTest, HashJoinShallowCopiesStrings) {
   const int kSize = 100;
   TestDataBuilder<STRING> builder;
@@ -461,4 +618,381 @@ TEST_F(HashJoinTest, EmptyRhsSkipsLhs) {
   test.Execute(std::move(operation));
 }
 
+TEST_P(HashJoinTest, EmptyLhsRightOuterJoin) {
+  OperationTest test;
+  test.AddInput(TestDataBuilder<INT64, STRING>().Build());
+  test.AddInput(builder_12345_.Build());
+  test.SetExpectedResult(TestDataBuilder<INT64, STRING, INT64, STRING>()
+                         .AddRow(__, __, 1, "a")
+                         .AddRow(__, __, 2, "b")
+                         .AddRow(__, __, 3, "c")
+                         .AddRow(__, __, 4, "d")
+                         .AddRow(__, __, 5, "e")
+                         .Build());
+  test.Execute(CreateOperation(RIGHT_OUTER, column_0_selector(),
+                               column_0_selector(), all_columns_projector(),
+                               rhs_key_uniqueness(),
+                               test.input_at(0), test.input_at(1)));
+}
+
+TEST_F(HashJoinTest, EmptyRhsRightOuterJoinSkipsLhs) {
+  auto lhs = TestDataBuilder<STRING>()
+                 .AddRow("foo")
+                 .ReturnException(ERROR_EVALUATION_ERROR)
+                 .Build();
+  auto rhs = TestDataBuilder<STRING>().Build();
+  OperationTest test;
+  test.AddInput(std::move(lhs));
+  test.AddInput(std::move(rhs));
+  test.SetExpectedResult(TestDataBuilder<STRING, STRING>().Build());
+  auto operation = CreateOperation(
+      RIGHT_OUTER, column_0_selector(), column_0_selector(),
+      all_columns_projector(), NOT_UNIQUE, test.input_at(0), test.input_at(1));
+  test.SetInputViewSizes(1);
+  test.Execute(std::move(operation));
+}
+
+// The lhs has rows with keys 0 .. 1499 (and a NULL key); the rhs has keys
+// 0 .. 499 (and a NULL key), each key twice if not unique. Partitioned joins
+// return the rows within a block in an unspecified order.
+class PartitionedHashJoinTest : public testing::TestWithParam<KeyUniqueness> {
+ public:
+  void SetUp() {
+    for (int i = 0; i < 1500; ++i) lhs_builder_.AddRow(i, "lhs");
+    lhs_builder_.AddRow(__, "lhs");
+    for (int copy = 0; copy < copies(); ++copy) {
+      for (int i = 499; i >= 0; --i) rhs_builder_.AddRow(i, "rhs");
+    }
+    rhs_builder_.AddRow(__, "rhs");
+  }
+
+  KeyUniqueness rhs_key_uniqueness() { return GetParam(); }
+  int copies() { return GetParam() == UNIQUE ? 1 : 2; }
+
+  unique_ptr<Operation> InnerJoinResult() {
+    TestDataBuilder<INT64, STRING, INT64, STRING> builder;
+    for (int i = 0; i < 500; ++i) {
+      for (int copy = 0; copy < copies(); ++copy) {
+        builder.AddRow(i, "lhs", i, "rhs");
+      }
+    }
+    return builder.Build();
+  }
+
+  unique_ptr<Operation> LeftOuterJoinResult() {
+    TestDataBuilder<INT64, STRING, INT64, STRING> builder;
+    for (int i = 0; i < 1500; ++i) {
+      if (i < 500) {
+        for (int copy = 0; copy < copies(); ++copy) {
+          builder.AddRow(i, "lhs", i, "rhs");
+        }
+      } else {
+        builder.AddRow(i, "lhs", __, __);
+      }
+    }
+    builder.AddRow(__, "lhs", __, __);
+    return builder.Build();
+  }
+
+  // The result of a RIGHT_OUTER (or FULL_OUTER) join of the rhs data (as the
+  // lhs) with the lhs data (as the rhs).
+  unique_ptr<Operation> SwappedRightOuterJoinResult(bool full_outer) {
+    TestDataBuilder<INT64, STRING, INT64, STRING> builder;
+    for (int i = 0; i < 1500; ++i) {
+      if (i < 500) {
+        for (int copy = 0; copy < copies(); ++copy) {
+          builder.AddRow(i, "rhs", i, "lhs");
+        }
+      } else {
+        builder.AddRow(__, __, i, "lhs");
+      }
+    }
+    builder.AddRow(__, __, __, "lhs");
+    if (full_outer) builder.AddRow(__, "rhs", __, __);
+    return builder.Build();
+  }
+
+  TestDataBuilder<INT64, STRING> lhs_builder_, rhs_builder_;
+};
+
+INSTANTIATE_TEST_CASE_P(rhs_key_uniqueness,
+                        PartitionedHashJoinTest,
+                        testing::Values(UNIQUE, NOT_UNIQUE));
+
+TEST_P(PartitionedHashJoinTest, InnerJoin) {
+  OperationTest test;
+  test.AddInput(lhs_builder_.Build());
+  test.AddInput(rhs_builder_.Build());
+  test.SetIgnoreRowOrder(true);
+  test.SetExpectedResult(InnerJoinResult());
+  test.Execute(CreatePartitionedOperation(
+      INNER, rhs_key_uniqueness(), 8, NULL,
+      test.input_at(0), test.input_at(1)));
+}
+
+TEST_P(PartitionedHashJoinTest, LeftOuterJoin) {
+  OperationTest test;
+  test.AddInput(lhs_builder_.Build());
+  test.AddInput(rhs_builder_.Build());
+  test.SetIgnoreRowOrder(true);
+  test.SetExpectedResult(LeftOuterJoinResult());
+  test.Execute(CreatePartitionedOperation(
+      LEFT_OUTER, rhs_key_uniqueness(), 4, NULL,
+      test.input_at(0), test.input_at(1)));
+}
+
+TEST_P(PartitionedHashJoinTest, ParallelBuild) {
+  ThreadPool thread_pool(4);
+  OperationTest test;
+  test.AddInput(lhs_builder_.Build());
+  test.AddInput(rhs_builder_.Build());
+  test.SetIgnoreRowOrder(true);
+  test.SetExpectedResult(InnerJoinResult());
+  test.Execute(CreatePartitionedOperation(
+      INNER, rhs_key_uniqueness(), 64, &thread_pool,
+      test.input_at(0), test.input_at(1)));
+}
+
+TEST_P(PartitionedHashJoinTest, RightOuterJoin) {
+  OperationTest test;
+  test.AddInput(rhs_builder_.Build());
+  test.AddInput(lhs_builder_.Build());
+  test.SetIgnoreRowOrder(true);
+  test.SetExpectedResult(SwappedRightOuterJoinResult(false));
+  test.Execute(CreatePartitionedOperation(
+      RIGHT_OUTER, rhs_key_uniqueness(), 8, NULL,
+      test.input_at(0), test.input_at(1)));
+}
+
+TEST_P(PartitionedHashJoinTest, FullOuterJoin) {
+  ThreadPool thread_pool(4);
+  OperationTest test;
+  test.AddInput(rhs_builder_.Build());
+  test.AddInput(lhs_builder_.Build());
+  test.SetIgnoreRowOrder(true);
+  test.SetExpectedResult(SwappedRightOuterJoinResult(true));
+  test.Execute(CreatePartitionedOperation(
+      FULL_OUTER, rhs_key_uniqueness(), 4, &thread_pool,
+      test.input_at(0), test.input_at(1)));
+}
+
+TEST_P(PartitionedHashJoinTest, KeyFilteredInnerJoin) {
+  JoinKeyFilter key_filter;
+  OperationTest test;
+  test.AddInput(lhs_builder_.Build());
+  test.AddInput(rhs_builder_.Build());
+  test.SetExpectedResult(InnerJoinResult());
+  test.SetIgnoreRowOrder(true);
+  test.Execute(CreateKeyFilteredOperation(
+      INNER, rhs_key_uniqueness(), 1, &key_filter,
+      test.input_at(0), test.input_at(1)));
+}
+
+TEST_P(PartitionedHashJoinTest, KeyFilteredPartitionedInnerJoin) {
+  JoinKeyFilter key_filter;
+  OperationTest test;
+  test.AddInput(lhs_builder_.Build());
+  test.AddInput(rhs_builder_.Build());
+  test.SetExpectedResult(InnerJoinResult());
+  test.SetIgnoreRowOrder(true);
+  test.Execute(CreateKeyFilteredOperation(
+      INNER, rhs_key_uniqueness(), 8, &key_filter,
+      test.input_at(0), test.input_at(1)));
+}
+
+TEST_P(PartitionedHashJoinTest, KeyFilterPublishedWhileCursorExists) {
+  JoinKeyFilter key_filter;
+  auto operation = CreateKeyFilteredOperation(
+      INNER, rhs_key_uniqueness(), 1, &key_filter,
+      lhs_builder_.Build(), rhs_builder_.Build());
+  std::unique_ptr<Cursor> cursor(SucceedOrDie(operation->CreateCursor()));
+  EXPECT_TRUE(key_filter.Get() == NULL);
+  ASSERT_TRUE(cursor->Next(Cursor::kDefaultRowCount).has_data());
+  EXPECT_TRUE(key_filter.Get() != NULL);
+  cursor.reset();
+  EXPECT_TRUE(key_filter.Get() == NULL);
+}
+
+TEST_P(PartitionedHashJoinTest, KeyFilteredRightOuterJoin) {
+  JoinKeyFilter key_filter;
+  OperationTest test;
+  test.AddInput(rhs_builder_.Build());
+  test.AddInput(lhs_builder_.Build());
+  test.SetExpectedResult(SwappedRightOuterJoinResult(false));
+  test.SetIgnoreRowOrder(true);
+  test.Execute(CreateKeyFilteredOperation(
+      RIGHT_OUTER, rhs_key_uniqueness(), 4, &key_filter,
+      test.input_at(0), test.input_at(1)));
+}
+
+TEST_P(PartitionedHashJoinTest, CoalescedInnerJoin) {
+  OperationTest test;
+  test.AddInput(lhs_builder_.Build());
+  test.AddInput(rhs_builder_.Build());
+  test.SetExpectedResult(InnerJoinResult());
+  test.SetIgnoreRowOrder(true);
+  test.Execute(CreateCoalescingOperation(
+      INNER, rhs_key_uniqueness(), 1,
+      test.input_at(0), test.input_at(1)));
+}
+
+TEST_P(PartitionedHashJoinTest, CoalescedPartitionedLeftOuterJoin) {
+  OperationTest test;
+  test.AddInput(lhs_builder_.Build());
+  test.AddInput(rhs_builder_.Build());
+  test.SetExpectedResult(LeftOuterJoinResult());
+  test.SetIgnoreRowOrder(true);
+  test.Execute(CreateCoalescingOperation(
+      LEFT_OUTER, rhs_key_uniqueness(), 4,
+      test.input_at(0), test.input_at(1)));
+}
+
+TEST_P(PartitionedHashJoinTest, CoalescedFullOuterJoin) {
+  OperationTest test;
+  test.AddInput(rhs_builder_.Build());
+  test.AddInput(lhs_builder_.Build());
+  test.SetExpectedResult(SwappedRightOuterJoinResult(true));
+  test.SetIgnoreRowOrder(true);
+  test.Execute(CreateCoalescingOperation(
+      FULL_OUTER, rhs_key_uniqueness(), 1,
+      test.input_at(0), test.input_at(1)));
+}
+
+// Every lhs view has a few matches only; they are returned in a single view.
+TEST_P(PartitionedHashJoinTest, CoalescedOutputFillsView) {
+  TestDataBuilder<INT64, STRING> lhs_builder, rhs_builder;
+  for (int i = 0; i < 4 * Cursor::kDefaultRowCount; ++i) {
+    lhs_builder.AddRow(i, "lhs");
+  }
+  for (int i = 0; i < 4 * Cursor::kDefaultRowCount; i += 100) {
+    rhs_builder.AddRow(i, "rhs");
+  }
+  for (bool coalesce_output : {false, true}) {
+    auto options = make_unique<HashJoinOptions>();
+    options->set_coalesce_output(coalesce_output);
+    auto operation = CreateOperationWithOptions(
+        INNER, rhs_key_uniqueness(), std::move(options),
+        lhs_builder.Build(), rhs_builder.Build());
+    std::unique_ptr<Cursor> cursor(SucceedOrDie(operation->CreateCursor()));
+    ResultView result = cursor->Next(Cursor::kDefaultRowCount);
+    ASSERT_TRUE(result.has_data());
+    EXPECT_EQ(coalesce_output ? 41 : 11, result.view().row_count());
+    EXPECT_EQ("lhs", result.view().column(1).typed_data<STRING>()[0]);
+  }
+}
+
+// The quota fits a few partitions of the rhs, so the rest is spilled.
+const size_t kSpillingMemoryQuota = 16 * 1024;
+
+TEST_P(PartitionedHashJoinTest, HybridInnerJoin) {
+  OperationTest test;
+  test.AddInput(lhs_builder_.Build());
+  test.AddInput(rhs_builder_.Build());
+  test.SetIgnoreRowOrder(true);
+  test.SetExpectedResult(InnerJoinResult());
+  test.Execute(CreateSpillingOperation(
+      INNER, rhs_key_uniqueness(), kSpillingMemoryQuota, NULL,
+      test.input_at(0), test.input_at(1)));
+}
+
+TEST_P(PartitionedHashJoinTest, HybridLeftOuterJoin) {
+  OperationTest test;
+  test.AddInput(lhs_builder_.Build());
+  test.AddInput(rhs_builder_.Build());
+  test.SetIgnoreRowOrder(true);
+  test.SetExpectedResult(LeftOuterJoinResult());
+  test.Execute(CreateSpillingOperation(
+      LEFT_OUTER, rhs_key_uniqueness(), kSpillingMemoryQuota, NULL,
+      test.input_at(0), test.input_at(1)));
+}
+
+TEST_P(PartitionedHashJoinTest, HybridRightOuterJoin) {
+  OperationTest test;
+  test.AddInput(rhs_builder_.Build());
+  test.AddInput(lhs_builder_.Build());
+  test.SetIgnoreRowOrder(true);
+  test.SetExpectedResult(SwappedRightOuterJoinResult(false));
+  test.Execute(CreateSpillingOperation(
+      RIGHT_OUTER, rhs_key_uniqueness(), kSpillingMemoryQuota, NULL,
+      test.input_at(0), test.input_at(1)));
+}
+
+TEST_P(PartitionedHashJoinTest, HybridFullOuterJoin) {
+  OperationTest test;
+  test.AddInput(rhs_builder_.Build());
+  test.AddInput(lhs_builder_.Build());
+  test.SetIgnoreRowOrder(true);
+  test.SetExpectedResult(SwappedRightOuterJoinResult(true));
+  test.Execute(CreateSpillingOperation(
+      FULL_OUTER, rhs_key_uniqueness(), kSpillingMemoryQuota, NULL,
+      test.input_at(0), test.input_at(1)));
+}
+
+TEST_P(PartitionedHashJoinTest, HybridParallelBuild) {
+  ThreadPool thread_pool(4);
+  OperationTest test;
+  test.AddInput(lhs_builder_.Build());
+  test.AddInput(rhs_builder_.Build());
+  test.SetIgnoreRowOrder(true);
+  test.SetExpectedResult(InnerJoinResult());
+  test.Execute(CreateSpillingOperation(
+      INNER, rhs_key_uniqueness(), kSpillingMemoryQuota, &thread_pool,
+      test.input_at(0), test.input_at(1)));
+}
+
+TEST_P(PartitionedHashJoinTest, HybridCoalescedInnerJoin) {
+  auto options = make_unique<HashJoinOptions>();
+  options->set_memory_quota(kSpillingMemoryQuota)->set_coalesce_output(true);
+  OperationTest test;
+  test.AddInput(lhs_builder_.Build());
+  test.AddInput(rhs_builder_.Build());
+  test.SetIgnoreRowOrder(true);
+  test.SetExpectedResult(InnerJoinResult());
+  test.Execute(CreateOperationWithOptions(
+      INNER, rhs_key_uniqueness(), std::move(options),
+      test.input_at(0), test.input_at(1)));
+}
+
+TEST_P(PartitionedHashJoinTest, HybridWithoutSpilling) {
+  OperationTest test;
+  test.AddInput(lhs_builder_.Build());
+  test.AddInput(rhs_builder_.Build());
+  test.SetIgnoreRowOrder(true);
+  test.SetExpectedResult(InnerJoinResult());
+  test.Execute(CreateSpillingOperation(
+      INNER, rhs_key_uniqueness(), 64 << 20, NULL,
+      test.input_at(0), test.input_at(1)));
+}
+
+TEST_P(PartitionedHashJoinTest, HybridPartitionMustFitInQuota) {
+  auto operation = CreateSpillingOperation(
+      INNER, rhs_key_uniqueness(), 0, NULL,
+      lhs_builder_.Build(), rhs_builder_.Build());
+  std::unique_ptr<Cursor> cursor(SucceedOrDie(operation->CreateCursor()));
+  ResultView result = cursor->Next(Cursor::kDefaultRowCount);
+  ASSERT_TRUE(result.is_failure());
+  EXPECT_EQ(ERROR_MEMORY_EXCEEDED, result.exception().return_code());
+}
+
+TEST(HashJoinOptionsTest, PartitionCountMustBePowerOfTwo) {
+  auto operation = CreatePartitionedOperation(
+      INNER, UNIQUE, 6, NULL,
+      TestDataBuilder<INT64>().AddRow(1).Build(),
+      TestDataBuilder<INT64>().AddRow(1).Build());
+  FailureOrOwned<Cursor> cursor = operation->CreateCursor();
+  ASSERT_TRUE(cursor.is_failure());
+  EXPECT_EQ(ERROR_INVALID_ARGUMENT_VALUE, cursor.exception().return_code());
+}
+
+TEST(HashJoinOptionsTest, KeyFilterRequiresUnmatchedLhsRowsDropped) {
+  JoinKeyFilter key_filter;
+  auto operation = CreateKeyFilteredOperation(
+      LEFT_OUTER, UNIQUE, 1, &key_filter,
+      TestDataBuilder<INT64>().AddRow(1).Build(),
+      TestDataBuilder<INT64>().AddRow(1).Build());
+  FailureOrOwned<Cursor> cursor = operation->CreateCursor();
+  ASSERT_TRUE(cursor.is_failure());
+  EXPECT_EQ(ERROR_INVALID_ARGUMENT_VALUE, cursor.exception().return_code());
+}
+
 }  // namespace supersonic
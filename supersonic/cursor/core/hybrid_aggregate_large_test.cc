@@ -24,6 +24,7 @@ using std::map;
 #include "supersonic/cursor/core/aggregate.h"
 #include "supersonic/cursor/core/sort.h"
 #include "supersonic/cursor/infrastructure/ordering.h"
+#include "supersonic/cursor/infrastructure/temporary_file_factory.h"
 #include "supersonic/testing/block_builder.h"
 #include "supersonic/testing/comparators.h"
 #include "supersonic/testing/operation_testing.h"
@@ -52,14 +53,19 @@ FailureOrOwned<Cursor> CreateHybridGroupAggregate(
   return BoundHybridGroupAggregate(
       group_by.Clone(),
       aggregation,
-      "",
+      DefaultTemporaryFileFactory(""),
+      FILE_COMPRESSION_NONE,
       HeapBufferAllocator::Get(),
       16,
       NULL,
       std::move(input));
 }
 
-TEST_F(HybridAggregateLargeTest, LargeInputWithManyDistinctKeys) {
+// Runs with the spilled data compressed as per the parameter.
+class HybridAggregateLargeCompressionTest
+    : public testing::TestWithParam<FileCompression> {};
+
+void TestLargeInputWithManyDistinctKeys(FileCompression spill_compression) {
   OperationTest test;
   test.SetInputViewSizes(1024);
   test.SetResultViewSizes(1024);
@@ -99,9 +105,22 @@ TEST_F(HybridAggregateLargeTest, LargeInputWithManyDistinctKeys) {
       std::move(aggregation),
       320000,
       "",
+      spill_compression,
       test.input()));
 }
 
+TEST_F(HybridAggregateLargeTest, LargeInputWithManyDistinctKeys) {
+  TestLargeInputWithManyDistinctKeys(FILE_COMPRESSION_NONE);
+}
+
+INSTANTIATE_TEST_CASE_P(Compression, HybridAggregateLargeCompressionTest,
+                        testing::Values(FILE_COMPRESSION_LIGHTWEIGHT,
+                                        FILE_COMPRESSION_LZ4));
+
+TEST_P(HybridAggregateLargeCompressionTest, LargeInputWithManyDistinctKeys) {
+  TestLargeInputWithManyDistinctKeys(GetParam());
+}
+
 // Large input, but small amount of unique keys and distinct aggregated values.
 TEST_F(HybridAggregateLargeTest, NonDistinctAndDistinctAggregationsLargeInput) {
   OperationTest test;
@@ -111,6 +130,7 @@ TEST_F(HybridAggregateLargeTest, NonDistinctAndDistinctAggregationsLargeInput) {
   // the worst case will produce about (8 * reps * (1 / 0.99)) rows, and even
   // for reps == 2000 it's 1600000 > kMaxBarrierRetries.
   test.SkipBarrierHandlingChecks(true);
+  test.SetIgnoreRowOrder(true);
   const int reps = 4000;
   test.SetInput(
       make_unique<RepeatingBlockOperation>(
@@ -148,6 +168,75 @@ TEST_F(HybridAggregateLargeTest, NonDistinctAndDistinctAggregationsLargeInput) {
       test.input()));
 }
 
+
+// The partitions of the pregroup output don't fit in the quota either, and
+// are split further.
+TEST_F(HybridAggregateLargeTest, PartitionsSplitRecursively) {
+  OperationTest test;
+  test.SetInputViewSizes(1024);
+  test.SetResultViewSizes(1024);
+  test.SkipBarrierHandlingChecks(true);
+  TestDataBuilder<INT32, INT32> input_builder;
+  TestDataBuilder<INT32, INT32, UINT64> expected_result_builder;
+  MTRandom random(0);
+  map<int32_t, int32_t> sum_for_key;
+  map<int32_t, uint64_t> count_for_key;
+  for (int i = 0; i < 300000; ++i) {
+    int32_t key = random.Rand32() % 100000;
+    int32_t value = random.Rand32() % 1000;
+    input_builder.AddRow(key, value);
+    sum_for_key[key] += value;
+    ++count_for_key[key];
+  }
+  for (map<int32_t, int32_t>::const_iterator mi = sum_for_key.begin();
+       mi != sum_for_key.end(); ++mi) {
+    expected_result_builder.AddRow(mi->first, mi->second,
+                                   count_for_key[mi->first]);
+  }
+  test.SetInput(input_builder.Build());
+  test.SetExpectedResult(expected_result_builder.Build());
+  test.SetIgnoreRowOrder(true);
+  auto aggregation = make_unique<AggregationSpecification>();
+  aggregation->AddAggregation(SUM, "col1", "sum");
+  aggregation->AddAggregation(COUNT, "", "cnt");
+  test.Execute(HybridGroupAggregate(
+      ProjectNamedAttribute("col0"),
+      std::move(aggregation),
+      64000,
+      "",
+      test.input()));
+}
+
+// A single group, with more distinct values than fit in the quota, can't be
+// split into partitions; it's sorted instead.
+TEST_F(HybridAggregateLargeTest, SingleGroupWithManyDistinctValues) {
+  OperationTest test;
+  test.SetInputViewSizes(1024);
+  test.SetResultViewSizes(1024);
+  test.SkipBarrierHandlingChecks(true);
+  TestDataBuilder<INT32, INT32> input_builder;
+  set<int32_t> values;
+  MTRandom random(0);
+  for (int i = 0; i < 200000; ++i) {
+    int32_t value = random.Rand32() % 100000;
+    input_builder.AddRow(7, value);
+    values.insert(value);
+  }
+  test.SetInput(input_builder.Build());
+  test.SetExpectedResult(TestDataBuilder<INT32, UINT64, UINT64>()
+                         .AddRow(7, values.size(), 200000)
+                         .Build());
+  auto aggregation = make_unique<AggregationSpecification>();
+  aggregation->AddDistinctAggregation(COUNT, "col1", "dcnt");
+  aggregation->AddAggregation(COUNT, "col1", "cnt");
+  test.Execute(HybridGroupAggregate(
+      ProjectNamedAttribute("col0"),
+      std::move(aggregation),
+      64000,
+      "",
+      test.input()));
+}
+
 }  // namespace
 
 }  // namespace supersonic
@@ -14,19 +14,25 @@
 //
 
 #include <memory>
+#include <string>
+#include <vector>
+using std::vector;
 
 #include "supersonic/base/infrastructure/projector.h"
 #include "supersonic/cursor/base/cursor.h"
 #include "supersonic/cursor/base/cursor_transformer.h"
 #include "supersonic/cursor/core/aggregate.h"
 #include "supersonic/cursor/core/hybrid_group_utils.h"
+#include "supersonic/cursor/core/scan_view.h"
 #include "supersonic/cursor/core/sort.h"
 #include "supersonic/cursor/core/spy.h"
 #include "supersonic/cursor/infrastructure/ordering.h"
+#include "supersonic/cursor/infrastructure/temporary_file_factory.h"
 #include "supersonic/testing/block_builder.h"
 #include "supersonic/testing/comparators.h"
 #include "supersonic/testing/operation_testing.h"
 #include "supersonic/testing/repeating_block.h"
+#include "supersonic/utils/strings/strcat.h"
 
 #include "gtest/gtest.h"
 #include "gtest/gtest.h"
@@ -43,6 +49,10 @@ class HybridAggregateTest : public testing::Test {
 
 class HybridAggregateSpyTest : public testing::TestWithParam<bool> {};
 
+// Runs with the spilled data compressed as per the parameter.
+class HybridAggregateCompressionTest
+    : public testing::TestWithParam<FileCompression> {};
+
 // A lot of tests just copied from aggregate_groups_test.cc. Maybe it would be
 // better to share this code somehow and avoid "copy & paste".
 
@@ -53,7 +63,8 @@ FailureOrOwned<Cursor> CreateGroupAggregate(
   return BoundHybridGroupAggregate(
       group_by.Clone(),
       aggregation,
-      "",
+      DefaultTemporaryFileFactory(""),
+      FILE_COMPRESSION_NONE,
       HeapBufferAllocator::Get(),
       16,
       NULL,
@@ -76,7 +87,8 @@ static unique_ptr<Cursor> Sort(unique_ptr<Cursor> input) {
       std::move(bound_sort_order),
       std::move(bound_result_projector),
       std::numeric_limits<size_t>::max(),
-      "",
+      DefaultTemporaryFileFactory(""),
+      FILE_COMPRESSION_NONE,
       HeapBufferAllocator::Get(),
       std::move(input))));
 }
@@ -623,6 +635,7 @@ TEST_F(HybridAggregateTest, Simple1) {
 
 TEST_F(HybridAggregateTest, DistinctAggregations) {
   OperationTest test;
+  test.SetIgnoreRowOrder(true);
   test.SetInput(TestDataBuilder<INT32, INT32>()
                 .AddRow(1, 3)
                 .AddRow(1, 4)
@@ -653,6 +666,7 @@ TEST_F(HybridAggregateTest, DistinctAggregations) {
 
 TEST_F(HybridAggregateTest, NonDistinctAndDistinctAggregations) {
   OperationTest test;
+  test.SetIgnoreRowOrder(true);
   test.SetInput(TestDataBuilder<INT32, INT32>()
                 .AddRow(1, 3)
                 .AddRow(1, 4)
@@ -731,7 +745,8 @@ TEST_F(HybridAggregateTest, HybridGroupTransformTest) {
       BoundHybridGroupAggregate(
           std::move(group_by_columns),
           aggregation,
-          "",
+          DefaultTemporaryFileFactory(""),
+          FILE_COMPRESSION_NONE,
           HeapBufferAllocator::Get(),
           0,
           (new HybridGroupDebugOptions)->set_return_transformed_input(true),
@@ -773,8 +788,10 @@ TEST_F(HybridAggregateTest, HybridGroupTransformOnlyDistinct) {
   aggregation.AddDistinctAggregation(SUM, "col1", "distinct1b");
   aggregation.AddDistinctAggregation(COUNT, "col1", "distinct1c");
   std::unique_ptr<Cursor> transformed(SucceedOrDie(BoundHybridGroupAggregate(
-      std::move(group_by_columns), aggregation, "", HeapBufferAllocator::Get(),
-      0, (new HybridGroupDebugOptions)->set_return_transformed_input(true),
+      std::move(group_by_columns), aggregation, DefaultTemporaryFileFactory(""),
+      FILE_COMPRESSION_NONE,
+      HeapBufferAllocator::Get(), 0,
+      (new HybridGroupDebugOptions)->set_return_transformed_input(true),
       std::move(input))));
   EXPECT_CURSORS_EQUAL(std::move(expected_output), std::move(transformed));
 }
@@ -814,8 +831,10 @@ TEST_F(HybridAggregateTest, HybridGroupTransformDistinctAndCountAll) {
   aggregation.AddDistinctAggregation(COUNT, "col1", "distinct1c");
   aggregation.AddAggregation(COUNT, "", "count_all");
   std::unique_ptr<Cursor> transformed(SucceedOrDie(BoundHybridGroupAggregate(
-      std::move(group_by_columns), aggregation, "", HeapBufferAllocator::Get(),
-      0, (new HybridGroupDebugOptions)->set_return_transformed_input(true),
+      std::move(group_by_columns), aggregation, DefaultTemporaryFileFactory(""),
+      FILE_COMPRESSION_NONE,
+      HeapBufferAllocator::Get(), 0,
+      (new HybridGroupDebugOptions)->set_return_transformed_input(true),
       std::move(input))));
   EXPECT_CURSORS_EQUAL(std::move(expected_output), std::move(transformed));
 }
@@ -845,8 +864,10 @@ TEST_F(HybridAggregateTest, HybridGroupTransformExampleTest) {
   aggregation.AddDistinctAggregation(COUNT, "col2", "dcnt2");
 
   std::unique_ptr<Cursor> transformed(SucceedOrDie(BoundHybridGroupAggregate(
-      std::move(group_by_columns), aggregation, "", HeapBufferAllocator::Get(),
-      0, (new HybridGroupDebugOptions)->set_return_transformed_input(true),
+      std::move(group_by_columns), aggregation, DefaultTemporaryFileFactory(""),
+      FILE_COMPRESSION_NONE,
+      HeapBufferAllocator::Get(), 0,
+      (new HybridGroupDebugOptions)->set_return_transformed_input(true),
       std::move(input))));
   EXPECT_FALSE(transformed->schema().attribute(0).is_nullable());
   EXPECT_TRUE(transformed->schema().attribute(1).is_nullable());
@@ -890,6 +911,7 @@ TEST_F(HybridAggregateTest, GroupByColumnPosition1) {
 
 TEST_F(HybridAggregateTest, GroupByAllColumns) {
   OperationTest test;
+  test.SetIgnoreRowOrder(true);
   test.SetInput(TestDataBuilder<INT32>()
                 .AddRow(1)
                 .AddRow(1)
@@ -942,6 +964,46 @@ TEST_F(HybridAggregateTest, GroupByColumnRenamed) {
       test.input()));
 }
 
+INSTANTIATE_TEST_CASE_P(Compression, HybridAggregateCompressionTest,
+                        testing::Values(FILE_COMPRESSION_LIGHTWEIGHT,
+                                        FILE_COMPRESSION_LZ4));
+
+// The partitions don't fit in the quota; they are spilled compressed, and
+// read back the same.
+TEST_P(HybridAggregateCompressionTest, SpilledPartitionsReadBack) {
+  BlockBuilder<INT32, STRING, INT64> builder;
+  for (int i = 0; i < 5000; ++i) {
+    if (i % 11 == 0) {
+      builder.AddRow(i % 300, __, i);
+    } else {
+      builder.AddRow(i % 300, StrCat("name_", i % 37), i);
+    }
+  }
+  std::unique_ptr<Block> input(builder.Build());
+  AggregationSpecification aggregation;
+  aggregation.AddAggregation(SUM, "col2", "sum");
+  aggregation.AddAggregation(COUNT, "col1", "cnt");
+  aggregation.AddDistinctAggregation(COUNT, "col1", "dcnt");
+  LocalTemporaryFileFactory factory(vector<string>(1, ""),
+                                    LocalTemporaryFileFactory::kNoDiskQuota);
+  OperationTest test;
+  test.SetExpectedResult(GroupAggregate(
+      ProjectNamedAttribute("col0"),
+      make_unique<AggregationSpecification>(aggregation), nullptr,
+      ScanView(input->view())));
+  test.SetIgnoreRowOrder(true);
+  test.SkipBarrierHandlingChecks(true);
+  test.Execute(HybridGroupAggregate(
+      ProjectNamedAttribute("col0"),
+      make_unique<AggregationSpecification>(aggregation),
+      16000,
+      &factory,
+      GetParam(),
+      ScanView(input->view())));
+  EXPECT_LT(0, factory.files_created());
+  EXPECT_EQ(0, factory.disk_usage());
+}
+
 }  // namespace
 
 }  // namespace supersonic
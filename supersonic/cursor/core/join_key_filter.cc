@@ -0,0 +1,198 @@
+// Copyright 2012 Google Inc. All Rights Reserved.
+//
+// Licensed under the Apache License, Version 2.0 (the "License");
+// you may not use this file except in compliance with the License.
+// You may obtain a copy of the License at
+//
+//     http://www.apache.org/licenses/LICENSE-2.0
+//
+// Unless required by applicable law or agreed to in writing, software
+// distributed under the License is distributed on an "AS IS" BASIS,
+// WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+// See the License for the specific language governing permissions and
+// limitations under the License.
+//
+
+#include "supersonic/cursor/core/join_key_filter.h"
+
+#include <algorithm>
+#include <memory>
+#include <string>
+#include "supersonic/utils/std_namespace.h"
+using std::make_unique;
+
+#include <glog/logging.h>
+#include "supersonic/utils/logging-inl.h"
+#include "supersonic/utils/exception/failureor.h"
+#include "supersonic/base/exception/exception.h"
+#include "supersonic/base/exception/exception_macros.h"
+#include "supersonic/base/infrastructure/bit_pointers.h"
+#include "supersonic/base/infrastructure/block.h"
+#include "supersonic/base/infrastructure/projector.h"
+#include "supersonic/base/infrastructure/tuple_schema.h"
+#include "supersonic/base/infrastructure/types.h"
+#include "supersonic/base/infrastructure/view_copier.h"
+#include "supersonic/cursor/base/cursor.h"
+#include "supersonic/cursor/base/operation.h"
+#include "supersonic/cursor/proto/cursors.pb.h"
+#include "supersonic/cursor/infrastructure/basic_cursor.h"
+#include "supersonic/cursor/infrastructure/basic_operation.h"
+#include "supersonic/cursor/infrastructure/row_hash_set.h"
+#include "supersonic/utils/strings/join.h"
+
+namespace supersonic {
+
+namespace {
+
+class JoinKeyFilterCursor : public BasicCursor {
+ public:
+  JoinKeyFilterCursor(unique_ptr<const BoundSingleSourceProjector> key_selector,
+                      JoinKeyFilter* key_filter,
+                      BufferAllocator* allocator,
+                      unique_ptr<Cursor> child_cursor)
+      : BasicCursor(std::move(child_cursor)),
+        key_selector_(std::move(key_selector)),
+        key_filter_(key_filter),
+        key_(key_selector_->result_schema()),
+        copier_(schema(), false),
+        result_block_(schema(), allocator),
+        hash_(new size_t[Cursor::kDefaultRowCount]),
+        selected_(new rowid_t[Cursor::kDefaultRowCount]),
+        passed_row_count_(0),
+        dropped_row_count_(0) {}
+
+  FailureOrVoid Init(BufferAllocator* allocator) {
+    if (!result_block_.Reallocate(Cursor::kDefaultRowCount) ||
+        !may_contain_.Reallocate(Cursor::kDefaultRowCount, allocator)) {
+      THROW(new Exception(ERROR_MEMORY_EXCEEDED,
+                          "Couldn't allocate the join key filter's buffers"));
+    }
+    return Success();
+  }
+
+  virtual ResultView Next(rowcount_t max_row_count) {
+    max_row_count = std::min(max_row_count, result_block_.row_capacity());
+    for (;;) {
+      ResultView result = child()->Next(max_row_count);
+      if (!result.has_data()) return result;
+      if (filter_ == NULL) {
+        filter_ = key_filter_->Get();
+        if (filter_ == NULL) return result;
+      }
+      const View& view = result.view();
+      const rowcount_t selected_row_count = SelectRows(view);
+      passed_row_count_ += selected_row_count;
+      dropped_row_count_ += view.row_count() - selected_row_count;
+      if (selected_row_count == view.row_count()) return result;
+      if (selected_row_count == 0) continue;
+      // Shallow; the selected rows stay valid until the next child's Next().
+      CHECK_EQ(selected_row_count,
+               copier_.Copy(selected_row_count, view, selected_.get(), 0,
+                            &result_block_));
+      my_view()->ResetFromSubRange(result_block_.view(), 0,
+                                   selected_row_count);
+      return ResultView::Success(my_view());
+    }
+  }
+
+  virtual bool IsWaitingOnBarrierSupported() const { return true; }
+
+  virtual void AppendDebugDescription(string* target) const {
+    StrAppend(target, "FilterByJoinKeys(passed: ", passed_row_count_,
+              ", dropped: ", dropped_row_count_, ")");
+  }
+
+  virtual CursorId GetCursorId() const { return JOIN_KEY_FILTER; }
+
+ private:
+  // Puts the ids of the view's rows that may have a match (with non-NULL keys
+  // in the filter) in selected_; returns their count.
+  rowcount_t SelectRows(const View& view) {
+    const rowcount_t row_count = view.row_count();
+    key_selector_->Project(view, &key_);
+    key_.set_row_count(row_count);
+    row_hash_set::HashKeys(key_, row_count, hash_.get());
+    bool_ptr may_contain = may_contain_.mutable_data();
+    filter_->FindMany(hash_.get(), row_count, may_contain);
+    for (int c = 0; c < key_.column_count(); ++c) {
+      bool_const_ptr is_null = key_.column(c).is_null();
+      if (is_null == NULL) continue;
+      for (rowid_t i = 0; i < row_count; ++i) {
+        may_contain[i] = may_contain[i] && !is_null[i];
+      }
+    }
+    rowcount_t selected_row_count = 0;
+    for (rowid_t i = 0; i < row_count; ++i) {
+      if (may_contain[i]) selected_[selected_row_count++] = i;
+    }
+    return selected_row_count;
+  }
+
+  unique_ptr<const BoundSingleSourceProjector> key_selector_;
+  JoinKeyFilter* key_filter_;
+
+  // The published filter; kept once the key filter has one.
+  std::shared_ptr<const BloomFilter> filter_;
+
+  View key_;
+  SelectiveViewCopier copier_;
+  Block result_block_;
+
+  // Scratchpads for filtering a single view.
+  std::unique_ptr<size_t[]> hash_;
+  bool_array may_contain_;
+  std::unique_ptr<rowid_t[]> selected_;
+
+  rowcount_t passed_row_count_;
+  rowcount_t dropped_row_count_;
+
+  DISALLOW_COPY_AND_ASSIGN(JoinKeyFilterCursor);
+};
+
+class JoinKeyFilterOperation : public BasicOperation {
+ public:
+  JoinKeyFilterOperation(unique_ptr<const SingleSourceProjector> key_selector,
+                         JoinKeyFilter* key_filter,
+                         unique_ptr<Operation> child)
+      : BasicOperation(std::move(child)),
+        key_selector_(std::move(key_selector)),
+        key_filter_(key_filter) {}
+
+  virtual FailureOrOwned<Cursor> CreateCursor() const {
+    FailureOrOwned<Cursor> child_cursor = child()->CreateCursor();
+    PROPAGATE_ON_FAILURE(child_cursor);
+    FailureOrOwned<const BoundSingleSourceProjector> key_selector =
+        key_selector_->Bind(child_cursor->schema());
+    PROPAGATE_ON_FAILURE(key_selector);
+    return BoundFilterByJoinKeys(key_selector.move(), key_filter_,
+                                 buffer_allocator(), child_cursor.move());
+  }
+
+ private:
+  unique_ptr<const SingleSourceProjector> key_selector_;
+  JoinKeyFilter* key_filter_;
+  DISALLOW_COPY_AND_ASSIGN(JoinKeyFilterOperation);
+};
+
+}  // namespace
+
+unique_ptr<Operation> FilterByJoinKeys(
+    unique_ptr<const SingleSourceProjector> key_selector,
+    JoinKeyFilter* key_filter,
+    unique_ptr<Operation> child) {
+  return make_unique<JoinKeyFilterOperation>(std::move(key_selector),
+                                             key_filter, std::move(child));
+}
+
+FailureOrOwned<Cursor> BoundFilterByJoinKeys(
+    unique_ptr<const BoundSingleSourceProjector> key_selector,
+    JoinKeyFilter* key_filter,
+    BufferAllocator* allocator,
+    unique_ptr<Cursor> child_cursor) {
+  auto cursor = make_unique<JoinKeyFilterCursor>(
+      std::move(key_selector), key_filter, allocator, std::move(child_cursor));
+  PROPAGATE_ON_FAILURE(cursor->Init(allocator));
+  return Success(std::move(cursor));
+}
+
+}  // namespace supersonic
@@ -0,0 +1,101 @@
+// Copyright 2012 Google Inc. All Rights Reserved.
+//
+// Licensed under the Apache License, Version 2.0 (the "License");
+// you may not use this file except in compliance with the License.
+// You may obtain a copy of the License at
+//
+//     http://www.apache.org/licenses/LICENSE-2.0
+//
+// Unless required by applicable law or agreed to in writing, software
+// distributed under the License is distributed on an "AS IS" BASIS,
+// WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+// See the License for the specific language governing permissions and
+// limitations under the License.
+//
+// Runtime filtering of the hash join's probe (lhs) input by the keys of its
+// build (rhs) input. Once the hash join has built its index, it publishes a
+// Bloom filter over the keys in a JoinKeyFilter (see
+// HashJoinOptions::set_key_filter). A FilterByJoinKeys operation placed
+// anywhere in the lhs input, typically right above the scan, then drops the
+// rows whose keys certainly have no match, before they reach the join:
+//
+//   JoinKeyFilter key_filter;
+//   HashJoinOptions* options = new HashJoinOptions;
+//   options->set_key_filter(&key_filter);
+//   HashJoinOperation join(
+//       INNER, lhs_key_selector->Clone(), rhs_key_selector, ...,
+//       FilterByJoinKeys(lhs_key_selector, &key_filter, lhs), rhs);
+//
+// Until the filter is published, all rows pass through.
+
+#ifndef SUPERSONIC_CURSOR_CORE_JOIN_KEY_FILTER_H_
+#define SUPERSONIC_CURSOR_CORE_JOIN_KEY_FILTER_H_
+
+#include <memory>
+#include <mutex>
+
+#include "supersonic/base/exception/result.h"
+#include "supersonic/cursor/infrastructure/bloom_filter.h"
+#include "supersonic/utils/macros.h"
+
+namespace supersonic {
+
+class BoundSingleSourceProjector;
+class BufferAllocator;
+class Cursor;
+class Operation;
+class SingleSourceProjector;
+
+// Passes the Bloom filter from the hash join to the FilterByJoinKeys cursors.
+// Thread-safe; the lhs input may be read on other threads than the one
+// building the index.
+class JoinKeyFilter {
+ public:
+  JoinKeyFilter() {}
+
+  // Makes the filter visible to the FilterByJoinKeys cursors.
+  void Publish(std::shared_ptr<const BloomFilter> filter) {
+    std::lock_guard<std::mutex> lock(mutex_);
+    filter_ = std::move(filter);
+  }
+
+  // Returns the published filter, or NULL if there is none yet.
+  std::shared_ptr<const BloomFilter> Get() const {
+    std::lock_guard<std::mutex> lock(mutex_);
+    return filter_;
+  }
+
+  // Drops the published filter. Called by the hash join when a new cursor is
+  // created and when its cursor is destroyed, so that a filter built for one
+  // cursor isn't applied to the input of another. Consequently, a single
+  // JoinKeyFilter must not be shared by the cursors of a join that exist at
+  // the same time.
+  void Reset() { Publish(NULL); }
+
+ private:
+  mutable std::mutex mutex_;
+  std::shared_ptr<const BloomFilter> filter_;
+  DISALLOW_COPY_AND_ASSIGN(JoinKeyFilter);
+};
+
+// Creates an operation that drops the rows of the child's output whose keys
+// (selected by key_selector) are certainly not in the filter published in
+// key_filter, and the rows with NULL keys, once the filter is published. The
+// keys must have the same types as the keys of the hash join's rhs input.
+// Takes ownership of key_selector and child, not of key_filter.
+unique_ptr<Operation> FilterByJoinKeys(
+    unique_ptr<const SingleSourceProjector> key_selector,
+    JoinKeyFilter* key_filter,
+    unique_ptr<Operation> child);
+
+// Creates the cursor of the above operation. Takes ownership of key_selector
+// and child_cursor, not of key_filter and allocator.
+FailureOrOwned<Cursor> BoundFilterByJoinKeys(
+    unique_ptr<const BoundSingleSourceProjector> key_selector,
+    JoinKeyFilter* key_filter,
+    BufferAllocator* allocator,
+    unique_ptr<Cursor> child_cursor);
+
+}  // namespace supersonic
+
+#endif  // SUPERSONIC_CURSOR_CORE_JOIN_KEY_FILTER_H_
@@ -0,0 +1,104 @@
+// Copyright 2012 Google Inc. All Rights Reserved.
+//
+// Licensed under the Apache License, Version 2.0 (the "License");
+// you may not use this file except in compliance with the License.
+// You may obtain a copy of the License at
+//
+//     http://www.apache.org/licenses/LICENSE-2.0
+//
+// Unless required by applicable law or agreed to in writing, software
+// distributed under the License is distributed on an "AS IS" BASIS,
+// WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+// See the License for the specific language governing permissions and
+// limitations under the License.
+//
+
+#include "supersonic/cursor/core/join_key_filter.h"
+
+#include <memory>
+
+#include "supersonic/base/infrastructure/block.h"
+#include "supersonic/base/infrastructure/projector.h"
+#include "supersonic/base/memory/memory.h"
+#include "supersonic/cursor/base/cursor.h"
+#include "supersonic/cursor/base/operation.h"
+#include "supersonic/cursor/infrastructure/bloom_filter.h"
+#include "supersonic/cursor/infrastructure/row_hash_set.h"
+#include "supersonic/testing/block_builder.h"
+#include "supersonic/testing/operation_testing.h"
+#include "gtest/gtest.h"
+
+namespace supersonic {
+
+namespace {
+
+// Publishes a filter with the keys from the block in key_filter.
+void PublishKeys(const Block& keys, JoinKeyFilter* key_filter) {
+  const rowcount_t row_count = keys.view().row_count();
+  std::unique_ptr<size_t[]> hash(new size_t[row_count]);
+  row_hash_set::HashKeys(keys.view(), row_count, hash.get());
+  FailureOrOwned<BloomFilter> filter =
+      BloomFilter::Create(row_count, HeapBufferAllocator::Get());
+  ASSERT_TRUE(filter.is_success());
+  filter->InsertMany(hash.get(), bool_const_ptr(), row_count);
+  key_filter->Publish(std::shared_ptr<const BloomFilter>(filter.move()));
+}
+
+class JoinKeyFilterTest : public testing::Test {
+ public:
+  void SetUp() {
+    input_builder_.
+        AddRow(1, "a").
+        AddRow(2, "b").
+        AddRow(__, "c").
+        AddRow(3, "d").
+        AddRow(4, "e").
+        AddRow(5, "f");
+  }
+
+  TestDataBuilder<INT64, STRING> input_builder_;
+};
+
+TEST_F(JoinKeyFilterTest, PassesAllRowsUntilPublished) {
+  JoinKeyFilter key_filter;
+  OperationTest test;
+  test.SetInput(input_builder_.Build());
+  test.SetExpectedResult(input_builder_.Build());
+  test.Execute(FilterByJoinKeys(ProjectAttributeAt(0), &key_filter,
+                                test.input()));
+}
+
+TEST_F(JoinKeyFilterTest, DropsRowsWithoutKeysInFilter) {
+  JoinKeyFilter key_filter;
+  PublishKeys(*BlockBuilder<INT64>().AddRow(2).AddRow(4).AddRow(6).Build(),
+              &key_filter);
+  OperationTest test;
+  test.SetInput(input_builder_.Build());
+  test.SetExpectedResult(TestDataBuilder<INT64, STRING>()
+                         .AddRow(2, "b")
+                         .AddRow(4, "e")
+                         .Build());
+  test.Execute(FilterByJoinKeys(ProjectAttributeAt(0), &key_filter,
+                                test.input()));
+}
+
+TEST_F(JoinKeyFilterTest, DropsAllRows) {
+  JoinKeyFilter key_filter;
+  PublishKeys(*BlockBuilder<INT64>().AddRow(7).Build(), &key_filter);
+  OperationTest test;
+  test.SetInput(input_builder_.Build());
+  test.SetExpectedResult(TestDataBuilder<INT64, STRING>().Build());
+  test.Execute(FilterByJoinKeys(ProjectAttributeAt(0), &key_filter,
+                                test.input()));
+}
+
+TEST_F(JoinKeyFilterTest, ResetDropsFilter) {
+  JoinKeyFilter key_filter;
+  PublishKeys(*BlockBuilder<INT64>().AddRow(7).Build(), &key_filter);
+  key_filter.Reset();
+  EXPECT_TRUE(key_filter.Get() == NULL);
+}
+
+}  // namespace
+
+}  // namespace supersonic
@@ -19,15 +19,18 @@
 #include <vector>
 using std::vector;
 
+#include "supersonic/base/infrastructure/block.h"
 #include "supersonic/base/infrastructure/types.h"
 #include "supersonic/cursor/base/cursor.h"
 #include "supersonic/cursor/base/cursor_transformer.h"
+#include "supersonic/cursor/core/scan_view.h"
 #include "supersonic/cursor/core/spy.h"
 #include "supersonic/cursor/infrastructure/ordering.h"
 #include "supersonic/proto/supersonic.pb.h"
 #include "supersonic/testing/block_builder.h"
 #include "supersonic/testing/comparators.h"
 #include "supersonic/testing/operation_testing.h"
+#include "supersonic/utils/random.h"
 #include "gtest/gtest.h"
 #include "supersonic/utils/container_literal.h"
 
@@ -505,6 +508,143 @@ TEST_F(MergeUnionAllTest, a1a1a2_b2) {
       uptr_vector<Operation>(a1a1a2_.Build(), b2_.Build())));
 }
 
+TEST_F(MergeUnionAllTest, RunsOfRowsFromOneInput) {
+  OperationTest test;
+  test.SetExpectedResult(TestDataBuilder<INT64, STRING>()
+      .AddRow(1, "a").AddRow(2, "a").AddRow(3, "a").AddRow(4, "b")
+      .AddRow(5, "b").AddRow(6, "b").AddRow(7, "b").AddRow(8, "c")
+      .AddRow(9, "c").AddRow(10, "a").AddRow(11, "a").AddRow(12, "a")
+      .AddRow(13, "b").AddRow(14, "c").AddRow(15, "c")
+      .Build());
+  auto sort_order = make_unique<SortOrder>();
+  sort_order->OrderByAttributeAt(0, ASCENDING);
+  test.Execute(MergeUnionAll(
+      std::move(sort_order),
+      uptr_vector<Operation>(
+          TestDataBuilder<INT64, STRING>()
+              .AddRow(1, "a").AddRow(2, "a").AddRow(3, "a")
+              .AddRow(10, "a").AddRow(11, "a").AddRow(12, "a")
+              .Build(),
+          TestDataBuilder<INT64, STRING>()
+              .AddRow(4, "b").AddRow(5, "b").AddRow(6, "b").AddRow(7, "b")
+              .AddRow(13, "b")
+              .Build(),
+          TestDataBuilder<INT64, STRING>()
+              .AddRow(8, "c").AddRow(9, "c").AddRow(14, "c").AddRow(15, "c")
+              .Build())));
+}
+
+// Rows with equal keys come in the order of their inputs.
+TEST_F(MergeUnionAllTest, EqualKeysInOrderOfInputs) {
+  OperationTest test;
+  test.SetExpectedResult(TestDataBuilder<INT64, STRING>()
+      .AddRow(0, "c0").AddRow(1, "a0").AddRow(1, "a1").AddRow(1, "b0")
+      .AddRow(1, "c1").AddRow(2, "a2").AddRow(2, "b1")
+      .Build());
+  auto sort_order = make_unique<SortOrder>();
+  sort_order->OrderByAttributeAt(0, ASCENDING);
+  test.Execute(MergeUnionAll(
+      std::move(sort_order),
+      uptr_vector<Operation>(
+          TestDataBuilder<INT64, STRING>()
+              .AddRow(1, "a0").AddRow(1, "a1").AddRow(2, "a2")
+              .Build(),
+          TestDataBuilder<INT64, STRING>()
+              .AddRow(1, "b0").AddRow(2, "b1")
+              .Build(),
+          TestDataBuilder<INT64, STRING>()
+              .AddRow(0, "c0").AddRow(1, "c1")
+              .Build())));
+}
+
+// The keys share their first 8 bytes, so the key prefixes are all equal.
+TEST_F(MergeUnionAllTest, LongStringKeysDescending) {
+  OperationTest test;
+  test.SetExpectedResult(TestDataBuilder<STRING, INT64>()
+      .AddRow("prefix__z", 1).AddRow("prefix__y", 2).AddRow("prefix__b", 1)
+      .AddRow("prefix__a", 2).AddRow("prefix_", 1).AddRow(__, 2)
+      .Build());
+  auto sort_order = make_unique<SortOrder>();
+  sort_order->OrderByAttributeAt(0, DESCENDING);
+  test.Execute(MergeUnionAll(
+      std::move(sort_order),
+      uptr_vector<Operation>(
+          TestDataBuilder<STRING, INT64>()
+              .AddRow("prefix__z", 1).AddRow("prefix__b", 1)
+              .AddRow("prefix_", 1)
+              .Build(),
+          TestDataBuilder<STRING, INT64>()
+              .AddRow("prefix__y", 2).AddRow("prefix__a", 2).AddRow(__, 2)
+              .Build())));
+}
+
+// Too large for OperationTest. Every input has stretches of consecutive keys
+// and repeats some of the others' keys; checks that the result is sorted, and
+// stable.
+TEST_F(MergeUnionAllTest, ManyRowsStable) {
+  const int kNumInputs = 7;
+  const int64_t kNumRowsPerInput = 20000;
+  MTRandom random(0);
+  vector<unique_ptr<Block>> blocks;
+  vector<unique_ptr<Cursor>> inputs;
+  for (int i = 0; i < kNumInputs; ++i) {
+    BlockBuilder<INT64, INT32, INT64> builder;
+    int64_t key = 0;
+    for (int64_t j = 0; j < kNumRowsPerInput; ++j) {
+      if (j < 10) {
+        builder.AddRow(__, i, j);
+        continue;
+      }
+      // Mostly runs of small steps, with an occasional jump.
+      key += (random.Rand32() % 50 == 0) ? random.Rand32() % 1000
+                                         : random.Rand32() % 2;
+      builder.AddRow(key, i, j);
+    }
+    blocks.push_back(builder.Build());
+    inputs.push_back(BoundScanView(blocks.back()->view()));
+  }
+  auto sort_order = make_unique<SortOrder>();
+  sort_order->OrderByAttributeAt(0, ASCENDING);
+  std::unique_ptr<Cursor> merge(SucceedOrDie(BoundMergeUnionAll(
+      SucceedOrDie(sort_order->Bind(blocks[0]->schema())),
+      std::move(inputs), HeapBufferAllocator::Get())));
+  int64_t row_count = 0;
+  bool previous_is_null = true;
+  int64_t previous_key = 0;
+  int32_t previous_input = -1;
+  int64_t previous_position = 0;
+  while (true) {
+    ResultView result = merge->Next(Cursor::kDefaultRowCount);
+    ASSERT_FALSE(result.is_failure());
+    if (result.is_eos()) break;
+    const View& view = result.view();
+    for (rowid_t i = 0; i < view.row_count(); ++i, ++row_count) {
+      const bool is_null = view.column(0).is_null()[i];
+      const int64_t key = view.column(0).typed_data<INT64>()[i];
+      const int32_t input = view.column(1).typed_data<INT32>()[i];
+      const int64_t position = view.column(2).typed_data<INT64>()[i];
+      if (row_count > 0) {
+        ASSERT_FALSE(previous_is_null == false && is_null) << row_count;
+        const bool equal_keys = (previous_is_null && is_null) ||
+            (!previous_is_null && !is_null && previous_key == key);
+        if (!previous_is_null && !is_null) {
+          ASSERT_LE(previous_key, key) << row_count;
+        }
+        if (equal_keys) {
+          ASSERT_TRUE(previous_input < input ||
+                      (previous_input == input && previous_position < position))
+              << row_count;
+        }
+      }
+      previous_is_null = is_null;
+      previous_key = key;
+      previous_input = input;
+      previous_position = position;
+    }
+  }
+  EXPECT_EQ(kNumInputs * kNumRowsPerInput, row_count);
+}
+
 TEST_F(MergeUnionAllTest, EmptySoftQuota) {
   MemoryLimit allocator_with_soft_quota(0, false, HeapBufferAllocator::Get());
   OperationTest test;
@@ -45,6 +45,10 @@ class OwnershipTaker : public Cursor {
     return child_->Next(max_row_count);
   }
 
+  virtual ResultView NextSelected(rowcount_t max_row_count) {
+    return child_->NextSelected(max_row_count);
+  }
+
   virtual void Interrupt() { child_->Interrupt(); }
 
   virtual void AppendDebugDescription(string* target) const {
@@ -0,0 +1,606 @@
+// Copyright 2012 Google Inc. All Rights Reserved.
+//
+// Licensed under the Apache License, Version 2.0 (the "License");
+// you may not use this file except in compliance with the License.
+// You may obtain a copy of the License at
+//
+//     http://www.apache.org/licenses/LICENSE-2.0
+//
+// Unless required by applicable law or agreed to in writing, software
+// distributed under the License is distributed on an "AS IS" BASIS,
+// WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+// See the License for the specific language governing permissions and
+// limitations under the License.
+//
+
+#include "supersonic/cursor/core/parallel.h"
+
+#include <algorithm>
+#include "supersonic/utils/std_namespace.h"
+#include <atomic>
+#include <condition_variable>
+#include <deque>
+#include <memory>
+#include <mutex>
+
+#include <glog/logging.h>
+#include "supersonic/utils/logging-inl.h"
+#include "supersonic/utils/exception/failureor.h"
+#include "supersonic/base/exception/exception.h"
+#include "supersonic/base/exception/exception_macros.h"
+#include "supersonic/base/infrastructure/block.h"
+#include "supersonic/base/infrastructure/tuple_schema.h"
+#include "supersonic/base/infrastructure/view_copier.h"
+#include "supersonic/base/memory/memory.h"
+#include "supersonic/cursor/base/operation.h"
+#include "supersonic/cursor/core/ownership_taker.h"
+#include "supersonic/cursor/infrastructure/basic_cursor.h"
+#include "supersonic/cursor/infrastructure/basic_operation.h"
+#include "supersonic/cursor/infrastructure/thread_pool.h"
+#include "supersonic/cursor/proto/cursors.pb.h"
+#include "supersonic/proto/supersonic.pb.h"
+
+namespace supersonic {
+
+namespace {
+
+class ViewMorselSource : public MorselSource {
+ public:
+  explicit ViewMorselSource(const View& view)
+      : view_(view),
+        next_row_(0),
+        interrupted_(false) {}
+
+  virtual const TupleSchema& schema() const { return view_.schema(); }
+
+  virtual FailureOr<bool> NextMorsel(rowcount_t max_row_count,
+                                     Block* buffer,
+                                     View* morsel) {
+    if (interrupted_.load(std::memory_order_relaxed)) {
+      THROW(new Exception(INTERRUPTED, ""));
+    }
+    // Checked first, so that exhausted sources don't overflow next_row_.
+    if (next_row_.load(std::memory_order_relaxed) >= view_.row_count()) {
+      return Success(false);
+    }
+    const rowcount_t offset = next_row_.fetch_add(max_row_count);
+    if (offset >= view_.row_count()) return Success(false);
+    morsel->ResetFromSubRange(
+        view_, offset, std::min(max_row_count, view_.row_count() - offset));
+    return Success(true);
+  }
+
+  virtual void Interrupt() {
+    interrupted_.store(true, std::memory_order_relaxed);
+  }
+
+ private:
+  const View& view_;
+  std::atomic<rowcount_t> next_row_;
+  std::atomic<bool> interrupted_;
+  DISALLOW_COPY_AND_ASSIGN(ViewMorselSource);
+};
+
+class CursorMorselSource : public MorselSource {
+ public:
+  explicit CursorMorselSource(unique_ptr<Cursor> cursor)
+      : cursor_(std::move(cursor)),
+        copier_(cursor_->schema(), true),
+        exhausted_(false) {}
+
+  virtual const TupleSchema& schema() const { return cursor_->schema(); }
+
+  virtual FailureOr<bool> NextMorsel(rowcount_t max_row_count,
+                                     Block* buffer,
+                                     View* morsel) {
+    std::lock_guard<std::mutex> lock(mutex_);
+    if (failure_ != NULL) THROW(failure_->Clone());
+    if (exhausted_) return Success(false);
+    ResultView result = cursor_->Next(max_row_count);
+    if (result.is_eos()) {
+      exhausted_ = true;
+      return Success(false);
+    }
+    if (result.is_failure()) {
+      failure_ = result.move_exception();
+      THROW(failure_->Clone());
+    }
+    if (result.is_waiting_on_barrier()) {
+      failure_.reset(new Exception(
+          ERROR_NOT_IMPLEMENTED,
+          "Parallel pipelines don't support WAITING_ON_BARRIER in the source"));
+      THROW(failure_->Clone());
+    }
+    // The result must be copied before the lock is released, as the next
+    // call to the cursor invalidates it.
+    const rowcount_t row_count = result.view().row_count();
+    buffer->ResetArenas();
+    if (copier_.Copy(row_count, result.view(), 0, buffer) < row_count) {
+      THROW(new Exception(ERROR_MEMORY_EXCEEDED,
+                          "Can't copy the morsel into the worker's buffer"));
+    }
+    morsel->ResetFromSubRange(buffer->view(), 0, row_count);
+    return Success(true);
+  }
+
+  virtual void Interrupt() { cursor_->Interrupt(); }
+
+ private:
+  std::mutex mutex_;
+  unique_ptr<Cursor> cursor_;
+  const ViewCopier copier_;
+  bool exhausted_;
+  // If the cursor failed, a copy of the exception is returned to every
+  // subsequent caller.
+  unique_ptr<Exception> failure_;
+  DISALLOW_COPY_AND_ASSIGN(CursorMorselSource);
+};
+
+class MorselScanCursor : public BasicCursor {
+ public:
+  MorselScanCursor(MorselSource* source,
+                   rowcount_t morsel_row_count,
+                   BufferAllocator* allocator)
+      : BasicCursor(source->schema()),
+        source_(source),
+        morsel_row_count_(morsel_row_count),
+        buffer_(source->schema(), allocator) {}
+
+  FailureOrVoid Init() {
+    if (!buffer_.Reallocate(morsel_row_count_)) {
+      THROW(new Exception(ERROR_MEMORY_EXCEEDED,
+                          "Can't allocate the morsel buffer"));
+    }
+    return Success();
+  }
+
+  virtual ResultView Next(rowcount_t max_row_count) {
+    PROPAGATE_ON_FAILURE(ThrowIfInterrupted());
+    FailureOr<bool> has_morsel = source_->NextMorsel(
+        std::min(max_row_count, morsel_row_count_), &buffer_, my_view());
+    PROPAGATE_ON_FAILURE(has_morsel);
+    if (!has_morsel.get()) return ResultView::EOS();
+    return ResultView::Success(my_view());
+  }
+
+  // Also stops the other workers, as they share the source.
+  virtual void Interrupt() {
+    BasicCursor::Interrupt();
+    source_->Interrupt();
+  }
+
+  virtual CursorId GetCursorId() const { return MORSEL_SCAN; }
+
+ private:
+  MorselSource* source_;
+  const rowcount_t morsel_row_count_;
+  Block buffer_;
+  DISALLOW_COPY_AND_ASSIGN(MorselScanCursor);
+};
+
+class MorselScanOperation : public BasicOperation {
+ public:
+  MorselScanOperation(MorselSource* source, rowcount_t morsel_row_count)
+      : source_(source),
+        morsel_row_count_(morsel_row_count) {}
+
+  virtual FailureOrOwned<Cursor> CreateCursor() const {
+    return BoundMorselScan(source_, morsel_row_count_, buffer_allocator());
+  }
+
+ private:
+  MorselSource* source_;
+  const rowcount_t morsel_row_count_;
+  DISALLOW_COPY_AND_ASSIGN(MorselScanOperation);
+};
+
+// Drives the children ("workers") on the thread pool, and returns their
+// results as soon as they are ready.
+//
+// Every worker owns a few buffers, i.e. a bounded queue of views. A worker's task takes a free buffer, calls
+// the worker's Next(), deep-copies the result into the buffer, and queues it
+// for the consumer. The task then reschedules itself if the worker has
+// another free buffer; otherwise the worker stays parked until the consumer
+// returns one of its buffers. At most one task per worker is scheduled at any
+// time, so the worker cursors are never called concurrently.
+class ParallelUnionCursor : public BasicCursor {
+ public:
+  ParallelUnionCursor(const TupleSchema& schema,
+                      vector<unique_ptr<Cursor>> workers,
+                      ThreadPool* thread_pool,
+                      int buffers_per_worker,
+                      BufferAllocator* allocator)
+      : BasicCursor(schema, std::move(workers)),
+        thread_pool_(thread_pool),
+        buffers_per_worker_(buffers_per_worker),
+        allocator_(allocator),
+        copier_(schema, true),
+        workers_(children_count()),
+        stopping_(false),
+        scheduled_workers_(0),
+        active_workers_(children_count()),
+        started_(false),
+        current_(NULL),
+        current_offset_(0),
+        current_row_count_(0) {}
+
+  virtual ~ParallelUnionCursor() {
+    // Makes the workers finish quickly; the tasks refer to this object, so
+    // they must complete before it goes away.
+    BasicCursor::Interrupt();
+    std::unique_lock<std::mutex> lock(mutex_);
+    stopping_ = true;
+    condition_.wait(lock, [this] { return scheduled_workers_ == 0; });
+  }
+
+  virtual ResultView Next(rowcount_t max_row_count) {
+    PROPAGATE_ON_FAILURE(ThrowIfInterrupted());
+    if (!started_) PROPAGATE_ON_FAILURE(Start());
+    if (current_ != NULL) {
+      if (current_offset_ < current_row_count_) return Serve(max_row_count);
+      Recycle();
+    }
+    std::unique_lock<std::mutex> lock(mutex_);
+    condition_.wait(lock, [this] {
+      return !ready_.empty() || active_workers_ == 0;
+    });
+    if (ready_.empty()) return ResultView::EOS();
+    ReadyResult result = std::move(ready_.front());
+    ready_.pop_front();
+    lock.unlock();
+    if (result.exception != NULL) {
+      // Stop the remaining workers; their results are no longer needed.
+      BasicCursor::Interrupt();
+      return ResultView::Failure(result.exception.release());
+    }
+    current_ = result.buffer;
+    current_worker_ = result.worker;
+    current_offset_ = 0;
+    current_row_count_ = result.row_count;
+    return Serve(max_row_count);
+  }
+
+  virtual bool IsWaitingOnBarrierSupported() const { return false; }
+
+  virtual CursorId GetCursorId() const { return PARALLEL_UNION; }
+
+ private:
+  struct WorkerState {
+    WorkerState() : scheduled(false), done(false) {}
+    vector<Block*> free_buffers;
+    bool scheduled;
+    // Set once the worker returns EOS or a failure.
+    bool done;
+  };
+
+  // A block of results (or a failure) queued for the consumer.
+  struct ReadyResult {
+    ReadyResult(int worker, Block* buffer)
+        : worker(worker), buffer(buffer), row_count(0) {}
+    int worker;
+    Block* buffer;
+    rowcount_t row_count;
+    unique_ptr<Exception> exception;
+  };
+
+  FailureOrVoid Start() {
+    for (int i = 0; i < workers_.size(); ++i) {
+      for (int j = 0; j < buffers_per_worker_; ++j) {
+        buffers_.emplace_back(new Block(schema(), allocator_));
+        if (!buffers_.back()->Reallocate(Cursor::kDefaultRowCount)) {
+          THROW(new Exception(ERROR_MEMORY_EXCEEDED,
+                              "Can't allocate buffers for parallel workers"));
+        }
+        workers_[i].free_buffers.push_back(buffers_.back().get());
+      }
+    }
+    started_ = true;
+    std::lock_guard<std::mutex> lock(mutex_);
+    for (int i = 0; i < workers_.size(); ++i) ScheduleWorker(i);
+    return Success();
+  }
+
+  // Must be called with mutex_ held, for a worker that is not scheduled and
+  // has a free buffer.
+  void ScheduleWorker(int worker) {
+    DCHECK(!workers_[worker].scheduled);
+    DCHECK(!workers_[worker].free_buffers.empty());
+    workers_[worker].scheduled = true;
+    ++scheduled_workers_;
+    thread_pool_->Schedule([this, worker] { RunWorker(worker); });
+  }
+
+  // Executed on the pool.
+  void RunWorker(int worker) {
+    Block* buffer;
+    {
+      std::lock_guard<std::mutex> lock(mutex_);
+      if (stopping_) {
+        UnscheduleWorker(worker);
+        return;
+      }
+      buffer = workers_[worker].free_buffers.back();
+      workers_[worker].free_buffers.pop_back();
+    }
+    ReadyResult result(worker, buffer);
+    bool done = false;
+    ResultView next = child_at(worker)->Next(buffer->row_capacity());
+    if (next.has_data()) {
+      const rowcount_t row_count = next.view().row_count();
+      buffer->ResetArenas();
+      if (copier_.Copy(row_count, next.view(), 0, buffer) < row_count) {
+        result.exception.reset(new Exception(
+            ERROR_MEMORY_EXCEEDED, "Can't copy the results of a worker"));
+      }
+      result.row_count = row_count;
+    } else if (next.is_failure()) {
+      result.exception = next.move_exception();
+    } else if (next.is_waiting_on_barrier()) {
+      result.exception.reset(new Exception(
+          ERROR_NOT_IMPLEMENTED,
+          "Parallel workers don't support WAITING_ON_BARRIER"));
+    } else {
+      DCHECK(next.is_eos());
+      done = true;
+    }
+    done |= (result.exception != NULL);
+
+    std::lock_guard<std::mutex> lock(mutex_);
+    if (next.is_eos()) {
+      workers_[worker].free_buffers.push_back(buffer);
+    } else {
+      ready_.push_back(std::move(result));
+    }
+    if (done) {
+      workers_[worker].done = true;
+      --active_workers_;
+    }
+    if (!done && !stopping_ && !workers_[worker].free_buffers.empty()) {
+      thread_pool_->Schedule([this, worker] { RunWorker(worker); });
+    } else {
+      UnscheduleWorker(worker);
+    }
+    condition_.notify_all();
+  }
+
+  // Must be called with mutex_ held.
+  void UnscheduleWorker(int worker) {
+    workers_[worker].scheduled = false;
+    --scheduled_workers_;
+    condition_.notify_all();
+  }
+
+  // Returns the current buffer to its worker, and wakes the worker up if it
+  // was parked.
+  void Recycle() {
+    std::lock_guard<std::mutex> lock(mutex_);
+    WorkerState* state = &workers_[current_worker_];
+    state->free_buffers.push_back(current_);
+    current_ = NULL;
+    if (!state->scheduled && !state->done && !stopping_) {
+      ScheduleWorker(current_worker_);
+    }
+  }
+
+  ResultView Serve(rowcount_t max_row_count) {
+    const rowcount_t row_count =
+        std::min(max_row_count, current_row_count_ - current_offset_);
+    my_view()->ResetFromSubRange(current_->view(), current_offset_, row_count);
+    current_offset_ += row_count;
+    return ResultView::Success(my_view());
+  }
+
+  ThreadPool* const thread_pool_;
+  const int buffers_per_worker_;
+  BufferAllocator* const allocator_;
+  const ViewCopier copier_;
+  vector<unique_ptr<Block>> buffers_;
+
+  // Guards the fields below, up to started_.
+  std::mutex mutex_;
+  // Signalled when a result is queued, and when a worker gets unscheduled.
+  std::condition_variable condition_;
+  vector<WorkerState> workers_;
+  std::deque<ReadyResult> ready_;
+  bool stopping_;
+  int scheduled_workers_;
+  int active_workers_;
+
+  // Accessed by the consumer only.
+  bool started_;
+  Block* current_;
+  int current_worker_;
+  rowcount_t current_offset_;
+  rowcount_t current_row_count_;
+
+  DISALLOW_COPY_AND_ASSIGN(ParallelUnionCursor);
+};
+
+class ParallelPipelineOperation : public ParallelOperation {
+ public:
+  ParallelPipelineOperation(unique_ptr<const ParallelOptions> options,
+                            unique_ptr<const PipelineFactory> pipeline_factory,
+                            unique_ptr<Operation> source)
+      : ParallelOperation(std::move(source)),
+        options_(std::move(options)),
+        pipeline_factory_(std::move(pipeline_factory)),
+        view_(NULL) {}
+
+  ParallelPipelineOperation(unique_ptr<const ParallelOptions> options,
+                            unique_ptr<const PipelineFactory> pipeline_factory,
+                            const View& view)
+      : options_(std::move(options)),
+        pipeline_factory_(std::move(pipeline_factory)),
+        view_(&view) {}
+
+  virtual FailureOrOwned<Cursor> CreateCursor() const {
+    unique_ptr<MorselSource> source;
+    if (view_ != NULL) {
+      source = CreateViewMorselSource(*view_);
+    } else {
+      FailureOrOwned<Cursor> source_cursor = child()->CreateCursor();
+      PROPAGATE_ON_FAILURE(source_cursor);
+      source = CreateCursorMorselSource(source_cursor.move());
+    }
+    unique_ptr<ThreadPool> owned_thread_pool;
+    ThreadPool* thread_pool = options_->thread_pool();
+    int parallelism = options_->parallelism();
+    if (thread_pool == NULL) {
+      owned_thread_pool.reset(new ThreadPool(
+          parallelism > 0 ? parallelism : ThreadPool::DefaultNumThreads()));
+      thread_pool = owned_thread_pool.get();
+    }
+    if (parallelism <= 0) parallelism = thread_pool->num_threads();
+
+    vector<unique_ptr<Cursor>> workers;
+    for (int i = 0; i < parallelism; ++i) {
+      unique_ptr<Operation> pipeline = pipeline_factory_->CreatePipeline(
+          make_unique<MorselScanOperation>(source.get(),
+                                           options_->morsel_row_count()));
+      pipeline->SetBufferAllocatorWhereUnset(buffer_allocator(), true);
+      FailureOrOwned<Cursor> worker = pipeline->CreateCursor();
+      PROPAGATE_ON_FAILURE(worker);
+      workers.push_back(TakeOwnership(worker.move(), std::move(pipeline)));
+    }
+    FailureOrOwned<Cursor> result = BoundParallelUnion(
+        *options_, thread_pool, buffer_allocator(), std::move(workers));
+    PROPAGATE_ON_FAILURE(result);
+    // The source and the pool must outlive the workers.
+    return Success(TakeOwnership(result.move(),
+                                 std::move(source),
+                                 std::move(owned_thread_pool)));
+  }
+
+ private:
+  unique_ptr<const ParallelOptions> options_;
+  unique_ptr<const PipelineFactory> pipeline_factory_;
+  // If not NULL, the source is the view rather than the child.
+  const View* view_;
+  DISALLOW_COPY_AND_ASSIGN(ParallelPipelineOperation);
+};
+
+class ParallelUnionOperation : public ParallelOperation {
+ public:
+  ParallelUnionOperation(unique_ptr<const ParallelOptions> options,
+                         vector<unique_ptr<Operation>> children)
+      : ParallelOperation(std::move(children)),
+        options_(std::move(options)) {}
+
+  virtual FailureOrOwned<Cursor> CreateCursor() const {
+    vector<unique_ptr<Cursor>> inputs;
+    for (int i = 0; i < children_count(); ++i) {
+      FailureOrOwned<Cursor> input = child_at(i)->CreateCursor();
+      PROPAGATE_ON_FAILURE(input);
+      inputs.push_back(input.move());
+    }
+    unique_ptr<ThreadPool> owned_thread_pool;
+    ThreadPool* thread_pool = options_->thread_pool();
+    if (thread_pool == NULL) {
+      const int num_threads = options_->parallelism() > 0
+          ? options_->parallelism()
+          : std::max<int>(1, children_count());
+      owned_thread_pool.reset(new ThreadPool(num_threads));
+      thread_pool = owned_thread_pool.get();
+    }
+    FailureOrOwned<Cursor> result = BoundParallelUnion(
+        *options_, thread_pool, buffer_allocator(), std::move(inputs));
+    PROPAGATE_ON_FAILURE(result);
+    return Success(TakeOwnership(result.move(), std::move(owned_thread_pool)));
+  }
+
+ private:
+  unique_ptr<const ParallelOptions> options_;
+  DISALLOW_COPY_AND_ASSIGN(ParallelUnionOperation);
+};
+
+}  // namespace
+
+void ParallelOperation::SetBufferAllocator(BufferAllocator* buffer_allocator,
+                                           bool cascade_to_children) {
+  BasicOperation::SetBufferAllocator(Synchronize(buffer_allocator),
+                                     cascade_to_children);
+}
+
+void ParallelOperation::SetBufferAllocatorWhereUnset(
+    BufferAllocator* buffer_allocator, bool cascade_to_children) {
+  BasicOperation::SetBufferAllocatorWhereUnset(Synchronize(buffer_allocator),
+                                               cascade_to_children);
+}
+
+BufferAllocator* ParallelOperation::Synchronize(
+    BufferAllocator* buffer_allocator) {
+  synchronized_allocators_.emplace_back(
+      new ThreadSafeBufferAllocator<BufferAllocator>(buffer_allocator));
+  return synchronized_allocators_.back().get();
+}
+
+unique_ptr<MorselSource> CreateViewMorselSource(const View& view) {
+  return make_unique<ViewMorselSource>(view);
+}
+
+unique_ptr<MorselSource> CreateCursorMorselSource(unique_ptr<Cursor> cursor) {
+  return make_unique<CursorMorselSource>(std::move(cursor));
+}
+
+FailureOrOwned<Cursor> BoundMorselScan(MorselSource* source,
+                                       rowcount_t morsel_row_count,
+                                       BufferAllocator* allocator) {
+  if (morsel_row_count == 0 || morsel_row_count > Cursor::kDefaultRowCount) {
+    THROW(new Exception(ERROR_INVALID_ARGUMENT_VALUE,
+                        "Morsel row count must be in [1, kDefaultRowCount]"));
+  }
+  unique_ptr<MorselScanCursor> cursor(
+      new MorselScanCursor(source, morsel_row_count, allocator));
+  PROPAGATE_ON_FAILURE(cursor->Init());
+  return Success(std::move(cursor));
+}
+
+FailureOrOwned<Cursor> BoundParallelUnion(
+    const ParallelOptions& options,
+    ThreadPool* thread_pool,
+    BufferAllocator* allocator,
+    vector<unique_ptr<Cursor>> inputs) {
+  if (inputs.empty()) {
+    THROW(new Exception(ERROR_INVALID_ARGUMENT_VALUE,
+                        "Parallel union needs at least one input"));
+  }
+  if (options.buffers_per_worker() <= 0) {
+    THROW(new Exception(ERROR_INVALID_ARGUMENT_VALUE,
+                        "Parallel union needs at least one buffer per input"));
+  }
+  const TupleSchema schema = inputs[0]->schema();
+  for (const unique_ptr<Cursor>& input : inputs) {
+    if (!TupleSchema::AreEqual(schema, input->schema(), false)) {
+      THROW(new Exception(ERROR_ATTRIBUTE_TYPE_MISMATCH,
+                          "Inputs of parallel union have different schemas"));
+    }
+  }
+  return Success(make_unique<ParallelUnionCursor>(
+      schema, std::move(inputs), thread_pool,
+      options.buffers_per_worker(), allocator));
+}
+
+unique_ptr<Operation> ParallelUnion(
+    unique_ptr<const ParallelOptions> options,
+    vector<unique_ptr<Operation>> children) {
+  return make_unique<ParallelUnionOperation>(std::move(options),
+                                             std::move(children));
+}
+
+unique_ptr<Operation> ParallelPipeline(
+    unique_ptr<const ParallelOptions> options,
+    unique_ptr<const PipelineFactory> pipeline_factory,
+    unique_ptr<Operation> source) {
+  return make_unique<ParallelPipelineOperation>(
+      std::move(options), std::move(pipeline_factory), std::move(source));
+}
+
+unique_ptr<Operation> ParallelPipelineOverView(
+    unique_ptr<const ParallelOptions> options,
+    unique_ptr<const PipelineFactory> pipeline_factory,
+    const View& view) {
+  return make_unique<ParallelPipelineOperation>(
+      std::move(options), std::move(pipeline_factory), view);
+}
+
+}  // namespace supersonic
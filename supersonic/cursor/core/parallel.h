@@ -0,0 +1,235 @@
+// Copyright 2012 Google Inc. All Rights Reserved.
+//
+// Licensed under the Apache License, Version 2.0 (the "License");
+// you may not use this file except in compliance with the License.
+// You may obtain a copy of the License at
+//
+//     http://www.apache.org/licenses/LICENSE-2.0
+//
+// Unless required by applicable law or agreed to in writing, software
+// distributed under the License is distributed on an "AS IS" BASIS,
+// WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+// See the License for the specific language governing permissions and
+// limitations under the License.
+//
+// Parallel execution of cursors.
+//
+// ParallelUnion runs each of its inputs on a separate thread, and returns the
+// union of their outputs as soon as the blocks are ready.
+//
+// ParallelPipeline is a morsel-driven parallel execution of a pipeline. A
+// pipeline (e.g. Filter -> Compute -> Project) is instantiated once per
+// worker. Every worker's leaf pulls small chunks of rows ("morsels") from
+// a source shared by all the workers, and the worker cursors are driven by
+// tasks on a work-stealing ThreadPool. The results are returned, in no
+// particular order, by a single consumer-side cursor.
+//
+// All the cursors are created on the caller's thread, but their Next() is
+// called from the pool's threads (never concurrently for a single cursor).
+// The parallel operations serialize their own calls to the buffer allocator,
+// but if the same allocator is also used concurrently elsewhere (e.g. by the
+// cursors consuming the results) it must be thread-safe; HeapBufferAllocator
+// is, but MemoryLimit is not (use ThreadSafeMemoryLimit instead). The bound
+// (cursor-level) functions require a thread-safe allocator.
+
+#ifndef SUPERSONIC_CURSOR_CORE_PARALLEL_H_
+#define SUPERSONIC_CURSOR_CORE_PARALLEL_H_
+
+#include <stddef.h>
+
+#include <vector>
+using std::vector;
+
+#include "supersonic/utils/std_namespace.h"
+#include "supersonic/base/exception/result.h"
+#include "supersonic/base/infrastructure/types.h"
+#include "supersonic/cursor/base/cursor.h"
+#include "supersonic/cursor/infrastructure/basic_operation.h"
+#include "supersonic/utils/macros.h"
+
+namespace supersonic {
+
+class Block;
+class BufferAllocator;
+class Operation;
+class ThreadPool;
+class TupleSchema;
+class View;
+
+// Options of the parallel execution.
+class ParallelOptions {
+ public:
+  ParallelOptions()
+      : parallelism_(0),
+        morsel_row_count_(Cursor::kDefaultRowCount),
+        buffers_per_worker_(2),
+        thread_pool_(NULL) {}
+
+  // For ParallelPipeline, the number of workers (pipeline instances); 0 (the
+  // default) means as many as there are threads in the thread pool. For
+  // ParallelUnion, the number of threads of the private pool; 0 means one
+  // thread per input.
+  ParallelOptions* set_parallelism(int parallelism) {
+    parallelism_ = parallelism;
+    return this;
+  }
+  int parallelism() const { return parallelism_; }
+
+  // Maximum number of rows in a single morsel taken from the source. Must not
+  // exceed Cursor::kDefaultRowCount.
+  ParallelOptions* set_morsel_row_count(rowcount_t morsel_row_count) {
+    morsel_row_count_ = morsel_row_count;
+    return this;
+  }
+  rowcount_t morsel_row_count() const { return morsel_row_count_; }
+
+  // Number of result blocks each worker (or union input) can fill before it
+  // has to wait for the consumer. Bounds the memory used for the results in
+  // flight.
+  ParallelOptions* set_buffers_per_worker(int buffers_per_worker) {
+    buffers_per_worker_ = buffers_per_worker;
+    return this;
+  }
+  int buffers_per_worker() const { return buffers_per_worker_; }
+
+  // The pool to run the workers on. Doesn't take ownership; the pool must
+  // outlive all the cursors created with these options. If not set (the
+  // default), every cursor creates a private pool (see parallelism(); for
+  // ParallelPipeline with parallelism() of 0, the pool has
+  // ThreadPool::DefaultNumThreads() threads).
+  ParallelOptions* set_thread_pool(ThreadPool* thread_pool) {
+    thread_pool_ = thread_pool;
+    return this;
+  }
+  ThreadPool* thread_pool() const { return thread_pool_; }
+
+ private:
+  int parallelism_;
+  rowcount_t morsel_row_count_;
+  int buffers_per_worker_;
+  ThreadPool* thread_pool_;
+  DISALLOW_COPY_AND_ASSIGN(ParallelOptions);
+};
+
+// Base for the operations whose cursors run on multiple threads. The
+// allocator is used by the workers concurrently, so the calls to it are
+// serialized. The wrappers are kept until the operation is destroyed, as
+// cursors created earlier may still refer to them.
+class ParallelOperation : public BasicOperation {
+ public:
+  virtual void SetBufferAllocator(BufferAllocator* buffer_allocator,
+                                  bool cascade_to_children);
+
+  virtual void SetBufferAllocatorWhereUnset(BufferAllocator* buffer_allocator,
+                                            bool cascade_to_children);
+
+ protected:
+  ParallelOperation() {}
+  explicit ParallelOperation(unique_ptr<Operation> child)
+      : BasicOperation(std::move(child)) {}
+  explicit ParallelOperation(vector<unique_ptr<Operation>> children)
+      : BasicOperation(std::move(children)) {}
+
+ private:
+  BufferAllocator* Synchronize(BufferAllocator* buffer_allocator);
+
+  vector<unique_ptr<BufferAllocator>> synchronized_allocators_;
+  DISALLOW_COPY_AND_ASSIGN(ParallelOperation);
+};
+
+// A thread-safe source of morsels, shared by all the workers of a parallel
+// pipeline.
+class MorselSource {
+ public:
+  virtual ~MorselSource() {}
+
+  virtual const TupleSchema& schema() const = 0;
+
+  // Sets the morsel to the next (at most max_row_count) rows of the source.
+  // Returns false if the source is exhausted. The buffer belongs to the
+  // calling worker; it has the source's schema and at least max_row_count
+  // rows of capacity, and the source may copy the rows there. The morsel
+  // remains valid until the next call with the same buffer. Can be called
+  // concurrently from multiple threads.
+  virtual FailureOr<bool> NextMorsel(rowcount_t max_row_count,
+                                     Block* buffer,
+                                     View* morsel) = 0;
+
+  // Requests the source to stop. Thread-safe.
+  virtual void Interrupt() = 0;
+
+ protected:
+  MorselSource() {}
+
+ private:
+  DISALLOW_COPY_AND_ASSIGN(MorselSource);
+};
+
+// Creates a source that splits the view into morsels without copying. The view
+// must outlive the source.
+unique_ptr<MorselSource> CreateViewMorselSource(const View& view);
+
+// Creates a source that reads from the cursor. Calls to the cursor are
+// serialized, and the data is copied into the workers' buffers. Takes
+// ownership of the cursor. The cursor must not return WAITING_ON_BARRIER.
+unique_ptr<MorselSource> CreateCursorMorselSource(unique_ptr<Cursor> cursor);
+
+// Creates a cursor that iterates over the morsels taken from the source.
+// Doesn't take ownership of the source nor the allocator.
+FailureOrOwned<Cursor> BoundMorselScan(MorselSource* source,
+                                       rowcount_t morsel_row_count,
+                                       BufferAllocator* allocator);
+
+// Builds the pipeline executed by a single worker.
+class PipelineFactory {
+ public:
+  virtual ~PipelineFactory() {}
+
+  // Returns the pipeline that consumes the input. Called once per worker (and
+  // per cursor creation); the input is the worker's morsel scan. Must be
+  // thread-compatible, i.e. create independent operations every time.
+  virtual unique_ptr<Operation> CreatePipeline(
+      unique_ptr<Operation> input) const = 0;
+};
+
+// Creates an operation that runs the pipeline built by the factory in
+// parallel over the data of the source. The output is the union of the
+// outputs of all the pipeline instances, in an unspecified order.
+unique_ptr<Operation> ParallelPipeline(
+    unique_ptr<const ParallelOptions> options,
+    unique_ptr<const PipelineFactory> pipeline_factory,
+    unique_ptr<Operation> source);
+
+// Same as above, but with the source scanning (without copying) over the view.
+// The view must outlive the operation and the cursors it creates.
+unique_ptr<Operation> ParallelPipelineOverView(
+    unique_ptr<const ParallelOptions> options,
+    unique_ptr<const PipelineFactory> pipeline_factory,
+    const View& view);
+
+// Creates an operation that returns the union of the outputs of the children,
+// in an unspecified order. Each child's cursor is driven on its own thread (or
+// a task on the pool set in the options), and the blocks are returned to the
+// consumer as soon as they are ready. The children must have identical
+// schemas (attribute names of the result are taken from the first child).
+// Useful when the input is already partitioned, e.g. one FileInput per shard.
+// The children must not return WAITING_ON_BARRIER.
+unique_ptr<Operation> ParallelUnion(
+    unique_ptr<const ParallelOptions> options,
+    vector<unique_ptr<Operation>> children);
+
+// Cursor version of the above. The inputs' cursors are driven by tasks on the
+// pool; at most one task per input is scheduled at any time. Takes ownership
+// of the inputs. Doesn't take ownership of the pool nor the allocator; the
+// pool must outlive the cursor. The allocator must be thread-safe. Beware of
+// nesting the parallel cursors on a single pool: a task blocked waiting for
+// the results of other tasks on the same pool may deadlock.
+FailureOrOwned<Cursor> BoundParallelUnion(
+    const ParallelOptions& options,
+    ThreadPool* thread_pool,
+    BufferAllocator* allocator,
+    vector<unique_ptr<Cursor>> inputs);
+
+}  // namespace supersonic
+
+#endif  // SUPERSONIC_CURSOR_CORE_PARALLEL_H_
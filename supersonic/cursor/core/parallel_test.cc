@@ -0,0 +1,303 @@
+// Copyright 2012 Google Inc. All Rights Reserved.
+//
+// Licensed under the Apache License, Version 2.0 (the "License");
+// you may not use this file except in compliance with the License.
+// You may obtain a copy of the License at
+//
+//     http://www.apache.org/licenses/LICENSE-2.0
+//
+// Unless required by applicable law or agreed to in writing, software
+// distributed under the License is distributed on an "AS IS" BASIS,
+// WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+// See the License for the specific language governing permissions and
+// limitations under the License.
+//
+
+#include "supersonic/cursor/core/parallel.h"
+
+#include <memory>
+#include "supersonic/utils/std_namespace.h"
+#include <vector>
+using std::vector;
+
+#include "supersonic/base/exception/exception.h"
+#include "supersonic/base/infrastructure/block.h"
+#include "supersonic/base/infrastructure/projector.h"
+#include "supersonic/base/infrastructure/types.h"
+#include "supersonic/base/memory/memory.h"
+#include "supersonic/cursor/base/cursor.h"
+#include "supersonic/cursor/base/operation.h"
+#include "supersonic/cursor/core/filter.h"
+#include "supersonic/cursor/core/scan_view.h"
+#include "supersonic/cursor/infrastructure/thread_pool.h"
+#include "supersonic/cursor/proto/cursors.pb.h"
+#include "supersonic/expression/core/arithmetic_expressions.h"
+#include "supersonic/expression/core/comparison_expressions.h"
+#include "supersonic/expression/core/projecting_expressions.h"
+#include "supersonic/expression/infrastructure/terminal_expressions.h"
+#include "supersonic/proto/supersonic.pb.h"
+#include "supersonic/testing/block_builder.h"
+#include "supersonic/testing/operation_testing.h"
+#include "gtest/gtest.h"
+
+namespace supersonic {
+
+namespace {
+
+class IdentityPipelineFactory : public PipelineFactory {
+ public:
+  virtual unique_ptr<Operation> CreatePipeline(
+      unique_ptr<Operation> input) const {
+    return input;
+  }
+};
+
+// Keeps the rows where col0 is divisible by 3.
+class FilterPipelineFactory : public PipelineFactory {
+ public:
+  virtual unique_ptr<Operation> CreatePipeline(
+      unique_ptr<Operation> input) const {
+    return Filter(Equal(Modulus(AttributeAt(0), ConstInt64(3)), ConstInt64(0)),
+                  ProjectAllAttributes(),
+                  std::move(input));
+  }
+};
+
+unique_ptr<const ParallelOptions> CreateOptions(int parallelism,
+                                                rowcount_t morsel_row_count) {
+  unique_ptr<ParallelOptions> options(new ParallelOptions);
+  options->set_parallelism(parallelism)
+         ->set_morsel_row_count(morsel_row_count);
+  return std::move(options);
+}
+
+class ParallelPipelineTest : public testing::Test {
+ protected:
+  virtual void SetUp() {
+    BlockBuilder<INT64, STRING> builder;
+    TestDataBuilder<INT64, STRING> expected_builder;
+    for (int64_t i = 0; i < 10000; ++i) {
+      const string value = (i % 2 == 0) ? "even" : "odd";
+      builder.AddRow(i, value);
+      if (i % 3 == 0) expected_builder.AddRow(i, value);
+    }
+    input_ = builder.Build();
+    expected_ = expected_builder.Build();
+  }
+
+  // Returns the number of rows, or -1 on failure.
+  int64_t CountRows(Cursor* cursor) {
+    int64_t row_count = 0;
+    while (true) {
+      ResultView result = cursor->Next(Cursor::kDefaultRowCount);
+      if (result.is_eos()) return row_count;
+      if (!result.has_data()) return -1;
+      row_count += result.view().row_count();
+    }
+  }
+
+  unique_ptr<Block> input_;
+  unique_ptr<Operation> expected_;
+};
+
+TEST_F(ParallelPipelineTest, FilterOverView) {
+  OperationTest test;
+  test.SetExpectedResult(std::move(expected_));
+  test.SetIgnoreRowOrder(true);
+  test.SkipBarrierHandlingChecks(true);
+  test.Execute(ParallelPipelineOverView(
+      CreateOptions(4, 100),
+      make_unique<FilterPipelineFactory>(),
+      input_->view()));
+}
+
+TEST_F(ParallelPipelineTest, FilterOverCursor) {
+  OperationTest test;
+  test.SetExpectedResult(std::move(expected_));
+  test.SetIgnoreRowOrder(true);
+  test.SkipBarrierHandlingChecks(true);
+  test.Execute(ParallelPipeline(
+      CreateOptions(3, 1000),
+      make_unique<FilterPipelineFactory>(),
+      ScanView(input_->view())));
+}
+
+TEST_F(ParallelPipelineTest, PassThroughWithNulls) {
+  TestDataBuilder<INT32, STRING> builder;
+  for (int i = 0; i < 3000; ++i) {
+    if (i % 7 == 0) {
+      builder.AddRow(__, "seven");
+    } else {
+      builder.AddRow(i, __);
+    }
+  }
+  OperationTest test;
+  test.SetInput(builder.Build());
+  test.SetExpectedResult(builder.Build());
+  test.SetIgnoreRowOrder(true);
+  test.SkipBarrierHandlingChecks(true);
+  test.Execute(ParallelPipeline(
+      CreateOptions(2, Cursor::kDefaultRowCount),
+      make_unique<IdentityPipelineFactory>(),
+      test.input()));
+}
+
+TEST_F(ParallelPipelineTest, MoreWorkersThanThreads) {
+  ThreadPool thread_pool(2);
+  unique_ptr<ParallelOptions> options(new ParallelOptions);
+  options->set_parallelism(7)
+         ->set_morsel_row_count(10)
+         ->set_buffers_per_worker(1)
+         ->set_thread_pool(&thread_pool);
+  unique_ptr<Operation> parallel(ParallelPipelineOverView(
+      std::move(options), make_unique<FilterPipelineFactory>(),
+      input_->view()));
+  for (int i = 0; i < 3; ++i) {
+    unique_ptr<Cursor> cursor(SucceedOrDie(parallel->CreateCursor()));
+    EXPECT_EQ(3334, CountRows(cursor.get()));
+  }
+}
+
+TEST_F(ParallelPipelineTest, DestroyedBeforeExhausted) {
+  unique_ptr<Operation> parallel(ParallelPipelineOverView(
+      CreateOptions(4, 10), make_unique<FilterPipelineFactory>(),
+      input_->view()));
+  unique_ptr<Cursor> cursor(SucceedOrDie(parallel->CreateCursor()));
+  EXPECT_TRUE(cursor->Next(1).has_data());
+}
+
+TEST_F(ParallelPipelineTest, SourceFailurePropagated) {
+  unique_ptr<Operation> parallel(ParallelPipeline(
+      CreateOptions(3, 10), make_unique<IdentityPipelineFactory>(),
+      TestDataBuilder<INT64>()
+          .AddRow(1).AddRow(2).AddRow(3)
+          .ReturnException(ERROR_GENERAL_IO_ERROR)
+          .Build()));
+  unique_ptr<Cursor> cursor(SucceedOrDie(parallel->CreateCursor()));
+  ResultView result = ResultView::EOS();
+  do {
+    result = cursor->Next(Cursor::kDefaultRowCount);
+  } while (result.has_data());
+  ASSERT_TRUE(result.is_failure());
+  EXPECT_EQ(ERROR_GENERAL_IO_ERROR, result.exception().return_code());
+}
+
+TEST_F(ParallelPipelineTest, Interrupted) {
+  unique_ptr<Operation> parallel(ParallelPipelineOverView(
+      CreateOptions(2, 10), make_unique<FilterPipelineFactory>(),
+      input_->view()));
+  unique_ptr<Cursor> cursor(SucceedOrDie(parallel->CreateCursor()));
+  EXPECT_TRUE(cursor->Next(10).has_data());
+  cursor->Interrupt();
+  ResultView result = cursor->Next(10);
+  ASSERT_TRUE(result.is_failure());
+  EXPECT_EQ(INTERRUPTED, result.exception().return_code());
+}
+
+TEST_F(ParallelPipelineTest, WorkersWithDifferentSchemasRejected) {
+  ThreadPool thread_pool(1);
+  unique_ptr<Operation> int_data(TestDataBuilder<INT64>().AddRow(1).Build());
+  unique_ptr<Operation> string_data(
+      TestDataBuilder<STRING>().AddRow("a").Build());
+  vector<unique_ptr<Cursor>> workers;
+  workers.push_back(SucceedOrDie(int_data->CreateCursor()));
+  workers.push_back(SucceedOrDie(string_data->CreateCursor()));
+  FailureOrOwned<Cursor> result = BoundParallelUnion(
+      ParallelOptions(), &thread_pool, HeapBufferAllocator::Get(),
+      std::move(workers));
+  ASSERT_TRUE(result.is_failure());
+  EXPECT_EQ(ERROR_ATTRIBUTE_TYPE_MISMATCH, result.exception().return_code());
+}
+
+// The range must contain a multiple of 5, so that the schemas are identical.
+unique_ptr<Operation> CreateUnionInput(int begin, int end) {
+  TestDataBuilder<INT32, STRING> builder;
+  for (int i = begin; i < end; ++i) {
+    if (i % 5 == 0) {
+      builder.AddRow(i, __);
+    } else {
+      builder.AddRow(i, "row");
+    }
+  }
+  return builder.Build();
+}
+
+TEST(ParallelUnionTest, UnionOfInputs) {
+  OperationTest test;
+  test.AddInput(CreateUnionInput(0, 1000));
+  test.AddInput(CreateUnionInput(1000, 1001));
+  test.AddInput(CreateUnionInput(1001, 1011));
+  test.AddInput(CreateUnionInput(1011, 5000));
+  test.SetExpectedResult(CreateUnionInput(0, 5000));
+  test.SetIgnoreRowOrder(true);
+  test.SkipBarrierHandlingChecks(true);
+  vector<unique_ptr<Operation>> inputs;
+  for (int i = 0; i < 4; ++i) inputs.push_back(test.input_at(i));
+  test.Execute(ParallelUnion(make_unique<ParallelOptions>(),
+                             std::move(inputs)));
+}
+
+TEST(ParallelUnionTest, SharedThreadPool) {
+  ThreadPool thread_pool(1);
+  vector<unique_ptr<Operation>> inputs;
+  for (int i = 0; i < 5; ++i) {
+    inputs.push_back(CreateUnionInput(i * 3000, (i + 1) * 3000));
+  }
+  unique_ptr<ParallelOptions> options(new ParallelOptions);
+  options->set_buffers_per_worker(1)->set_thread_pool(&thread_pool);
+  unique_ptr<Operation> parallel_union(
+      ParallelUnion(std::move(options), std::move(inputs)));
+  unique_ptr<Cursor> cursor(SucceedOrDie(parallel_union->CreateCursor()));
+  int64_t row_count = 0;
+  ResultView result = ResultView::EOS();
+  while ((result = cursor->Next(Cursor::kDefaultRowCount)).has_data()) {
+    row_count += result.view().row_count();
+  }
+  EXPECT_TRUE(result.is_eos());
+  EXPECT_EQ(15000, row_count);
+}
+
+TEST(ParallelUnionTest, InputFailurePropagated) {
+  vector<unique_ptr<Operation>> inputs;
+  inputs.push_back(CreateUnionInput(0, 100));
+  inputs.push_back(TestDataBuilder<INT32, STRING>()
+                   .AddRow(1, __)
+                   .ReturnException(ERROR_GENERAL_IO_ERROR)
+                   .Build());
+  unique_ptr<Operation> parallel_union(
+      ParallelUnion(make_unique<ParallelOptions>(), std::move(inputs)));
+  unique_ptr<Cursor> cursor(SucceedOrDie(parallel_union->CreateCursor()));
+  ResultView result = ResultView::EOS();
+  do {
+    result = cursor->Next(Cursor::kDefaultRowCount);
+  } while (result.has_data());
+  ASSERT_TRUE(result.is_failure());
+  EXPECT_EQ(ERROR_GENERAL_IO_ERROR, result.exception().return_code());
+}
+
+TEST(ParallelUnionTest, DifferentSchemasRejected) {
+  OperationTest test;
+  test.AddInput(TestDataBuilder<INT32>().AddRow(1).Build());
+  test.AddInput(TestDataBuilder<STRING>().AddRow("a").Build());
+  test.SetExpectedBindFailure(ERROR_ATTRIBUTE_TYPE_MISMATCH);
+  vector<unique_ptr<Operation>> inputs;
+  inputs.push_back(test.input_at(0));
+  inputs.push_back(test.input_at(1));
+  test.Execute(ParallelUnion(make_unique<ParallelOptions>(),
+                             std::move(inputs)));
+}
+
+TEST(ParallelUnionTest, CursorIdIsParallelUnion) {
+  ThreadPool thread_pool(1);
+  unique_ptr<Operation> data(TestDataBuilder<INT32>().AddRow(1).Build());
+  vector<unique_ptr<Cursor>> inputs;
+  inputs.push_back(SucceedOrDie(data->CreateCursor()));
+  unique_ptr<Cursor> cursor(SucceedOrDie(BoundParallelUnion(
+      ParallelOptions(), &thread_pool, HeapBufferAllocator::Get(),
+      std::move(inputs))));
+  EXPECT_EQ(PARALLEL_UNION, cursor->GetCursorId());
+}
+
+}  // namespace
+
+}  // namespace supersonic
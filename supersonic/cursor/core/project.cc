@@ -45,7 +45,20 @@ class ProjectCursor : public BasicCursor {
         result_view_(projector_->result_schema()) {}
 
   virtual ResultView Next(rowcount_t max_row_count) {
-    ResultView next_result = child()->Next(max_row_count);
+    return ProjectResult(child()->Next(max_row_count));
+  }
+
+  // Passes the child's selection vector on.
+  virtual ResultView NextSelected(rowcount_t max_row_count) {
+    return ProjectResult(child()->NextSelected(max_row_count));
+  }
+
+  virtual bool IsWaitingOnBarrierSupported() const { return true; }
+
+  virtual CursorId GetCursorId() const { return PROJECT; }
+
+ private:
+  ResultView ProjectResult(ResultView next_result) {
     PROPAGATE_ON_FAILURE(next_result);
     if (!next_result.has_data()) {
       CHECK(next_result.is_eos() || next_result.is_waiting_on_barrier());
@@ -53,14 +66,10 @@ class ProjectCursor : public BasicCursor {
     }
     projector_->Project(next_result.view(), &result_view_);
     result_view_.set_row_count(next_result.view().row_count());
+    result_view_.set_selection(next_result.view().selection());
     return ResultView::Success(&result_view_);
   }
 
-  virtual bool IsWaitingOnBarrierSupported() const { return true; }
-
-  virtual CursorId GetCursorId() const { return PROJECT; }
-
- private:
   unique_ptr<const BoundSingleSourceProjector> projector_;
   View result_view_;
 
@@ -21,8 +21,14 @@
 #include "supersonic/base/infrastructure/projector.h"
 #include "supersonic/cursor/base/cursor.h"
 #include "supersonic/cursor/base/operation.h"
+#include "supersonic/cursor/core/filter.h"
 #include "supersonic/cursor/core/ownership_taker.h"
+#include "supersonic/cursor/core/scan_view.h"
+#include "supersonic/expression/core/comparison_expressions.h"
+#include "supersonic/expression/core/projecting_expressions.h"
+#include "supersonic/expression/infrastructure/terminal_expressions.h"
 #include "supersonic/proto/supersonic.pb.h"
+#include "supersonic/testing/block_builder.h"
 #include "supersonic/testing/operation_testing.h"
 #include "gtest/gtest.h"
 
@@ -85,4 +91,22 @@ TEST_F(ProjectCursorTest, InvalidProjectorSpecification) {
   EXPECT_TRUE(projector.is_failure());
 }
 
+TEST_F(ProjectCursorTest, SelectionPassedOn) {
+  std::unique_ptr<Block> input(BlockBuilder<INT32, STRING>()
+                               .AddRow(1, "foo")
+                               .AddRow(3, "bar")
+                               .Build());
+  std::unique_ptr<Cursor> project = SucceedOrDie(TurnIntoCursor(
+      Project(ProjectNamedAttribute("col1"),
+              Filter(Greater(NamedAttribute("col0"), ConstInt32(2)),
+                     ProjectAllAttributes(),
+                     ScanView(input->view())))));
+  ResultView result = project->NextSelected(Cursor::kDefaultRowCount);
+  ASSERT_TRUE(result.has_data());
+  ASSERT_EQ(1, result.view().row_count());
+  ASSERT_TRUE(result.view().selection() != NULL);
+  EXPECT_EQ(1, result.view().row_position(0));
+  EXPECT_EQ(input->view().column(1).data(), result.view().column(0).data());
+}
+
 }  // namespace supersonic
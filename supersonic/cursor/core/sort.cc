@@ -82,6 +82,18 @@
 // sophisticated sort (e.g. radix sort), but I would not expect spectacular
 // results (after all, if there was a faster sort, gcc would likely use it in
 // its STL implementation).
+//
+// If all the sort key columns are of fixed-width types, the column-wise sort is
+// replaced altogether: the key columns are encoded into normalized keys (see
+// normalized_key.h), byte strings that compare with memcmp in the sort order,
+// and the rows are radix-sorted by their normalized keys in one go.
+//
+// ParallelSortPermutation splits the input into one chunk per thread, sorts
+// the chunks independently as above, and then merges them pairwise, in rounds,
+// with a row-wise comparator. So that all the threads have work in the last
+// rounds too, every merge is split further into independent merges: the longer
+// of the two runs is cut at evenly spaced rows, and the other run at the first
+// row not less than the one at the cut.
 
 #include "supersonic/cursor/core/sort.h"
 
@@ -108,13 +120,17 @@
 #include "supersonic/cursor/core/limit.h"
 #include "supersonic/cursor/core/merge_union_all.h"
 #include "supersonic/cursor/core/ownership_taker.h"
+#include "supersonic/cursor/core/parallel.h"
 #include "supersonic/cursor/core/project.h"
 #include "supersonic/cursor/core/scan_view.h"
 #include "supersonic/cursor/infrastructure/basic_cursor.h"
 #include "supersonic/cursor/infrastructure/basic_operation.h"
 #include "supersonic/cursor/infrastructure/file_io.h"
+#include "supersonic/cursor/infrastructure/normalized_key.h"
 #include "supersonic/cursor/infrastructure/ordering.h"
 #include "supersonic/cursor/infrastructure/table.h"
+#include "supersonic/cursor/infrastructure/temporary_file_factory.h"
+#include "supersonic/cursor/infrastructure/thread_pool.h"
 #include "supersonic/cursor/infrastructure/view_cursor.h"
 #include "supersonic/cursor/infrastructure/writer.h"
 #include "supersonic/expression/base/expression.h"
@@ -308,25 +324,242 @@ void SortTypedColumn(DataType type,
   TypeSpecialization<void, ColumnSorter>(type, sorter);
 }
 
+// Sorts ranges of a permutation of the rows of a view by their normalized
+// keys. The memory for the keys of all the rows, and for the radix sort's
+// scratch space, is taken from the allocator up front, on the calling thread,
+// so the allocator needn't be thread-safe; ranges sorted in parallel use
+// disjoint parts of it.
+class NormalizedKeySorter {
+ public:
+  // Returns NULL if the sort key can't be normalized, or the memory can't be
+  // allocated. Keeps references to the columns of the input; it must outlive
+  // the sorter.
+  static unique_ptr<NormalizedKeySorter> Create(
+      const BoundSortOrder& sort_order,
+      const View& input,
+      BufferAllocator* allocator) {
+    unique_ptr<NormalizedKeyEncoder> encoder =
+        NormalizedKeyEncoder::Create(sort_order, input);
+    if (encoder == NULL) return nullptr;
+    const rowcount_t row_count = input.row_count();
+    // The keys, their scratch copies, and the scratch row ids.
+    unique_ptr<Buffer> buffer(allocator->Allocate(
+        row_count * (2 * encoder->key_width() + sizeof(rowid_t))));
+    if (buffer == NULL) return nullptr;
+    return unique_ptr<NormalizedKeySorter>(new NormalizedKeySorter(
+        std::move(encoder), row_count, std::move(buffer)));
+  }
+
+  void SortRange(const Range& range, Permutation* permutation) const {
+    const rowcount_t row_count = range.to - range.from;
+    const size_t key_width = encoder_->key_width();
+    uint8_t* const data = static_cast<uint8_t*>(buffer_->data());
+    uint8_t* const keys = data + range.from * key_width;
+    uint8_t* const scratch_keys =
+        data + (input_row_count_ + range.from) * key_width;
+    rowid_t* const scratch_rows = reinterpret_cast<rowid_t*>(
+        data + 2 * input_row_count_ * key_width) + range.from;
+    rowid_t* const rows = permutation->mutable_permutation() + range.from;
+    encoder_->Encode(rows, row_count, keys);
+    RadixSortNormalizedKeys(key_width, row_count, keys, rows, scratch_keys,
+                            scratch_rows);
+  }
+
+ private:
+  NormalizedKeySorter(unique_ptr<NormalizedKeyEncoder> encoder,
+                      rowcount_t input_row_count,
+                      unique_ptr<Buffer> buffer)
+      : encoder_(std::move(encoder)),
+        input_row_count_(input_row_count),
+        buffer_(std::move(buffer)) {}
+
+  const unique_ptr<NormalizedKeyEncoder> encoder_;
+  const rowcount_t input_row_count_;
+  const unique_ptr<Buffer> buffer_;
+  DISALLOW_COPY_AND_ASSIGN(NormalizedKeySorter);
+};
+
+// Sorts the specified range of the permutation; see SortPermutation. Sorts by
+// the normalized keys if normalized_key_sorter isn't NULL, and column by
+// column otherwise.
+void SortPermutationRange(const BoundSortOrder& sort_order,
+                          const View& input,
+                          const NormalizedKeySorter* normalized_key_sorter,
+                          const Range& range,
+                          Permutation* permutation) {
+  if (normalized_key_sorter != NULL) {
+    normalized_key_sorter->SortRange(range, permutation);
+    return;
+  }
+  // Pair for double buffering.
+  pair<vector<Range>, vector<Range> > ranges;
+  vector<Range>* source_ranges = &ranges.first;
+  vector<Range>* target_ranges = &ranges.second;
+  source_ranges->push_back(range);
+  int num_columns = sort_order.schema().attribute_count();
+  for (int i = 0; i < num_columns; ++i) {
+    const Attribute attribute = sort_order.schema().attribute(i);
+    const Column& input_column = input.column(
+        sort_order.source_attribute_position(i));
+    SortTypedColumn(attribute.type(),
+                    sort_order.column_order(i) == DESCENDING,
+                    input_column.data(), input_column.is_null(),
+                    *source_ranges, target_ranges,
+                    permutation,
+                    i == num_columns - 1);
+    if (target_ranges->empty()) break;
+    std::swap(source_ranges, target_ranges);
+    target_ranges->clear();
+  }
+}
+
+// ParallelSortPermutation doesn't split inputs into chunks smaller than this;
+// sorting them takes too little time to be worth scheduling.
+const int64_t kMinParallelSortChunkRowCount = 16 * 1024;
+
+// Compares the rows of the input view (given by their ids) by the sort key.
+// Used to merge the sorted chunks.
+class RowLessThan {
+ public:
+  RowLessThan(const BoundSortOrder& sort_order, const View& input) {
+    const TupleSchema& key_schema = sort_order.schema();
+    for (int i = 0; i < key_schema.attribute_count(); ++i) {
+      const Column& column =
+          input.column(sort_order.source_attribute_position(i));
+      key_columns_.push_back(&column);
+      value_comparators_.push_back(
+          GetSortComparator(key_schema.attribute(i).type(),
+                            sort_order.column_order(i) == DESCENDING,
+                            column.is_null() == NULL,
+                            i + 1 == key_schema.attribute_count()));
+    }
+  }
+
+  bool operator()(const rowid_t a, const rowid_t b) const {
+    for (int i = 0; i < key_columns_.size(); ++i) {
+      const Column& column = *key_columns_[i];
+      bool_const_ptr is_null = column.is_null();
+      const VariantConstPointer value_a =
+          (is_null != NULL && is_null[a]) ? NULL : column.data_plus_offset(a);
+      const VariantConstPointer value_b =
+          (is_null != NULL && is_null[b]) ? NULL : column.data_plus_offset(b);
+      const ComparisonResult a_cmp_b = value_comparators_[i](value_a, value_b);
+      if (a_cmp_b == RESULT_LESS) return true;
+      // RESULT_GREATER_OR_EQUAL is only returned for the last column.
+      if (a_cmp_b != RESULT_EQUAL) return false;
+    }
+    return false;
+  }
+
+ private:
+  vector<const Column*> key_columns_;
+  vector<InequalityComparator> value_comparators_;
+  DISALLOW_COPY_AND_ASSIGN(RowLessThan);
+};
+
+// A merge of two sorted runs of one permutation into another permutation,
+// starting at target_from.
+struct MergeTask {
+  MergeTask(const Range& left, const Range& right, int64_t target_from)
+      : left(left), right(right), target_from(target_from) {}
+  Range left;
+  Range right;
+  int64_t target_from;
+};
+
+// Splits the merge of the adjacent sorted runs left and right of the
+// permutation into up to piece_count independent merges, appended to tasks.
+void SplitMerge(const Permutation& permutation,
+                const RowLessThan& less_than,
+                const Range& left,
+                const Range& right,
+                int piece_count,
+                vector<MergeTask>* tasks) {
+  DCHECK_EQ(left.to, right.from);
+  const bool cut_left = (left.to - left.from >= right.to - right.from);
+  const Range& cut = cut_left ? left : right;
+  const Range& other = cut_left ? right : left;
+  const int64_t cut_row_count = cut.to - cut.from;
+  if (cut_row_count < piece_count) {
+    piece_count = std::max<int64_t>(cut_row_count, 1);
+  }
+  const rowid_t* const rows = permutation.permutation();
+  auto compare = [&less_than](rowid_t a, rowid_t b) {
+    return less_than(a, b);
+  };
+  Range cut_piece(cut.from, cut.from);
+  Range other_piece(other.from, other.from);
+  int64_t target_from = left.from;
+  for (int i = 1; i <= piece_count; ++i) {
+    if (i == piece_count) {
+      cut_piece.to = cut.to;
+      other_piece.to = other.to;
+    } else {
+      cut_piece.to = cut.from + cut_row_count * i / piece_count;
+      other_piece.to = std::lower_bound(rows + other_piece.from,
+                                        rows + other.to,
+                                        rows[cut_piece.to],
+                                        compare) - rows;
+    }
+    const int64_t row_count = (cut_piece.to - cut_piece.from) +
+                              (other_piece.to - other_piece.from);
+    if (row_count > 0) {
+      tasks->push_back(cut_left
+                       ? MergeTask(cut_piece, other_piece, target_from)
+                       : MergeTask(other_piece, cut_piece, target_from));
+      target_from += row_count;
+    }
+    cut_piece.from = cut_piece.to;
+    other_piece.from = other_piece.to;
+  }
+}
+
+// Bounds on the number of runs merged at once by BasicMerger.
+const size_t kMinMergeFanIn = 2;
+const size_t kMaxMergeFanIn = 128;
+
+unique_ptr<const BoundSortOrder> CopySortOrder(
+    const BoundSortOrder& sort_order) {
+  vector<ColumnOrder> column_order;
+  for (int i = 0; i < sort_order.schema().attribute_count(); ++i) {
+    column_order.push_back(sort_order.column_order(i));
+  }
+  return make_unique<BoundSortOrder>(
+      make_unique<BoundSingleSourceProjector>(sort_order.projector()),
+      column_order);
+}
+
+// Stores the sorted runs in temporary files. The final merge reads at most
+// max_fan_in runs at once (including the additional cursor), each through a
+// FileInput block; if there are more runs, the smallest ones are merged into
+// new runs first, just enough of them for the rest to fit in the final merge.
 class BasicMerger : public Merger {
  public:
-  BasicMerger(TupleSchema schema, StringPiece temporary_directory_prefix,
+  BasicMerger(TupleSchema schema, size_t memory_quota,
+              TemporaryFileFactory* temporary_file_factory,
+              FileCompression spill_compression,
               BufferAllocator* allocator)
       : schema_(schema),
-        temporary_directory_prefix_(temporary_directory_prefix.ToString()),
+        max_fan_in_(std::max(
+            kMinMergeFanIn,
+            std::min(kMaxMergeFanIn,
+                     memory_quota /
+                         std::max<size_t>(1, EstimateFileInputMemoryUsage(
+                                                 schema))))),
+        temporary_file_factory_(temporary_file_factory),
+        spill_compression_(spill_compression),
         allocator_(allocator) {}
 
   FailureOrVoid AddSorted(unique_ptr<Cursor> cursor) {
-    std::unique_ptr<file::FileRemover> temp_file(new file::FileRemover(
-        TempFile::Create(temporary_directory_prefix_.c_str())));
-    if (temp_file->get() == NULL) {
-      THROW(new Exception(ERROR_TEMP_FILE_CREATION_ERROR,
-                          StrCat("Couldn't create temporary file in ",
-                                 temporary_directory_prefix_)));
-    }
+    FailureOr<File*> file = temporary_file_factory_->CreateTemporaryFile();
+    PROPAGATE_ON_FAILURE(file);
+    std::unique_ptr<file::FileRemover> temp_file(
+        new file::FileRemover(file.get()));
+    rowcount_t row_count;
     {
       std::unique_ptr<Sink> file_sink(
-          FileOutput(temp_file->get(), DO_NOT_TAKE_OWNERSHIP));
+          FileOutput(temp_file->get(), DO_NOT_TAKE_OWNERSHIP,
+                     spill_compression_, FileIOThreadPool()));
       Writer part_writer(std::move(cursor));
       FailureOr<rowcount_t> write_all_result =
           part_writer.WriteAll(file_sink.get());
@@ -339,29 +572,38 @@ class BasicMerger : public Merger {
       FailureOrVoid file_sink_finalize_result = file_sink->Finalize();
       PROPAGATE_ON_FAILURE(write_all_result);
       PROPAGATE_ON_FAILURE(file_sink_finalize_result);
+      row_count = write_all_result.get();
     }
     // TODO(user): Don't just ignore the util::Status object!
     // We didn't opensource util::task::Status.
     temp_file->get()->Seek(0);
-    file_buffers_.emplace_back(temp_file.release());
+    runs_.push_back(SortedRun(std::move(temp_file), row_count));
     return Success();
   }
 
-  // TODO(user): Consider some pre-merging phase if the number of files is big
-  // enough.
   FailureOrOwned<Cursor> Merge(unique_ptr<const BoundSortOrder> sort_order,
                                unique_ptr<Cursor> additional) {
-    vector<unique_ptr<Cursor>> merged_cursors;
-    while (!file_buffers_.empty()) {
-      FailureOrOwned<Cursor> file_cursor(
-          FileInput(schema_,
-                    file_buffers_.back()->release(),
-                    true,  // delete_when_done
-                    allocator_));
-      file_buffers_.pop_back();
-      PROPAGATE_ON_FAILURE(file_cursor);
-      merged_cursors.push_back(file_cursor.move());
+    const size_t final_fan_in = max_fan_in_ - ((bool) additional ? 1 : 0);
+    while (runs_.size() > final_fan_in) {
+      const size_t fan_in =
+          std::min(max_fan_in_, runs_.size() - final_fan_in + 1);
+      // The smallest runs go last.
+      std::sort(runs_.begin(), runs_.end(),
+                [](const SortedRun& a, const SortedRun& b) {
+                  return a.row_count > b.row_count;
+                });
+      vector<unique_ptr<Cursor>> merged_cursors;
+      PROPAGATE_ON_FAILURE(OpenRuns(fan_in, &merged_cursors));
+      FailureOrOwned<Cursor> merged(
+          BoundMergeUnionAll(CopySortOrder(*sort_order),
+                             std::move(merged_cursors),
+                             allocator_));
+      PROPAGATE_ON_FAILURE(merged);
+      // The merged runs' files are deleted once they have been read.
+      PROPAGATE_ON_FAILURE(AddSorted(merged.move()));
     }
+    vector<unique_ptr<Cursor>> merged_cursors;
+    PROPAGATE_ON_FAILURE(OpenRuns(runs_.size(), &merged_cursors));
     if ((bool) additional) {
       // Use the additional cursor as the last source.
       merged_cursors.emplace_back(std::move(additional));
@@ -375,14 +617,40 @@ class BasicMerger : public Merger {
   }
 
   virtual bool empty() const {
-    return file_buffers_.empty();
+    return runs_.empty();
   }
 
  private:
+  struct SortedRun {
+    SortedRun(std::unique_ptr<file::FileRemover> file, rowcount_t row_count)
+        : file(std::move(file)), row_count(row_count) {}
+    std::unique_ptr<file::FileRemover> file;
+    rowcount_t row_count;
+  };
+
+  // Removes the last count runs, appending cursors reading them (and
+  // deleting their files when done) to cursors.
+  FailureOrVoid OpenRuns(size_t count, vector<unique_ptr<Cursor>>* cursors) {
+    for (size_t i = 0; i < count; ++i) {
+      FailureOrOwned<Cursor> file_cursor(
+          FileInput(schema_,
+                    runs_.back().file->release(),
+                    true,  // delete_when_done
+                    allocator_,
+                    FileIOThreadPool()));
+      runs_.pop_back();
+      PROPAGATE_ON_FAILURE(file_cursor);
+      cursors->push_back(file_cursor.move());
+    }
+    return Success();
+  }
+
   TupleSchema schema_;
-  string temporary_directory_prefix_;
+  const size_t max_fan_in_;
+  TemporaryFileFactory* temporary_file_factory_;
+  const FileCompression spill_compression_;
   BufferAllocator* allocator_;
-  PointerVector<file::FileRemover> file_buffers_;
+  vector<SortedRun> runs_;
   DISALLOW_COPY_AND_ASSIGN(BasicMerger);
 };
 
@@ -393,11 +661,16 @@ class UnbufferedSorter : public Sorter {
   // GetResultCursor() exists.
   UnbufferedSorter(const TupleSchema& schema,
                    unique_ptr<const BoundSortOrder> sort_order,
-                   StringPiece temporary_directory_prefix,
-                   BufferAllocator* allocator)
+                   size_t memory_quota,
+                   TemporaryFileFactory* temporary_file_factory,
+                   FileCompression spill_compression,
+                   BufferAllocator* allocator,
+                   ThreadPool* thread_pool)
       : sort_order_(std::move(sort_order)),
         allocator_(allocator),
-        merger_(CreateMerger(schema, temporary_directory_prefix, allocator)) {}
+        thread_pool_(thread_pool),
+        merger_(CreateMerger(schema, memory_quota, temporary_file_factory,
+                             spill_compression, allocator)) {}
 
   virtual ~UnbufferedSorter() {}
 
@@ -432,7 +705,8 @@ class UnbufferedSorter : public Sorter {
   // valid as long as the Cursor exists.
   FailureOrOwned<Cursor> SortView(const View& view) {
     auto permutation = make_unique<Permutation>(view.row_count());
-    SortPermutation(*sort_order_, view, permutation.get());
+    ParallelSortPermutation(*sort_order_, view, thread_pool_, allocator_,
+                            permutation.get());
     FailureOrOwned<Cursor> sorted = BoundScanViewWithSelection(
         view, permutation->size(), permutation->permutation(),
         allocator_, Cursor::kDefaultRowCount);
@@ -443,6 +717,8 @@ class UnbufferedSorter : public Sorter {
  private:
   unique_ptr<const BoundSortOrder> sort_order_;
   BufferAllocator* allocator_;
+  // May be NULL, for sorting on the calling thread only.
+  ThreadPool* thread_pool_;
   unique_ptr<Merger> merger_;
   DISALLOW_COPY_AND_ASSIGN(UnbufferedSorter);
 };
@@ -455,8 +731,10 @@ class BufferingSorter : public Sorter {
   BufferingSorter(const TupleSchema& schema,
                   unique_ptr<const BoundSortOrder> sort_order,
                   size_t memory_quota,
-                  StringPiece temporary_directory_prefix,
-                  BufferAllocator* allocator)
+                  TemporaryFileFactory* temporary_file_factory,
+                  FileCompression spill_compression,
+                  BufferAllocator* allocator,
+                  ThreadPool* thread_pool)
       : allocator_(allocator),
         softquota_bypass_allocator_(
             new SoftQuotaBypassingBufferAllocator(allocator_,
@@ -470,8 +748,9 @@ class BufferingSorter : public Sorter {
                             softquota_bypass_allocator_.get())),
         memory_buffer_(
             new Table(schema, materialization_allocator_.get())),
-        unbuffered_sorter_(schema, std::move(sort_order), temporary_directory_prefix,
-                           allocator) {}
+        unbuffered_sorter_(schema, std::move(sort_order), memory_quota,
+                           temporary_file_factory, spill_compression,
+                           allocator, thread_pool) {}
 
   virtual ~BufferingSorter() {}
 
@@ -558,16 +837,19 @@ class SortCursor : public BasicCursor {
   SortCursor(unique_ptr<const BoundSortOrder> sort_order,
              unique_ptr<const BoundSingleSourceProjector> result_projector,
              size_t memory_quota,
-             StringPiece temporary_directory_prefix,
+             TemporaryFileFactory* temporary_file_factory,
+             FileCompression spill_compression,
              BufferAllocator* allocator,
+             ThreadPool* thread_pool,
              unique_ptr<Cursor> child)
       : BasicCursor(result_projector->result_schema()),
         is_waiting_on_barrier_supported_(child->IsWaitingOnBarrierSupported()),
         writer_(std::move(child)),
         result_projector_(std::move(result_projector)),
         sorter_(CreateBufferingSorter(writer_.schema(), std::move(sort_order),
-                                      memory_quota, temporary_directory_prefix,
-                                      allocator)),
+                                      memory_quota, temporary_file_factory,
+                                      spill_compression, allocator,
+                                      thread_pool)),
         sorter_sink_(sorter_.get()) {}
 
   virtual ResultView Next(rowcount_t max_row_count) {
@@ -632,19 +914,51 @@ FailureOrVoid SortCursor::ProcessData() {
   return Success();
 }
 
+FailureOrOwned<Cursor> CreateSortCursor(
+    unique_ptr<const BoundSortOrder> sort_order,
+    unique_ptr<const BoundSingleSourceProjector> result_projector,
+    size_t memory_quota,
+    TemporaryFileFactory* temporary_file_factory,
+    FileCompression spill_compression,
+    BufferAllocator* allocator,
+    ThreadPool* thread_pool,
+    unique_ptr<Cursor> child) {
+  if (result_projector == nullptr) {
+    auto all = ProjectAllAttributes();
+    result_projector = SucceedOrDie(all->Bind(child->schema()));
+  }
+
+  return Success(make_unique<SortCursor>(
+      std::move(sort_order), std::move(result_projector),
+      memory_quota,
+      temporary_file_factory,
+      spill_compression,
+      allocator,
+      thread_pool,
+      std::move(child)));
+}
+
 class SortOperation : public BasicOperation {
  public:
-  // Takes ownership of the sort order and the projector.
+  // Takes ownership of the sort order, the projector and the options. The
+  // parallel options are NULL for a sort on the calling thread only.
   SortOperation(unique_ptr<const SortOrder> sort_order,
                 unique_ptr<const SingleSourceProjector> result_projector,
                 size_t memory_quota,
-                StringPiece temporary_directory_prefix,
+                const SortOptions& options,
+                unique_ptr<const ParallelOptions> parallel_options,
                 unique_ptr<Operation> child)
       : BasicOperation(std::move(child)),
         sort_order_(std::move(sort_order)),
         result_projector_(std::move(result_projector)),
         memory_quota_(memory_quota),
-        temporary_directory_prefix_(temporary_directory_prefix.ToString()) {
+        temporary_file_factory_(
+            options.temporary_file_factory() != NULL
+                ? options.temporary_file_factory()
+                : DefaultTemporaryFileFactory(
+                      options.temporary_directory_prefix())),
+        spill_compression_(options.spill_compression()),
+        parallel_options_(std::move(parallel_options)) {
     CHECK_NOTNULL(sort_order_.get());
   }
 
@@ -663,13 +977,31 @@ class SortOperation : public BasicOperation {
       PROPAGATE_ON_FAILURE(result_projector);
       result_projector_ptr = result_projector.move();
     }
-    // result_projector_ptr can contain NULL. BoundSort handles this.
-    return BoundSort(sort_order.move(),
-                     std::move(result_projector_ptr),
-                     memory_quota_,
-                     temporary_directory_prefix_,
-                     buffer_allocator(),
-                     child_cursor.move());
+    unique_ptr<ThreadPool> owned_thread_pool;
+    ThreadPool* thread_pool = NULL;
+    if (parallel_options_ != NULL) {
+      thread_pool = parallel_options_->thread_pool();
+      if (thread_pool == NULL) {
+        const int parallelism = parallel_options_->parallelism();
+        owned_thread_pool.reset(new ThreadPool(
+            parallelism > 0 ? parallelism : ThreadPool::DefaultNumThreads()));
+        thread_pool = owned_thread_pool.get();
+      }
+    }
+    // result_projector_ptr can contain NULL. CreateSortCursor handles this.
+    FailureOrOwned<Cursor> cursor = CreateSortCursor(
+        sort_order.move(),
+        std::move(result_projector_ptr),
+        memory_quota_,
+        temporary_file_factory_,
+        spill_compression_,
+        buffer_allocator(),
+        thread_pool,
+        child_cursor.move());
+    PROPAGATE_ON_FAILURE(cursor);
+    if (owned_thread_pool == NULL) return cursor;
+    // The pool must outlive the cursor.
+    return Success(TakeOwnership(cursor.move(), std::move(owned_thread_pool)));
   }
 
  private:
@@ -677,7 +1009,10 @@ class SortOperation : public BasicOperation {
   // result_projector_ may be NULL.
   std::unique_ptr<const SingleSourceProjector> result_projector_;
   size_t memory_quota_;
-  string temporary_directory_prefix_;
+  TemporaryFileFactory* temporary_file_factory_;
+  FileCompression spill_compression_;
+  // NULL for a single-threaded sort.
+  std::unique_ptr<const ParallelOptions> parallel_options_;
   DISALLOW_COPY_AND_ASSIGN(SortOperation);
 };
 
@@ -687,13 +1022,18 @@ class ExtendedSortOperation : public BasicOperation {
   ExtendedSortOperation(const ExtendedSortSpecification* sort_order,
                         const SingleSourceProjector* result_projector,
                         size_t memory_quota,
-                        StringPiece temporary_directory_prefix,
+                        const SortOptions& options,
                         unique_ptr<Operation> child)
       : BasicOperation(std::move(child)),
         sort_order_(sort_order),
         result_projector_(result_projector),
         memory_quota_(memory_quota),
-        temporary_directory_prefix_(temporary_directory_prefix.ToString()) {
+        temporary_file_factory_(
+            options.temporary_file_factory() != NULL
+                ? options.temporary_file_factory()
+                : DefaultTemporaryFileFactory(
+                      options.temporary_directory_prefix())),
+        spill_compression_(options.spill_compression()) {
     CHECK_NOTNULL(sort_order);
   }
 
@@ -715,7 +1055,8 @@ class ExtendedSortOperation : public BasicOperation {
     return BoundExtendedSort(new ExtendedSortSpecification(*sort_order_),
                              bound_result_projector.release(),
                              memory_quota_,
-                             temporary_directory_prefix_,
+                             temporary_file_factory_,
+                             spill_compression_,
                              buffer_allocator(),
                              Cursor::kDefaultRowCount,
                              child_cursor.move());
@@ -726,61 +1067,140 @@ class ExtendedSortOperation : public BasicOperation {
   // result_projector_ may be NULL.
   std::unique_ptr<const SingleSourceProjector> result_projector_;
   size_t memory_quota_;
-  string temporary_directory_prefix_;
+  TemporaryFileFactory* temporary_file_factory_;
+  FileCompression spill_compression_;
   DISALLOW_COPY_AND_ASSIGN(ExtendedSortOperation);
 };
 
 }  // namespace
 
 unique_ptr<Merger> CreateMerger(TupleSchema schema,
-                     StringPiece temporary_directory_prefix,
-                     BufferAllocator* allocator) {
-  return make_unique<BasicMerger>(schema, temporary_directory_prefix, allocator);
+                                size_t memory_quota,
+                                TemporaryFileFactory* temporary_file_factory,
+                                FileCompression spill_compression,
+                                BufferAllocator* allocator) {
+  return make_unique<BasicMerger>(schema, memory_quota,
+                                  temporary_file_factory,
+                                  spill_compression, allocator);
 }
 
-unique_ptr<Sorter> CreateUnbufferedSorter(const TupleSchema& schema,
-                                          unique_ptr<const BoundSortOrder> sort_order,
-                                          StringPiece temporary_directory_prefix,
-                                          BufferAllocator* allocator) {
+unique_ptr<Sorter> CreateUnbufferedSorter(
+    const TupleSchema& schema,
+    unique_ptr<const BoundSortOrder> sort_order,
+    size_t memory_quota,
+    TemporaryFileFactory* temporary_file_factory,
+    FileCompression spill_compression,
+    BufferAllocator* allocator,
+    ThreadPool* thread_pool) {
   return make_unique<UnbufferedSorter>(schema, std::move(sort_order),
-                                       temporary_directory_prefix, allocator);
+                                       memory_quota, temporary_file_factory,
+                                       spill_compression, allocator,
+                                       thread_pool);
 }
 
 unique_ptr<Sorter> CreateBufferingSorter(
     const TupleSchema& schema,
     unique_ptr<const BoundSortOrder> sort_order,
     size_t memory_quota,
-    StringPiece temporary_directory_prefix,
-    BufferAllocator* allocator) {
+    TemporaryFileFactory* temporary_file_factory,
+    FileCompression spill_compression,
+    BufferAllocator* allocator,
+    ThreadPool* thread_pool) {
   return make_unique<BufferingSorter>(schema, std::move(sort_order),
-                                      memory_quota, temporary_directory_prefix,
-                                      allocator);
+                                      memory_quota, temporary_file_factory,
+                                      spill_compression, allocator,
+                                      thread_pool);
+}
+
+void SortPermutation(const BoundSortOrder& sort_order,
+                     const View& input,
+                     Permutation* permutation) {
+  SortPermutation(sort_order, input, HeapBufferAllocator::Get(), permutation);
 }
 
 void SortPermutation(const BoundSortOrder& sort_order,
                      const View& input,
+                     BufferAllocator* allocator,
                      Permutation* permutation) {
   CHECK_EQ(input.row_count(), permutation->size());
-  // Pair for double buffering.
-  pair<vector<Range>, vector<Range> > ranges;
-  vector<Range>* source_ranges = &ranges.first;
-  vector<Range>* target_ranges = &ranges.second;
-  source_ranges->push_back(Range(0, input.row_count()));
-  int num_columns = sort_order.schema().attribute_count();
-  for (int i = 0; i < num_columns; ++i) {
-    const Attribute attribute = sort_order.schema().attribute(i);
-    const Column& input_column = input.column(
-        sort_order.source_attribute_position(i));
-    SortTypedColumn(attribute.type(),
-                    sort_order.column_order(i) == DESCENDING,
-                    input_column.data(), input_column.is_null(),
-                    *source_ranges, target_ranges,
-                    permutation,
-                    i == num_columns - 1);
-    if (target_ranges->empty()) break;
-    std::swap(source_ranges, target_ranges);
-    target_ranges->clear();
+  unique_ptr<NormalizedKeySorter> normalized_key_sorter;
+  if (input.row_count() > 1) {
+    normalized_key_sorter =
+        NormalizedKeySorter::Create(sort_order, input, allocator);
   }
+  SortPermutationRange(sort_order, input, normalized_key_sorter.get(),
+                       Range(0, input.row_count()), permutation);
+}
+
+void ParallelSortPermutation(const BoundSortOrder& sort_order,
+                             const View& input,
+                             ThreadPool* thread_pool,
+                             Permutation* permutation) {
+  ParallelSortPermutation(sort_order, input, thread_pool,
+                          HeapBufferAllocator::Get(), permutation);
+}
+
+void ParallelSortPermutation(const BoundSortOrder& sort_order,
+                             const View& input,
+                             ThreadPool* thread_pool,
+                             BufferAllocator* allocator,
+                             Permutation* permutation) {
+  CHECK_EQ(input.row_count(), permutation->size());
+  const int64_t row_count = input.row_count();
+  const int64_t chunk_count =
+      (thread_pool == NULL)
+          ? 1
+          : std::min<int64_t>(thread_pool->num_threads(),
+                              row_count / kMinParallelSortChunkRowCount);
+  if (chunk_count <= 1) {
+    SortPermutation(sort_order, input, allocator, permutation);
+    return;
+  }
+  vector<Range> runs;
+  for (int64_t i = 0; i < chunk_count; ++i) {
+    runs.push_back(Range(row_count * i / chunk_count,
+                         row_count * (i + 1) / chunk_count));
+  }
+  const unique_ptr<NormalizedKeySorter> normalized_key_sorter =
+      NormalizedKeySorter::Create(sort_order, input, allocator);
+  ParallelFor(thread_pool, chunk_count, [&](int i) {
+    SortPermutationRange(sort_order, input, normalized_key_sorter.get(),
+                         runs[i], permutation);
+  });
+
+  RowLessThan less_than(sort_order, input);
+  auto compare = [&less_than](rowid_t a, rowid_t b) {
+    return less_than(a, b);
+  };
+  Permutation buffer(row_count);
+  Permutation* source = permutation;
+  Permutation* target = &buffer;
+  while (runs.size() > 1) {
+    const int pieces_per_merge =
+        std::max<int64_t>(chunk_count / (runs.size() / 2), 1);
+    vector<MergeTask> tasks;
+    vector<Range> merged_runs;
+    for (size_t i = 0; i + 1 < runs.size(); i += 2) {
+      SplitMerge(*source, less_than, runs[i], runs[i + 1], pieces_per_merge,
+                 &tasks);
+      merged_runs.push_back(Range(runs[i].from, runs[i + 1].to));
+    }
+    if (runs.size() % 2 == 1) {
+      // The odd run is merged with an empty one, i.e. copied.
+      const Range& last = runs.back();
+      tasks.push_back(MergeTask(last, Range(last.to, last.to), last.from));
+      merged_runs.push_back(last);
+    }
+    ParallelFor(thread_pool, tasks.size(), [&](int i) {
+      const MergeTask& task = tasks[i];
+      source->MergeInto(task.left.from, task.left.to,
+                        task.right.from, task.right.to,
+                        compare, target, task.target_from);
+    });
+    std::swap(source, target);
+    runs.swap(merged_runs);
+  }
+  if (source != permutation) permutation->Swap(source);
 }
 
 unique_ptr<Operation> Sort(
@@ -790,15 +1210,38 @@ unique_ptr<Operation> Sort(
     unique_ptr<Operation> child) {
   return make_unique<SortOperation>(
       std::move(sort_order), std::move(result_projector),
-      memory_quota, "", std::move(child));
+      memory_quota, SortOptions(), nullptr, std::move(child));
+}
+
+unique_ptr<Operation> ParallelSort(
+    unique_ptr<const SortOrder> sort_order,
+    unique_ptr<const SingleSourceProjector> result_projector,
+    size_t memory_quota,
+    unique_ptr<const ParallelOptions> options,
+    unique_ptr<Operation> child) {
+  CHECK(options != NULL);
+  return make_unique<SortOperation>(
+      std::move(sort_order), std::move(result_projector),
+      memory_quota, SortOptions(), std::move(options), std::move(child));
 }
 
 unique_ptr<Operation> ExtendedSort(const ExtendedSortSpecification* specification,
                                    const SingleSourceProjector* result_projector,
                                    size_t memory_limit,
                                    unique_ptr<Operation> child) {
-  return make_unique<ExtendedSortOperation>(specification, result_projector,
-                                            memory_limit, "", std::move(child));
+  return ExtendedSort(specification, result_projector, memory_limit,
+                      SortOptions(), std::move(child));
+}
+
+unique_ptr<Operation> ExtendedSort(
+    const ExtendedSortSpecification* specification,
+    const SingleSourceProjector* result_projector,
+    size_t memory_limit,
+    const SortOptions& options,
+    unique_ptr<Operation> child) {
+  return make_unique<ExtendedSortOperation>(
+      specification, result_projector, memory_limit, options,
+      std::move(child));
 }
 
 unique_ptr<Operation> SortWithTempDirPrefix(
@@ -807,29 +1250,35 @@ unique_ptr<Operation> SortWithTempDirPrefix(
     size_t memory_quota,
     StringPiece temporary_directory_prefix,
     unique_ptr<Operation> child) {
+  SortOptions options;
+  options.set_temporary_directory_prefix(temporary_directory_prefix);
+  return SortWithOptions(std::move(sort_order), std::move(result_projector),
+                         memory_quota, options, std::move(child));
+}
+
+unique_ptr<Operation> SortWithOptions(
+    unique_ptr<const SortOrder> sort_order,
+    unique_ptr<const SingleSourceProjector> result_projector,
+    size_t memory_quota,
+    const SortOptions& options,
+    unique_ptr<Operation> child) {
   return make_unique<SortOperation>(
       std::move(sort_order), std::move(result_projector),
-      memory_quota, temporary_directory_prefix, std::move(child));
+      memory_quota, options, nullptr, std::move(child));
 }
 
 FailureOrOwned<Cursor> BoundSort(
     unique_ptr<const BoundSortOrder> sort_order,
     unique_ptr<const BoundSingleSourceProjector> result_projector,
     size_t memory_quota,
-    StringPiece temporary_directory_prefix,
+    TemporaryFileFactory* temporary_file_factory,
+    FileCompression spill_compression,
     BufferAllocator* allocator,
     unique_ptr<Cursor> child) {
-  if (result_projector == nullptr) {
-    auto all = ProjectAllAttributes();
-    result_projector = SucceedOrDie(all->Bind(child->schema()));
-  }
-
-  return Success(make_unique<SortCursor>(
-      std::move(sort_order), std::move(result_projector),
-      memory_quota,
-      temporary_directory_prefix,
-      allocator,
-      std::move(child)));
+  return CreateSortCursor(std::move(sort_order), std::move(result_projector),
+                          memory_quota, temporary_file_factory,
+                          spill_compression, allocator, NULL,
+                          std::move(child));
 }
 
 // This methods works by creating an additional attribute for each key attribute
@@ -842,7 +1291,8 @@ FailureOrOwned<Cursor> BoundExtendedSort(
     const ExtendedSortSpecification* sort_specification,
     const BoundSingleSourceProjector* result_projector,
     size_t memory_quota,
-    StringPiece temporary_directory_prefix,
+    TemporaryFileFactory* temporary_file_factory,
+    FileCompression spill_compression,
     BufferAllocator* allocator,
     rowcount_t max_row_count,
     unique_ptr<Cursor> child) {
@@ -980,7 +1430,8 @@ FailureOrOwned<Cursor> BoundExtendedSort(
       BoundSort(make_unique<BoundSortOrder>(std::move(keys_projector), keys_orders),
           std::move(owned_result_projector),
           memory_quota,
-          temporary_directory_prefix,
+          temporary_file_factory,
+          spill_compression,
           allocator,
           std::move(child));
 
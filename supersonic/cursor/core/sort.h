@@ -17,9 +17,12 @@
 #define SUPERSONIC_CURSOR_CORE_SORT_H_
 
 #include <cstddef>
+#include <string>
+using std::string;
 
 #include "supersonic/base/exception/result.h"
 #include "supersonic/base/infrastructure/tuple_schema.h"
+#include "supersonic/cursor/infrastructure/file_io.h"
 #include "supersonic/cursor/infrastructure/writer.h"
 #include "supersonic/utils/strings/stringpiece.h"
 
@@ -31,9 +34,12 @@ class BufferAllocator;
 class Cursor;
 class ExtendedSortSpecification;
 class Operation;
+class ParallelOptions;
 class Permutation;
 class SingleSourceProjector;
 class SortOrder;
+class TemporaryFileFactory;
+class ThreadPool;
 class View;
 
 // Sorts the specified input view according to the sort_order, and writes
@@ -66,6 +72,32 @@ void SortPermutation(const BoundSortOrder& sort_order,
                      const View& input,
                      Permutation* permutation);
 
+// Like above, but takes the memory for sorting by normalized keys (see
+// normalized_key.h) from the allocator. If it can't be allocated, the rows are
+// sorted column by column instead, which needs no extra memory.
+void SortPermutation(const BoundSortOrder& sort_order,
+                     const View& input,
+                     BufferAllocator* allocator,
+                     Permutation* permutation);
+
+// Like SortPermutation, but uses the threads of the thread_pool: the input is
+// split into chunks that are sorted in parallel, and then merged, also in
+// parallel. Inputs too small to split, or a NULL thread_pool, are sorted on
+// the calling thread. Needs a scratch copy of the permutation.
+void ParallelSortPermutation(const BoundSortOrder& sort_order,
+                             const View& input,
+                             ThreadPool* thread_pool,
+                             Permutation* permutation);
+
+// Like above, but takes the memory for sorting by normalized keys from the
+// allocator, as the SortPermutation overload above does. The allocations are
+// made on the calling thread.
+void ParallelSortPermutation(const BoundSortOrder& sort_order,
+                             const View& input,
+                             ThreadPool* thread_pool,
+                             BufferAllocator* allocator,
+                             Permutation* permutation);
+
 // Creates a new sort operation. The memory_limit allows to constrain memory
 // usage. Currently, the implementation only has a "soft" guarantee that the
 // upper limit of memory usage is of similar order of magnitude that the
@@ -73,25 +105,27 @@ void SortPermutation(const BoundSortOrder& sort_order,
 // than memory_limit value, and momentary usage even more than that. When
 // there's too much data to sort in this amount of memory, partial sorted
 // results are saved to temporary files, to be merged at the end.
-// temporary_directory_prefix is passed to TempFile::Create (use empty string
-// for default).
+// The files are created by a TemporaryFileFactory (see SortOptions).
 // TODO(user): Achieve tighter guarantees on memory usage.
-// TODO(user): Introduce SortOptions and remove SortWithTempDirPrefix.
-// TODO(user): (same as in aggregate.h) in ptab's words: Instead of directory
-// prefix I wish we use something like:
-//
-// class TemporaryFileFactory {
-//   File* CreateTemporaryFile();
-// }
-//
-// This way transition to d-server or other storage would be easier. Even for
-// testing it might be helpful.
+// TODO(user): Remove SortWithTempDirPrefix in favor of SortWithOptions.
 unique_ptr<Operation> Sort(
     unique_ptr<const SortOrder> sort_order,
     unique_ptr<const SingleSourceProjector> result_projector,
     size_t memory_limit,  // in bytes
     unique_ptr<Operation> child);
 
+// Creates a sort operation like Sort, that sorts every buffer of data (see
+// memory_limit above) on a number of threads, with ParallelSortPermutation.
+// Of the ParallelOptions (in parallel.h), only thread_pool() is used, and
+// parallelism(), as the number of threads of the private pool if thread_pool()
+// is not set.
+unique_ptr<Operation> ParallelSort(
+    unique_ptr<const SortOrder> sort_order,
+    unique_ptr<const SingleSourceProjector> result_projector,
+    size_t memory_limit,  // in bytes
+    unique_ptr<const ParallelOptions> options,
+    unique_ptr<Operation> child);
+
 unique_ptr<Operation> SortWithTempDirPrefix(
     unique_ptr<const SortOrder> sort_order,
     unique_ptr<const SingleSourceProjector> result_projector,
@@ -99,6 +133,59 @@ unique_ptr<Operation> SortWithTempDirPrefix(
     StringPiece temporary_directory_prefix,
     unique_ptr<Operation> child);
 
+// Options of the data a sort spills to temporary files.
+class SortOptions {
+ public:
+  SortOptions()
+      : temporary_file_factory_(NULL),
+        spill_compression_(FILE_COMPRESSION_NONE) {}
+
+  const string& temporary_directory_prefix() const {
+    return temporary_directory_prefix_;
+  }
+  TemporaryFileFactory* temporary_file_factory() const {
+    return temporary_file_factory_;
+  }
+  FileCompression spill_compression() const { return spill_compression_; }
+
+  // Where the temporary files are created, if there's no
+  // temporary_file_factory: the files are created by the
+  // DefaultTemporaryFileFactory for the prefix. Empty (the default) means the
+  // default temporary directory.
+  SortOptions* set_temporary_directory_prefix(StringPiece prefix) {
+    temporary_directory_prefix_ = prefix.ToString();
+    return this;
+  }
+
+  // Creates the temporary files, e.g. on several disks, within a disk quota.
+  // Not owned; must outlive the sort's cursors. NULL (the default) means the
+  // temporary_directory_prefix is used.
+  SortOptions* set_temporary_file_factory(TemporaryFileFactory* factory) {
+    temporary_file_factory_ = factory;
+    return this;
+  }
+
+  // How the sorted parts are compressed in the temporary files (see
+  // file_io.h). Uncompressed by default.
+  SortOptions* set_spill_compression(FileCompression spill_compression) {
+    spill_compression_ = spill_compression;
+    return this;
+  }
+
+ private:
+  string temporary_directory_prefix_;
+  TemporaryFileFactory* temporary_file_factory_;
+  FileCompression spill_compression_;
+};
+
+// Creates a sort operation like Sort, with options (see SortOptions).
+unique_ptr<Operation> SortWithOptions(
+    unique_ptr<const SortOrder> sort_order,
+    unique_ptr<const SingleSourceProjector> result_projector,
+    size_t memory_limit,  // in bytes
+    const SortOptions& options,
+    unique_ptr<Operation> child);
+
 // Identical with Sort, but supports case insensitivity and limit on the number
 // of returned elements. Also, unlike sort, its parameter is serializable.
 // Takes ownership of all input.
@@ -107,17 +194,27 @@ unique_ptr<Operation> ExtendedSort(const ExtendedSortSpecification* specificatio
                         size_t memory_limit,
                         unique_ptr<Operation> child);
 
+// Creates a sort operation like ExtendedSort, with options (see SortOptions).
+unique_ptr<Operation> ExtendedSort(
+    const ExtendedSortSpecification* specification,
+    const SingleSourceProjector* result_projector,
+    size_t memory_limit,
+    const SortOptions& options,
+    unique_ptr<Operation> child);
+
 // Creates a new sort cursor. It will emit data from the child cursor, ordered
 // according to the sort_order, and projected via result_projector. Takes
 // ownership of the sort_order and the result_projector.
 // If BoundSort exceeds memory_limit, it will try to complete the operation by
-// storing sorted parts of the data in temporary files and merging them all at
-// the end.
+// storing sorted parts of the data in temporary files, created by the
+// temporary_file_factory (which must outlive the cursor) and compressed as per
+// spill_compression, and merging them all at the end.
 FailureOrOwned<Cursor> BoundSort(
     unique_ptr<const BoundSortOrder> sort_order,
     unique_ptr<const BoundSingleSourceProjector> result_projector,
     size_t memory_limit,  // in bytes
-    StringPiece temporary_directory_prefix,
+    TemporaryFileFactory* temporary_file_factory,
+    FileCompression spill_compression,
     BufferAllocator* allocator,
     unique_ptr<Cursor> child_cursor);
 
@@ -127,7 +224,8 @@ FailureOrOwned<Cursor> BoundExtendedSort(
     const ExtendedSortSpecification* sort_specification,
     const BoundSingleSourceProjector* result_projector,
     size_t memory_quota,
-    StringPiece temporary_directory_prefix,
+    TemporaryFileFactory* temporary_file_factory,
+    FileCompression spill_compression,
     BufferAllocator* allocator,
     rowcount_t max_row_count,
     unique_ptr<Cursor> child);
@@ -161,9 +259,14 @@ class Merger {
 };
 
 // Create a Merger instance that stores the data in files, using Supersonic's
-// FileInput/FileOutput, in the specified directory.
+// FileInput/FileOutput, in files created by the temporary_file_factory,
+// compressed as per spill_compression. The memory_quota bounds the number of
+// files read at once (by their FileInput buffers; between 2 and 128); if more
+// sorted parts are added, Merge() first merges some of them into new files.
 unique_ptr<Merger> CreateMerger(TupleSchema schema,
-                                StringPiece temporary_directory_prefix,
+                                size_t memory_quota,
+                                TemporaryFileFactory* temporary_file_factory,
+                                FileCompression spill_compression,
                                 BufferAllocator* allocator);
 
 // Sorter accepts an arbitrary(*) amount of unordered data and produces a sorted
@@ -192,21 +295,33 @@ class Sorter {
   DISALLOW_COPY_AND_ASSIGN(Sorter);
 };
 
-// Creates an unbuffered Sorter object with a given schema, sort order and a
-// location for temporary files. Every View passed to Write is separately sorted
-// and written to a file.
-unique_ptr<Sorter> CreateUnbufferedSorter(const TupleSchema& schema,
-                                          unique_ptr<const BoundSortOrder> sort_order,
-                                          StringPiece temporary_directory_prefix,
-                                          BufferAllocator* allocator);
+// Creates an unbuffered Sorter object with a given schema, sort order, memory
+// quota for merging (see CreateMerger) and a location and compression for
+// temporary files.
+// Every View passed to Write is separately sorted and written to a file. If
+// thread_pool is not NULL, the views are sorted with
+// ParallelSortPermutation on its threads. Doesn't take ownership of the
+// thread_pool, which must outlive the sorter and its result cursor.
+unique_ptr<Sorter> CreateUnbufferedSorter(
+    const TupleSchema& schema,
+    unique_ptr<const BoundSortOrder> sort_order,
+    size_t memory_quota,
+    TemporaryFileFactory* temporary_file_factory,
+    FileCompression spill_compression,
+    BufferAllocator* allocator,
+    ThreadPool* thread_pool);
 
 // Creates a buffering Sorter object with a given schema, sort order, memory
-// limit and a location for temporary files.
-unique_ptr<Sorter> CreateBufferingSorter(const TupleSchema& schema,
-                                         unique_ptr<const BoundSortOrder> sort_order,
-                                         size_t memory_quota,
-                                         StringPiece temporary_directory_prefix,
-                                         BufferAllocator* allocator);
+// limit and a location and compression for temporary files. The thread_pool,
+// if not NULL, is used to sort the buffers, as in CreateUnbufferedSorter.
+unique_ptr<Sorter> CreateBufferingSorter(
+    const TupleSchema& schema,
+    unique_ptr<const BoundSortOrder> sort_order,
+    size_t memory_quota,
+    TemporaryFileFactory* temporary_file_factory,
+    FileCompression spill_compression,
+    BufferAllocator* allocator,
+    ThreadPool* thread_pool);
 
 // Sink class for Sorter. Allows using Writer with Sorter.
 class SorterSink : public Sink {
@@ -20,16 +20,23 @@
 
 #include "supersonic/utils/std_namespace.h"
 #include "supersonic/base/infrastructure/projector.h"
+#include "supersonic/base/memory/memory.h"
 #include "supersonic/cursor/base/cursor.h"
 #include "supersonic/cursor/base/cursor_transformer.h"
 #include "supersonic/cursor/core/specification_builder.h"
+#include "supersonic/cursor/core/parallel.h"
+#include "supersonic/cursor/core/scan_view.h"
 #include "supersonic/cursor/core/spy.h"
 #include "supersonic/cursor/infrastructure/ordering.h"
+#include "supersonic/cursor/infrastructure/temporary_file_factory.h"
+#include "supersonic/cursor/infrastructure/thread_pool.h"
 #include "supersonic/proto/specification.pb.h"
 #include "supersonic/proto/supersonic.pb.h"
 #include "supersonic/testing/block_builder.h"
 #include "supersonic/testing/comparators.h"
 #include "supersonic/testing/operation_testing.h"
+#include "supersonic/utils/random.h"
+#include "supersonic/utils/strings/strcat.h"
 #include "gtest/gtest.h"
 
 namespace supersonic {
@@ -66,7 +73,8 @@ public:
     return BoundSort(bound_sort_order.move(),
                      bound_projector.move(),
                      soft_quota,
-                     "",
+                     DefaultTemporaryFileFactory(""),
+                     FILE_COMPRESSION_NONE,
                      HeapBufferAllocator::Get(),
                      std::move(input));
   }
@@ -686,4 +694,342 @@ TEST_P(SortTest, TransformTest) {
   EXPECT_EQ(saved, spy_transformer->GetEntryAt(0)->original());
 }
 
+namespace {
+
+// Large enough to be split between threads. Key col0 has a few hundred
+// distinct values and NULLs, col1 a dozen strings and NULLs; col2 is unique.
+unique_ptr<Block> CreateParallelSortInput(int64_t row_count) {
+  MTRandom random(0);
+  BlockBuilder<INT32, STRING, INT64> builder;
+  for (int64_t i = 0; i < row_count; ++i) {
+    const uint32_t r = random.Rand32();
+    const string value = StrCat("value_", r % 12);
+    if (r % 17 == 0) {
+      builder.AddRow(__, value, i);
+    } else if (r % 13 == 0) {
+      builder.AddRow(r % 300, __, i);
+    } else {
+      builder.AddRow(r % 300, value, i);
+    }
+  }
+  return builder.Build();
+}
+
+// Checks that the parallel sort orders the rows the same as the serial one.
+// Neither is stable, so only the keys at every position are compared.
+void TestParallelSortPermutation(const SortOrder& sort_order,
+                                 int num_threads,
+                                 int64_t row_count) {
+  unique_ptr<Block> input = CreateParallelSortInput(row_count);
+  const View& view = input->view();
+  unique_ptr<const BoundSortOrder> bound_sort_order(
+      SucceedOrDie(sort_order.Bind(view.schema())));
+  Permutation expected(view.row_count());
+  SortPermutation(*bound_sort_order, view, &expected);
+  ThreadPool thread_pool(num_threads);
+  Permutation actual(view.row_count());
+  ParallelSortPermutation(*bound_sort_order, view, &thread_pool, &actual);
+
+  const Column& ints = view.column(0);
+  const Column& strings = view.column(1);
+  for (rowid_t i = 0; i < view.row_count(); ++i) {
+    const rowid_t e = expected.at(i);
+    const rowid_t a = actual.at(i);
+    ASSERT_EQ(ints.is_null()[e], ints.is_null()[a]) << "at " << i;
+    if (!ints.is_null()[e]) {
+      ASSERT_EQ(ints.typed_data<INT32>()[e], ints.typed_data<INT32>()[a])
+          << "at " << i;
+    }
+    ASSERT_EQ(strings.is_null()[e], strings.is_null()[a]) << "at " << i;
+    if (!strings.is_null()[e]) {
+      ASSERT_EQ(strings.typed_data<STRING>()[e],
+                strings.typed_data<STRING>()[a]) << "at " << i;
+    }
+  }
+  // Every row is there exactly once.
+  vector<bool> seen(view.row_count(), false);
+  for (rowid_t i = 0; i < view.row_count(); ++i) {
+    ASSERT_FALSE(seen[actual.at(i)]);
+    seen[actual.at(i)] = true;
+  }
+}
+
+// Counts the memory an allocator granted and refused.
+class CountingMemoryStatisticsCollector
+    : public MemoryStatisticsCollectorInterface {
+ public:
+  CountingMemoryStatisticsCollector() : allocated_(0), refused_(0) {}
+
+  virtual void AllocatedMemoryBytes(size_t bytes) { allocated_ += bytes; }
+  virtual void RefusedMemoryBytes(size_t bytes) { refused_ += bytes; }
+  virtual void FreedMemoryBytes(size_t bytes) {}
+
+  size_t allocated() const { return allocated_; }
+  size_t refused() const { return refused_; }
+
+ private:
+  size_t allocated_;
+  size_t refused_;
+  DISALLOW_COPY_AND_ASSIGN(CountingMemoryStatisticsCollector);
+};
+
+// Expects the serial and the parallel sort, with their memory taken from the
+// allocator, to order the rows the same as the serial sort with its memory
+// taken from the heap. The rows are sorted by col0 and the unique col2, so
+// the order is fully determined, and the normalized keys are 16 bytes.
+void TestSortPermutationWithAllocator(BufferAllocator* allocator) {
+  unique_ptr<Block> input = CreateParallelSortInput(100000);
+  const View& view = input->view();
+  SortOrder sort_order;
+  sort_order.add(ProjectAttributeAt(0), ASCENDING)
+            ->add(ProjectAttributeAt(2), DESCENDING);
+  unique_ptr<const BoundSortOrder> bound_sort_order(
+      SucceedOrDie(sort_order.Bind(view.schema())));
+  Permutation expected(view.row_count());
+  SortPermutation(*bound_sort_order, view, &expected);
+  Permutation serial(view.row_count());
+  SortPermutation(*bound_sort_order, view, allocator, &serial);
+  ThreadPool thread_pool(4);
+  Permutation parallel(view.row_count());
+  ParallelSortPermutation(*bound_sort_order, view, &thread_pool, allocator,
+                          &parallel);
+  for (rowid_t i = 0; i < view.row_count(); ++i) {
+    ASSERT_EQ(expected.at(i), serial.at(i)) << "at " << i;
+    ASSERT_EQ(expected.at(i), parallel.at(i)) << "at " << i;
+  }
+}
+
+}  // namespace
+
+TEST(ParallelSortPermutationTest, TwoColumns) {
+  SortOrder sort_order;
+  sort_order.add(ProjectAttributeAt(0), ASCENDING)
+            ->add(ProjectAttributeAt(1), ASCENDING);
+  TestParallelSortPermutation(sort_order, 4, 200000);
+}
+
+TEST(ParallelSortPermutationTest, TwoColumnsDescending) {
+  SortOrder sort_order;
+  sort_order.add(ProjectAttributeAt(1), DESCENDING)
+            ->add(ProjectAttributeAt(0), DESCENDING);
+  TestParallelSortPermutation(sort_order, 4, 200000);
+}
+
+TEST(ParallelSortPermutationTest, OddNumberOfChunks) {
+  SortOrder sort_order;
+  sort_order.add(ProjectAttributeAt(0), DESCENDING)
+            ->add(ProjectAttributeAt(1), ASCENDING);
+  TestParallelSortPermutation(sort_order, 5, 150000);
+}
+
+TEST(ParallelSortPermutationTest, TooSmallToSplit) {
+  SortOrder sort_order;
+  sort_order.add(ProjectAttributeAt(0), ASCENDING)
+            ->add(ProjectAttributeAt(1), ASCENDING);
+  TestParallelSortPermutation(sort_order, 4, 1000);
+}
+
+TEST(SortPermutationTest, TakesNormalizedKeysFromAllocator) {
+  CountingMemoryStatisticsCollector* statistics =
+      new CountingMemoryStatisticsCollector;
+  MemoryStatisticsCollectingBufferAllocator allocator(
+      HeapBufferAllocator::Get(), statistics);
+  TestSortPermutationWithAllocator(&allocator);
+  // 16-byte keys and their scratch copies, and scratch row ids, for all the
+  // rows, once for each of the two sorts.
+  EXPECT_EQ(2 * 100000 * (2 * 16 + sizeof(rowid_t)), statistics->allocated());
+  EXPECT_EQ(0, statistics->refused());
+}
+
+TEST(SortPermutationTest, SortsColumnWiseIfAllocationFails) {
+  MemoryLimit memory_limit(0);
+  CountingMemoryStatisticsCollector* statistics =
+      new CountingMemoryStatisticsCollector;
+  MemoryStatisticsCollectingBufferAllocator allocator(&memory_limit,
+                                                      statistics);
+  TestSortPermutationWithAllocator(&allocator);
+  EXPECT_EQ(0, statistics->allocated());
+  EXPECT_LT(0, statistics->refused());
+}
+
+// Too large for OperationTest; the rows are sorted by the unique col2, so the
+// order of the result is fully determined.
+TEST(ParallelSortTest, SortsEveryBuffer) {
+  const int64_t kRowCount = 300000;
+  unique_ptr<Block> input = CreateParallelSortInput(kRowCount);
+  // Reverses col2.
+  unique_ptr<SortOrder> sort_order(new SortOrder);
+  sort_order->add(ProjectAttributeAt(2), DESCENDING);
+  unique_ptr<ParallelOptions> options(new ParallelOptions);
+  options->set_parallelism(3);
+  // Makes the sorter flush a few buffers to files.
+  unique_ptr<Operation> sort(ParallelSort(
+      std::move(sort_order), ProjectAllAttributes(), 4 << 20,
+      std::move(options), ScanView(input->view())));
+  unique_ptr<Cursor> cursor(SucceedOrDie(sort->CreateCursor()));
+  int64_t expected = kRowCount;
+  while (true) {
+    ResultView result = cursor->Next(Cursor::kDefaultRowCount);
+    ASSERT_FALSE(result.is_failure());
+    if (result.is_eos()) break;
+    const View& view = result.view();
+    for (rowid_t i = 0; i < view.row_count(); ++i) {
+      ASSERT_EQ(--expected, view.column(2).typed_data<INT64>()[i]);
+    }
+  }
+  EXPECT_EQ(0, expected);
+}
+
+TEST(ParallelSortTest, SharedThreadPool) {
+  ThreadPool thread_pool(2);
+  unique_ptr<ParallelOptions> options(new ParallelOptions);
+  options->set_thread_pool(&thread_pool);
+  OperationTest test;
+  test.SetInput(TestDataBuilder<INT32, STRING>()
+                .AddRow(3, "c")
+                .AddRow(__, "a")
+                .AddRow(1, "b")
+                .AddRow(3, "a")
+                .Build());
+  test.SetExpectedResult(TestDataBuilder<INT32, STRING>()
+                         .AddRow(__, "a")
+                         .AddRow(1, "b")
+                         .AddRow(3, "a")
+                         .AddRow(3, "c")
+                         .Build());
+  unique_ptr<SortOrder> sort_order(new SortOrder);
+  sort_order->add(ProjectAttributeAt(0), ASCENDING)
+            ->add(ProjectAttributeAt(1), ASCENDING);
+  test.Execute(ParallelSort(std::move(sort_order), ProjectAllAttributes(),
+                            1 << 20, std::move(options), test.input()));
+}
+
+// Every view written to an unbuffered sorter goes to a file created by the
+// factory; the files are read back, and deleted once merged.
+TEST(SorterTest, SpillsThroughTemporaryFileFactory) {
+  const int64_t kRowCount = 30000;
+  unique_ptr<Block> input = CreateParallelSortInput(kRowCount);
+  const TupleSchema& schema = input->schema();
+  LocalTemporaryFileFactory factory({ "", "" },
+                                    LocalTemporaryFileFactory::kNoDiskQuota);
+  SortOrder sort_order;
+  sort_order.add(ProjectAttributeAt(2), DESCENDING);
+  {
+    unique_ptr<Sorter> sorter(CreateUnbufferedSorter(
+        schema, SucceedOrDie(sort_order.Bind(schema)), 1 << 20, &factory,
+        FILE_COMPRESSION_NONE, HeapBufferAllocator::Get(), NULL));
+    for (int i = 0; i < 3; ++i) {
+      View part(input->view());
+      part.Advance(i * kRowCount / 3);
+      part.set_row_count(kRowCount / 3);
+      ASSERT_EQ(kRowCount / 3, SucceedOrDie(sorter->Write(part)));
+    }
+    EXPECT_EQ(3, factory.files_created());
+    unique_ptr<Cursor> cursor(SucceedOrDie(sorter->GetResultCursor()));
+    int64_t expected = kRowCount;
+    while (true) {
+      ResultView result = cursor->Next(Cursor::kDefaultRowCount);
+      ASSERT_FALSE(result.is_failure());
+      if (result.is_eos()) break;
+      const View& view = result.view();
+      for (rowid_t i = 0; i < view.row_count(); ++i) {
+        ASSERT_EQ(--expected, view.column(2).typed_data<INT64>()[i]);
+      }
+    }
+    EXPECT_EQ(0, expected);
+  }
+  EXPECT_LT(0, factory.bytes_written());
+  EXPECT_EQ(factory.bytes_written(), factory.bytes_read());
+  EXPECT_EQ(0, factory.disk_usage());
+}
+
+// The extended sort spills through the factory of its options, too.
+TEST(ExtendedSortOptionsTest, SpillsThroughTemporaryFileFactory) {
+  const int64_t kRowCount = 30000;
+  unique_ptr<Block> input = CreateParallelSortInput(kRowCount);
+  LocalTemporaryFileFactory factory({ "" },
+                                    LocalTemporaryFileFactory::kNoDiskQuota);
+  SortOptions options;
+  options.set_temporary_file_factory(&factory)
+         ->set_spill_compression(FILE_COMPRESSION_LIGHTWEIGHT);
+  unique_ptr<Operation> sort(ExtendedSort(
+      ExtendedSortSpecificationBuilder().Add("col2", DESCENDING, true)
+                                        ->Build(),
+      static_cast<SingleSourceProjector*>(nullptr), 1 << 16, options,
+      ScanView(input->view())));
+  {
+    unique_ptr<Cursor> cursor(SucceedOrDie(sort->CreateCursor()));
+    int64_t expected = kRowCount;
+    while (true) {
+      ResultView result = cursor->Next(Cursor::kDefaultRowCount);
+      ASSERT_FALSE(result.is_failure());
+      if (result.is_eos()) break;
+      const View& view = result.view();
+      for (rowid_t i = 0; i < view.row_count(); ++i) {
+        ASSERT_EQ(--expected, view.column(2).typed_data<INT64>()[i]);
+      }
+    }
+    EXPECT_EQ(0, expected);
+  }
+  EXPECT_LT(0, factory.files_created());
+  EXPECT_EQ(0, factory.disk_usage());
+}
+
+TEST(SorterTest, FailsBeyondDiskQuota) {
+  unique_ptr<Block> input = CreateParallelSortInput(30000);
+  const TupleSchema& schema = input->schema();
+  LocalTemporaryFileFactory factory({ "" }, 1 << 16);
+  SortOrder sort_order;
+  sort_order.add(ProjectAttributeAt(2), DESCENDING);
+  unique_ptr<Sorter> sorter(CreateUnbufferedSorter(
+      schema, SucceedOrDie(sort_order.Bind(schema)), 1 << 20, &factory,
+      FILE_COMPRESSION_NONE, HeapBufferAllocator::Get(), NULL));
+  EXPECT_TRUE(sorter->Write(input->view()).is_failure());
+  EXPECT_EQ(0, factory.disk_usage());
+}
+
+// With a quota too small for more than two open files, the merger goes through
+// several intermediate passes. Run k holds the values k, k + kRunCount, ...;
+// the additional cursor another kRunCount of them.
+TEST(MergerTest, CascadedMergeWithSmallFanIn) {
+  const int kRunCount = 11;
+  const int kRunLength = 1000;
+  vector<unique_ptr<Block>> runs;
+  for (int k = 0; k <= kRunCount; ++k) {
+    BlockBuilder<INT64, STRING> builder;
+    for (int i = 0; i < kRunLength; ++i) {
+      const int64_t value = static_cast<int64_t>(i) * (kRunCount + 1) + k;
+      builder.AddRow(value, StrCat("value_", value));
+    }
+    runs.push_back(builder.Build());
+  }
+  SortOrder sort_order;
+  sort_order.add(ProjectAttributeAt(0), ASCENDING);
+  const TupleSchema& schema = runs[0]->schema();
+  unique_ptr<Merger> merger(
+      CreateMerger(schema, 0, DefaultTemporaryFileFactory(""),
+                   FILE_COMPRESSION_LIGHTWEIGHT, HeapBufferAllocator::Get()));
+  for (int k = 0; k < kRunCount; ++k) {
+    ASSERT_TRUE(merger->AddSorted(BoundScanView(runs[k]->view())).is_success());
+  }
+  EXPECT_FALSE(merger->empty());
+  unique_ptr<Cursor> cursor(SucceedOrDie(merger->Merge(
+      SucceedOrDie(sort_order.Bind(schema)),
+      BoundScanView(runs[kRunCount]->view()))));
+  int64_t expected = 0;
+  while (true) {
+    ResultView result = cursor->Next(Cursor::kDefaultRowCount);
+    ASSERT_FALSE(result.is_failure());
+    if (result.is_eos()) break;
+    const View& view = result.view();
+    for (rowid_t i = 0; i < view.row_count(); ++i) {
+      ASSERT_EQ(expected, view.column(0).typed_data<INT64>()[i]);
+      ASSERT_EQ(StrCat("value_", expected),
+                view.column(1).typed_data<STRING>()[i].as_string());
+      ++expected;
+    }
+  }
+  EXPECT_EQ((kRunCount + 1) * kRunLength, expected);
+}
+
 }  // namespace supersonic
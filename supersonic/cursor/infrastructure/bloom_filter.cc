@@ -0,0 +1,67 @@
+// Copyright 2012 Google Inc. All Rights Reserved.
+//
+// Licensed under the Apache License, Version 2.0 (the "License");
+// you may not use this file except in compliance with the License.
+// You may obtain a copy of the License at
+//
+//     http://www.apache.org/licenses/LICENSE-2.0
+//
+// Unless required by applicable law or agreed to in writing, software
+// distributed under the License is distributed on an "AS IS" BASIS,
+// WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+// See the License for the specific language governing permissions and
+// limitations under the License.
+//
+
+#include "supersonic/cursor/infrastructure/bloom_filter.h"
+
+#include <string.h>
+
+#include "supersonic/base/exception/exception.h"
+#include "supersonic/base/exception/exception_macros.h"
+
+namespace supersonic {
+
+namespace {
+
+// Bits of the filter per expected key.
+const size_t kBitsPerKey = 10;
+
+const size_t kBitsPerBlock = 256;
+
+}  // namespace
+
+FailureOrOwned<BloomFilter> BloomFilter::Create(rowcount_t key_count,
+                                                BufferAllocator* allocator) {
+  const size_t block_count =
+      (key_count * kBitsPerKey + kBitsPerBlock - 1) / kBitsPerBlock + 1;
+  const size_t size = block_count * kWordsPerBlock * sizeof(uint32_t);
+  unique_ptr<Buffer> buffer(allocator->Allocate(size));
+  if (buffer == NULL) {
+    THROW(new Exception(ERROR_MEMORY_EXCEEDED,
+                        "Couldn't allocate memory for the Bloom filter"));
+  }
+  memset(buffer->data(), '\0', size);
+  return Success(
+      unique_ptr<BloomFilter>(new BloomFilter(std::move(buffer), block_count)));
+}
+
+void BloomFilter::InsertMany(const size_t* hash, bool_const_ptr selection,
+                             rowcount_t row_count) {
+  if (selection == NULL) {
+    for (rowid_t i = 0; i < row_count; ++i) Insert(hash[i]);
+  } else {
+    for (rowid_t i = 0; i < row_count; ++i) {
+      if (selection[i]) Insert(hash[i]);
+    }
+  }
+}
+
+void BloomFilter::FindMany(const size_t* hash, rowcount_t row_count,
+                           bool_ptr result) const {
+  for (rowid_t i = 0; i < row_count; ++i) {
+    result[i] = MayContain(hash[i]);
+  }
+}
+
+}  // namespace supersonic
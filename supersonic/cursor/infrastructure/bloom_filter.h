@@ -0,0 +1,120 @@
+// Copyright 2012 Google Inc. All Rights Reserved.
+//
+// Licensed under the Apache License, Version 2.0 (the "License");
+// you may not use this file except in compliance with the License.
+// You may obtain a copy of the License at
+//
+//     http://www.apache.org/licenses/LICENSE-2.0
+//
+// Unless required by applicable law or agreed to in writing, software
+// distributed under the License is distributed on an "AS IS" BASIS,
+// WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+// See the License for the specific language governing permissions and
+// limitations under the License.
+//
+// A blocked Bloom filter over key hashes, as computed by
+// row_hash_set::HashKeys. Used by the hash join to let the probe side drop the
+// rows that can't match before they reach the join (see
+// cursor/core/join_key_filter.h).
+
+#ifndef SUPERSONIC_CURSOR_INFRASTRUCTURE_BLOOM_FILTER_H_
+#define SUPERSONIC_CURSOR_INFRASTRUCTURE_BLOOM_FILTER_H_
+
+#include <stddef.h>
+#include <stdint.h>
+
+#include <memory>
+
+#include "supersonic/utils/macros.h"
+#include "supersonic/utils/exception/failureor.h"
+#include "supersonic/base/infrastructure/bit_pointers.h"
+#include "supersonic/base/infrastructure/types.h"
+#include "supersonic/base/memory/memory.h"
+
+namespace supersonic {
+
+// The filter is split into 256-bit blocks. A key sets 8 bits, one in every
+// 32-bit word of a single block, so a lookup touches only one cache line. With
+// the default sizing (about 10 bits per key) the false positive rate is about
+// 1-2%. There are no false negatives.
+class BloomFilter {
+ public:
+  // Creates an empty filter sized for key_count keys, allocated with the
+  // allocator (not owned). Fails with ERROR_MEMORY_EXCEEDED if the memory
+  // can't be allocated.
+  static FailureOrOwned<BloomFilter> Create(rowcount_t key_count,
+                                            BufferAllocator* allocator);
+
+  // Adds the key with the given hash.
+  void Insert(size_t hash) {
+    uint32_t* block = Block(hash);
+    const uint32_t key = static_cast<uint32_t>(Mix(hash));
+    for (int i = 0; i < kWordsPerBlock; ++i) {
+      block[i] |= BitMask(key, i);
+    }
+  }
+
+  // Returns false if the key with the given hash has certainly not been added.
+  bool MayContain(size_t hash) const {
+    const uint32_t* block = Block(hash);
+    const uint32_t key = static_cast<uint32_t>(Mix(hash));
+    for (int i = 0; i < kWordsPerBlock; ++i) {
+      if ((block[i] & BitMask(key, i)) == 0) return false;
+    }
+    return true;
+  }
+
+  // Adds the keys with the hashes hash[0 .. row_count - 1], skipping the ones
+  // for which the selection vector (if not NULL) is false.
+  void InsertMany(const size_t* hash, bool_const_ptr selection,
+                  rowcount_t row_count);
+
+  // Sets result[i] to MayContain(hash[i]), for i in [0, row_count).
+  void FindMany(const size_t* hash, rowcount_t row_count,
+                bool_ptr result) const;
+
+  size_t block_count() const { return block_count_; }
+
+ private:
+  static const int kWordsPerBlock = 8;
+
+  BloomFilter(unique_ptr<Buffer> buffer, size_t block_count)
+      : buffer_(std::move(buffer)),
+        words_(static_cast<uint32_t*>(buffer_->data())),
+        block_count_(block_count) {}
+
+  // The column hashers don't mix the bits of integer keys much, so the hashes
+  // are mixed once more (with the MurmurHash3 finalizer).
+  static uint64_t Mix(uint64_t hash) {
+    hash ^= hash >> 33;
+    hash *= 0xff51afd7ed558ccdULL;
+    hash ^= hash >> 33;
+    hash *= 0xc4ceb9fe1a85ec53ULL;
+    hash ^= hash >> 33;
+    return hash;
+  }
+
+  // The block is picked by the high 32 bits of the mixed hash, and the bits
+  // within it by the low 32 bits.
+  uint32_t* Block(size_t hash) const {
+    const uint64_t high = Mix(hash) >> 32;
+    return words_ + ((high * block_count_) >> 32) * kWordsPerBlock;
+  }
+
+  static uint32_t BitMask(uint32_t key, int word) {
+    static const uint32_t kSalt[kWordsPerBlock] = {
+        0x47b6137bU, 0x44974d91U, 0x8824ad5bU, 0xa2b7289dU,
+        0x705495c7U, 0x2df1424bU, 0x9efc4947U, 0x5c6bfb31U };
+    return 1U << ((key * kSalt[word]) >> 27);
+  }
+
+  unique_ptr<Buffer> buffer_;
+  uint32_t* const words_;
+  const size_t block_count_;
+
+  DISALLOW_COPY_AND_ASSIGN(BloomFilter);
+};
+
+}  // namespace supersonic
+
+#endif  // SUPERSONIC_CURSOR_INFRASTRUCTURE_BLOOM_FILTER_H_
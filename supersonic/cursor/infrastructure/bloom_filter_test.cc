@@ -0,0 +1,88 @@
+// Copyright 2012 Google Inc. All Rights Reserved.
+//
+// Licensed under the Apache License, Version 2.0 (the "License");
+// you may not use this file except in compliance with the License.
+// You may obtain a copy of the License at
+//
+//     http://www.apache.org/licenses/LICENSE-2.0
+//
+// Unless required by applicable law or agreed to in writing, software
+// distributed under the License is distributed on an "AS IS" BASIS,
+// WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+// See the License for the specific language governing permissions and
+// limitations under the License.
+//
+
+#include "supersonic/cursor/infrastructure/bloom_filter.h"
+
+#include <vector>
+
+#include "supersonic/base/exception/result.h"
+#include "supersonic/base/memory/memory.h"
+#include "gtest/gtest.h"
+
+namespace supersonic {
+
+namespace {
+
+unique_ptr<BloomFilter> CreateFilter(rowcount_t key_count) {
+  FailureOrOwned<BloomFilter> filter =
+      BloomFilter::Create(key_count, HeapBufferAllocator::Get());
+  CHECK(filter.is_success());
+  return filter.move();
+}
+
+TEST(BloomFilterTest, EmptyFilterContainsNothing) {
+  unique_ptr<BloomFilter> filter(CreateFilter(0));
+  EXPECT_EQ(1, filter->block_count());
+  for (size_t i = 0; i < 1000; ++i) {
+    EXPECT_FALSE(filter->MayContain(i));
+  }
+}
+
+TEST(BloomFilterTest, NoFalseNegatives) {
+  const rowcount_t kKeyCount = 10000;
+  unique_ptr<BloomFilter> filter(CreateFilter(kKeyCount));
+  for (size_t i = 0; i < kKeyCount; ++i) {
+    filter->Insert(i * 7919);
+  }
+  for (size_t i = 0; i < kKeyCount; ++i) {
+    EXPECT_TRUE(filter->MayContain(i * 7919));
+  }
+}
+
+TEST(BloomFilterTest, FewFalsePositives) {
+  const rowcount_t kKeyCount = 10000;
+  unique_ptr<BloomFilter> filter(CreateFilter(kKeyCount));
+  for (size_t i = 0; i < kKeyCount; ++i) {
+    filter->Insert(2 * i);
+  }
+  int false_positives = 0;
+  for (size_t i = 0; i < kKeyCount; ++i) {
+    if (filter->MayContain(2 * i + 1)) ++false_positives;
+  }
+  EXPECT_LT(false_positives, kKeyCount / 20);
+}
+
+TEST(BloomFilterTest, InsertManyAndFindMany) {
+  const rowcount_t kKeyCount = 100;
+  unique_ptr<BloomFilter> filter(CreateFilter(kKeyCount));
+  std::vector<size_t> hash(kKeyCount);
+  bool_array selection;
+  selection.Reallocate(kKeyCount, HeapBufferAllocator::Get());
+  for (rowid_t i = 0; i < kKeyCount; ++i) {
+    hash[i] = i;
+    selection.mutable_data()[i] = (i % 2 == 0);
+  }
+  filter->InsertMany(&hash.front(), selection.const_data(), kKeyCount);
+  bool_array result;
+  result.Reallocate(kKeyCount, HeapBufferAllocator::Get());
+  filter->FindMany(&hash.front(), kKeyCount, result.mutable_data());
+  for (rowid_t i = 0; i < kKeyCount; i += 2) {
+    EXPECT_TRUE(result.const_data()[i]);
+  }
+}
+
+}  // namespace
+
+}  // namespace supersonic
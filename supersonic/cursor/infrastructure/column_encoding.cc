@@ -0,0 +1,538 @@
+// Copyright 2012 Google Inc. All Rights Reserved.
+//
+// Licensed under the Apache License, Version 2.0 (the "License");
+// you may not use this file except in compliance with the License.
+// You may obtain a copy of the License at
+//
+//     http://www.apache.org/licenses/LICENSE-2.0
+//
+// Unless required by applicable law or agreed to in writing, software
+// distributed under the License is distributed on an "AS IS" BASIS,
+// WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+// See the License for the specific language governing permissions and
+// limitations under the License.
+//
+// Format of an encoded column: the is_null bitmap (only if the column is
+// nullable; (row_count + 7) / 8 bytes, least significant bit first), then a
+// byte with the Encoding, then its payload:
+// - PLAIN: the values as they are in the column (for STRING and BINARY, their
+//   lengths as packed integers, followed by their bytes);
+// - FRAME_OF_REFERENCE: the values as packed integers;
+// - DELTA: the first value (8 bytes), then the differences between the
+//   consecutive values, zig-zag encoded, as packed integers;
+// - DICTIONARY: the number of distinct values (8 bytes), their lengths as
+//   packed integers, their bytes, and the index of every row's value as
+//   packed integers.
+// Packed integers are stored as their minimum (8 bytes) and the number of bits
+// per value (1 byte), followed by the differences from the minimum, of that
+// many bits each, least significant bit first.
+//
+// Integer values are mapped to uint64_t preserving their order (the signed
+// ones sign-extended, with their sign bit flipped).
+
+#include "supersonic/cursor/infrastructure/column_encoding.h"
+
+#include <stdint.h>
+#include <string.h>
+
+#include <algorithm>
+#include <limits>
+#include <type_traits>
+#include <unordered_map>
+#include <vector>
+using std::vector;
+
+#include <glog/logging.h>
+#include "supersonic/utils/logging-inl.h"
+#include "supersonic/base/exception/exception.h"
+#include "supersonic/base/exception/exception_macros.h"
+#include "supersonic/base/infrastructure/bit_pointers.h"
+#include "supersonic/base/infrastructure/block.h"
+#include "supersonic/base/infrastructure/types_infrastructure.h"
+#include "supersonic/base/memory/arena.h"
+
+namespace supersonic {
+
+namespace {
+
+enum Encoding {
+  PLAIN = 0,
+  FRAME_OF_REFERENCE = 1,
+  DELTA = 2,
+  DICTIONARY = 3
+};
+
+// A dictionary is used only if there are at most that many rows per distinct
+// value.
+const size_t kMinRowsPerDictionaryEntry = 2;
+
+const uint64_t kSignBit = 0x8000000000000000ULL;
+
+void AppendUint8(uint8_t value, string* output) {
+  output->push_back(static_cast<char>(value));
+}
+
+void AppendUint64(uint64_t value, string* output) {
+  output->append(reinterpret_cast<const char*>(&value), sizeof(value));
+}
+
+int BitWidth(uint64_t value) {
+  return (value == 0) ? 0 : 64 - __builtin_clzll(value);
+}
+
+size_t PackedBitsSize(size_t count, int width) {
+  return (count * width + 7) / 8;
+}
+
+// Appends the values, of width bits each (all the higher bits must be 0).
+void AppendPackedBits(const uint64_t* values, size_t count, int width,
+                      string* output) {
+  if (width == 0) return;
+  const size_t start = output->size();
+  output->resize(start + PackedBitsSize(count, width));
+  char* out = &(*output)[start];
+  uint64_t buffer = 0;
+  int bits = 0;  // Bits used in the buffer; always less than 64.
+  for (size_t i = 0; i < count; ++i) {
+    const uint64_t value = values[i];
+    buffer |= value << bits;
+    if (bits + width >= 64) {
+      memcpy(out, &buffer, sizeof(buffer));
+      out += sizeof(buffer);
+      buffer = (bits == 0) ? 0 : value >> (64 - bits);
+      bits += width - 64;
+    } else {
+      bits += width;
+    }
+  }
+  memcpy(out, &buffer, (bits + 7) / 8);
+}
+
+// Reads back count values written by AppendPackedBits, from the
+// PackedBitsSize(count, width) bytes at data.
+void UnpackBits(const char* data, size_t count, int width, uint64_t* values) {
+  if (width == 0) {
+    std::fill(values, values + count, 0);
+    return;
+  }
+  const uint64_t mask = (width == 64) ? ~0ULL : (1ULL << width) - 1;
+  const size_t size = PackedBitsSize(count, width);
+  size_t position = 0;
+  uint64_t buffer = 0;
+  int bits = 0;  // Bits left in the buffer.
+  for (size_t i = 0; i < count; ++i) {
+    if (bits >= width) {
+      values[i] = buffer & mask;
+      buffer = (width == 64) ? 0 : buffer >> width;
+      bits -= width;
+    } else {
+      uint64_t next = 0;
+      const size_t length = std::min(sizeof(next), size - position);
+      memcpy(&next, data + position, length);
+      position += length;
+      values[i] = (buffer | (next << bits)) & mask;
+      const int used = width - bits;
+      buffer = (used == 64) ? 0 : next >> used;
+      bits = length * 8 - used;
+    }
+  }
+}
+
+// Returns the size of the values stored with AppendPackedIntegers.
+size_t PackedIntegersSize(const uint64_t* values, size_t count) {
+  if (count == 0) return sizeof(uint64_t) + 1;
+  const auto min_max = std::minmax_element(values, values + count);
+  return sizeof(uint64_t) + 1 +
+      PackedBitsSize(count, BitWidth(*min_max.second - *min_max.first));
+}
+
+// Appends the values as packed integers. Modifies the values.
+void AppendPackedIntegers(uint64_t* values, size_t count, string* output) {
+  uint64_t base = 0;
+  int width = 0;
+  if (count > 0) {
+    const auto min_max = std::minmax_element(values, values + count);
+    base = *min_max.first;
+    width = BitWidth(*min_max.second - base);
+  }
+  AppendUint64(base, output);
+  AppendUint8(width, output);
+  for (size_t i = 0; i < count; ++i) {
+    values[i] -= base;
+  }
+  AppendPackedBits(values, count, width, output);
+}
+
+inline uint64_t ZigZag(uint64_t delta) {
+  return (delta << 1) ^ static_cast<uint64_t>(static_cast<int64_t>(delta) >> 63);
+}
+
+inline uint64_t UnZigZag(uint64_t value) {
+  return (value >> 1) ^ (~(value & 1) + 1);
+}
+
+template<typename CppType>
+inline uint64_t ToOrdered(CppType value) {
+  return std::is_signed<CppType>::value
+      ? static_cast<uint64_t>(static_cast<int64_t>(value)) ^ kSignBit
+      : static_cast<uint64_t>(value);
+}
+
+template<typename CppType>
+inline CppType FromOrdered(uint64_t value) {
+  return std::is_signed<CppType>::value
+      ? static_cast<CppType>(static_cast<int64_t>(value ^ kSignBit))
+      : static_cast<CppType>(value);
+}
+
+template<>
+inline bool FromOrdered<bool>(uint64_t value) { return value != 0; }
+
+inline bool IsNull(bool_const_ptr is_null, rowid_t row) {
+  return is_null != NULL && is_null[row];
+}
+
+template<DataType type>
+void EncodeIntegers(const Column& column, rowcount_t row_count,
+                    string* output) {
+  typedef typename TypeTraits<type>::cpp_type CppType;
+  const CppType* data = column.typed_data<type>();
+  bool_const_ptr is_null = column.is_null();
+  // The values under NULLs are replaced with the previous value (the first
+  // non-NULL one for the leading NULLs), so they don't widen the range.
+  rowid_t first = 0;
+  while (first < row_count && IsNull(is_null, first)) ++first;
+  vector<uint64_t> values(row_count);
+  uint64_t previous = (first < row_count) ? ToOrdered(data[first]) : 0;
+  for (rowid_t i = 0; i < row_count; ++i) {
+    if (!IsNull(is_null, i)) previous = ToOrdered(data[i]);
+    values[i] = previous;
+  }
+  vector<uint64_t> deltas(row_count > 0 ? row_count - 1 : 0);
+  for (rowid_t i = 1; i < row_count; ++i) {
+    deltas[i - 1] = ZigZag(values[i] - values[i - 1]);
+  }
+
+  const size_t plain_size = row_count * sizeof(CppType);
+  const size_t frame_of_reference_size =
+      PackedIntegersSize(values.data(), values.size());
+  const size_t delta_size = (row_count == 0)
+      ? std::numeric_limits<size_t>::max()
+      : sizeof(uint64_t) + PackedIntegersSize(deltas.data(), deltas.size());
+  if (plain_size <= frame_of_reference_size && plain_size <= delta_size) {
+    AppendUint8(PLAIN, output);
+    output->append(reinterpret_cast<const char*>(data), plain_size);
+  } else if (frame_of_reference_size <= delta_size) {
+    AppendUint8(FRAME_OF_REFERENCE, output);
+    AppendPackedIntegers(values.data(), values.size(), output);
+  } else {
+    AppendUint8(DELTA, output);
+    AppendUint64(values[0], output);
+    AppendPackedIntegers(deltas.data(), deltas.size(), output);
+  }
+}
+
+void EncodeStrings(const Column& column, rowcount_t row_count,
+                   string* output) {
+  const StringPiece* data = column.variable_length_data();
+  bool_const_ptr is_null = column.is_null();
+  vector<uint64_t> lengths(row_count);
+  size_t total_length = 0;
+  for (rowid_t i = 0; i < row_count; ++i) {
+    lengths[i] = IsNull(is_null, i) ? 0 : data[i].size();
+    total_length += lengths[i];
+  }
+  const size_t plain_size =
+      PackedIntegersSize(lengths.data(), lengths.size()) + total_length;
+
+  // Gives up on the dictionary as soon as it has too many entries.
+  const size_t max_entry_count = row_count / kMinRowsPerDictionaryEntry;
+  std::unordered_map<StringPiece, uint64_t> dictionary;
+  vector<StringPiece> entries;
+  vector<uint64_t> indexes(row_count);
+  for (rowid_t i = 0; i < row_count && entries.size() <= max_entry_count;
+       ++i) {
+    const StringPiece value = IsNull(is_null, i) ? StringPiece() : data[i];
+    auto inserted = dictionary.insert(std::make_pair(value, entries.size()));
+    if (inserted.second) entries.push_back(value);
+    indexes[i] = inserted.first->second;
+  }
+  if (row_count > 0 && entries.size() <= max_entry_count) {
+    vector<uint64_t> entry_lengths(entries.size());
+    size_t entries_length = 0;
+    for (size_t i = 0; i < entries.size(); ++i) {
+      entry_lengths[i] = entries[i].size();
+      entries_length += entries[i].size();
+    }
+    const size_t dictionary_size = sizeof(uint64_t) +
+        PackedIntegersSize(entry_lengths.data(), entry_lengths.size()) +
+        entries_length + PackedIntegersSize(indexes.data(), indexes.size());
+    if (dictionary_size < plain_size) {
+      AppendUint8(DICTIONARY, output);
+      AppendUint64(entries.size(), output);
+      AppendPackedIntegers(entry_lengths.data(), entry_lengths.size(), output);
+      for (const StringPiece& entry : entries) {
+        output->append(entry.data(), entry.size());
+      }
+      AppendPackedIntegers(indexes.data(), indexes.size(), output);
+      return;
+    }
+  }
+  AppendUint8(PLAIN, output);
+  AppendPackedIntegers(lengths.data(), lengths.size(), output);
+  // AppendPackedIntegers modified the lengths.
+  for (rowid_t i = 0; i < row_count; ++i) {
+    if (!IsNull(is_null, i)) output->append(data[i].data(), data[i].size());
+  }
+}
+
+void EncodePlain(const Column& column, rowcount_t row_count, string* output) {
+  AppendUint8(PLAIN, output);
+  output->append(static_cast<const char*>(column.data().raw()),
+                 row_count * column.type_info().size());
+}
+
+// Reads consecutive parts of the encoded column.
+class Reader {
+ public:
+  explicit Reader(StringPiece input)
+      : data_(input.data()),
+        remaining_(input.size()) {}
+
+  bool ReadUint8(uint8_t* value) { return Read(sizeof(*value), value); }
+
+  bool ReadUint64(uint64_t* value) { return Read(sizeof(*value), value); }
+
+  bool Read(size_t length, void* target) {
+    const char* data;
+    if (!Skip(length, &data)) return false;
+    memcpy(target, data, length);
+    return true;
+  }
+
+  // Points data to the next length bytes, and moves past them.
+  bool Skip(size_t length, const char** data) {
+    if (length > remaining_) return false;
+    *data = data_;
+    data_ += length;
+    remaining_ -= length;
+    return true;
+  }
+
+  // Reads count packed integers.
+  bool ReadPackedIntegers(size_t count, uint64_t* values) {
+    uint64_t base;
+    uint8_t width;
+    const char* data;
+    if (!ReadUint64(&base) || !ReadUint8(&width) || width > 64 ||
+        !Skip(PackedBitsSize(count, width), &data)) {
+      return false;
+    }
+    UnpackBits(data, count, width, values);
+    for (size_t i = 0; i < count; ++i) {
+      values[i] += base;
+    }
+    return true;
+  }
+
+  size_t remaining() const { return remaining_; }
+
+ private:
+  const char* data_;
+  size_t remaining_;
+};
+
+FailureOrVoid MalformedInput() {
+  THROW(new Exception(ERROR_GENERAL_IO_ERROR, "Malformed encoded column."));
+}
+
+template<DataType type>
+FailureOrVoid DecodeIntegers(Reader* reader, uint8_t encoding,
+                             rowcount_t row_count, OwnedColumn* column) {
+  typedef typename TypeTraits<type>::cpp_type CppType;
+  CppType* data = column->mutable_typed_data<type>();
+  if (encoding == PLAIN) {
+    if (!reader->Read(row_count * sizeof(CppType), data)) {
+      return MalformedInput();
+    }
+    return Success();
+  }
+  vector<uint64_t> values(row_count);
+  if (encoding == FRAME_OF_REFERENCE) {
+    if (!reader->ReadPackedIntegers(row_count, values.data())) {
+      return MalformedInput();
+    }
+    for (rowid_t i = 0; i < row_count; ++i) {
+      data[i] = FromOrdered<CppType>(values[i]);
+    }
+    return Success();
+  }
+  if (encoding != DELTA || row_count == 0) return MalformedInput();
+  uint64_t value;
+  if (!reader->ReadUint64(&value) ||
+      !reader->ReadPackedIntegers(row_count - 1, values.data())) {
+    return MalformedInput();
+  }
+  data[0] = FromOrdered<CppType>(value);
+  for (rowid_t i = 1; i < row_count; ++i) {
+    value += UnZigZag(values[i - 1]);
+    data[i] = FromOrdered<CppType>(value);
+  }
+  return Success();
+}
+
+// Copies the strings, of the given lengths, from the reader to the arena and
+// sets the pieces to them.
+FailureOrVoid ReadStrings(Reader* reader, const vector<uint64_t>& lengths,
+                          Arena* arena, StringPiece* pieces) {
+  size_t total_length = 0;
+  for (uint64_t length : lengths) {
+    if (length > reader->remaining()) return MalformedInput();
+    total_length += length;
+  }
+  const char* source;
+  if (!reader->Skip(total_length, &source)) return MalformedInput();
+  char* target = NULL;
+  if (total_length > 0) {
+    target = static_cast<char*>(arena->AllocateBytes(total_length));
+    if (target == NULL) {
+      THROW(new Exception(ERROR_MEMORY_EXCEEDED,
+                          "Arena allocation for decoded strings failed."));
+    }
+    memcpy(target, source, total_length);
+  }
+  for (size_t i = 0; i < lengths.size(); ++i) {
+    pieces[i] = StringPiece(target, lengths[i]);
+    target += lengths[i];
+  }
+  return Success();
+}
+
+FailureOrVoid DecodeStrings(Reader* reader, uint8_t encoding,
+                            rowcount_t row_count, OwnedColumn* column) {
+  StringPiece* data = column->mutable_variable_length_data();
+  if (encoding == PLAIN) {
+    vector<uint64_t> lengths(row_count);
+    if (!reader->ReadPackedIntegers(row_count, lengths.data())) {
+      return MalformedInput();
+    }
+    return ReadStrings(reader, lengths, column->arena(), data);
+  }
+  if (encoding != DICTIONARY) return MalformedInput();
+  uint64_t entry_count;
+  if (!reader->ReadUint64(&entry_count) || entry_count > row_count) {
+    return MalformedInput();
+  }
+  vector<uint64_t> entry_lengths(entry_count);
+  if (!reader->ReadPackedIntegers(entry_count, entry_lengths.data())) {
+    return MalformedInput();
+  }
+  vector<StringPiece> entries(entry_count);
+  PROPAGATE_ON_FAILURE(ReadStrings(reader, entry_lengths, column->arena(),
+                                   entries.data()));
+  vector<uint64_t> indexes(row_count);
+  if (!reader->ReadPackedIntegers(row_count, indexes.data())) {
+    return MalformedInput();
+  }
+  for (rowid_t i = 0; i < row_count; ++i) {
+    if (indexes[i] >= entry_count) return MalformedInput();
+    data[i] = entries[indexes[i]];
+  }
+  return Success();
+}
+
+}  // namespace
+
+void EncodeColumn(const Column& column, rowcount_t row_count, string* output) {
+  if (column.attribute().is_nullable()) {
+    const size_t start = output->size();
+    output->resize(start + bit_pointer::byte_count(row_count), '\0');
+    char* bitmap = &(*output)[start];
+    bool_const_ptr is_null = column.is_null();
+    for (rowid_t i = 0; i < row_count; ++i) {
+      if (IsNull(is_null, i)) bitmap[i / 8] |= 1 << (i % 8);
+    }
+  }
+  switch (column.type_info().type()) {
+    case INT32: EncodeIntegers<INT32>(column, row_count, output); break;
+    case INT64: EncodeIntegers<INT64>(column, row_count, output); break;
+    case UINT32: EncodeIntegers<UINT32>(column, row_count, output); break;
+    case UINT64: EncodeIntegers<UINT64>(column, row_count, output); break;
+    case BOOL: EncodeIntegers<BOOL>(column, row_count, output); break;
+    case DATE: EncodeIntegers<DATE>(column, row_count, output); break;
+    case DATETIME: EncodeIntegers<DATETIME>(column, row_count, output); break;
+    case ENUM: EncodeIntegers<ENUM>(column, row_count, output); break;
+    case STRING:
+    case BINARY:
+      EncodeStrings(column, row_count, output);
+      break;
+    default:
+      EncodePlain(column, row_count, output);
+  }
+}
+
+FailureOrVoid DecodeColumn(StringPiece input, rowcount_t row_count,
+                           OwnedColumn* column) {
+  Reader reader(input);
+  if (column->content().attribute().is_nullable()) {
+    const char* bitmap;
+    if (!reader.Skip(bit_pointer::byte_count(row_count), &bitmap)) {
+      return MalformedInput();
+    }
+    bool_ptr is_null = column->mutable_is_null();
+    for (rowid_t i = 0; i < row_count; ++i) {
+      is_null[i] = (bitmap[i / 8] >> (i % 8)) & 1;
+    }
+  }
+  uint8_t encoding;
+  if (!reader.ReadUint8(&encoding)) return MalformedInput();
+  switch (column->content().type_info().type()) {
+    case INT32:
+      PROPAGATE_ON_FAILURE(
+          DecodeIntegers<INT32>(&reader, encoding, row_count, column));
+      break;
+    case INT64:
+      PROPAGATE_ON_FAILURE(
+          DecodeIntegers<INT64>(&reader, encoding, row_count, column));
+      break;
+    case UINT32:
+      PROPAGATE_ON_FAILURE(
+          DecodeIntegers<UINT32>(&reader, encoding, row_count, column));
+      break;
+    case UINT64:
+      PROPAGATE_ON_FAILURE(
+          DecodeIntegers<UINT64>(&reader, encoding, row_count, column));
+      break;
+    case BOOL:
+      PROPAGATE_ON_FAILURE(
+          DecodeIntegers<BOOL>(&reader, encoding, row_count, column));
+      break;
+    case DATE:
+      PROPAGATE_ON_FAILURE(
+          DecodeIntegers<DATE>(&reader, encoding, row_count, column));
+      break;
+    case DATETIME:
+      PROPAGATE_ON_FAILURE(
+          DecodeIntegers<DATETIME>(&reader, encoding, row_count, column));
+      break;
+    case ENUM:
+      PROPAGATE_ON_FAILURE(
+          DecodeIntegers<ENUM>(&reader, encoding, row_count, column));
+      break;
+    case STRING:
+    case BINARY:
+      PROPAGATE_ON_FAILURE(
+          DecodeStrings(&reader, encoding, row_count, column));
+      break;
+    default:
+      if (encoding != PLAIN ||
+          !reader.Read(row_count * column->content().type_info().size(),
+                       column->mutable_data())) {
+        return MalformedInput();
+      }
+  }
+  if (reader.remaining() != 0) return MalformedInput();
+  return Success();
+}
+
+}  // namespace supersonic
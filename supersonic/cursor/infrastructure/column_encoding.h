@@ -0,0 +1,58 @@
+// Copyright 2012 Google Inc. All Rights Reserved.
+//
+// Licensed under the Apache License, Version 2.0 (the "License");
+// you may not use this file except in compliance with the License.
+// You may obtain a copy of the License at
+//
+//     http://www.apache.org/licenses/LICENSE-2.0
+//
+// Unless required by applicable law or agreed to in writing, software
+// distributed under the License is distributed on an "AS IS" BASIS,
+// WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+// See the License for the specific language governing permissions and
+// limitations under the License.
+//
+// Lightweight encodings of columns, used by file_io to compress the data
+// spilled to temporary files. Every column is encoded on its own, with the
+// encoding that gives the fewest bytes for its values:
+// - integers (also DATE, DATETIME, ENUM and BOOL) as they are, bit-packed
+//   relative to their minimum (frame of reference), or as bit-packed
+//   differences between consecutive values (delta), which suits sorted
+//   columns and timestamps;
+// - STRING and BINARY as bit-packed lengths followed by the bytes, or as a
+//   dictionary of the distinct values and bit-packed indexes into it;
+// - FLOAT and DOUBLE as they are.
+// The is_null vector of a nullable column is stored as a bitmap first. The
+// values under NULLs are not preserved.
+//
+// The encoding is meant for temporary storage on the same machine: it stores
+// the integers in host byte order, like the rest of the file_io format.
+
+#ifndef SUPERSONIC_CURSOR_INFRASTRUCTURE_COLUMN_ENCODING_H_
+#define SUPERSONIC_CURSOR_INFRASTRUCTURE_COLUMN_ENCODING_H_
+
+#include <string>
+namespace supersonic {using std::string; }
+
+#include "supersonic/base/exception/result.h"
+#include "supersonic/base/infrastructure/types.h"
+#include "supersonic/utils/strings/stringpiece.h"
+
+namespace supersonic {
+
+class Column;
+class OwnedColumn;
+
+// Appends the encoding of the first row_count rows of the column to output.
+void EncodeColumn(const Column& column, rowcount_t row_count, string* output);
+
+// Decodes row_count rows encoded with EncodeColumn into the column, which must
+// have the same attribute and capacity for the rows. Variable-length values
+// are copied to the column's arena. Fails if the input is malformed, or on
+// OOM.
+FailureOrVoid DecodeColumn(StringPiece input, rowcount_t row_count,
+                           OwnedColumn* column);
+
+}  // namespace supersonic
+
+#endif  // SUPERSONIC_CURSOR_INFRASTRUCTURE_COLUMN_ENCODING_H_
@@ -0,0 +1,178 @@
+// Copyright 2012 Google Inc. All Rights Reserved.
+//
+// Licensed under the Apache License, Version 2.0 (the "License");
+// you may not use this file except in compliance with the License.
+// You may obtain a copy of the License at
+//
+//     http://www.apache.org/licenses/LICENSE-2.0
+//
+// Unless required by applicable law or agreed to in writing, software
+// distributed under the License is distributed on an "AS IS" BASIS,
+// WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+// See the License for the specific language governing permissions and
+// limitations under the License.
+//
+
+#include "supersonic/cursor/infrastructure/column_encoding.h"
+
+#include <memory>
+#include <string>
+using std::string;
+
+#include "supersonic/base/infrastructure/block.h"
+#include "supersonic/base/memory/memory.h"
+#include "supersonic/testing/block_builder.h"
+#include "supersonic/testing/comparators.h"
+#include "supersonic/utils/random.h"
+#include "supersonic/utils/strings/stringpiece.h"
+#include "gtest/gtest.h"
+
+namespace supersonic {
+
+namespace {
+
+// Encodes every column of the view, decodes it into a new block and expects
+// it to be equal to the original. Returns the total size of the encodings.
+size_t ExpectRoundTrip(const View& view) {
+  std::unique_ptr<Block> decoded(
+      new Block(view.schema(), HeapBufferAllocator::Get()));
+  EXPECT_TRUE(decoded->Reallocate(view.row_count()));
+  size_t size = 0;
+  for (int i = 0; i < view.column_count(); ++i) {
+    string encoded;
+    EncodeColumn(view.column(i), view.row_count(), &encoded);
+    size += encoded.size();
+    EXPECT_TRUE(DecodeColumn(encoded, view.row_count(),
+                             decoded->mutable_column(i)).is_success());
+  }
+  View decoded_view(decoded->view());
+  decoded_view.set_row_count(view.row_count());
+  EXPECT_VIEWS_EQUAL(view, decoded_view);
+  return size;
+}
+
+TEST(ColumnEncodingTest, AllTypesWithNulls) {
+  std::unique_ptr<Block> block(
+      BlockBuilder<INT32, INT64, UINT32, UINT64, BOOL, DATE, DATETIME,
+                   FLOAT, DOUBLE, STRING>()
+          .AddRow(-7, -5000000000LL, 4000000000U, 18000000000000000000ULL,
+                  true, 17000, 1500000000000000LL, 2.5f, -1e300, "foo")
+          .AddRow(__, __, __, __, __, __, __, __, __, __)
+          .AddRow(2147483647, 0, 0, 0, false, 0, -1, -0.0f, 0.0, "")
+          .AddRow(-2147483647 - 1, 9223372036854775807LL, 7, 1, true, 1, 0,
+                  1e30f, 1e-300, "a somewhat longer string")
+          .Build());
+  ExpectRoundTrip(block->view());
+}
+
+TEST(ColumnEncodingTest, NotNullColumns) {
+  // Without NULLs, BlockBuilder makes the columns not nullable.
+  std::unique_ptr<Block> block(BlockBuilder<INT64, BINARY>()
+      .AddRow(3, "x")
+      .AddRow(1, "")
+      .AddRow(2, "zz")
+      .Build());
+  ASSERT_FALSE(block->schema().attribute(0).is_nullable());
+  ExpectRoundTrip(block->view());
+}
+
+TEST(ColumnEncodingTest, EmptyColumns) {
+  std::unique_ptr<Block> block(BlockBuilder<INT32, STRING, DOUBLE>().Build());
+  ExpectRoundTrip(block->view());
+}
+
+TEST(ColumnEncodingTest, SmallRangeIsBitPacked) {
+  BlockBuilder<INT64> builder;
+  for (int i = 0; i < 1000; ++i) {
+    builder.AddRow(1000000000000LL + (i * 7919) % 16);
+  }
+  std::unique_ptr<Block> block(builder.Build());
+  // 4 bits per value.
+  EXPECT_GT(1000 * sizeof(int64_t) / 8, ExpectRoundTrip(block->view()));
+}
+
+TEST(ColumnEncodingTest, SortedValuesAreDeltaEncoded) {
+  BlockBuilder<DATETIME> builder;
+  MTRandom random(0);
+  int64_t timestamp = 1500000000000000LL;
+  for (int i = 0; i < 1000; ++i) {
+    timestamp += random.Rand32() % 1000;
+    builder.AddRow(timestamp);
+  }
+  std::unique_ptr<Block> block(builder.Build());
+  // The range is too wide for the frame of reference to pay off as much;
+  // the 10-bit deltas do.
+  EXPECT_GT(1000 * sizeof(int64_t) / 4, ExpectRoundTrip(block->view()));
+}
+
+TEST(ColumnEncodingTest, DescendingValuesAreDeltaEncoded) {
+  BlockBuilder<INT32> builder;
+  for (int i = 0; i < 1000; ++i) {
+    builder.AddRow(2000000000 - i * 3);
+  }
+  std::unique_ptr<Block> block(builder.Build());
+  EXPECT_GT(1000 * sizeof(int32_t) / 4, ExpectRoundTrip(block->view()));
+}
+
+TEST(ColumnEncodingTest, RepeatedStringsUseDictionary) {
+  BlockBuilder<STRING> builder;
+  const char* kValues[] = { "Mountain View", "New York", "Zurich", "Warsaw" };
+  for (int i = 0; i < 1000; ++i) {
+    if (i % 17 == 0) {
+      builder.AddRow(__);
+    } else {
+      builder.AddRow(kValues[(i * 7) % 4]);
+    }
+  }
+  std::unique_ptr<Block> block(builder.Build());
+  // The null bitmap and 3 bits per index (NULLs get an entry too), rather
+  // than about 8 bytes per row.
+  EXPECT_GT(1000, ExpectRoundTrip(block->view()));
+}
+
+TEST(ColumnEncodingTest, RandomValues) {
+  MTRandom random(17);
+  BlockBuilder<INT64, UINT32, STRING> builder;
+  for (int i = 0; i < 2000; ++i) {
+    if (random.Rand32() % 10 == 0) {
+      builder.AddRow(__, __, __);
+    } else {
+      builder.AddRow(static_cast<int64_t>(random.Rand64()), random.Rand32(),
+                     string(random.Rand32() % 20, 'a' + random.Rand32() % 26));
+    }
+  }
+  std::unique_ptr<Block> block(builder.Build());
+  ExpectRoundTrip(block->view());
+}
+
+TEST(ColumnEncodingTest, MalformedInput) {
+  std::unique_ptr<Block> block(BlockBuilder<INT64, STRING>()
+      .AddRow(1, "one")
+      .AddRow(__, "two")
+      .AddRow(3, __)
+      .Build());
+  std::unique_ptr<Block> decoded(
+      new Block(block->schema(), HeapBufferAllocator::Get()));
+  ASSERT_TRUE(decoded->Reallocate(3));
+  for (int i = 0; i < 2; ++i) {
+    string encoded;
+    EncodeColumn(block->column(i), 3, &encoded);
+    // Truncated.
+    for (size_t length = 0; length < encoded.size(); ++length) {
+      EXPECT_TRUE(DecodeColumn(StringPiece(encoded.data(), length), 3,
+                               decoded->mutable_column(i)).is_failure());
+    }
+    // Trailing bytes.
+    EXPECT_TRUE(DecodeColumn(encoded + "x", 3,
+                             decoded->mutable_column(i)).is_failure());
+    // Unknown encoding.
+    string unknown = encoded;
+    unknown[1] = 100;
+    EXPECT_TRUE(DecodeColumn(unknown, 3,
+                             decoded->mutable_column(i)).is_failure());
+  }
+}
+
+}  // namespace
+
+}  // namespace supersonic
@@ -20,6 +20,7 @@
 
 #include "supersonic/base/exception/result.h"
 #include "supersonic/base/infrastructure/types.h"
+#include "supersonic/cursor/infrastructure/file_io.h"
 
 class File;
 
@@ -30,6 +31,7 @@ class View;
 FailureOrVoid WriteViewWithMaxChunkRowCount(
     const View& view,
     const rowcount_t max_chunk_row_count,
+    FileCompression compression,
     File* output_file);
 
 }  // namespace supersonic
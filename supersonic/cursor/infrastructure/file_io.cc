@@ -25,19 +25,37 @@
 // for null and empty strings), then single array with data for all not null and
 // not empty elements.
 //
+// If the file is written with compression, every chunk's row count has the
+// kEncodedChunk bit set, and each column is stored as a byte with the
+// ColumnCompression, the size of the stored data (8 bytes), the size of the
+// data uncompressed (8 bytes; only for LZ4) and the data: the column encoded
+// with EncodeColumn (see column_encoding.h), compressed with LZ4 if so marked.
+//
 // Note - this is suitable only for temporary storage; for long-term storage
 // other formats should be used.
 
 #include "supersonic/cursor/infrastructure/file_io.h"
 #include "supersonic/cursor/infrastructure/file_io-internal.h"
 
+#include <errno.h>
+#include <fcntl.h>
+#include <string.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <unistd.h>
 #include <cstddef>
 
 #include <algorithm>
 #include "supersonic/utils/std_namespace.h"
+#include <condition_variable>
 #include <limits>
 #include "supersonic/utils/std_namespace.h"
 #include <memory>
+#include <mutex>
+
+#ifdef HAVE_LZ4_H
+#include <lz4.h>
+#endif  // HAVE_LZ4_H
 
 #include "supersonic/utils/integral_types.h"
 #include <glog/logging.h>
@@ -56,10 +74,15 @@
 #include "supersonic/cursor/base/cursor.h"
 #include "supersonic/cursor/proto/cursors.pb.h"
 #include "supersonic/cursor/infrastructure/basic_cursor.h"
+#include "supersonic/cursor/infrastructure/column_encoding.h"
 #include "supersonic/cursor/infrastructure/iterators.h"
+#include "supersonic/cursor/infrastructure/temporary_file_factory.h"
+#include "supersonic/cursor/infrastructure/thread_pool.h"
 #include "supersonic/cursor/infrastructure/writer.h"
 #include "supersonic/proto/supersonic.pb.h"
 #include "supersonic/utils/file.h"
+#include "supersonic/utils/file_util.h"
+#include "supersonic/utils/strings/strcat.h"
 #include "supersonic/utils/strings/stringpiece.h"
 
 namespace supersonic {
@@ -69,29 +92,125 @@ namespace supersonic {
 
 static const int kMaxChunkRowCount = 8192;
 
+// Set in the row count of the chunks with encoded columns.
+static const uint64_t kEncodedChunk = 1ULL << 63;
+
+// Size of the buffers of the reads ahead and writes behind.
+static const size_t kFileIOBufferSize = 128 << 10;
+
+// Threads of FileIOThreadPool().
+static const int kFileIOThreadCount = 4;
+
+ThreadPool* FileIOThreadPool() {
+  static ThreadPool* const thread_pool = new ThreadPool(kFileIOThreadCount);
+  return thread_pool;
+}
+
 namespace {
 
+// How an encoded column is stored.
+enum ColumnCompression {
+  COLUMN_UNCOMPRESSED = 0,
+  COLUMN_LZ4 = 1
+};
+
 static Exception* NewFileOutputException() {
   return (new Exception(ERROR_GENERAL_IO_ERROR,
                         "Writing view to the output file failed."));
 }
 
+// Writes to a file. Without a thread pool, the data goes straight to the
+// file. With one, it is appended to a buffer, and every full buffer is
+// written to the file by a task on the pool, while the next one is filled
+// (write-behind).
+class OutputFile {
+ public:
+  // Doesn't take ownership of the file nor the thread pool (may be NULL).
+  OutputFile(File* file, ThreadPool* thread_pool)
+      : file_(file),
+        thread_pool_(thread_pool),
+        writing_(false),
+        failed_(false) {}
+
+  // Waits for the write in progress, if any.
+  ~OutputFile() {
+    std::unique_lock<std::mutex> lock(mutex_);
+    done_.wait(lock, [this] { return !writing_; });
+  }
+
+  FailureOrVoid Write(const void* data, size_t length) {
+    if (thread_pool_ == NULL) {
+      if (file_->Write(data, length) != length) {
+        THROW(NewFileOutputException());
+      }
+      return Success();
+    }
+    buffer_.append(static_cast<const char*>(data), length);
+    if (buffer_.size() >= kFileIOBufferSize) {
+      PROPAGATE_ON_FAILURE(StartWrite());
+    }
+    return Success();
+  }
+
+  // Writes all the buffered data to the file, and waits until it's written.
+  FailureOrVoid Flush() {
+    if (!buffer_.empty()) PROPAGATE_ON_FAILURE(StartWrite());
+    return WaitForWrite();
+  }
+
+ private:
+  // Waits for the previous write, then schedules the write of the buffer.
+  FailureOrVoid StartWrite() {
+    PROPAGATE_ON_FAILURE(WaitForWrite());
+    writing_buffer_.swap(buffer_);
+    buffer_.clear();
+    writing_ = true;
+    thread_pool_->Schedule([this] {
+      const bool written =
+          file_->Write(writing_buffer_.data(), writing_buffer_.size()) ==
+          writing_buffer_.size();
+      std::lock_guard<std::mutex> lock(mutex_);
+      failed_ = failed_ || !written;
+      writing_ = false;
+      done_.notify_all();
+    });
+    return Success();
+  }
+
+  FailureOrVoid WaitForWrite() {
+    std::unique_lock<std::mutex> lock(mutex_);
+    done_.wait(lock, [this] { return !writing_; });
+    if (failed_) THROW(NewFileOutputException());
+    return Success();
+  }
+
+  File* const file_;
+  ThreadPool* const thread_pool_;
+  // The data to be written.
+  string buffer_;
+  // The data being written on the pool.
+  string writing_buffer_;
+  // Guard writing_ and failed_.
+  std::mutex mutex_;
+  std::condition_variable done_;
+  bool writing_;
+  bool failed_;
+  DISALLOW_COPY_AND_ASSIGN(OutputFile);
+};
+
 // Writes data to a file, returns true on success.
 // TODO(user): this thing will require a bit of specialization for BIT.
 FailureOrVoid Write(const void* buffer, const size_t length,
-                    File* output_file) {
-  if (!(output_file->Write(buffer, length) == length)) {
-    THROW(NewFileOutputException());
-  }
-  return Success();
+                    OutputFile* output_file) {
+  return output_file->Write(buffer, length);
 }
 
-FailureOrVoid WriteUint64(const uint64_t datum, File* output_file) {
+FailureOrVoid WriteUint64(const uint64_t datum, OutputFile* output_file) {
   PROPAGATE_ON_FAILURE(Write(&datum, sizeof(uint64_t), output_file));
   return Success();
 }
 
-FailureOrVoid WriteRowCount(const rowcount_t datum, File* output_file) {
+FailureOrVoid WriteRowCount(const rowcount_t datum, OutputFile* output_file) {
   PROPAGATE_ON_FAILURE(WriteUint64(static_cast<uint64_t>(datum), output_file));
   return Success();
 }
@@ -100,7 +219,7 @@ FailureOrVoid WriteRowCount(const rowcount_t datum, File* output_file) {
 // Two versions for the two possible representations of the is_null data.
 FailureOrVoid WriteBits(bit_pointer::bit_const_ptr buffer,
                         const size_t bits,
-                        File* output_file) {
+                        OutputFile* output_file) {
   // We cast to a single byte, shift is always between 0 and 31.
   DCHECK(0 <= buffer.shift() && buffer.shift() <= 31);
   char shift = buffer.shift();
@@ -113,14 +232,14 @@ FailureOrVoid WriteBits(bit_pointer::bit_const_ptr buffer,
 
 FailureOrVoid WriteBits(const bool* buffer,
                         const size_t bits,
-                        File* output_file) {
+                        OutputFile* output_file) {
   PROPAGATE_ON_FAILURE(Write(buffer, bits, output_file));
   return Success();
 }
 
 FailureOrVoid WriteVariableLengthData(const Column& column,
                                       const rowcount_t row_count,
-                                      File* output_file) {
+                                      OutputFile* output_file) {
   const StringPiece* string_pieces = column.variable_length_data();
 
   // Write lengths of strings first (0 for null and empty strings).
@@ -148,7 +267,7 @@ FailureOrVoid WriteVariableLengthData(const Column& column,
 
 FailureOrVoid WriteColumn(const Column& column,
                           const rowcount_t row_count,
-                          File* output_file) {
+                          OutputFile* output_file) {
   const TypeInfo& type_info = column.type_info();
   if (column.attribute().is_nullable()) {
     CHECK(column.is_null() != NULL) <<
@@ -170,31 +289,101 @@ FailureOrVoid WriteColumn(const Column& column,
   return Success();
 }
 
-}  // namespace
+// Writes the column encoded with EncodeColumn, compressed with LZ4 if asked
+// to and if that makes it smaller. Uses the buffers for the encoded and
+// compressed data.
+FailureOrVoid WriteEncodedColumn(const Column& column,
+                                 const rowcount_t row_count,
+                                 FileCompression compression,
+                                 string* encoded,
+                                 string* compressed,
+                                 OutputFile* output_file) {
+  encoded->clear();
+  EncodeColumn(column, row_count, encoded);
+#ifdef HAVE_LZ4_H
+  if (compression == FILE_COMPRESSION_LZ4 &&
+      encoded->size() <= LZ4_MAX_INPUT_SIZE) {
+    compressed->resize(LZ4_compressBound(encoded->size()));
+    const int compressed_size = LZ4_compress_default(
+        encoded->data(), &(*compressed)[0], encoded->size(),
+        compressed->size());
+    if (compressed_size > 0 && compressed_size < encoded->size()) {
+      const char column_compression = COLUMN_LZ4;
+      PROPAGATE_ON_FAILURE(Write(&column_compression,
+                                 sizeof(column_compression), output_file));
+      PROPAGATE_ON_FAILURE(WriteUint64(compressed_size, output_file));
+      PROPAGATE_ON_FAILURE(WriteUint64(encoded->size(), output_file));
+      PROPAGATE_ON_FAILURE(Write(compressed->data(), compressed_size,
+                                 output_file));
+      return Success();
+    }
+  }
+#endif  // HAVE_LZ4_H
+  const char column_compression = COLUMN_UNCOMPRESSED;
+  PROPAGATE_ON_FAILURE(Write(&column_compression, sizeof(column_compression),
+                             output_file));
+  PROPAGATE_ON_FAILURE(WriteUint64(encoded->size(), output_file));
+  PROPAGATE_ON_FAILURE(Write(encoded->data(), encoded->size(), output_file));
+  return Success();
+}
 
 // Writes view to a file, splits it into chunks not bigger then
-// max_chunk_row_count. This function exist only to test splitting logic.
-FailureOrVoid WriteViewWithMaxChunkRowCount(
-    const View& view,
-    const rowcount_t max_chunk_row_count,
-    File* output_file) {
+// max_chunk_row_count.
+FailureOrVoid WriteView(const View& view,
+                        const rowcount_t max_chunk_row_count,
+                        FileCompression compression,
+                        string* encoded,
+                        string* compressed,
+                        OutputFile* output_file) {
   ViewIterator iterator(view);
   while (iterator.next(max_chunk_row_count)) {
-    PROPAGATE_ON_FAILURE(WriteRowCount(iterator.row_count(), output_file));
-    for (int i = 0; i < iterator.column_count(); ++i) {
-      PROPAGATE_ON_FAILURE(WriteColumn(iterator.column(i),
-                                       iterator.row_count(),
-                                       output_file));
+    if (compression == FILE_COMPRESSION_NONE) {
+      PROPAGATE_ON_FAILURE(WriteRowCount(iterator.row_count(), output_file));
+      for (int i = 0; i < iterator.column_count(); ++i) {
+        PROPAGATE_ON_FAILURE(WriteColumn(iterator.column(i),
+                                         iterator.row_count(),
+                                         output_file));
+      }
+    } else {
+      PROPAGATE_ON_FAILURE(WriteUint64(
+          static_cast<uint64_t>(iterator.row_count()) | kEncodedChunk,
+          output_file));
+      for (int i = 0; i < iterator.column_count(); ++i) {
+        PROPAGATE_ON_FAILURE(WriteEncodedColumn(iterator.column(i),
+                                                iterator.row_count(),
+                                                compression,
+                                                encoded,
+                                                compressed,
+                                                output_file));
+      }
     }
   }
   return Success();
 }
 
+}  // namespace
+
+// This function exist only to test splitting logic.
+FailureOrVoid WriteViewWithMaxChunkRowCount(
+    const View& view,
+    const rowcount_t max_chunk_row_count,
+    FileCompression compression,
+    File* output_file) {
+  string encoded;
+  string compressed;
+  OutputFile output(output_file, NULL);
+  return WriteView(view, max_chunk_row_count, compression, &encoded,
+                   &compressed, &output);
+}
+
 class FileSink : public Sink {
  public:
-  FileSink(File* output_file, Ownership file_ownership)
+  FileSink(File* output_file, Ownership file_ownership,
+           FileCompression compression, ThreadPool* io_thread_pool)
       : output_file_(output_file),
-        file_ownership_(file_ownership) {
+        file_ownership_(file_ownership),
+        compression_(compression),
+        output_(new OutputFile(output_file, io_thread_pool)) {
     CHECK_NOTNULL(output_file_);
   }
 
@@ -205,12 +394,15 @@ class FileSink : public Sink {
   // Writes view to the output file, splits it into small chunks that can be
   // read back without allocating much memory.
   virtual FailureOr<rowcount_t> Write(const View& data) {
-    PROPAGATE_ON_FAILURE(
-        WriteViewWithMaxChunkRowCount(data, kMaxChunkRowCount, output_file_));
+    PROPAGATE_ON_FAILURE(WriteView(data, kMaxChunkRowCount, compression_,
+                                   &encoded_column_, &compressed_column_,
+                                   output_.get()));
     return Success(data.row_count());
   }
 
   virtual FailureOrVoid Finalize() {
+    FailureOrVoid flushed = output_->Flush();
+    output_.reset();
     if (file_ownership_ == TAKE_OWNERSHIP) {
       if (!output_file_->Close()) {
         output_file_ = NULL;
@@ -218,18 +410,35 @@ class FileSink : public Sink {
       }
     }
     output_file_ = NULL;
-    return Success();
+    return flushed;
   }
 
  private:
   File* output_file_;
   Ownership file_ownership_;
+  FileCompression compression_;
+  std::unique_ptr<OutputFile> output_;
+  // Buffers for WriteEncodedColumn.
+  string encoded_column_;
+  string compressed_column_;
 
   DISALLOW_COPY_AND_ASSIGN(FileSink);
 };
 
 Sink* FileOutput(File* output_file, Ownership file_ownership) {
-  return new FileSink(output_file, file_ownership);
+  return new FileSink(output_file, file_ownership, FILE_COMPRESSION_NONE,
+                      NULL);
+}
+
+Sink* FileOutput(File* output_file, Ownership file_ownership,
+                 FileCompression compression) {
+  return new FileSink(output_file, file_ownership, compression, NULL);
+}
+
+Sink* FileOutput(File* output_file, Ownership file_ownership,
+                 FileCompression compression, ThreadPool* io_thread_pool) {
+  return new FileSink(output_file, file_ownership, compression,
+                      io_thread_pool);
 }
 
 // File input.
@@ -244,8 +453,186 @@ Exception* NewFileInputException() {
 
 enum ReadResult { DATA, END_OF_FILE };
 
+// Reads a file sequentially. Without a thread pool, straight from the file.
+// With one, through two buffers: while one is read from, a task on the pool
+// reads the next part of the file into the other one (read-ahead). The first
+// read is started right away. Alternatively, reads a file mapped to memory,
+// whose data can then be used in place (see Map()).
+class InputFile {
+ public:
+  // Doesn't take ownership of the file nor the thread pool (may be NULL).
+  InputFile(File* file, ThreadPool* thread_pool)
+      : file_(file),
+        thread_pool_(thread_pool),
+        mapped_data_(NULL),
+        mapped_size_(0),
+        position_(0),
+        exhausted_(false),
+        reading_(false),
+        failed_(false),
+        end_of_file_(false) {
+    if (thread_pool_ != NULL) StartRead();
+  }
+
+  // Maps the file to memory, read-only.
+  static FailureOrOwned<InputFile> MapFile(const string& file_name) {
+    const int fd = open(file_name.c_str(), O_RDONLY);
+    if (fd < 0) {
+      THROW(new Exception(ERROR_GENERAL_IO_ERROR,
+                          StrCat("Couldn't open ", file_name, ": ",
+                                 strerror(errno))));
+    }
+    struct stat file_stat;
+    if (fstat(fd, &file_stat) != 0) {
+      const int fstat_errno = errno;
+      close(fd);
+      THROW(new Exception(ERROR_GENERAL_IO_ERROR,
+                          StrCat("Couldn't stat ", file_name, ": ",
+                                 strerror(fstat_errno))));
+    }
+    const size_t size = file_stat.st_size;
+    // Mapping no bytes fails; an empty file needs no mapping anyway.
+    void* data = NULL;
+    if (size > 0) {
+      data = mmap(NULL, size, PROT_READ, MAP_SHARED, fd, 0);
+    }
+    const int mmap_errno = errno;
+    close(fd);
+    if (data == MAP_FAILED) {
+      THROW(new Exception(ERROR_GENERAL_IO_ERROR,
+                          StrCat("Couldn't map ", file_name, ": ",
+                                 strerror(mmap_errno))));
+    }
+    // Scans read the file once, front to back.
+    if (data != NULL) madvise(data, size, MADV_SEQUENTIAL);
+    return Success(new InputFile(static_cast<const char*>(data), size));
+  }
+
+  // Waits for the read in progress, if any. Unmaps the file, if mapped.
+  ~InputFile() {
+    std::unique_lock<std::mutex> lock(mutex_);
+    done_.wait(lock, [this] { return !reading_; });
+    if (mapped_data_ != NULL) {
+      munmap(const_cast<char*>(mapped_data_), mapped_size_);
+    }
+  }
+
+  // If the file is mapped, and its next length bytes start at an address
+  // aligned to alignment, returns them and skips past them. The bytes stay
+  // valid for the lifetime of the InputFile. Otherwise returns NULL, and the
+  // bytes are to be read with Read().
+  const char* Map(size_t length, size_t alignment) {
+    if (file_ != NULL || mapped_size_ - position_ < length) return NULL;
+    const char* data = mapped_data_ + position_;
+    if (reinterpret_cast<uintptr_t>(data) % alignment != 0) return NULL;
+    position_ += length;
+    return data;
+  }
+
+  // As File::Read: returns the number of bytes read, fewer than length only
+  // at the end of the file, or a negative number on error.
+  int64_t Read(void* data, size_t length) {
+    if (file_ == NULL) {
+      length = std::min(length, mapped_size_ - position_);
+      if (length > 0) memcpy(data, mapped_data_ + position_, length);
+      position_ += length;
+      return length;
+    }
+    if (thread_pool_ == NULL) return file_->Read(data, length);
+    char* target = static_cast<char*>(data);
+    size_t read = 0;
+    while (read < length) {
+      if (position_ == buffer_.size()) {
+        const int64_t available = NextBuffer();
+        if (available < 0) return -1;
+        if (available == 0) break;
+      }
+      const size_t count = std::min(length - read, buffer_.size() - position_);
+      memcpy(target + read, buffer_.data() + position_, count);
+      position_ += count;
+      read += count;
+    }
+    return read;
+  }
+
+  // As File::eof.
+  bool eof() {
+    if (file_ == NULL) return position_ == mapped_size_;
+    return (thread_pool_ == NULL) ? file_->eof() : exhausted_;
+  }
+
+ private:
+  InputFile(const char* mapped_data, size_t mapped_size)
+      : file_(NULL),
+        thread_pool_(NULL),
+        mapped_data_(mapped_data),
+        mapped_size_(mapped_size),
+        position_(0),
+        exhausted_(false),
+        reading_(false),
+        failed_(false),
+        end_of_file_(false) {}
+
+  void StartRead() {
+    reading_ = true;
+    thread_pool_->Schedule([this] {
+      read_buffer_.resize(kFileIOBufferSize);
+      const int64_t read = file_->Read(&read_buffer_[0], read_buffer_.size());
+      read_buffer_.resize(std::max<int64_t>(read, 0));
+      std::lock_guard<std::mutex> lock(mutex_);
+      failed_ = read < 0;
+      end_of_file_ = read < static_cast<int64_t>(kFileIOBufferSize);
+      reading_ = false;
+      done_.notify_all();
+    });
+  }
+
+  // Waits for the read in progress, makes its buffer the current one and
+  // starts the next read. Returns the number of bytes now available, 0 at the
+  // end of the file, or -1 on error.
+  int64_t NextBuffer() {
+    std::unique_lock<std::mutex> lock(mutex_);
+    done_.wait(lock, [this] { return !reading_; });
+    if (failed_) return -1;
+    buffer_.swap(read_buffer_);
+    position_ = 0;
+    if (buffer_.empty()) {
+      exhausted_ = true;
+      return 0;
+    }
+    if (end_of_file_) {
+      read_buffer_.clear();
+    } else {
+      StartRead();
+    }
+    return buffer_.size();
+  }
+
+  // NULL if the file is mapped.
+  File* const file_;
+  ThreadPool* const thread_pool_;
+  // The mapped file, if any.
+  const char* const mapped_data_;
+  const size_t mapped_size_;
+  // The data being read from, up to position_. If the file is mapped,
+  // position_ is in mapped_data_.
+  string buffer_;
+  size_t position_;
+  // Set once all the data has been read.
+  bool exhausted_;
+  // The data read on the pool.
+  string read_buffer_;
+  // Guard reading_, failed_ and end_of_file_.
+  std::mutex mutex_;
+  std::condition_variable done_;
+  bool reading_;
+  bool failed_;
+  bool end_of_file_;
+  DISALLOW_COPY_AND_ASSIGN(InputFile);
+};
+
 // Reads data from a file.
-FailureOr<ReadResult> Read(File* input_file,
+FailureOr<ReadResult> Read(InputFile* input_file,
                            const size_t length,
                            void* buffer) {
   int64_t read = input_file->Read(buffer, length);
@@ -254,17 +641,21 @@ FailureOr<ReadResult> Read(File* input_file,
   THROW(NewFileInputException());
 }
 
-FailureOr<ReadResult> ReadUint64(File* input_file, uint64_t* datum) {
+FailureOr<ReadResult> ReadUint64(InputFile* input_file, uint64_t* datum) {
   FailureOr<ReadResult> result = Read(input_file, sizeof(uint64_t), datum);
   PROPAGATE_ON_FAILURE(result);
   return result;
 }
 
-FailureOr<ReadResult> ReadRowCount(File* input_file, rowcount_t* datum) {
+// Reads the row count of a chunk, and whether its columns are encoded.
+FailureOr<ReadResult> ReadRowCount(InputFile* input_file, rowcount_t* datum,
+                                   bool* encoded) {
   uint64_t datum_uint64_t;
   FailureOr<ReadResult> result = ReadUint64(input_file, &datum_uint64_t);
   PROPAGATE_ON_FAILURE(result);
   if (result.get() == END_OF_FILE) return Success(END_OF_FILE);
+  *encoded = (datum_uint64_t & kEncodedChunk) != 0;
+  datum_uint64_t &= ~kEncodedChunk;
   if (datum_uint64_t > std::numeric_limits<rowcount_t>::max()) {
     THROW(new Exception(ERROR_GENERAL_IO_ERROR, "Row ID overflow."));
   }
@@ -274,7 +665,7 @@ FailureOr<ReadResult> ReadRowCount(File* input_file, rowcount_t* datum) {
 
 // Reads bit-data from a file, returns true on success.
 // Two versions for two possible representations of the is_null column.
-FailureOr<ReadResult> ReadBits(File* input_file,
+FailureOr<ReadResult> ReadBits(InputFile* input_file,
                                const size_t bits,
                                bit_pointer::bit_ptr buffer) {
   // We cast to a single byte, shift is always between 0 and 31.
@@ -299,7 +690,7 @@ FailureOr<ReadResult> ReadBits(File* input_file,
   return Success(DATA);
 }
 
-FailureOr<ReadResult> ReadBits(File* input_file,
+FailureOr<ReadResult> ReadBits(InputFile* input_file,
                                const size_t bits,
                                bool* buffer) {
   return Read(input_file, bits, buffer);
@@ -317,16 +708,34 @@ FailureOrVoid ExpectData(FailureOr<ReadResult> result) {
 
 class FileInputCursor : public BasicCursor {
  public:
-  FileInputCursor(Block* block, File* input_file, bool delete_when_done)
+  FileInputCursor(Block* block, File* input_file, bool delete_when_done,
+                  ThreadPool* io_thread_pool)
       : BasicCursor(block->schema()),
         block_(block),
         input_file_(input_file),
+        input_(new InputFile(input_file, io_thread_pool)),
         delete_when_done_(delete_when_done),
+        chunk_view_(block->schema()),
+        rows_pending_in_block_(0),
+        first_pending_row_offset_(0),
+        strings_length_buffer_(new uint64_t[kMaxChunkRowCount]) {}
+
+  // Reads a mapped file. Takes ownership of the mapped_input.
+  FileInputCursor(Block* block, InputFile* mapped_input)
+      : BasicCursor(block->schema()),
+        block_(block),
+        input_file_(NULL),
+        input_(mapped_input),
+        delete_when_done_(false),
+        chunk_view_(block->schema()),
         rows_pending_in_block_(0),
         first_pending_row_offset_(0),
         strings_length_buffer_(new uint64_t[kMaxChunkRowCount]) {}
 
   virtual ~FileInputCursor() {
+    // Waits for the read ahead.
+    input_.reset();
+    if (input_file_ == NULL) return;
     if (delete_when_done_) {
       if (!input_file_->Delete()) {
         LOG(WARNING) << "Failed to delete file in FileInputCursor.";
@@ -340,19 +749,32 @@ class FileInputCursor : public BasicCursor {
   virtual CursorId GetCursorId() const { return FILE_INPUT; }
 
  private:
-  FailureOrVoid ReadColumn(OwnedColumn* column, const rowcount_t row_count);
+  // Reads the column_index-th column of an unencoded chunk. If the file is
+  // mapped, the fixed-width data and variable-length values are used in place.
+  FailureOrVoid ReadColumn(int column_index, const rowcount_t row_count);
+
+  // Reads a column written by WriteEncodedColumn.
+  FailureOrVoid ReadEncodedColumn(OwnedColumn* column,
+                                  const rowcount_t row_count);
 
   FailureOrVoid ReadVariableLengthData(OwnedColumn* column,
                                        const rowcount_t row_count);
 
   std::unique_ptr<Block> block_;
+  // NULL if the file is mapped.
   File* input_file_;
+  std::unique_ptr<InputFile> input_;
   bool delete_when_done_;
+  // The last chunk read: the columns of block_, or of the mapped file.
+  View chunk_view_;
   rowcount_t rows_pending_in_block_;
   rowcount_t first_pending_row_offset_;
   // Temporary buffer used by ReadVariableLengthColumn() to store strings'
   // lengths.
   std::unique_ptr<uint64_t[]> strings_length_buffer_;
+  // Temporary buffers used by ReadEncodedColumn().
+  string encoded_column_;
+  string compressed_column_;
 
   DISALLOW_COPY_AND_ASSIGN(FileInputCursor);
 };
@@ -361,6 +783,14 @@ FailureOrOwned<Cursor> FileInput(const TupleSchema& schema,
                                  File* input_file,
                                  const bool delete_when_done,
                                  BufferAllocator* allocator) {
+  return FileInput(schema, input_file, delete_when_done, allocator, NULL);
+}
+
+FailureOrOwned<Cursor> FileInput(const TupleSchema& schema,
+                                 File* input_file,
+                                 const bool delete_when_done,
+                                 BufferAllocator* allocator,
+                                 ThreadPool* io_thread_pool) {
   CHECK_NOTNULL(input_file);
   CHECK_NOTNULL(allocator);
   auto block = make_unique<Block>(schema, allocator);
@@ -370,7 +800,35 @@ FailureOrOwned<Cursor> FileInput(const TupleSchema& schema,
                         "Block allocation for FileInputCursor failed."));
   }
   return Success(make_unique<FileInputCursor>(
-      block.release(), input_file, delete_when_done));
+      block.release(), input_file, delete_when_done, io_thread_pool));
+}
+
+FailureOrOwned<Cursor> MappedFileInput(const TupleSchema& schema,
+                                       const string& file_name,
+                                       BufferAllocator* allocator) {
+  CHECK_NOTNULL(allocator);
+  FailureOrOwned<InputFile> mapped_input = InputFile::MapFile(file_name);
+  PROPAGATE_ON_FAILURE(mapped_input);
+  auto block = make_unique<Block>(schema, allocator);
+  if (!block.get() || !block->Reallocate(kMaxChunkRowCount)) {
+    THROW(new Exception(ERROR_MEMORY_EXCEEDED,
+                        "Block allocation for FileInputCursor failed."));
+  }
+  return Success(make_unique<FileInputCursor>(block.release(),
+                                              mapped_input.move().release()));
+}
+
+size_t EstimateFileInputMemoryUsage(const TupleSchema& schema) {
+  const size_t kVariableLengthValueSize = 16;
+  size_t row_size = 0;
+  for (int i = 0; i < schema.attribute_count(); ++i) {
+    const Attribute& attribute = schema.attribute(i);
+    const TypeInfo& type_info = GetTypeInfo(attribute.type());
+    row_size += type_info.size();
+    if (type_info.is_variable_length()) row_size += kVariableLengthValueSize;
+    if (attribute.is_nullable()) row_size += sizeof(bool);
+  }
+  return row_size * kMaxChunkRowCount + 2 * kFileIOBufferSize;
 }
 
 // Reads chunk of data from the input file. If chunk contains more rows then
@@ -379,7 +837,7 @@ ResultView FileInputCursor::Next(const rowcount_t max_row_count) {
   PROPAGATE_ON_FAILURE(ThrowIfInterrupted());
   if (rows_pending_in_block_ != 0) {
     rowcount_t rows_to_return = min(max_row_count, rows_pending_in_block_);
-    my_view()->ResetFromSubRange(block_->view(),
+    my_view()->ResetFromSubRange(chunk_view_,
                                  first_pending_row_offset_,
                                  rows_to_return);
     first_pending_row_offset_ += rows_to_return;
@@ -388,7 +846,9 @@ ResultView FileInputCursor::Next(const rowcount_t max_row_count) {
   }
 
   rowcount_t chunk_row_count = 0;
-  FailureOr<ReadResult> result = ReadRowCount(input_file_, &chunk_row_count);
+  bool encoded = false;
+  FailureOr<ReadResult> result =
+      ReadRowCount(input_.get(), &chunk_row_count, &encoded);
   PROPAGATE_ON_FAILURE(result);
   if (result.get() == END_OF_FILE) return ResultView::EOS();
 
@@ -408,58 +868,121 @@ ResultView FileInputCursor::Next(const rowcount_t max_row_count) {
   }
 
   block_->ResetArenas();
+  chunk_view_.ResetFrom(block_->view());
   for (int i = 0; i < schema().attribute_count(); ++i) {
-    PROPAGATE_ON_FAILURE(ReadColumn(block_->mutable_column(i),
-                                    chunk_row_count));
+    if (encoded) {
+      PROPAGATE_ON_FAILURE(ReadEncodedColumn(block_->mutable_column(i),
+                                             chunk_row_count));
+    } else {
+      PROPAGATE_ON_FAILURE(ReadColumn(i, chunk_row_count));
+    }
   }
 
   rowcount_t rows_to_return = min(chunk_row_count, max_row_count);
-  my_view()->ResetFromSubRange(block_->view(), 0, rows_to_return);
+  my_view()->ResetFromSubRange(chunk_view_, 0, rows_to_return);
   rows_pending_in_block_ = chunk_row_count - rows_to_return;
   first_pending_row_offset_ = rows_to_return;
   return ResultView::Success(my_view());
 }
 
-FailureOrVoid FileInputCursor::ReadColumn(OwnedColumn* column,
+FailureOrVoid FileInputCursor::ReadColumn(int column_index,
                                           const rowcount_t row_count) {
+  OwnedColumn* column = block_->mutable_column(column_index);
   if (column->content().attribute().is_nullable()) {
     PROPAGATE_ON_FAILURE(ExpectData(
-        ReadBits(input_file_, row_count, column->mutable_is_null())));
+        ReadBits(input_.get(), row_count, column->mutable_is_null())));
   }
 
   const TypeInfo& type_info = column->content().type_info();
   if (type_info.is_variable_length()) {
     PROPAGATE_ON_FAILURE(ReadVariableLengthData(column, row_count));
+    return Success();
+  }
+  const size_t size = row_count << type_info.log2_size();
+  const char* mapped_data = input_->Map(size, type_info.size());
+  if (mapped_data != NULL) {
+    Column* chunk_column = chunk_view_.mutable_column(column_index);
+    chunk_column->Reset(VariantConstPointer(mapped_data),
+                        chunk_column->is_null());
   } else {
     PROPAGATE_ON_FAILURE(ExpectData(
-        Read(input_file_, row_count << type_info.log2_size(),
-             column->mutable_data())));
+        Read(input_.get(), size, column->mutable_data())));
   }
   return Success();
 }
 
+FailureOrVoid FileInputCursor::ReadEncodedColumn(OwnedColumn* column,
+                                                 const rowcount_t row_count) {
+  char column_compression;
+  PROPAGATE_ON_FAILURE(ExpectData(
+      Read(input_.get(), sizeof(column_compression), &column_compression)));
+  uint64_t stored_size;
+  PROPAGATE_ON_FAILURE(ExpectData(ReadUint64(input_.get(), &stored_size)));
+  if (column_compression == COLUMN_UNCOMPRESSED) {
+    encoded_column_.resize(stored_size);
+    if (stored_size > 0) {
+      PROPAGATE_ON_FAILURE(ExpectData(
+          Read(input_.get(), stored_size, &encoded_column_[0])));
+    }
+    return DecodeColumn(encoded_column_, row_count, column);
+  }
+  if (column_compression != COLUMN_LZ4) {
+    THROW(new Exception(ERROR_GENERAL_IO_ERROR,
+                        "Unknown compression of a column in the input file."));
+  }
+#ifdef HAVE_LZ4_H
+  uint64_t encoded_size;
+  PROPAGATE_ON_FAILURE(ExpectData(ReadUint64(input_.get(), &encoded_size)));
+  if (stored_size == 0 || stored_size > LZ4_MAX_INPUT_SIZE ||
+      encoded_size > LZ4_MAX_INPUT_SIZE) {
+    THROW(new Exception(ERROR_GENERAL_IO_ERROR,
+                        "Invalid size of an LZ4 column in the input file."));
+  }
+  compressed_column_.resize(stored_size);
+  PROPAGATE_ON_FAILURE(ExpectData(
+      Read(input_.get(), stored_size, &compressed_column_[0])));
+  encoded_column_.resize(encoded_size);
+  const int decompressed_size = LZ4_decompress_safe(
+      compressed_column_.data(), &encoded_column_[0], stored_size,
+      encoded_size);
+  if (decompressed_size != encoded_size) {
+    THROW(new Exception(ERROR_GENERAL_IO_ERROR,
+                        "Decompressing a column of the input file failed."));
+  }
+  return DecodeColumn(encoded_column_, row_count, column);
+#else
+  THROW(new Exception(ERROR_NOT_IMPLEMENTED,
+                      "The input file uses LZ4, which Supersonic was built "
+                      "without."));
+#endif  // HAVE_LZ4_H
+}
+
 FailureOrVoid FileInputCursor::ReadVariableLengthData(
     OwnedColumn* column,
     const rowcount_t row_count) {
   PROPAGATE_ON_FAILURE(ExpectData(
-      Read(input_file_, sizeof(uint64_t) * row_count,
+      Read(input_.get(), sizeof(uint64_t) * row_count,
            strings_length_buffer_.get())));
 
   size_t total_strings_length = 0;
   for (size_t row = 0; row < row_count; ++row) {
     total_strings_length += strings_length_buffer_[row];
   }
-  char* strings_data = NULL;
+  const char* strings_data = NULL;
 
   if (total_strings_length != 0) {
-    strings_data = static_cast<char*>(
+    strings_data = input_->Map(total_strings_length, 1);
+  }
+  if (total_strings_length != 0 && strings_data == NULL) {
+    char* read_data = static_cast<char*>(
         column->arena()->AllocateBytes(total_strings_length));
-    if (!strings_data) {
+    if (!read_data) {
       THROW(new Exception(ERROR_MEMORY_EXCEEDED,
                           "Arena allocation for FileInputCursor failed."));
     }
     PROPAGATE_ON_FAILURE(ExpectData(
-        Read(input_file_, total_strings_length, strings_data)));
+        Read(input_.get(), total_strings_length, read_data)));
+    strings_data = read_data;
   }
 
   StringPiece* string_pieces = column->mutable_variable_length_data();
@@ -472,4 +995,50 @@ FailureOrVoid FileInputCursor::ReadVariableLengthData(
   return Success();
 }
 
+// Temporary file buffer.
+// --------------------------------------------------------------------
+
+FailureOrOwned<TemporaryFileBuffer> TemporaryFileBuffer::Create(
+    TemporaryFileFactory* temporary_file_factory,
+    FileCompression compression) {
+  FailureOr<File*> file = temporary_file_factory->CreateTemporaryFile();
+  PROPAGATE_ON_FAILURE(file);
+  return Success(unique_ptr<TemporaryFileBuffer>(
+      new TemporaryFileBuffer(file.get(), compression)));
+}
+
+TemporaryFileBuffer::TemporaryFileBuffer(File* file,
+                                         FileCompression compression)
+    : file_(new file::FileRemover(file)),
+      sink_(FileOutput(file, DO_NOT_TAKE_OWNERSHIP, compression,
+                       FileIOThreadPool())),
+      row_count_(0) {}
+
+TemporaryFileBuffer::~TemporaryFileBuffer() {
+  // The file is removed anyway, so the errors don't matter.
+  if (sink_ != NULL) sink_->Finalize();
+}
+
+FailureOrVoid TemporaryFileBuffer::Write(const View& view) {
+  CHECK(sink_ != NULL) << "Already read back.";
+  FailureOr<rowcount_t> written = sink_->Write(view);
+  PROPAGATE_ON_FAILURE(written);
+  row_count_ += written.get();
+  return Success();
+}
+
+FailureOrOwned<Cursor> TemporaryFileBuffer::Read(const TupleSchema& schema,
+                                                 BufferAllocator* allocator) {
+  CHECK(sink_ != NULL) << "Already read back.";
+  FailureOrVoid finalized = sink_->Finalize();
+  sink_.reset();
+  PROPAGATE_ON_FAILURE(finalized);
+  if (!file_->get()->Seek(0)) {
+    THROW(new Exception(ERROR_GENERAL_IO_ERROR,
+                        "Couldn't rewind the temporary file."));
+  }
+  return FileInput(schema, file_->release(), true, allocator,
+                   FileIOThreadPool());
+}
+
 }  // namespace supersonic
@@ -41,28 +41,67 @@
 #ifndef SUPERSONIC_CURSOR_INFRASTRUCTURE_FILE_IO_H_
 #define SUPERSONIC_CURSOR_INFRASTRUCTURE_FILE_IO_H_
 
+#include <memory>
+#include <string>
+using std::string;
+
 #include "supersonic/utils/basictypes.h"
+#include "supersonic/utils/macros.h"
 #include "supersonic/base/exception/result.h"
+#include "supersonic/base/infrastructure/types.h"
+#include "supersonic/utils/strings/stringpiece.h"
 
 class File;
+namespace file { class FileRemover; }
 
 namespace supersonic {
 
 class BufferAllocator;
 class Cursor;
+class TemporaryFileFactory;
 class TupleSchema;
 class Sink;
+class ThreadPool;
+class View;
+
+// How FileOutput stores the columns of the views it writes. FileInput reads
+// the files back whatever the compression.
+enum FileCompression {
+  // The column buffers are written as they are; fastest to write and read.
+  FILE_COMPRESSION_NONE,
+  // Every column is stored with the lightweight encoding that suits its values
+  // best (see column_encoding.h): bit-packed integers, deltas of sorted
+  // values, dictionaries of repeated strings. Cheap to encode and decode.
+  FILE_COMPRESSION_LIGHTWEIGHT,
+  // As FILE_COMPRESSION_LIGHTWEIGHT, with every encoded column further
+  // compressed with LZ4 if that makes it smaller. If Supersonic is built
+  // without LZ4 (HAVE_LZ4_H), the same as FILE_COMPRESSION_LIGHTWEIGHT.
+  FILE_COMPRESSION_LZ4
+};
 
 // The output file should be open for writing by a caller. If Ownership ==
 // DO_NOT_TAKE_OWNERSHIP, does not close File* and it is legal to use it after
 // FileSink is destroyed (for instance to Seek() to the beginning of the file
 // and read data back). In such case caller needs to close the file when it is
-// done with it. To save space caller can pass file that compresses its output
-// data (for example file/bzip2file/bzip2file::BZip2OutputFile).
-// TODO(user): Include information about performance of different compression
-// algorithms that can be applied to these files.
+// done with it. The data is written uncompressed (FILE_COMPRESSION_NONE); use
+// the variant below, or a file that compresses its output data (for example
+// file/bzip2file/bzip2file::BZip2OutputFile), to save space.
 Sink* FileOutput(File* output_file, Ownership file_ownership);
 
+// As above, with the columns stored as specified by the compression. When the
+// disk is the bottleneck, as for data spilled by many operations at once,
+// FILE_COMPRESSION_LIGHTWEIGHT or FILE_COMPRESSION_LZ4 usually pay off.
+Sink* FileOutput(File* output_file, Ownership file_ownership,
+                 FileCompression compression);
+
+// As above, with the data written behind: it is buffered, and every full
+// buffer is written to the file by a task on the io_thread_pool, while the
+// sink goes on encoding the next views. Finalize() waits for the writes to
+// complete, and reports their failures; until then the file must not be used.
+// Doesn't take ownership of the io_thread_pool. NULL writes synchronously.
+Sink* FileOutput(File* output_file, Ownership file_ownership,
+                 FileCompression compression, ThreadPool* io_thread_pool);
+
 // Creates cursor to read from a file that was written with FileSink. Takes
 // ownership of the file (caller should not try to close it). If
 // delete_when_done is set, file object is deleted from a filesystem when Cursor
@@ -76,6 +115,72 @@ FailureOrOwned<Cursor> FileInput(const TupleSchema& schema,
                                  const bool delete_when_done,
                                  BufferAllocator* allocator);
 
+// As above, with the file read ahead: tasks on the io_thread_pool read the
+// next part of the file while the cursor decodes the current one, so reading
+// many files (as the runs of a merge) doesn't stall on every one of them in
+// turn. Doesn't take ownership of the io_thread_pool. NULL reads synchronously.
+FailureOrOwned<Cursor> FileInput(const TupleSchema& schema,
+                                 File* input_file,
+                                 const bool delete_when_done,
+                                 BufferAllocator* allocator,
+                                 ThreadPool* io_thread_pool);
+
+// Creates a cursor to read a local file written with FileSink, mapped to
+// memory rather than read. The fixed-width data of the columns written
+// uncompressed (FILE_COMPRESSION_NONE), and the bytes of their variable-length
+// values, are used in place: the views returned point into the mapping, which
+// also lets processes reading the same file share the page cache. Only the
+// is_null vectors, the StringPieces, the columns that happen to be misaligned
+// in the file and the compressed chunks are copied to a block. The file must
+// not be modified while the cursor exists; it is not deleted.
+FailureOrOwned<Cursor> MappedFileInput(const TupleSchema& schema,
+                                       const string& file_name,
+                                       BufferAllocator* allocator);
+
+// A process-wide pool of a few threads for the file reads and writes of the
+// operations that spill to disk. Created on first use, never destroyed.
+ThreadPool* FileIOThreadPool();
+
+// Returns an estimate of the memory used by a cursor created by FileInput for
+// the schema: it reads the file a chunk (of up to 8192 rows) at a time into a
+// block, plus the buffers of the read-ahead. Assumes short variable-length
+// values, of 16 bytes on average.
+size_t EstimateFileInputMemoryUsage(const TupleSchema& schema);
+
+// A temporary file that views are appended to, and then read back (once). Used
+// by the operations that spill their data to disk. The file is deleted when
+// the data has been read back, or when the buffer is destroyed unread.
+class TemporaryFileBuffer {
+ public:
+  // Creates the file with the factory, which must outlive the buffer and the
+  // cursor reading it back. The views are written with the compression.
+  static FailureOrOwned<TemporaryFileBuffer> Create(
+      TemporaryFileFactory* temporary_file_factory,
+      FileCompression compression);
+
+  ~TemporaryFileBuffer();
+
+  // Appends the rows of the view to the file.
+  FailureOrVoid Write(const View& view);
+
+  // Number of rows written so far.
+  rowcount_t row_count() const { return row_count_; }
+
+  // Finishes writing, and returns a cursor reading the rows back. The file is
+  // deleted when the cursor is destroyed. Can be called once; the buffer can't
+  // be used afterwards.
+  FailureOrOwned<Cursor> Read(const TupleSchema& schema,
+                              BufferAllocator* allocator);
+
+ private:
+  TemporaryFileBuffer(File* file, FileCompression compression);
+
+  std::unique_ptr<file::FileRemover> file_;
+  std::unique_ptr<Sink> sink_;
+  rowcount_t row_count_;
+  DISALLOW_COPY_AND_ASSIGN(TemporaryFileBuffer);
+};
+
 }  // namespace supersonic
 
 #endif  // SUPERSONIC_CURSOR_INFRASTRUCTURE_FILE_IO_H_
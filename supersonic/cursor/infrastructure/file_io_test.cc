@@ -0,0 +1,284 @@
+// Copyright 2012 Google Inc. All Rights Reserved.
+//
+// Licensed under the Apache License, Version 2.0 (the "License");
+// you may not use this file except in compliance with the License.
+// You may obtain a copy of the License at
+//
+//     http://www.apache.org/licenses/LICENSE-2.0
+//
+// Unless required by applicable law or agreed to in writing, software
+// distributed under the License is distributed on an "AS IS" BASIS,
+// WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+// See the License for the specific language governing permissions and
+// limitations under the License.
+//
+
+#include "supersonic/cursor/infrastructure/file_io.h"
+
+#include <stdio.h>
+
+#include <algorithm>
+#include "supersonic/utils/std_namespace.h"
+#include <memory>
+#include <string>
+using std::string;
+
+#include "supersonic/base/infrastructure/block.h"
+#include "supersonic/base/memory/memory.h"
+#include "supersonic/cursor/base/cursor.h"
+#include "supersonic/cursor/core/scan_view.h"
+#include "supersonic/cursor/infrastructure/file_io-internal.h"
+#include "supersonic/cursor/infrastructure/temporary_file_factory.h"
+#include "supersonic/cursor/infrastructure/thread_pool.h"
+#include "supersonic/cursor/infrastructure/writer.h"
+#include "supersonic/testing/block_builder.h"
+#include "supersonic/testing/comparators.h"
+#include "supersonic/utils/file.h"
+#include "supersonic/utils/file_util.h"
+#include "gtest/gtest.h"
+
+namespace supersonic {
+
+namespace {
+
+// Returns the number of bytes in the file, and rewinds it.
+int64_t FileSize(File* file) {
+  CHECK(file->Seek(0));
+  int64_t size = 0;
+  char buffer[4096];
+  int64_t read;
+  while ((read = file->Read(buffer, sizeof(buffer))) > 0) size += read;
+  CHECK(file->Seek(0));
+  return size;
+}
+
+std::unique_ptr<Block> CreateBlock(rowcount_t row_count) {
+  BlockBuilder<INT32, DATETIME, STRING, DOUBLE, BOOL> builder;
+  const char* kNames[] = { "red", "green", "blue" };
+  for (rowcount_t i = 0; i < row_count; ++i) {
+    if (i % 11 == 5) {
+      builder.AddRow(__, __, __, __, __);
+    } else {
+      builder.AddRow(i % 100, 1500000000000000LL + i * 1000, kNames[i % 3],
+                     i * 0.5, i % 2 == 0);
+    }
+  }
+  return builder.Build();
+}
+
+class FileIOTest : public testing::TestWithParam<FileCompression> {};
+
+// Writes the view in chunks of up to max_chunk_row_count rows, reads it back
+// and expects the same rows. Returns the size of the file.
+int64_t ExpectRoundTrip(const View& view, rowcount_t max_chunk_row_count,
+                        FileCompression compression) {
+  File* file = TempFile::Create("");
+  CHECK(file != NULL);
+  EXPECT_TRUE(WriteViewWithMaxChunkRowCount(view, max_chunk_row_count,
+                                            compression, file).is_success());
+  const int64_t size = FileSize(file);
+  FailureOrOwned<Cursor> input(
+      FileInput(view.schema(), file, true, HeapBufferAllocator::Get()));
+  EXPECT_TRUE(input.is_success());
+  EXPECT_CURSORS_EQUAL(BoundScanView(view), input.move());
+  return size;
+}
+
+// As above, reading the file with MappedFileInput.
+void ExpectMappedRoundTrip(const View& view, rowcount_t max_chunk_row_count,
+                           FileCompression compression) {
+  File* file = TempFile::Create("");
+  CHECK(file != NULL);
+  const string file_name = file->CreateFileName();
+  EXPECT_TRUE(WriteViewWithMaxChunkRowCount(view, max_chunk_row_count,
+                                            compression, file).is_success());
+  CHECK(file->Close());
+  FailureOrOwned<Cursor> input(
+      MappedFileInput(view.schema(), file_name, HeapBufferAllocator::Get()));
+  EXPECT_TRUE(input.is_success());
+  EXPECT_CURSORS_EQUAL(BoundScanView(view), input.move());
+  remove(file_name.c_str());
+}
+
+TEST_P(FileIOTest, RoundTrip) {
+  std::unique_ptr<Block> block(CreateBlock(1000));
+  ExpectRoundTrip(block->view(), 8192, GetParam());
+}
+
+TEST_P(FileIOTest, MappedRoundTrip) {
+  std::unique_ptr<Block> block(CreateBlock(20000));
+  ExpectMappedRoundTrip(block->view(), 8192, GetParam());
+  ExpectMappedRoundTrip(block->view(), 333, GetParam());
+  std::unique_ptr<Block> not_null_block(BlockBuilder<INT32, INT64, STRING>()
+      .AddRow(1, 10, "a")
+      .AddRow(2, 20, "bc")
+      .AddRow(3, 30, "")
+      .Build());
+  ExpectMappedRoundTrip(not_null_block->view(), 2, GetParam());
+  std::unique_ptr<Block> empty_block(CreateBlock(0));
+  ExpectMappedRoundTrip(empty_block->view(), 8192, GetParam());
+}
+
+TEST_P(FileIOTest, SplitIntoChunks) {
+  std::unique_ptr<Block> block(CreateBlock(100));
+  ExpectRoundTrip(block->view(), 7, GetParam());
+  ExpectRoundTrip(block->view(), 1, GetParam());
+}
+
+TEST_P(FileIOTest, EmptyFile) {
+  std::unique_ptr<Block> block(CreateBlock(0));
+  ExpectRoundTrip(block->view(), 8192, GetParam());
+}
+
+TEST_P(FileIOTest, SinkWritesReadableFile) {
+  std::unique_ptr<Block> block(CreateBlock(300));
+  File* file = TempFile::Create("");
+  ASSERT_TRUE(file != NULL);
+  std::unique_ptr<Sink> sink(
+      FileOutput(file, DO_NOT_TAKE_OWNERSHIP, GetParam()));
+  View view(block->view());
+  view.set_row_count(100);
+  ASSERT_TRUE(sink->Write(view).is_success());
+  view.ResetFromSubRange(block->view(), 100, 200);
+  ASSERT_TRUE(sink->Write(view).is_success());
+  ASSERT_TRUE(sink->Finalize().is_success());
+  ASSERT_TRUE(file->Seek(0));
+  FailureOrOwned<Cursor> input(
+      FileInput(block->schema(), file, true, HeapBufferAllocator::Get()));
+  ASSERT_TRUE(input.is_success());
+  EXPECT_CURSORS_EQUAL(BoundScanView(block->view()), input.move());
+}
+
+TEST_P(FileIOTest, TemporaryFileBuffer) {
+  std::unique_ptr<Block> block(CreateBlock(500));
+  FailureOrOwned<TemporaryFileBuffer> buffer =
+      TemporaryFileBuffer::Create(DefaultTemporaryFileFactory(""), GetParam());
+  ASSERT_TRUE(buffer.is_success());
+  ASSERT_TRUE(buffer->Write(block->view()).is_success());
+  EXPECT_EQ(500, buffer->row_count());
+  FailureOrOwned<Cursor> input =
+      buffer->Read(block->schema(), HeapBufferAllocator::Get());
+  ASSERT_TRUE(input.is_success());
+  EXPECT_CURSORS_EQUAL(BoundScanView(block->view()), input.move());
+}
+
+TEST_P(FileIOTest, WriteBehindAndReadAhead) {
+  // Several megabytes, so many buffers of the read-ahead and write-behind.
+  std::unique_ptr<Block> block(CreateBlock(100000));
+  ThreadPool pool(2);
+  File* file = TempFile::Create("");
+  ASSERT_TRUE(file != NULL);
+  std::unique_ptr<Sink> sink(
+      FileOutput(file, DO_NOT_TAKE_OWNERSHIP, GetParam(), &pool));
+  View view(block->view());
+  for (rowcount_t offset = 0; offset < block->row_capacity();
+       offset += 30000) {
+    view.ResetFromSubRange(
+        block->view(), offset,
+        std::min<rowcount_t>(30000, block->row_capacity() - offset));
+    ASSERT_TRUE(sink->Write(view).is_success());
+  }
+  ASSERT_TRUE(sink->Finalize().is_success());
+  ASSERT_TRUE(file->Seek(0));
+  FailureOrOwned<Cursor> input(FileInput(
+      block->schema(), file, true, HeapBufferAllocator::Get(), &pool));
+  ASSERT_TRUE(input.is_success());
+  EXPECT_CURSORS_EQUAL(BoundScanView(block->view()), input.move());
+}
+
+TEST_P(FileIOTest, ReadAheadCursorDestroyedEarly) {
+  std::unique_ptr<Block> block(CreateBlock(50000));
+  File* file = TempFile::Create("");
+  ASSERT_TRUE(file != NULL);
+  ASSERT_TRUE(WriteViewWithMaxChunkRowCount(block->view(), 8192, GetParam(),
+                                            file).is_success());
+  ASSERT_TRUE(file->Seek(0));
+  ThreadPool pool(1);
+  FailureOrOwned<Cursor> input(FileInput(
+      block->schema(), file, true, HeapBufferAllocator::Get(), &pool));
+  ASSERT_TRUE(input.is_success());
+  std::unique_ptr<Cursor> cursor(input.move());
+  ResultView result = cursor->Next(Cursor::kDefaultRowCount);
+  ASSERT_TRUE(result.has_data());
+  // Waits for the read in progress before deleting the file.
+  cursor.reset();
+}
+
+INSTANTIATE_TEST_CASE_P(AllCompressions, FileIOTest,
+                        testing::Values(FILE_COMPRESSION_NONE,
+                                        FILE_COMPRESSION_LIGHTWEIGHT,
+                                        FILE_COMPRESSION_LZ4));
+
+TEST(MappedFileInputTest, DataIsUsedInPlace) {
+  std::unique_ptr<Block> block(BlockBuilder<INT64, STRING>()
+      .AddRow(1, "one")
+      .AddRow(2, "two")
+      .Build());
+  File* file = TempFile::Create("");
+  ASSERT_TRUE(file != NULL);
+  const string file_name = file->CreateFileName();
+  ASSERT_TRUE(WriteViewWithMaxChunkRowCount(block->view(), 8192,
+                                            FILE_COMPRESSION_NONE,
+                                            file).is_success());
+  // Seeking flushes the written data.
+  ASSERT_TRUE(file->Seek(0));
+  FailureOrOwned<Cursor> input(MappedFileInput(block->schema(), file_name,
+                                               HeapBufferAllocator::Get()));
+  ASSERT_TRUE(input.is_success());
+  ResultView result = input->Next(Cursor::kDefaultRowCount);
+  ASSERT_TRUE(result.has_data());
+  EXPECT_EQ(2, result.view().row_count());
+  EXPECT_EQ(1, result.view().column(0).typed_data<INT64>()[0]);
+  // The view reads the shared mapping, so it sees the file being modified.
+  ASSERT_TRUE(file->Seek(sizeof(uint64_t)));
+  const int64_t modified = 7;
+  ASSERT_EQ(sizeof(modified), file->Write(&modified, sizeof(modified)));
+  ASSERT_TRUE(file->Seek(0));
+  EXPECT_EQ(7, result.view().column(0).typed_data<INT64>()[0]);
+  EXPECT_EQ("two", result.view().column(1).typed_data<STRING>()[1]);
+  EXPECT_TRUE(file->Delete());
+  file->Close();
+}
+
+TEST(MappedFileInputTest, MissingFileFails) {
+  std::unique_ptr<Block> block(BlockBuilder<INT64>().Build());
+  EXPECT_TRUE(MappedFileInput(block->schema(), TempFile::TempFilename(NULL),
+                              HeapBufferAllocator::Get()).is_failure());
+}
+
+TEST(FileIOCompressionTest, CompressedFilesAreSmaller) {
+  std::unique_ptr<Block> block(CreateBlock(5000));
+  const int64_t uncompressed =
+      ExpectRoundTrip(block->view(), 8192, FILE_COMPRESSION_NONE);
+  const int64_t lightweight =
+      ExpectRoundTrip(block->view(), 8192, FILE_COMPRESSION_LIGHTWEIGHT);
+  const int64_t lz4 =
+      ExpectRoundTrip(block->view(), 8192, FILE_COMPRESSION_LZ4);
+  EXPECT_LT(lightweight * 3, uncompressed);
+  EXPECT_LE(lz4, lightweight);
+}
+
+TEST(FileIOCompressionTest, CorruptedColumnFails) {
+  std::unique_ptr<Block> block(BlockBuilder<INT64>()
+      .AddRow(1)
+      .AddRow(2)
+      .Build());
+  File* file = TempFile::Create("");
+  ASSERT_TRUE(file != NULL);
+  ASSERT_TRUE(WriteViewWithMaxChunkRowCount(block->view(), 8192,
+                                            FILE_COMPRESSION_LIGHTWEIGHT,
+                                            file).is_success());
+  // Overwrite the column's compression, after the row count.
+  ASSERT_TRUE(file->Seek(sizeof(uint64_t)));
+  const char unknown = 100;
+  ASSERT_EQ(1, file->Write(&unknown, 1));
+  ASSERT_TRUE(file->Seek(0));
+  FailureOrOwned<Cursor> input(
+      FileInput(block->schema(), file, true, HeapBufferAllocator::Get()));
+  ASSERT_TRUE(input.is_success());
+  EXPECT_TRUE(input->Next(Cursor::kDefaultRowCount).is_failure());
+}
+
+}  // namespace
+
+}  // namespace supersonic
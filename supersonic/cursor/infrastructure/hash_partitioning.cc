@@ -0,0 +1,71 @@
+// Copyright 2012 Google Inc. All Rights Reserved.
+//
+// Licensed under the Apache License, Version 2.0 (the "License");
+// you may not use this file except in compliance with the License.
+// You may obtain a copy of the License at
+//
+//     http://www.apache.org/licenses/LICENSE-2.0
+//
+// Unless required by applicable law or agreed to in writing, software
+// distributed under the License is distributed on an "AS IS" BASIS,
+// WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+// See the License for the specific language governing permissions and
+// limitations under the License.
+//
+
+#include "supersonic/cursor/infrastructure/hash_partitioning.h"
+
+#include <stdint.h>
+
+#include <algorithm>
+
+#include <glog/logging.h>
+#include "supersonic/utils/logging-inl.h"
+
+#include "supersonic/base/infrastructure/block.h"
+#include "supersonic/cursor/infrastructure/row_hash_set.h"
+
+namespace supersonic {
+
+void ComputeHashPartitions(const View& key, int partition_bits,
+                           size_t* hash, int* partition) {
+  ComputeHashSubpartitions(key, partition_bits, 0, hash, partition);
+}
+
+void ComputeHashSubpartitions(const View& key, int partition_bits, int level,
+                              size_t* hash, int* partition) {
+  DCHECK_LE(partition_bits * (level + 1), 64);
+  const rowcount_t row_count = key.row_count();
+  row_hash_set::HashKeys(key, row_count, hash);
+  if (partition_bits == 0) {
+    std::fill(partition, partition + row_count, 0);
+    return;
+  }
+  const int skipped_bits = partition_bits * level;
+  for (rowid_t i = 0; i < row_count; ++i) {
+    partition[i] =
+        ((static_cast<uint64_t>(hash[i]) * 0x9E3779B97F4A7C15ULL)
+             << skipped_bits) >> (64 - partition_bits);
+  }
+}
+
+void GroupByPartition(const int* partition, rowcount_t row_count,
+                      int partition_count, rowid_t* order, rowcount_t* offset) {
+  std::fill(offset, offset + partition_count + 1, 0);
+  for (rowid_t i = 0; i < row_count; ++i) {
+    ++offset[partition[i] + 1];
+  }
+  for (int p = 0; p < partition_count; ++p) {
+    offset[p + 1] += offset[p];
+  }
+  for (rowid_t i = 0; i < row_count; ++i) {
+    order[offset[partition[i]]++] = i;
+  }
+  // Each offset[p] now points at the end of the partition p.
+  for (int p = partition_count; p > 0; --p) {
+    offset[p] = offset[p - 1];
+  }
+  offset[0] = 0;
+}
+
+}  // namespace supersonic
@@ -0,0 +1,53 @@
+// Copyright 2012 Google Inc. All Rights Reserved.
+//
+// Licensed under the Apache License, Version 2.0 (the "License");
+// you may not use this file except in compliance with the License.
+// You may obtain a copy of the License at
+//
+//     http://www.apache.org/licenses/LICENSE-2.0
+//
+// Unless required by applicable law or agreed to in writing, software
+// distributed under the License is distributed on an "AS IS" BASIS,
+// WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+// See the License for the specific language governing permissions and
+// limitations under the License.
+//
+// Splitting of rows into partitions by the hashes of their keys, used by the
+// operations that process the partitions independently (the partitioned hash
+// join, the parallel and the hybrid group aggregations).
+
+#ifndef SUPERSONIC_CURSOR_INFRASTRUCTURE_HASH_PARTITIONING_H_
+#define SUPERSONIC_CURSOR_INFRASTRUCTURE_HASH_PARTITIONING_H_
+
+#include <stddef.h>
+
+#include "supersonic/base/infrastructure/types.h"
+
+namespace supersonic {
+
+class View;
+
+// Computes the hashes of the rows of the key view (the same way RowHashSet
+// does), and assigns the rows to 2^partition_bits partitions by the high bits
+// of the scrambled hashes. (RowHashSet picks its slots by the low bits of the
+// hashes, and these need to stay diverse within a partition.) hash and
+// partition must hold key.row_count() values.
+void ComputeHashPartitions(const View& key, int partition_bits,
+                           size_t* hash, int* partition);
+
+// Like ComputeHashPartitions, but picks the level-th group of partition_bits
+// bits (level 0 being the bits used by ComputeHashPartitions). Used to split a
+// partition further: its rows agree on the bits of the lower levels.
+// partition_bits * (level + 1) must not exceed 64.
+void ComputeHashSubpartitions(const View& key, int partition_bits, int level,
+                              size_t* hash, int* partition);
+
+// Arranges the row ids by partition (counting sort). On return, the ids of the
+// rows in partition p, in ascending order, are at order[offset[p]] ..
+// order[offset[p + 1] - 1]. offset must hold partition_count + 1 values.
+void GroupByPartition(const int* partition, rowcount_t row_count,
+                      int partition_count, rowid_t* order, rowcount_t* offset);
+
+}  // namespace supersonic
+
+#endif  // SUPERSONIC_CURSOR_INFRASTRUCTURE_HASH_PARTITIONING_H_
@@ -0,0 +1,100 @@
+// Copyright 2012 Google Inc. All Rights Reserved.
+//
+// Licensed under the Apache License, Version 2.0 (the "License");
+// you may not use this file except in compliance with the License.
+// You may obtain a copy of the License at
+//
+//     http://www.apache.org/licenses/LICENSE-2.0
+//
+// Unless required by applicable law or agreed to in writing, software
+// distributed under the License is distributed on an "AS IS" BASIS,
+// WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+// See the License for the specific language governing permissions and
+// limitations under the License.
+//
+
+#include "supersonic/cursor/infrastructure/hash_partitioning.h"
+
+#include <memory>
+#include <vector>
+using std::vector;
+
+#include "supersonic/base/infrastructure/block.h"
+#include "supersonic/testing/block_builder.h"
+#include "gtest/gtest.h"
+
+namespace supersonic {
+
+namespace {
+
+TEST(HashPartitioningTest, EqualKeysGoToTheSamePartition) {
+  BlockBuilder<INT64, STRING> builder;
+  for (int i = 0; i < 1000; ++i) {
+    builder.AddRow(i % 50, (i % 2 == 0) ? "even" : "odd");
+  }
+  std::unique_ptr<Block> block(builder.Build());
+  const View& view = block->view();
+  size_t hash[1000];
+  int partition[1000];
+  ComputeHashPartitions(view, 3, hash, partition);
+  vector<int> used(8, 0);
+  for (int i = 0; i < 1000; ++i) {
+    ASSERT_LE(0, partition[i]);
+    ASSERT_GT(8, partition[i]);
+    ++used[partition[i]];
+    // Rows i and i % 100 have equal keys.
+    EXPECT_EQ(partition[i % 100], partition[i]);
+    EXPECT_EQ(hash[i % 100], hash[i]);
+  }
+  for (int p = 0; p < 8; ++p) EXPECT_LT(0, used[p]) << p;
+}
+
+TEST(HashPartitioningTest, SinglePartition) {
+  std::unique_ptr<Block> block(
+      BlockBuilder<INT32>().AddRow(1).AddRow(2).AddRow(3).Build());
+  size_t hash[3];
+  int partition[3];
+  ComputeHashPartitions(block->view(), 0, hash, partition);
+  EXPECT_EQ(0, partition[0]);
+  EXPECT_EQ(0, partition[1]);
+  EXPECT_EQ(0, partition[2]);
+}
+
+TEST(HashPartitioningTest, SubpartitionsSplitAPartition) {
+  BlockBuilder<INT64> builder;
+  for (int i = 0; i < 4000; ++i) builder.AddRow(i);
+  std::unique_ptr<Block> block(builder.Build());
+  size_t hash[4000];
+  int partition[4000];
+  int subpartition[4000];
+  ComputeHashPartitions(block->view(), 2, hash, partition);
+  ComputeHashSubpartitions(block->view(), 2, 1, hash, subpartition);
+  // Every partition is split into all the subpartitions.
+  vector<int> used(16, 0);
+  for (int i = 0; i < 4000; ++i) {
+    ASSERT_LE(0, subpartition[i]);
+    ASSERT_GT(4, subpartition[i]);
+    ++used[partition[i] * 4 + subpartition[i]];
+  }
+  for (int p = 0; p < 16; ++p) EXPECT_LT(0, used[p]) << p;
+  // Level 0 is the partitioning itself.
+  ComputeHashSubpartitions(block->view(), 2, 0, hash, subpartition);
+  for (int i = 0; i < 4000; ++i) EXPECT_EQ(partition[i], subpartition[i]);
+}
+
+TEST(HashPartitioningTest, GroupByPartition) {
+  const int partition[] = { 2, 0, 2, 1, 0, 2 };
+  rowid_t order[6];
+  rowcount_t offset[4];
+  GroupByPartition(partition, 6, 3, order, offset);
+  EXPECT_EQ(0, offset[0]);
+  EXPECT_EQ(2, offset[1]);
+  EXPECT_EQ(3, offset[2]);
+  EXPECT_EQ(6, offset[3]);
+  const rowid_t expected_order[] = { 1, 4, 3, 0, 2, 5 };
+  for (int i = 0; i < 6; ++i) EXPECT_EQ(expected_order[i], order[i]) << i;
+}
+
+}  // namespace
+
+}  // namespace supersonic
@@ -27,12 +27,14 @@ CursorProxy::CursorProxy(Cursor* cursor)
     : cursor_(cursor),
       is_waiting_on_barrier_supported_(
           cursor_->IsWaitingOnBarrierSupported()),
+      accept_selection_(false),
       cursor_status_(ResultView::BOS()) {}
 
 CursorProxy::CursorProxy(unique_ptr<Cursor> cursor)
     : cursor_(std::move(cursor)),
       is_waiting_on_barrier_supported_(
           cursor_->IsWaitingOnBarrierSupported()),
+      accept_selection_(false),
       cursor_status_(ResultView::BOS()) {}
 
 void CursorProxy::Terminate() {
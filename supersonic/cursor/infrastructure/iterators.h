@@ -166,7 +166,8 @@ class CursorProxy {
   void Next(rowcount_t max_row_count) {
     DCHECK(!cursor_status_.is_done())
         << "Cursor already iterated to completion.";
-    cursor_status_ = cursor_->Next(max_row_count);
+    cursor_status_ = accept_selection_ ? cursor_->NextSelected(max_row_count)
+                                       : cursor_->Next(max_row_count);
     if (cursor_status_.is_done() &&
         FLAGS_supersonic_release_cursors_aggressively) {
       // Dispose of the cursor to release resources ASAP.
@@ -176,6 +177,11 @@ class CursorProxy {
 
   void Interrupt() { if (cursor_ != NULL) cursor_->Interrupt(); }
 
+  // If set, Next() calls the cursor's NextSelected().
+  void set_accept_selection(bool accept_selection) {
+    accept_selection_ = accept_selection;
+  }
+
   // Replaces the underlying cursor with the result of the transformation.
   void ApplyToCursor(CursorTransformer* transformer) {
     cursor_ = transformer->Transform(std::move(cursor_));
@@ -202,6 +208,7 @@ class CursorProxy {
  private:
   std::unique_ptr<Cursor> cursor_;
   const bool is_waiting_on_barrier_supported_;
+  bool accept_selection_;
   string terminal_debug_description_;
   ResultView cursor_status_;
   DISALLOW_COPY_AND_ASSIGN(CursorProxy);
@@ -263,6 +270,13 @@ class CursorIterator {
     return true;
   }
 
+  // If set, the iterator reads the cursor with NextSelected(), so its views may
+  // carry selection vectors (see View::selection()). Set it before the first
+  // Next(), and only if you read the views' columns through the selection.
+  void set_accept_selection(bool accept_selection) {
+    proxy_.set_accept_selection(accept_selection);
+  }
+
   // Destroys the underlying cursor. If the iterator was not done, it will
   // then behave as if it reached an exception.
   void Terminate() {
@@ -0,0 +1,364 @@
+// Copyright 2012 Google Inc. All Rights Reserved.
+//
+// Licensed under the Apache License, Version 2.0 (the "License");
+// you may not use this file except in compliance with the License.
+// You may obtain a copy of the License at
+//
+//     http://www.apache.org/licenses/LICENSE-2.0
+//
+// Unless required by applicable law or agreed to in writing, software
+// distributed under the License is distributed on an "AS IS" BASIS,
+// WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+// See the License for the specific language governing permissions and
+// limitations under the License.
+//
+
+#include "supersonic/cursor/infrastructure/normalized_key.h"
+
+#include <string.h>
+
+#include <algorithm>
+#include <vector>
+using std::vector;
+
+#include <glog/logging.h>
+#include "supersonic/utils/logging-inl.h"
+
+#include "supersonic/base/infrastructure/block.h"
+#include "supersonic/cursor/infrastructure/ordering.h"
+#include "supersonic/utils/endian.h"
+
+namespace supersonic {
+
+namespace {
+
+// Buckets smaller than this are sorted by insertion sort.
+const rowcount_t kRadixSortMinRowCount = 64;
+
+// Map the values to unsigned integers of the same width, in the same order.
+inline uint32_t OrderedBits(int32_t value) {
+  return static_cast<uint32_t>(value) ^ 0x80000000U;
+}
+
+inline uint64_t OrderedBits(int64_t value) {
+  return static_cast<uint64_t>(value) ^ 0x8000000000000000ULL;
+}
+
+inline uint32_t OrderedBits(uint32_t value) { return value; }
+
+inline uint64_t OrderedBits(uint64_t value) { return value; }
+
+inline uint32_t OrderedBits(float value) {
+  uint32_t bits;
+  memcpy(&bits, &value, sizeof(bits));
+  return (bits & 0x80000000U) ? ~bits : (bits | 0x80000000U);
+}
+
+inline uint64_t OrderedBits(double value) {
+  uint64_t bits;
+  memcpy(&bits, &value, sizeof(bits));
+  return (bits & 0x8000000000000000ULL) ? ~bits
+                                        : (bits | 0x8000000000000000ULL);
+}
+
+inline uint8_t OrderedBits(bool value) { return value ? 1 : 0; }
+
+inline void StoreBigEndian(uint8_t value, uint8_t* target) { *target = value; }
+
+inline void StoreBigEndian(uint32_t value, uint8_t* target) {
+  BigEndian::Store32(target, value);
+}
+
+inline void StoreBigEndian(uint64_t value, uint8_t* target) {
+  BigEndian::Store64(target, value);
+}
+
+template<DataType type>
+void EncodeColumn(const Column& column, bool descending, size_t offset,
+                  const rowid_t* rows, rowcount_t row_count,
+                  size_t key_width, uint8_t* keys) {
+  typedef typename TypeTraits<type>::cpp_type cpp_type;
+  const cpp_type* data = column.typed_data<type>();
+  bool_const_ptr is_null = column.is_null();
+  const size_t value_size = sizeof(OrderedBits(cpp_type()));
+  const size_t column_width = value_size + ((is_null != NULL) ? 1 : 0);
+  uint8_t* key = keys + offset;
+  for (rowcount_t i = 0; i < row_count; ++i, key += key_width) {
+    const rowid_t row = rows[i];
+    uint8_t* value = key;
+    if (is_null != NULL) {
+      if (is_null[row]) {
+        memset(key, 0, column_width);
+        continue;
+      }
+      *value++ = 1;
+    }
+    StoreBigEndian(OrderedBits(data[row]), value);
+  }
+  if (descending) {
+    key = keys + offset;
+    for (rowcount_t i = 0; i < row_count; ++i, key += key_width) {
+      for (size_t j = 0; j < column_width; ++j) key[j] = ~key[j];
+    }
+  }
+}
+
+// Returns the size of the values of the type in the normalized key, or 0 if
+// they can't be normalized.
+size_t NormalizedValueSize(DataType type) {
+  switch (type) {
+    case BOOL:
+      return 1;
+    case INT32:
+    case UINT32:
+    case FLOAT:
+    case DATE:
+      return 4;
+    case INT64:
+    case UINT64:
+    case DOUBLE:
+    case DATETIME:
+      return 8;
+    default:
+      return 0;
+  }
+}
+
+// A normalized key, padded to whole words. The bytes of the words are in
+// memory order, i.e. compared with memcmp.
+template<int word_count>
+struct PaddedKey {
+  uint8_t byte(size_t position) const {
+    return reinterpret_cast<const uint8_t*>(words)[position];
+  }
+
+  // Compares the keys in memcmp order, from the word-th word on.
+  bool LessThan(const PaddedKey& other, int word) const {
+    for (; word < word_count; ++word) {
+      if (words[word] != other.words[word]) {
+        return BigEndian::ToHost64(words[word]) <
+               BigEndian::ToHost64(other.words[word]);
+      }
+    }
+    return false;
+  }
+
+  uint64_t words[word_count];
+};
+
+// Most-significant-byte-first radix sort of the padded keys, considering only
+// the bytes at the given positions (those that aren't equal in all the keys).
+// Every pass scatters the keys (and rows) to the other of two arrays, so that
+// they aren't copied back after every pass.
+template<int word_count>
+class RadixSorter {
+ public:
+  typedef PaddedKey<word_count> Key;
+
+  explicit RadixSorter(const vector<size_t>& positions)
+      : positions_(positions) {}
+
+  // Sorts the row_count keys by their bytes at positions_[depth] and on; the
+  // keys agree on the preceding positions. The keys and the rows are moved
+  // along to the other arrays (of the same size), which are used as scratch
+  // space; the result ends up in the other arrays if to_other, and in the
+  // original ones otherwise.
+  void Sort(size_t depth, rowcount_t row_count, Key* keys, rowid_t* rows,
+            Key* other_keys, rowid_t* other_rows, bool to_other) const {
+    while (depth < positions_.size() && row_count >= kRadixSortMinRowCount) {
+      const size_t position = positions_[depth];
+      rowcount_t count[256] = { 0 };
+      for (rowcount_t i = 0; i < row_count; ++i) {
+        ++count[keys[i].byte(position)];
+      }
+      if (count[keys[0].byte(position)] == row_count) {
+        ++depth;
+        continue;
+      }
+      rowcount_t next[256];
+      rowcount_t offset = 0;
+      for (int b = 0; b < 256; ++b) {
+        next[b] = offset;
+        offset += count[b];
+      }
+      for (rowcount_t i = 0; i < row_count; ++i) {
+        const rowcount_t target = next[keys[i].byte(position)]++;
+        other_keys[target] = keys[i];
+        other_rows[target] = rows[i];
+      }
+      offset = 0;
+      for (int b = 0; b < 256; ++b) {
+        if (count[b] > 0) {
+          Sort(depth + 1, count[b], other_keys + offset, other_rows + offset,
+               keys + offset, rows + offset, !to_other);
+        }
+        offset += count[b];
+      }
+      return;
+    }
+    if (to_other) {
+      std::copy(keys, keys + row_count, other_keys);
+      std::copy(rows, rows + row_count, other_rows);
+      keys = other_keys;
+      rows = other_rows;
+    }
+    if (depth < positions_.size()) {
+      InsertionSort(positions_[depth] / sizeof(uint64_t), row_count, keys,
+                    rows);
+    }
+  }
+
+ private:
+  // Sorts the keys by their words from the word-th on.
+  static void InsertionSort(int word, rowcount_t row_count,
+                            Key* keys, rowid_t* rows) {
+    DCHECK_LT(row_count, kRadixSortMinRowCount);
+    for (rowcount_t i = 1; i < row_count; ++i) {
+      const Key key = keys[i];
+      const rowid_t row = rows[i];
+      rowcount_t j = i;
+      for (; j > 0 && key.LessThan(keys[j - 1], word); --j) {
+        keys[j] = keys[j - 1];
+        rows[j] = rows[j - 1];
+      }
+      keys[j] = key;
+      rows[j] = row;
+    }
+  }
+
+  const vector<size_t>& positions_;
+  DISALLOW_COPY_AND_ASSIGN(RadixSorter);
+};
+
+template<int word_count>
+void RadixSortPaddedKeys(rowcount_t row_count, uint8_t* key_bytes,
+                         rowid_t* rows, uint8_t* scratch_key_bytes,
+                         rowid_t* scratch_rows) {
+  typedef PaddedKey<word_count> Key;
+  Key* const keys = reinterpret_cast<Key*>(key_bytes);
+  // Finds the bytes that differ between any two keys.
+  uint64_t differences[word_count] = { 0 };
+  for (rowcount_t i = 1; i < row_count; ++i) {
+    for (int w = 0; w < word_count; ++w) {
+      differences[w] |= keys[i].words[w] ^ keys[0].words[w];
+    }
+  }
+  const uint8_t* difference_bytes =
+      reinterpret_cast<const uint8_t*>(differences);
+  vector<size_t> positions;
+  for (size_t position = 0; position < sizeof(Key); ++position) {
+    if (difference_bytes[position] != 0) positions.push_back(position);
+  }
+  if (positions.empty()) return;
+  RadixSorter<word_count>(positions).Sort(
+      0, row_count, keys, rows, reinterpret_cast<Key*>(scratch_key_bytes),
+      scratch_rows, false);
+}
+
+}  // namespace
+
+std::unique_ptr<NormalizedKeyEncoder> NormalizedKeyEncoder::Create(
+    const BoundSortOrder& sort_order, const View& input) {
+  std::vector<KeyColumn> key_columns;
+  size_t key_width = 0;
+  const TupleSchema& key_schema = sort_order.schema();
+  for (int i = 0; i < key_schema.attribute_count(); ++i) {
+    const DataType type = key_schema.attribute(i).type();
+    const size_t value_size = NormalizedValueSize(type);
+    if (value_size == 0) return nullptr;
+    const Column& column =
+        input.column(sort_order.source_attribute_position(i));
+    KeyColumn key_column = {
+      type, sort_order.column_order(i) == DESCENDING, &column, key_width
+    };
+    key_columns.push_back(key_column);
+    key_width += value_size + ((column.is_null() != NULL) ? 1 : 0);
+  }
+  // Padded to whole words.
+  key_width = (key_width + 7) / 8 * 8;
+  if (key_width == 0 || key_width > kMaxNormalizedKeyWidth) return nullptr;
+  return std::unique_ptr<NormalizedKeyEncoder>(
+      new NormalizedKeyEncoder(key_columns, key_width));
+}
+
+void NormalizedKeyEncoder::Encode(const rowid_t* rows, rowcount_t row_count,
+                                  uint8_t* keys) const {
+  // Clears the padding.
+  memset(keys, 0, row_count * key_width_);
+  for (const KeyColumn& key_column : key_columns_) {
+    const Column& column = *key_column.column;
+    const bool descending = key_column.descending;
+    const size_t offset = key_column.offset;
+    switch (key_column.type) {
+      case INT32:
+        EncodeColumn<INT32>(column, descending, offset, rows, row_count,
+                            key_width_, keys);
+        break;
+      case INT64:
+        EncodeColumn<INT64>(column, descending, offset, rows, row_count,
+                            key_width_, keys);
+        break;
+      case UINT32:
+        EncodeColumn<UINT32>(column, descending, offset, rows, row_count,
+                             key_width_, keys);
+        break;
+      case UINT64:
+        EncodeColumn<UINT64>(column, descending, offset, rows, row_count,
+                             key_width_, keys);
+        break;
+      case FLOAT:
+        EncodeColumn<FLOAT>(column, descending, offset, rows, row_count,
+                            key_width_, keys);
+        break;
+      case DOUBLE:
+        EncodeColumn<DOUBLE>(column, descending, offset, rows, row_count,
+                             key_width_, keys);
+        break;
+      case BOOL:
+        EncodeColumn<BOOL>(column, descending, offset, rows, row_count,
+                           key_width_, keys);
+        break;
+      case DATE:
+        EncodeColumn<DATE>(column, descending, offset, rows, row_count,
+                           key_width_, keys);
+        break;
+      case DATETIME:
+        EncodeColumn<DATETIME>(column, descending, offset, rows, row_count,
+                               key_width_, keys);
+        break;
+      default:
+        LOG(FATAL) << "Can't normalize the type "
+                   << DataType_Name(key_column.type);
+    }
+  }
+}
+
+void RadixSortNormalizedKeys(size_t key_width, rowcount_t row_count,
+                             uint8_t* keys, rowid_t* rows,
+                             uint8_t* scratch_keys, rowid_t* scratch_rows) {
+  DCHECK_EQ(0, reinterpret_cast<uintptr_t>(keys) % sizeof(uint64_t));
+  DCHECK_EQ(0, reinterpret_cast<uintptr_t>(scratch_keys) % sizeof(uint64_t));
+  if (row_count <= 1) return;
+  switch (key_width) {
+    case 8:
+      RadixSortPaddedKeys<1>(row_count, keys, rows, scratch_keys,
+                                scratch_rows);
+      break;
+    case 16:
+      RadixSortPaddedKeys<2>(row_count, keys, rows, scratch_keys,
+                                scratch_rows);
+      break;
+    case 24:
+      RadixSortPaddedKeys<3>(row_count, keys, rows, scratch_keys,
+                                scratch_rows);
+      break;
+    case 32:
+      RadixSortPaddedKeys<4>(row_count, keys, rows, scratch_keys,
+                                scratch_rows);
+      break;
+    default:
+      LOG(FATAL) << "Unsupported normalized key width " << key_width;
+  }
+}
+
+}  // namespace supersonic
@@ -0,0 +1,104 @@
+// Copyright 2012 Google Inc. All Rights Reserved.
+//
+// Licensed under the Apache License, Version 2.0 (the "License");
+// you may not use this file except in compliance with the License.
+// You may obtain a copy of the License at
+//
+//     http://www.apache.org/licenses/LICENSE-2.0
+//
+// Unless required by applicable law or agreed to in writing, software
+// distributed under the License is distributed on an "AS IS" BASIS,
+// WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+// See the License for the specific language governing permissions and
+// limitations under the License.
+//
+// Normalized sort keys: the values of the sort key columns of a row, encoded
+// into a string of bytes such that comparing two rows' strings with memcmp
+// orders the rows the same as the sort order. Sort keys made of fixed-width
+// types only can be normalized; sort.cc then orders the rows with a radix sort
+// on their normalized keys instead of comparison sorts column by column.
+//
+// Every column contributes, in order of the sort key, a byte that is 0 for
+// NULL and 1 otherwise (only if the column has an is_null vector), followed by
+// the bytes of the value, most significant first, with the bits rearranged so
+// that the values order as unsigned integers: the sign bit of the signed
+// integers flipped, and all bits of negative floating point numbers inverted
+// (the sign bit of the others flipped). NULLs have all value bytes set to 0.
+// For DESCENDING columns all the bytes of the column are inverted, which puts
+// NULLs last, as SortPermutation does. The keys are padded with zero bytes to
+// a whole number of 64-bit words.
+
+#ifndef SUPERSONIC_CURSOR_INFRASTRUCTURE_NORMALIZED_KEY_H_
+#define SUPERSONIC_CURSOR_INFRASTRUCTURE_NORMALIZED_KEY_H_
+
+#include <stddef.h>
+#include <stdint.h>
+
+#include <memory>
+#include <vector>
+
+#include "supersonic/base/infrastructure/types.h"
+#include "supersonic/proto/supersonic.pb.h"
+#include "supersonic/utils/macros.h"
+
+namespace supersonic {
+
+class BoundSortOrder;
+class Column;
+class View;
+
+// Longest normalized key NormalizedKeyEncoder will produce. Longer keys are
+// mostly equal in their leading bytes, for which the radix sort gains little.
+const size_t kMaxNormalizedKeyWidth = 32;
+
+// Encodes the sort key of the rows of a view into normalized keys.
+class NormalizedKeyEncoder {
+ public:
+  // Returns NULL if the sort key can't be normalized: if any of its columns
+  // is of a variable-length type (STRING, BINARY) or ENUM, or the normalized
+  // keys would be longer than kMaxNormalizedKeyWidth. Keeps references to the
+  // columns of the input; it must outlive the encoder.
+  static std::unique_ptr<NormalizedKeyEncoder> Create(
+      const BoundSortOrder& sort_order, const View& input);
+
+  // The length of every normalized key, in bytes; a multiple of 8.
+  size_t key_width() const { return key_width_; }
+
+  // Writes the normalized keys of the rows rows[0] .. rows[row_count - 1] of
+  // the input to keys, key_width() bytes each.
+  void Encode(const rowid_t* rows, rowcount_t row_count, uint8_t* keys) const;
+
+ private:
+  struct KeyColumn {
+    DataType type;
+    bool descending;
+    const Column* column;
+    // Position of the column's bytes within the normalized key.
+    size_t offset;
+  };
+
+  NormalizedKeyEncoder(const std::vector<KeyColumn>& key_columns,
+                       size_t key_width)
+      : key_columns_(key_columns),
+        key_width_(key_width) {}
+
+  const std::vector<KeyColumn> key_columns_;
+  const size_t key_width_;
+  DISALLOW_COPY_AND_ASSIGN(NormalizedKeyEncoder);
+};
+
+// Sorts row_count normalized keys of key_width bytes each (stored one after
+// another in keys) in memcmp order, reordering the rows (row_count values)
+// along with them. key_width must be a multiple of 8, not greater than
+// kMaxNormalizedKeyWidth, and keys must be 8-byte aligned. Uses a
+// most-significant-byte-first radix sort, skipping the bytes that all the keys
+// (of the input, or of a bucket) share, and a comparison sort for small
+// buckets. Not stable. scratch_keys and scratch_rows are scratch space of the
+// sizes of keys and rows; scratch_keys must also be 8-byte aligned.
+void RadixSortNormalizedKeys(size_t key_width, rowcount_t row_count,
+                             uint8_t* keys, rowid_t* rows,
+                             uint8_t* scratch_keys, rowid_t* scratch_rows);
+
+}  // namespace supersonic
+
+#endif  // SUPERSONIC_CURSOR_INFRASTRUCTURE_NORMALIZED_KEY_H_
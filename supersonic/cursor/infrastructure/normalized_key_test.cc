@@ -0,0 +1,220 @@
+// Copyright 2012 Google Inc. All Rights Reserved.
+//
+// Licensed under the Apache License, Version 2.0 (the "License");
+// you may not use this file except in compliance with the License.
+// You may obtain a copy of the License at
+//
+//     http://www.apache.org/licenses/LICENSE-2.0
+//
+// Unless required by applicable law or agreed to in writing, software
+// distributed under the License is distributed on an "AS IS" BASIS,
+// WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+// See the License for the specific language governing permissions and
+// limitations under the License.
+//
+
+#include "supersonic/cursor/infrastructure/normalized_key.h"
+
+#include <string.h>
+
+#include <algorithm>
+#include <memory>
+#include <vector>
+using std::vector;
+
+#include "supersonic/base/infrastructure/block.h"
+#include "supersonic/base/infrastructure/projector.h"
+#include "supersonic/cursor/infrastructure/ordering.h"
+#include "supersonic/testing/block_builder.h"
+#include "supersonic/utils/random.h"
+#include "gtest/gtest.h"
+
+namespace supersonic {
+
+namespace {
+
+std::unique_ptr<const BoundSortOrder> BindSortOrder(const SortOrder& order,
+                                                    const View& view) {
+  return SucceedOrDie(order.Bind(view.schema()));
+}
+
+// Returns the normalized keys of all the rows of the view.
+vector<uint8_t> EncodeAll(const NormalizedKeyEncoder& encoder,
+                          const View& view) {
+  vector<rowid_t> rows(view.row_count());
+  for (rowid_t i = 0; i < view.row_count(); ++i) rows[i] = i;
+  vector<uint8_t> keys(view.row_count() * encoder.key_width());
+  encoder.Encode(rows.data(), view.row_count(), keys.data());
+  return keys;
+}
+
+// Expects the normalized keys of the consecutive rows of the view to be in
+// strictly increasing memcmp order.
+void ExpectIncreasing(const SortOrder& order, const View& view) {
+  std::unique_ptr<const BoundSortOrder> bound_order =
+      BindSortOrder(order, view);
+  std::unique_ptr<NormalizedKeyEncoder> encoder =
+      NormalizedKeyEncoder::Create(*bound_order, view);
+  ASSERT_TRUE(encoder != NULL);
+  const size_t width = encoder->key_width();
+  const vector<uint8_t> keys = EncodeAll(*encoder, view);
+  for (rowid_t i = 1; i < view.row_count(); ++i) {
+    EXPECT_LT(memcmp(&keys[(i - 1) * width], &keys[i * width], width), 0)
+        << "rows " << i - 1 << " and " << i;
+  }
+}
+
+TEST(NormalizedKeyTest, SignedIntegersWithNulls) {
+  std::unique_ptr<Block> block(BlockBuilder<INT32, INT64>()
+      .AddRow(__, __)
+      .AddRow(-2147483647 - 1, -5000000000LL)
+      .AddRow(-1, -1)
+      .AddRow(0, 0)
+      .AddRow(1, 1)
+      .AddRow(2147483647, 5000000000LL)
+      .Build());
+  SortOrder by_int32;
+  by_int32.add(ProjectAttributeAt(0), ASCENDING);
+  ExpectIncreasing(by_int32, block->view());
+  SortOrder by_int64;
+  by_int64.add(ProjectAttributeAt(1), ASCENDING);
+  ExpectIncreasing(by_int64, block->view());
+}
+
+TEST(NormalizedKeyTest, DescendingPutsNullsLast) {
+  std::unique_ptr<Block> block(BlockBuilder<UINT32, DATETIME>()
+      .AddRow(4000000000U, 3)
+      .AddRow(7, 2)
+      .AddRow(0, 1)
+      .AddRow(__, __)
+      .Build());
+  SortOrder order;
+  order.add(ProjectAttributeAt(0), DESCENDING);
+  ExpectIncreasing(order, block->view());
+  SortOrder by_datetime;
+  by_datetime.add(ProjectAttributeAt(1), DESCENDING);
+  ExpectIncreasing(by_datetime, block->view());
+}
+
+TEST(NormalizedKeyTest, FloatingPoint) {
+  std::unique_ptr<Block> block(BlockBuilder<FLOAT, DOUBLE>()
+      .AddRow(-1e30f, -1e300)
+      .AddRow(-2.5f, -2.5)
+      .AddRow(-1e-30f, -1e-300)
+      .AddRow(0.0f, 0.0)
+      .AddRow(1e-30f, 1e-300)
+      .AddRow(2.5f, 2.5)
+      .AddRow(1e30f, 1e300)
+      .Build());
+  SortOrder by_float;
+  by_float.add(ProjectAttributeAt(0), ASCENDING);
+  ExpectIncreasing(by_float, block->view());
+  SortOrder by_double;
+  by_double.add(ProjectAttributeAt(1), ASCENDING);
+  ExpectIncreasing(by_double, block->view());
+}
+
+TEST(NormalizedKeyTest, MultipleColumns) {
+  std::unique_ptr<Block> block(BlockBuilder<BOOL, DATE, UINT64>()
+      .AddRow(false, 10, 5)
+      .AddRow(false, 10, 4)
+      .AddRow(false, 9, 7)
+      .AddRow(false, __, 1)
+      .AddRow(true, 11, 9)
+      .AddRow(true, 11, 0)
+      .Build());
+  SortOrder order;
+  order.add(ProjectAttributeAt(0), ASCENDING)
+       ->add(ProjectAttributeAt(1), DESCENDING)
+       ->add(ProjectAttributeAt(2), DESCENDING);
+  ExpectIncreasing(order, block->view());
+}
+
+TEST(NormalizedKeyTest, NullByteOnlyForNullableColumns) {
+  std::unique_ptr<Block> block(BlockBuilder<INT32, INT64>()
+      .AddRow(1, __)
+      .Build());
+  SortOrder order;
+  order.add(ProjectAttributeAt(0), ASCENDING)
+       ->add(ProjectAttributeAt(1), ASCENDING);
+  // Only col1 keeps its is_null vector.
+  View view(block->view());
+  view.mutable_column(0)->ResetIsNull(NULL);
+  std::unique_ptr<const BoundSortOrder> bound_order =
+      BindSortOrder(order, view);
+  std::unique_ptr<NormalizedKeyEncoder> encoder =
+      NormalizedKeyEncoder::Create(*bound_order, view);
+  ASSERT_TRUE(encoder != NULL);
+  // 4 + (1 + 8) bytes, padded.
+  EXPECT_EQ(16, encoder->key_width());
+}
+
+TEST(NormalizedKeyTest, VariableLengthKeysNotNormalized) {
+  std::unique_ptr<Block> block(BlockBuilder<INT32, STRING>()
+      .AddRow(1, "a")
+      .Build());
+  SortOrder order;
+  order.add(ProjectAttributeAt(0), ASCENDING)
+       ->add(ProjectAttributeAt(1), ASCENDING);
+  std::unique_ptr<const BoundSortOrder> bound_order =
+      BindSortOrder(order, block->view());
+  EXPECT_TRUE(NormalizedKeyEncoder::Create(*bound_order, block->view()) ==
+              NULL);
+}
+
+TEST(NormalizedKeyTest, TooLongKeysNotNormalized) {
+  std::unique_ptr<Block> block(
+      BlockBuilder<INT64, INT64, INT64, INT64, INT64>()
+          .AddRow(1, 2, 3, 4, 5)
+          .Build());
+  SortOrder order;
+  for (int i = 0; i < 5; ++i) {
+    order.add(ProjectAttributeAt(i), ASCENDING);
+  }
+  std::unique_ptr<const BoundSortOrder> bound_order =
+      BindSortOrder(order, block->view());
+  // At least 5 * 8 bytes.
+  EXPECT_TRUE(NormalizedKeyEncoder::Create(*bound_order, block->view()) ==
+              NULL);
+}
+
+TEST(NormalizedKeyTest, RadixSortMatchesComparisonSort) {
+  MTRandom random(0);
+  const size_t kWidth = 16;
+  for (rowcount_t row_count : { 0, 1, 5, 63, 64, 1000, 100000 }) {
+    vector<uint8_t> keys(row_count * kWidth);
+    for (size_t i = 0; i < keys.size(); ++i) {
+      // Few distinct values in the leading bytes, so that some buckets are
+      // split all the way down, and constant bytes, to be skipped.
+      const size_t byte = i % kWidth;
+      keys[i] = (byte < 2) ? random.Rand32() % 3
+              : (byte < 8) ? random.Rand32() % 256
+              : (byte == 12) ? 7 : 0;
+    }
+    vector<rowid_t> rows(row_count);
+    for (rowid_t i = 0; i < row_count; ++i) rows[i] = i;
+    const vector<uint8_t> original = keys;
+
+    vector<uint64_t> scratch_keys(row_count * kWidth / sizeof(uint64_t));
+    vector<rowid_t> scratch_rows(row_count);
+    RadixSortNormalizedKeys(
+        kWidth, row_count, keys.data(), rows.data(),
+        reinterpret_cast<uint8_t*>(scratch_keys.data()), scratch_rows.data());
+
+    for (rowid_t i = 0; i < row_count; ++i) {
+      // The rows moved along with their keys.
+      ASSERT_EQ(0, memcmp(&keys[i * kWidth], &original[rows[i] * kWidth],
+                          kWidth));
+      if (i > 0) {
+        ASSERT_LE(memcmp(&keys[(i - 1) * kWidth], &keys[i * kWidth], kWidth),
+                  0);
+      }
+    }
+    std::sort(rows.begin(), rows.end());
+    for (rowid_t i = 0; i < row_count; ++i) ASSERT_EQ(i, rows[i]);
+  }
+}
+
+}  // namespace
+
+}  // namespace supersonic
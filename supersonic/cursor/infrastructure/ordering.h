@@ -213,6 +213,32 @@ class Permutation {
     std::random_shuffle(begin, end, generator);
   }
 
+  // Merges the sorted ranges [left_from, left_to) and [right_from, right_to)
+  // of the permutation, writing the result to the target permutation, from
+  // position target_from on. The target must be a different permutation.
+  template<typename LessThanComparator>
+  void MergeInto(rowcount_t left_from, rowcount_t left_to,
+                 rowcount_t right_from, rowcount_t right_to,
+                 LessThanComparator comparator,
+                 Permutation* target, rowcount_t target_from) const {
+    DCHECK_NE(this, target);
+    DCHECK_LE(left_from, left_to);
+    DCHECK_LE(left_to, size());
+    DCHECK_LE(right_from, right_to);
+    DCHECK_LE(right_to, size());
+    DCHECK_LE(target_from + (left_to - left_from) + (right_to - right_from),
+              target->size());
+    std::merge(permutation_.begin() + left_from,
+               permutation_.begin() + left_to,
+               permutation_.begin() + right_from,
+               permutation_.begin() + right_to,
+               target->permutation_.begin() + target_from,
+               comparator);
+  }
+
+  // Exchanges the contents with the other permutation.
+  void Swap(Permutation* other) { permutation_.swap(other->permutation_); }
+
   // Returns the number of elements in the partition.
   rowcount_t size() const { return permutation_.size(); }
 
@@ -224,6 +250,12 @@ class Permutation {
     return (!permutation_.empty()) ? &permutation_.front() : NULL;
   }
 
+  // Returns the entire permutation for modification. The caller must keep it
+  // a permutation.
+  rowid_t* mutable_permutation() {
+    return (!permutation_.empty()) ? &permutation_.front() : NULL;
+  }
+
  private:
   vector<rowid_t> permutation_;
   DISALLOW_COPY_AND_ASSIGN(Permutation);
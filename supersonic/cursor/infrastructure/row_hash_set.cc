@@ -15,6 +15,13 @@
 
 #include "supersonic/cursor/infrastructure/row_hash_set.h"
 
+#include <string.h>
+
+#include <algorithm>
+#ifdef __SSE2__
+#include <emmintrin.h>
+#endif
+
 #include "supersonic/utils/std_namespace.h"
 
 #include "supersonic/utils/integral_types.h"
@@ -30,6 +37,7 @@
 #include "supersonic/base/infrastructure/tuple_schema.h"
 #include "supersonic/base/infrastructure/types.h"
 #include "supersonic/base/infrastructure/types_infrastructure.h"
+#include "supersonic/base/memory/memory.h"
 #include "supersonic/cursor/base/cursor.h"
 #include "supersonic/cursor/infrastructure/iterators.h"
 #include "supersonic/cursor/infrastructure/table.h"
@@ -150,7 +158,7 @@ class RowComparator {
 
   // Function equal assumes that hashes of two rows are equal. It performs
   // comparison on every key-column of two given rows.
-  bool Equal(int left_pos, int right_pos) const {
+  bool Equal(rowid_t left_pos, rowid_t right_pos) const {
     for (const auto& comparator: comparators_) {
       if (!comparator->Equal(left_pos, right_pos))
         return false;
@@ -214,6 +222,48 @@ struct EqualRowIdsLink {
   rowid_t next;
 };
 
+// The hash table maps keys to the ids of the rows in the index. It uses open
+// addressing: the slots are arranged in groups of kGroupSize, and every slot
+// has a control byte, either kEmptySlot or a 7-bit tag taken from the key's
+// hash. A lookup probes the groups one after another (with triangular steps),
+// comparing the tag with all the control bytes of a group at once (with SSE2),
+// and the full hashes and keys only for the slots with matching tags. As no
+// rows are ever removed (other than by Clear), a lookup ends at the first
+// group with an empty slot. Find matches the tags of all the query rows
+// against their first groups in one pass, before comparing any keys; inserts
+// can't, as every insert changes the control bytes the next rows match.
+static const int kGroupSize = 16;
+static const uint8_t kEmptySlot = 0x80;
+
+// Load factor of 7/8.
+static const int kMaxLoadNumerator = 7;
+static const int kMaxLoadDenominator = 8;
+
+// The group and the tag are taken from the low bits of the hash; HashKeys
+// spreads the bits of the keys over the whole hash.
+inline uint8_t HashTag(size_t hash) { return hash & 0x7f; }
+
+inline size_t HashGroup(size_t hash, size_t group_mask) {
+  return (hash >> 7) & group_mask;
+}
+
+// Returns a bit mask of the slots in the group whose control bytes are equal
+// to value.
+inline uint32_t MatchControl(const uint8_t* group, uint8_t value) {
+#ifdef __SSE2__
+  const __m128i control =
+      _mm_loadu_si128(reinterpret_cast<const __m128i*>(group));
+  return _mm_movemask_epi8(
+      _mm_cmpeq_epi8(control, _mm_set1_epi8(static_cast<char>(value))));
+#else
+  uint32_t mask = 0;
+  for (int i = 0; i < kGroupSize; ++i) {
+    mask |= static_cast<uint32_t>(group[i] == value) << i;
+  }
+  return mask;
+#endif
+}
+
 // The actual row hash set implementation.
 // TODO(user): replace vectors and scoped_arrays with Tables, to close the
 // loop on memory management.
@@ -228,6 +278,12 @@ class RowHashSetImpl {
 
   bool ReserveRowCapacity(rowcount_t block_capacity);
 
+  // The number of rows that can be inserted, given the capacities of the
+  // index and of the table.
+  rowcount_t row_capacity() const {
+    return std::min(index_.row_capacity(), table_row_capacity_);
+  }
+
   // RowSet variant.
   void FindUnique(
       const View& query, const bool_const_ptr selection_vector,
@@ -260,8 +316,36 @@ class RowHashSetImpl {
       rowid_t* result_row_ids) const;
 
   // Computes the column of hashes for the 'key' view, given the row count.
+  // Prefetches the first groups to be probed for the rows.
   // TODO(user): perhaps make the row_count part of the view?
-  static void HashQuery(const View& key, rowcount_t row_count, size_t* hash);
+  void HashQuery(const View& key, rowcount_t row_count, size_t* hash) const;
+
+  // Looks up the row in the index with the hash and a key for which
+  // equal(index_row_id) holds. Returns the id of the row, or kInvalidRowId if
+  // there is none; in that case, if empty_slot is not NULL, sets it to the
+  // slot to insert the row into.
+  // If first_match is not NULL, it is the mask of the slots of the first
+  // group probed whose tags match (see MatchControl), already computed.
+  template <typename KeyEqual>
+  rowid_t FindInTable(size_t hash, const KeyEqual& equal,
+                      const uint32_t* first_match, size_t* empty_slot) const;
+
+  // Finds the slot for the key of the row with the given hash in the table,
+  // knowing that the key is not in the table yet.
+  size_t FindEmptySlot(size_t hash) const;
+
+  // Grows the table, if needed, to hold row_count rows within the maximum
+  // load, with memory from the allocator. Returns false if it can't be
+  // allocated; the table is left as it was.
+  bool ReserveTableCapacity(rowcount_t row_count);
+
+  // Moves the table back to the single group kept in place, and empties it.
+  void ResetTable();
+
+  void SetSlot(size_t slot, size_t hash, rowid_t index_row_id) {
+    control_[slot] = HashTag(hash);
+    slots_[slot] = index_row_id;
+  }
 
   // Selects key columns from index_ and from queries to Insert.
   std::unique_ptr<const BoundSingleSourceProjector> key_selector_;
@@ -293,19 +377,22 @@ class RowHashSetImpl {
   //  Array for keeping block rows' hashes.
   vector<size_t> hash_;
 
-  // Size of last_row_id_. Should be power of 2. Adjusted by ReserveRowCapacity.
-  int last_row_id_size_;
-
-  // Value of last_row_id_[hash_index] denotes position of last row in
-  // indexed_block_ having same value of hash_index =
-  // (query_hash_[query_row_id] & hash_mask_).
-  std::unique_ptr<int[]> last_row_id_;
-
-  // Index of a previous row having the same hash_index = (row.hash &
-  // hash_mask_) but a different key. (For multisets, there may be many rows
-  // with the same key (and thus hash); only the first instance is actually
-  // written to this array).
-  std::unique_ptr<int[]> prev_row_id_;
+  BufferAllocator* const allocator_;
+
+  // The hash table (see kGroupSize): control bytes and row ids of the slots,
+  // group_count_ * kGroupSize of each. A single group is kept in place (in
+  // first_group_control_ and first_group_slots_); more are allocated in
+  // table_buffer_. The number of groups is a power of 2, adjusted by
+  // ReserveRowCapacity. For multisets, only the first row with a given key is
+  // in the table.
+  size_t group_count_;
+  uint8_t first_group_control_[kGroupSize];
+  rowid_t first_group_slots_[kGroupSize];
+  std::unique_ptr<Buffer> table_buffer_;
+  uint8_t* control_;
+  rowid_t* slots_;
+  // The number of rows the table holds within the maximum load.
+  rowcount_t table_row_capacity_;
 
   // Structure used for comparing rows.
   mutable RowComparator comparator_;
@@ -314,8 +401,9 @@ class RowHashSetImpl {
   // find/insert.
   mutable size_t query_hash_[Cursor::kDefaultRowCount];
 
-  // Bit mask used for calculating last_row_id_ index.
-  int hash_mask_;
+  // The masks of the slots with matching tags in the first groups probed for
+  // the rows of a query to find.
+  mutable uint32_t query_first_match_[Cursor::kDefaultRowCount];
 
   const bool is_multiset_;
 
@@ -345,61 +433,119 @@ RowHashSetImpl::RowHashSetImpl(
       index_appender_(&index_, true),
       index_key_(key_selector_->result_schema()),
       query_key_(key_selector_->result_schema()),
-      last_row_id_size_(0),
+      allocator_(allocator),
       comparator_(query_key_.schema()),
-      hash_mask_(0),
       is_multiset_(is_multiset),
       max_unique_keys_in_result_(max_unique_keys_in_result) {
-  // FindUnique and FindMany compute hash index % hash_mask_, which results
-  // in a non-negative integer, used to index the indirection tables.
-  // To make sure that the newly created instance adheres to the implicit
-  // invariants, we need to pre-allocate and fill certain dummy values.
-  last_row_id_ = make_unique<int[]>(1);
-  last_row_id_[0] = -1;
-  prev_row_id_ = make_unique<int[]>(1);
+  ResetTable();
+}
+
+void RowHashSetImpl::ResetTable() {
+  table_buffer_.reset();
+  group_count_ = 1;
+  control_ = first_group_control_;
+  slots_ = first_group_slots_;
+  table_row_capacity_ = kGroupSize * kMaxLoadNumerator / kMaxLoadDenominator;
+  memset(control_, kEmptySlot, kGroupSize);
 }
 
 bool RowHashSetImpl::ReserveRowCapacity(rowcount_t row_count) {
-  if (index_.row_capacity() >= row_count) return true;
-  if (!index_.ReserveRowCapacity(row_count)) return false;
-  key_selector_->Project(index_.view(), &index_key_);
-  comparator_.set_right_view(&index_key_);
-  hash_.reserve(index_.row_capacity());
-  if (is_multiset_) equal_row_ids_.resize(index_.row_capacity());
-
-  // Arbitrary load factor of 75%. (Same is used in Java HashMap).
-  while (last_row_id_size_ * 3 < index_.row_capacity() * 4) {
-    if (last_row_id_size_ == 0) {
-      last_row_id_size_ = 16;
-    } else {
-      last_row_id_size_ *= 2;
-    }
+  if (index_.row_capacity() < row_count) {
+    if (!index_.ReserveRowCapacity(row_count)) return false;
+    key_selector_->Project(index_.view(), &index_key_);
+    comparator_.set_right_view(&index_key_);
+    hash_.reserve(index_.row_capacity());
+    if (is_multiset_) equal_row_ids_.resize(index_.row_capacity());
   }
-  last_row_id_ = make_unique<int[]>(last_row_id_size_);
-  std::fill(last_row_id_.get(), last_row_id_.get() + last_row_id_size_, -1);
-  hash_mask_ = last_row_id_size_ - 1;
-
-  prev_row_id_ = make_unique<int[]>(last_row_id_size_);
+  return ReserveTableCapacity(index_.row_capacity());
+}
 
-  // Rebuild the linked lists that depend on hash_index (which changed, as
-  // it depends on hash_mask_, that changed).
+bool RowHashSetImpl::ReserveTableCapacity(rowcount_t row_count) {
+  if (table_row_capacity_ >= row_count) return true;
+  size_t group_count = group_count_;
+  while (group_count * kGroupSize * kMaxLoadNumerator <
+         row_count * kMaxLoadDenominator) {
+    group_count *= 2;
+  }
+  const size_t slot_count = group_count * kGroupSize;
+  std::unique_ptr<Buffer> table_buffer(
+      allocator_->Allocate(slot_count * (sizeof(uint8_t) + sizeof(rowid_t))));
+  if (table_buffer == NULL) return false;
+  table_buffer_ = std::move(table_buffer);
+  group_count_ = group_count;
+  control_ = static_cast<uint8_t*>(table_buffer_->data());
+  // The row ids are aligned, as slot_count is a multiple of kGroupSize.
+  slots_ = reinterpret_cast<rowid_t*>(control_ + slot_count);
+  table_row_capacity_ = slot_count * kMaxLoadNumerator / kMaxLoadDenominator;
+  memset(control_, kEmptySlot, slot_count);
+
+  // Reinsert the rows (all of them distinct), as their slots depend on the
+  // number of groups.
   if (is_multiset_) {
     for (auto& equal_row_group: equal_row_groups_) {
-      rowid_t first = equal_row_group.first;
-      int hash_index = (hash_mask_ & hash_[first]);
-      prev_row_id_[first] = last_row_id_[hash_index];
-      last_row_id_[hash_index] = first;
+      const rowid_t first = equal_row_group.first;
+      SetSlot(FindEmptySlot(hash_[first]), hash_[first], first);
     }
   } else {
     for (rowid_t i = 0; i < index_.view().row_count(); ++i) {
-      int hash_index = (hash_mask_ & hash_[i]);
-      prev_row_id_[i] = last_row_id_[hash_index];
-      last_row_id_[hash_index] = i;
+      SetSlot(FindEmptySlot(hash_[i]), hash_[i], i);
     }
   }
   return true;
 }
 
+void RowHashSetImpl::HashQuery(
+    const View& key_columns, rowcount_t row_count, size_t* hash) const {
+  HashKeys(key_columns, row_count, hash);
+  // Done for the whole query before any probes, so that the (likely cache
+  // missing) reads of the control bytes overlap.
+  const size_t group_mask = group_count_ - 1;
+  for (rowid_t i = 0; i < row_count; ++i) {
+    __builtin_prefetch(control_ + HashGroup(hash[i], group_mask) * kGroupSize);
+  }
+}
+
+template <typename KeyEqual>
+rowid_t RowHashSetImpl::FindInTable(
+    size_t hash, const KeyEqual& equal, const uint32_t* first_match,
+    size_t* empty_slot) const {
+  const size_t group_mask = group_count_ - 1;
+  const uint8_t tag = HashTag(hash);
+  size_t group = HashGroup(hash, group_mask);
+  for (size_t step = 1; ; ++step) {
+    const uint8_t* control = control_ + group * kGroupSize;
+    const rowid_t* slots = slots_ + group * kGroupSize;
+    for (uint32_t match = (step == 1 && first_match != NULL)
+                              ? *first_match : MatchControl(control, tag);
+         match != 0; match &= match - 1) {
+      const rowid_t index_row_id = slots[__builtin_ctz(match)];
+      if (hash_[index_row_id] == hash && equal(index_row_id)) {
+        return index_row_id;
+      }
+    }
+    const uint32_t empty = MatchControl(control, kEmptySlot);
+    if (empty != 0) {
+      if (empty_slot != NULL) {
+        *empty_slot = group * kGroupSize + __builtin_ctz(empty);
+      }
+      return kInvalidRowId;
+    }
+    // Triangular probing visits every group, as their number is a power of 2.
+    group = (group + step) & group_mask;
+  }
+}
+
+size_t RowHashSetImpl::FindEmptySlot(size_t hash) const {
+  const size_t group_mask = group_count_ - 1;
+  size_t group = HashGroup(hash, group_mask);
+  for (size_t step = 1; ; ++step) {
+    const uint32_t empty =
+        MatchControl(control_ + group * kGroupSize, kEmptySlot);
+    if (empty != 0) return group * kGroupSize + __builtin_ctz(empty);
+    group = (group + step) & group_mask;
+  }
+}
+
 void RowHashSetImpl::FindUnique(
     const View& query, const bool_const_ptr selection_vector,
     FindResult* result) const {
@@ -424,6 +570,16 @@ void RowHashSetImpl::FindInternal(
   comparator_.set_left_view(&query);
 
   HashQuery(query, query.row_count(), query_hash_);
+  // Matches the tags of all the rows against their first groups, which the
+  // prefetches have brought in by now, in a tight loop with no key
+  // comparisons. Most rows' lookups end there.
+  const size_t group_mask = group_count_ - 1;
+  for (rowid_t i = 0; i < query.row_count(); ++i) {
+    query_first_match_[i] = MatchControl(
+        control_ + HashGroup(query_hash_[i], group_mask) * kGroupSize,
+        HashTag(query_hash_[i]));
+  }
+  const bool hash_comparison_only = comparator_.hash_comparison_only();
   ViewRowIterator iterator(query);
   while (iterator.next()) {
     const rowid_t query_row_id = iterator.current_row_index();
@@ -431,21 +587,13 @@ void RowHashSetImpl::FindInternal(
     if (selection_vector != NULL && !selection_vector[query_row_id]) {
       *result_row_id = kInvalidRowId;
     } else {
-      int hash_index = (hash_mask_ & query_hash_[query_row_id]);
-      int index_row_id = last_row_id_[hash_index];
-      if (comparator_.hash_comparison_only()) {
-        while (index_row_id != -1 &&
-               (query_hash_[query_row_id] != hash_[index_row_id])) {
-          index_row_id = prev_row_id_[index_row_id];
-        }
-      } else {
-        while (index_row_id != -1 &&
-               (query_hash_[query_row_id] != hash_[index_row_id]
-                || !comparator_.Equal(query_row_id, index_row_id))) {
-          index_row_id = prev_row_id_[index_row_id];
-        }
-      }
-      *result_row_id = (index_row_id != -1) ? index_row_id : kInvalidRowId;
+      *result_row_id = FindInTable(
+          query_hash_[query_row_id],
+          [this, hash_comparison_only, query_row_id](rowid_t index_row_id) {
+            return hash_comparison_only ||
+                comparator_.Equal(query_row_id, index_row_id);
+          },
+          &query_first_match_[query_row_id], NULL);
     }
   }
 }
@@ -463,6 +611,7 @@ size_t RowHashSetImpl::InsertUnique(
   key_selector_->Project(query, &query_key_);
   HashQuery(query_key_, query.row_count(), query_hash_);
   comparator_.set_left_view(&query_key_);
+  const bool hash_comparison_only = comparator_.hash_comparison_only();
 
   ViewRowIterator iterator(query);
   while (iterator.next()) {
@@ -473,33 +622,22 @@ size_t RowHashSetImpl::InsertUnique(
       if (result_row_id)
           *result_row_id = kInvalidRowId;
     } else {
-      // TODO(user): The following 12 lines are identical to the piece
-      // of code in FindInternal. Needs refactoring (but be careful about a
-      // performance regression).
-      int hash_index = (hash_mask_ & query_hash_[query_row_id]);
-      int index_row_id = last_row_id_[hash_index];
-
-      if (comparator_.hash_comparison_only()) {
-        while (index_row_id != -1 &&
-               (query_hash_[query_row_id] != hash_[index_row_id])) {
-          index_row_id = prev_row_id_[index_row_id];
-        }
-      } else {
-        while (index_row_id != -1 &&
-               (query_hash_[query_row_id] != hash_[index_row_id]
-                || !comparator_.Equal(query_row_id, index_row_id))) {
-          index_row_id = prev_row_id_[index_row_id];
-        }
-      }
-
-      if (index_row_id == -1) {
+      size_t empty_slot;
+      rowid_t index_row_id = FindInTable(
+          query_hash_[query_row_id],
+          [this, hash_comparison_only, query_row_id](rowid_t index_row_id) {
+            return hash_comparison_only ||
+                comparator_.Equal(query_row_id, index_row_id);
+          },
+          NULL, &empty_slot);
+
+      if (index_row_id == kInvalidRowId) {
         if (index_.row_count() <= max_unique_keys_in_result_) {
           index_row_id = index_.row_count();
-          if (index_row_id  == index_.row_capacity() ||
+          if (index_row_id >= row_capacity() ||
               !index_appender_.AppendRow(iterator)) break;
           hash_.push_back(query_hash_[query_row_id]);
-          prev_row_id_[index_row_id] = last_row_id_[hash_index];
-          last_row_id_[hash_index] = index_row_id;
+          SetSlot(empty_slot, query_hash_[query_row_id], index_row_id);
         } else {
           index_row_id = index_.row_count() - 1;
         }
@@ -527,6 +665,7 @@ size_t RowHashSetImpl::InsertMany(
   // query_hash_.
   HashQuery(query_key_, query.row_count(), query_hash_);
   comparator_.set_left_view(&index_key_);
+  const bool hash_comparison_only = comparator_.hash_comparison_only();
 
   if (result)
     result->set_equal_row_ids(&equal_row_ids_.front());
@@ -541,36 +680,26 @@ size_t RowHashSetImpl::InsertMany(
         *result_row_id = kInvalidRowId;
     } else {
       // Copy query row into the index.
-      if (query_row_id  == index_.row_capacity() ||
+      if (insert_row_id >= row_capacity() ||
           !index_appender_.AppendRow(iterator)) break;
       hash_.push_back(query_hash_[query_row_id]);
-      int hash_index = (hash_mask_ & query_hash_[query_row_id]);
-      int index_row_id = last_row_id_[hash_index];
-
-      // We iterate over all rows with the same hash_index (which is a
-      // truncation of the hash), looking for a row with the same hash as
-      // our row.
-      if (comparator_.hash_comparison_only()) {
-        // This is the case where hash-comparison is equivalent to a full
-        // comparison.
-        while (index_row_id != -1 &&
-               (query_hash_[query_row_id] != hash_[index_row_id])) {
-          index_row_id = prev_row_id_[index_row_id];
-        }
-      } else {
-        while (index_row_id != -1 &&
-               (query_hash_[query_row_id] != hash_[index_row_id]
-                || !comparator_.Equal(insert_row_id, index_row_id))) {
-          index_row_id = prev_row_id_[index_row_id];
-        }
-      }
 
-      // If we found no row with an equal hash, we start a new group at the end
-      // of the list of rows with the same hash_index.
-      if (index_row_id == -1) {
+      // The key of the row is compared in the index, where it has just been
+      // copied to.
+      size_t empty_slot;
+      rowid_t index_row_id = FindInTable(
+          query_hash_[query_row_id],
+          [this, hash_comparison_only, insert_row_id](rowid_t index_row_id) {
+            return hash_comparison_only ||
+                comparator_.Equal(insert_row_id, index_row_id);
+          },
+          NULL, &empty_slot);
+
+      // If we found no row with an equal key, the row starts a new group, and
+      // goes into the table.
+      if (index_row_id == kInvalidRowId) {
         index_row_id = insert_row_id;
-        prev_row_id_[index_row_id] = last_row_id_[hash_index];
-        last_row_id_[hash_index] = index_row_id;
+        SetSlot(empty_slot, query_hash_[query_row_id], index_row_id);
       }
 
       // Head of the linked list grouping Rows with the same key as query row.
@@ -609,12 +738,12 @@ void RowHashSetImpl::Clear() {
   index_.move_block();
   key_selector_->Project(index_.view(), &index_key_);
   hash_.clear();
-  std::fill(last_row_id_.get(), last_row_id_.get() + last_row_id_size_, -1);
+  ResetTable();
   equal_row_groups_.clear();
 }
 
-// TODO(user): More internal datastructures could be compacted (last_row_id_ and
-// prev_row_id_), but it would require recomputing their content.
+// TODO(user): More internal datastructures could be compacted (control_ and
+// slots_), but it would require recomputing their content.
 void RowHashSetImpl::Compact() {
   index_.Compact();
   // Using the swap trick to trim excess vector capacity.
@@ -622,26 +751,6 @@ void RowHashSetImpl::Compact() {
   vector<EqualRowGroup>(equal_row_groups_).swap(equal_row_groups_);
 }
 
-void RowHashSetImpl::HashQuery(
-    const View& key_columns, rowcount_t row_count, size_t* hash) {
-  const TupleSchema& key_schema = key_columns.schema();
-  // TODO(user): this should go into the constructor.
-  // If somebody uses hash-join to do a cross-join (that is no columns are
-  // given as key) we have to fill out the hash table with any single hash,
-  // say zero.
-  if (key_schema.attribute_count() == 0) {
-    memset(hash, '\0', row_count * sizeof(*hash));
-  }
-  // In the other case the first ColumnHasher will initialize the data for
-  // us.
-  for (int c = 0; c < key_schema.attribute_count(); ++c) {
-    ColumnHasher column_hasher =
-        GetColumnHasher(key_schema.attribute(c).type(), c != 0, false);
-    const Column& key_column = key_columns.column(c);
-    column_hasher(key_column.data(), key_column.is_null(), row_count, hash);
-  }
-}
-
 void RowIdSetIterator::Next() {
   current_ = equal_row_ids_[current_].next;
 }
@@ -782,6 +891,24 @@ rowcount_t RowHashMultiSet::size() const { return indexed_view().row_count(); }
 #undef CPP_TYPE
 
 
+void HashKeys(const View& key, rowcount_t row_count, size_t* hash) {
+  const TupleSchema& key_schema = key.schema();
+  // If somebody uses hash-join to do a cross-join (that is no columns are
+  // given as key) we have to fill out the hash table with any single hash,
+  // say zero.
+  if (key_schema.attribute_count() == 0) {
+    memset(hash, '\0', row_count * sizeof(*hash));
+  }
+  // In the other case the first ColumnHasher will initialize the data for
+  // us.
+  for (int c = 0; c < key_schema.attribute_count(); ++c) {
+    ColumnHasher column_hasher =
+        GetKeyColumnHasher(key_schema.attribute(c).type(), c != 0);
+    const Column& key_column = key.column(c);
+    column_hasher(key_column.data(), key_column.is_null(), row_count, hash);
+  }
+}
+
 }  // namespace row_hash_set
 
 }  // namespace supersonic
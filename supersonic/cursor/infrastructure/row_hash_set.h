@@ -310,6 +310,10 @@ class FindMultiResult {
   friend class RowHashSetImpl;
 };
 
+// Computes the hashes of the first row_count rows of the key view, the same
+// way the row hash sets hash their keys. hash must hold row_count values.
+void HashKeys(const View& key, rowcount_t row_count, size_t* hash);
+
 }  // namespace row_hash_set
 
 }  // namespace supersonic
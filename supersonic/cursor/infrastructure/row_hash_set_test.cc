@@ -30,6 +30,7 @@ using std::vector;
 #include "supersonic/base/infrastructure/projector.h"
 #include "supersonic/base/infrastructure/tuple_schema.h"
 #include "supersonic/base/memory/memory.h"
+#include "supersonic/cursor/infrastructure/table.h"
 #include "supersonic/proto/supersonic.pb.h"
 #include "supersonic/testing/block_builder.h"
 #include "supersonic/testing/row.h"
@@ -632,6 +633,38 @@ TEST_F(RowHashSetTest,
   }
 }
 
+// Keys that differ only in their high bits, inserted in several queries, so
+// that the table grows while many of them probe the same groups.
+TEST_F(RowHashSetTest, RowHashSetInsertManyCollidingKeys) {
+  const int kQueryCount = 20;
+  const int kQueryRowCount = 1000;
+  vector<std::unique_ptr<Block>> queries;
+  for (int j = 0; j < 2 * kQueryCount; ++j) {
+    BlockBuilder<INT64, STRING> builder;
+    for (int i = 0; i < kQueryRowCount; ++i) {
+      const int64_t key = j * kQueryRowCount + i;
+      builder.AddRow(key << 20, SimpleItoa(key % 3));
+    }
+    queries.push_back(builder.Build());
+  }
+  for (int j = 0; j < kQueryCount; ++j) {
+    EXPECT_EQ(kQueryRowCount,
+              row_hash_set_->Insert(queries[j]->view(),
+                                    row_hash_set_result_.get()));
+    for (int i = 0; i < kQueryRowCount; ++i) {
+      EXPECT_EQ(j * kQueryRowCount + i, row_hash_set_result_->Result(i));
+    }
+  }
+  EXPECT_EQ(kQueryCount * kQueryRowCount, row_hash_set_->size());
+  for (int j = 0; j < 2 * kQueryCount; ++j) {
+    row_hash_set_->Find(queries[j]->view(), row_hash_set_result_.get());
+    for (int i = 0; i < kQueryRowCount; ++i) {
+      EXPECT_EQ(j < kQueryCount ? j * kQueryRowCount + i : kInvalidRowId,
+                row_hash_set_result_->Result(i));
+    }
+  }
+}
+
 TEST_F(RowHashSetTest, ReserveCapacity) {
   EXPECT_EQ(query_1().row_count(),
             row_hash_set_->Insert(query_1(), row_hash_set_result_.get()));
@@ -682,6 +715,47 @@ TEST_F(RowHashSetTest, MultiPartialSuccessUnderMemoryConstraints) {
   EXPECT_EQ(Row(query_24680(), 2), Row(set.indexed_view(), 5));
 }
 
+TEST_F(RowHashSetTest, TableTakesMemoryFromAllocator) {
+  MemoryLimit index_limit;
+  Table index(row_hash_set_block_schema_, &index_limit);
+  ASSERT_TRUE(index.ReserveRowCapacity(1000));
+  MemoryLimit limit;
+  RowHashSet set(row_hash_set_block_schema_, &limit);
+  ASSERT_TRUE(set.ReserveRowCapacity(1000));
+  // At least a control byte and a row id for every row, besides the index.
+  EXPECT_LE(index_limit.GetUsage() + 1000 * (1 + sizeof(rowid_t)),
+            limit.GetUsage());
+}
+
+// With memory for the index to grow, but not the table, an insert stops when
+// the table is full.
+TEST_F(RowHashSetTest, PartialSuccessWhenTableCantGrow) {
+  const int kRowCount = 1000;
+  TupleSchema schema;
+  schema.add_attribute(Attribute("c1", INT64, NOT_NULLABLE));
+  BlockBuilder<INT64> builder;
+  for (int i = 0; i < kRowCount; ++i) builder.AddRow(i);
+  std::unique_ptr<Block> query(builder.Build());
+  MemoryLimit index_limit;
+  Table index(schema, &index_limit);
+  ASSERT_TRUE(index.ReserveRowCapacity(kRowCount));
+  // Enough for the reallocated index even while its old block is held, but
+  // not for the reallocated table.
+  const size_t index_usage = index_limit.GetUsage();
+
+  MemoryLimit limit;
+  RowHashSet set(schema, &limit);
+  ASSERT_TRUE(set.ReserveRowCapacity(1));
+  limit.SetQuota(limit.GetUsage() + index_usage);
+  // A single group of 16 slots, 7/8 full.
+  EXPECT_EQ(14, set.Insert(query->view(), row_hash_set_result_.get()));
+  EXPECT_EQ(14, set.size());
+  set.Find(query->view(), row_hash_set_result_.get());
+  for (int i = 0; i < kRowCount; ++i) {
+    EXPECT_EQ(i < 14 ? i : kInvalidRowId, row_hash_set_result_->Result(i));
+  }
+}
+
 // TODO(user): Selection vector tests.
 
 }  // namespace row_hash_set
@@ -0,0 +1,640 @@
+// Copyright 2012 Google Inc. All Rights Reserved.
+//
+// Licensed under the Apache License, Version 2.0 (the "License");
+// you may not use this file except in compliance with the License.
+// You may obtain a copy of the License at
+//
+//     http://www.apache.org/licenses/LICENSE-2.0
+//
+// Unless required by applicable law or agreed to in writing, software
+// distributed under the License is distributed on an "AS IS" BASIS,
+// WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+// See the License for the specific language governing permissions and
+// limitations under the License.
+//
+
+#include "supersonic/cursor/infrastructure/table_file.h"
+
+#include <string.h>
+
+#include <algorithm>
+#include "supersonic/utils/std_namespace.h"
+#include <memory>
+
+#include "supersonic/utils/integral_types.h"
+#include <glog/logging.h>
+#include "supersonic/utils/logging-inl.h"
+#include "supersonic/utils/macros.h"
+#include "supersonic/utils/exception/failureor.h"
+#include "supersonic/base/exception/exception.h"
+#include "supersonic/base/exception/exception_macros.h"
+#include "supersonic/base/infrastructure/block.h"
+#include "supersonic/base/infrastructure/projector.h"
+#include "supersonic/base/infrastructure/tuple_schema.h"
+#include "supersonic/base/memory/memory.h"
+#include "supersonic/cursor/base/cursor.h"
+#include "supersonic/cursor/infrastructure/basic_cursor.h"
+#include "supersonic/cursor/infrastructure/column_encoding.h"
+#include "supersonic/cursor/infrastructure/table.h"
+#include "supersonic/cursor/infrastructure/writer.h"
+#include "supersonic/cursor/proto/cursors.pb.h"
+#include "supersonic/cursor/proto/table_file.pb.h"
+#include "supersonic/utils/file.h"
+#include "supersonic/utils/file_util.h"
+#include "supersonic/utils/strings/strcat.h"
+#include "supersonic/utils/strings/stringpiece.h"
+
+namespace supersonic {
+
+namespace {
+
+const char kMagic[] = { 'S', 'U', 'P', 'T' };
+const uint32_t kFormatVersion = 1;
+// The offset of the footer offset in the file.
+const size_t kFooterOffsetPosition = sizeof(kMagic) + sizeof(kFormatVersion);
+const size_t kHeaderSize = kFooterOffsetPosition + sizeof(uint64_t);
+// Larger footers are taken for a corrupted file.
+const uint64_t kMaxFooterSize = 1ULL << 30;
+// Longer strings are not stored as the min or max of a column chunk; it would
+// make the footer too large.
+const size_t kMaxStatisticsStringLength = 64;
+
+typedef TableFileFooter::ColumnStatistics ColumnStatistics;
+
+Exception* NewCorruptedFileException(const string& message) {
+  return new Exception(ERROR_GENERAL_IO_ERROR,
+                       StrCat("Invalid table file: ", message));
+}
+
+FailureOrVoid WriteBytes(const void* data, size_t length, File* output_file) {
+  if (output_file->Write(data, length) != length) {
+    THROW(new Exception(ERROR_GENERAL_IO_ERROR,
+                        "Writing to the table file failed."));
+  }
+  return Success();
+}
+
+// Reads exactly length bytes.
+FailureOrVoid ReadBytes(File* input_file, size_t length, void* data) {
+  if (input_file->Read(data, length) != length) {
+    THROW(NewCorruptedFileException("unexpected end of file."));
+  }
+  return Success();
+}
+
+// Sets the min and max of the statistics, in the field of their type.
+void SetMinMax(int64_t min, int64_t max, ColumnStatistics* statistics) {
+  statistics->set_min_int64(min);
+  statistics->set_max_int64(max);
+}
+
+void SetMinMax(uint64_t min, uint64_t max, ColumnStatistics* statistics) {
+  statistics->set_min_uint64(min);
+  statistics->set_max_uint64(max);
+}
+
+void SetMinMax(double min, double max, ColumnStatistics* statistics) {
+  statistics->set_min_double(min);
+  statistics->set_max_double(max);
+}
+
+void SetMinMax(StringPiece min, StringPiece max,
+               ColumnStatistics* statistics) {
+  if (min.size() > kMaxStatisticsStringLength ||
+      max.size() > kMaxStatisticsStringLength) {
+    return;
+  }
+  statistics->set_min_bytes(min.data(), min.size());
+  statistics->set_max_bytes(max.data(), max.size());
+}
+
+// Computes the statistics of the first row_count rows of a column of the type,
+// with the min and max as StatisticsType.
+template <DataType type, typename StatisticsType>
+void ComputeStatistics(const Column& column, rowcount_t row_count,
+                       ColumnStatistics* statistics) {
+  const typename TypeTraits<type>::cpp_type* data = column.typed_data<type>();
+  bool_const_ptr is_null = column.is_null();
+  uint64_t null_count = 0;
+  bool has_values = false;
+  StatisticsType min = StatisticsType();
+  StatisticsType max = StatisticsType();
+  for (rowcount_t row = 0; row < row_count; ++row) {
+    if (is_null != NULL && is_null[row]) {
+      ++null_count;
+      continue;
+    }
+    const StatisticsType value = data[row];
+    // NaNs aren't in any range.
+    if (!(value == value)) continue;
+    if (!has_values) {
+      min = max = value;
+      has_values = true;
+    } else if (value < min) {
+      min = value;
+    } else if (max < value) {
+      max = value;
+    }
+  }
+  statistics->set_null_count(null_count);
+  if (has_values) SetMinMax(min, max, statistics);
+}
+
+void ComputeColumnStatistics(const Column& column, rowcount_t row_count,
+                             ColumnStatistics* statistics) {
+  switch (column.type_info().type()) {
+    case INT32:
+      ComputeStatistics<INT32, int64_t>(column, row_count, statistics);
+      break;
+    case INT64:
+      ComputeStatistics<INT64, int64_t>(column, row_count, statistics);
+      break;
+    case UINT32:
+      ComputeStatistics<UINT32, uint64_t>(column, row_count, statistics);
+      break;
+    case UINT64:
+      ComputeStatistics<UINT64, uint64_t>(column, row_count, statistics);
+      break;
+    case FLOAT:
+      ComputeStatistics<FLOAT, double>(column, row_count, statistics);
+      break;
+    case DOUBLE:
+      ComputeStatistics<DOUBLE, double>(column, row_count, statistics);
+      break;
+    case BOOL:
+      ComputeStatistics<BOOL, int64_t>(column, row_count, statistics);
+      break;
+    case DATE:
+      ComputeStatistics<DATE, int64_t>(column, row_count, statistics);
+      break;
+    case DATETIME:
+      ComputeStatistics<DATETIME, int64_t>(column, row_count, statistics);
+      break;
+    case STRING:
+      ComputeStatistics<STRING, StringPiece>(column, row_count, statistics);
+      break;
+    case BINARY:
+      ComputeStatistics<BINARY, StringPiece>(column, row_count, statistics);
+      break;
+    default:
+      LOG(FATAL) << "Unsupported type " << column.type_info().name();
+  }
+}
+
+// Whether values between min and max can be in the range, whose bounds are
+// of the type.
+template <DataType type, typename StatisticsType>
+bool MayOverlap(const StatisticsType& min, const StatisticsType& max,
+                const TableFilePredicate::Range& range) {
+  if (!range.lower_bound.is_null() &&
+      max < StatisticsType(range.lower_bound.typed_value<type>())) {
+    return false;
+  }
+  if (!range.upper_bound.is_null() &&
+      StatisticsType(range.upper_bound.typed_value<type>()) < min) {
+    return false;
+  }
+  return true;
+}
+
+// Whether the column chunk of row_count rows, of the type, can have values in
+// the range.
+bool ColumnChunkMayMatch(const TableFileFooter::ColumnChunk& chunk,
+                         uint64_t row_count,
+                         DataType type,
+                         const TableFilePredicate::Range& range) {
+  const ColumnStatistics& statistics = chunk.statistics();
+  if (statistics.null_count() >= row_count) return false;
+  switch (type) {
+    case INT32:
+      return !statistics.has_min_int64() ||
+          MayOverlap<INT32, int64_t>(statistics.min_int64(),
+                                     statistics.max_int64(), range);
+    case INT64:
+      return !statistics.has_min_int64() ||
+          MayOverlap<INT64, int64_t>(statistics.min_int64(),
+                                     statistics.max_int64(), range);
+    case UINT32:
+      return !statistics.has_min_uint64() ||
+          MayOverlap<UINT32, uint64_t>(statistics.min_uint64(),
+                                       statistics.max_uint64(), range);
+    case UINT64:
+      return !statistics.has_min_uint64() ||
+          MayOverlap<UINT64, uint64_t>(statistics.min_uint64(),
+                                       statistics.max_uint64(), range);
+    case FLOAT:
+      return !statistics.has_min_double() ||
+          MayOverlap<FLOAT, double>(statistics.min_double(),
+                                    statistics.max_double(), range);
+    case DOUBLE:
+      return !statistics.has_min_double() ||
+          MayOverlap<DOUBLE, double>(statistics.min_double(),
+                                     statistics.max_double(), range);
+    case BOOL:
+      return !statistics.has_min_int64() ||
+          MayOverlap<BOOL, int64_t>(statistics.min_int64(),
+                                    statistics.max_int64(), range);
+    case DATE:
+      return !statistics.has_min_int64() ||
+          MayOverlap<DATE, int64_t>(statistics.min_int64(),
+                                    statistics.max_int64(), range);
+    case DATETIME:
+      return !statistics.has_min_int64() ||
+          MayOverlap<DATETIME, int64_t>(statistics.min_int64(),
+                                        statistics.max_int64(), range);
+    case STRING:
+      return !statistics.has_min_bytes() ||
+          MayOverlap<STRING, StringPiece>(statistics.min_bytes(),
+                                          statistics.max_bytes(), range);
+    case BINARY:
+      return !statistics.has_min_bytes() ||
+          MayOverlap<BINARY, StringPiece>(statistics.min_bytes(),
+                                          statistics.max_bytes(), range);
+    default:
+      LOG(FATAL) << "Unsupported type " << GetTypeInfo(type).name();
+  }
+}
+
+bool IsSupportedType(DataType type) {
+  return type != ENUM && type != DATA_TYPE;
+}
+
+// Reads the footer of the file, from the beginning.
+FailureOrVoid ReadFooter(File* input_file, TableFileFooter* footer) {
+  if (!input_file->Seek(0)) {
+    THROW(new Exception(ERROR_GENERAL_IO_ERROR,
+                        "Seeking in the table file failed."));
+  }
+  char header[kHeaderSize];
+  PROPAGATE_ON_FAILURE(ReadBytes(input_file, kHeaderSize, header));
+  if (memcmp(header, kMagic, sizeof(kMagic)) != 0) {
+    THROW(NewCorruptedFileException("no magic number."));
+  }
+  uint32_t format_version;
+  memcpy(&format_version, header + sizeof(kMagic), sizeof(format_version));
+  if (format_version != kFormatVersion) {
+    THROW(NewCorruptedFileException(
+        StrCat("unsupported format version ", format_version, ".")));
+  }
+  uint64_t footer_offset;
+  memcpy(&footer_offset, header + kFooterOffsetPosition,
+         sizeof(footer_offset));
+  if (footer_offset < kHeaderSize || !input_file->Seek(footer_offset)) {
+    THROW(NewCorruptedFileException("invalid footer offset."));
+  }
+  uint64_t footer_size;
+  PROPAGATE_ON_FAILURE(ReadBytes(input_file, sizeof(footer_size),
+                                 &footer_size));
+  if (footer_size > kMaxFooterSize) {
+    THROW(NewCorruptedFileException("invalid footer size."));
+  }
+  string serialized_footer(footer_size, '\0');
+  if (footer_size > 0) {
+    PROPAGATE_ON_FAILURE(ReadBytes(input_file, footer_size,
+                                   &serialized_footer[0]));
+  }
+  if (!footer->ParseFromString(serialized_footer)) {
+    THROW(NewCorruptedFileException("can't parse the footer."));
+  }
+  for (const TableFileFooter::RowGroup& row_group : footer->row_group()) {
+    if (row_group.column_size() != footer->attribute_size() ||
+        row_group.row_count() == 0 ||
+        row_group.row_count() > std::numeric_limits<rowcount_t>::max()) {
+      THROW(NewCorruptedFileException("invalid row group."));
+    }
+  }
+  return Success();
+}
+
+FailureOr<TupleSchema> SchemaFromFooter(const TableFileFooter& footer) {
+  TupleSchema schema;
+  for (const TableFileFooter::Attribute& attribute : footer.attribute()) {
+    if (!IsSupportedType(attribute.type()) ||
+        !schema.add_attribute(Attribute(attribute.name(), attribute.type(),
+                                        attribute.nullability()))) {
+      THROW(NewCorruptedFileException(
+          StrCat("invalid attribute ", attribute.name(), ".")));
+    }
+  }
+  return Success(schema);
+}
+
+class TableFileSink : public Sink {
+ public:
+  TableFileSink(const TupleSchema& schema,
+                File* output_file,
+                Ownership file_ownership,
+                rowcount_t row_group_row_count)
+      : output_file_(output_file),
+        file_ownership_(file_ownership),
+        row_group_row_count_(row_group_row_count),
+        row_group_(schema, HeapBufferAllocator::Get()),
+        header_written_(false),
+        position_(0) {
+    CHECK_NOTNULL(output_file_);
+    CHECK_GT(row_group_row_count_, 0);
+  }
+
+  ~TableFileSink() {
+    CHECK(output_file_ == NULL);
+  }
+
+  virtual FailureOr<rowcount_t> Write(const View& data) {
+    if (!TupleSchema::AreEqual(data.schema(), row_group_.schema(), false)) {
+      THROW(new Exception(ERROR_ATTRIBUTE_TYPE_MISMATCH,
+                          "The view doesn't match the table file's schema."));
+    }
+    PROPAGATE_ON_FAILURE(WriteHeader());
+    View part(data.schema());
+    rowcount_t offset = 0;
+    while (offset < data.row_count()) {
+      const rowcount_t row_count =
+          min(data.row_count() - offset,
+              row_group_row_count_ - row_group_.row_count());
+      part.ResetFromSubRange(data, offset, row_count);
+      if (row_group_.AppendView(part) != row_count) {
+        THROW(new Exception(ERROR_MEMORY_EXCEEDED,
+                            "Buffering a row group of a table file failed."));
+      }
+      offset += row_count;
+      if (row_group_.row_count() == row_group_row_count_) {
+        PROPAGATE_ON_FAILURE(WriteRowGroup());
+      }
+    }
+    return Success(data.row_count());
+  }
+
+  virtual FailureOrVoid Finalize() {
+    FailureOrVoid written = WriteFooter();
+    File* output_file = output_file_;
+    output_file_ = NULL;
+    if (file_ownership_ == TAKE_OWNERSHIP && !output_file->Close() &&
+        written.is_success()) {
+      THROW(new Exception(ERROR_GENERAL_IO_ERROR, "Error closing the file."));
+    }
+    return written;
+  }
+
+ private:
+  FailureOrVoid WriteHeader() {
+    if (header_written_) return Success();
+    const TupleSchema& schema = row_group_.schema();
+    for (int i = 0; i < schema.attribute_count(); ++i) {
+      if (!IsSupportedType(schema.attribute(i).type())) {
+        THROW(new Exception(
+            ERROR_NOT_IMPLEMENTED,
+            StrCat("Table files don't support the type of attribute ",
+                   schema.attribute(i).name(), ".")));
+      }
+    }
+    PROPAGATE_ON_FAILURE(WriteBytes(kMagic, sizeof(kMagic), output_file_));
+    PROPAGATE_ON_FAILURE(WriteBytes(&kFormatVersion, sizeof(kFormatVersion),
+                                    output_file_));
+    // Overwritten with the offset of the footer in WriteFooter().
+    const uint64_t footer_offset = 0;
+    PROPAGATE_ON_FAILURE(WriteBytes(&footer_offset, sizeof(footer_offset),
+                                    output_file_));
+    header_written_ = true;
+    position_ = kHeaderSize;
+    return Success();
+  }
+
+  // Writes the buffered rows as a row group, and clears the buffer.
+  FailureOrVoid WriteRowGroup() {
+    const View& view = row_group_.view();
+    TableFileFooter::RowGroup* row_group = footer_.add_row_group();
+    row_group->set_row_count(view.row_count());
+    for (int i = 0; i < view.column_count(); ++i) {
+      encoded_column_.clear();
+      EncodeColumn(view.column(i), view.row_count(), &encoded_column_);
+      TableFileFooter::ColumnChunk* chunk = row_group->add_column();
+      chunk->set_offset(position_);
+      chunk->set_size(encoded_column_.size());
+      ComputeColumnStatistics(view.column(i), view.row_count(),
+                              chunk->mutable_statistics());
+      PROPAGATE_ON_FAILURE(WriteBytes(encoded_column_.data(),
+                                      encoded_column_.size(), output_file_));
+      position_ += encoded_column_.size();
+    }
+    row_group_.Clear();
+    return Success();
+  }
+
+  FailureOrVoid WriteFooter() {
+    PROPAGATE_ON_FAILURE(WriteHeader());
+    if (row_group_.row_count() > 0) PROPAGATE_ON_FAILURE(WriteRowGroup());
+    const TupleSchema& schema = row_group_.schema();
+    for (int i = 0; i < schema.attribute_count(); ++i) {
+      TableFileFooter::Attribute* attribute = footer_.add_attribute();
+      attribute->set_name(schema.attribute(i).name());
+      attribute->set_type(schema.attribute(i).type());
+      attribute->set_nullability(schema.attribute(i).nullability());
+    }
+    string serialized_footer;
+    CHECK(footer_.SerializeToString(&serialized_footer));
+    const uint64_t footer_size = serialized_footer.size();
+    PROPAGATE_ON_FAILURE(WriteBytes(&footer_size, sizeof(footer_size),
+                                    output_file_));
+    PROPAGATE_ON_FAILURE(WriteBytes(serialized_footer.data(),
+                                    serialized_footer.size(), output_file_));
+    if (!output_file_->Seek(kFooterOffsetPosition)) {
+      THROW(new Exception(ERROR_GENERAL_IO_ERROR,
+                          "Seeking in the table file failed."));
+    }
+    return WriteBytes(&position_, sizeof(position_), output_file_);
+  }
+
+  File* output_file_;
+  const Ownership file_ownership_;
+  const rowcount_t row_group_row_count_;
+  // The rows of the next row group.
+  Table row_group_;
+  bool header_written_;
+  // The number of bytes written so far.
+  uint64_t position_;
+  TableFileFooter footer_;
+  // Buffer for WriteRowGroup().
+  string encoded_column_;
+
+  DISALLOW_COPY_AND_ASSIGN(TableFileSink);
+};
+
+class TableFileInputCursor : public BasicCursor {
+ public:
+  // Takes ownership of the file, the block and the projector. Reads the
+  // columns of the block, at the source_positions in the file, of the
+  // row_groups, and projects them with the projector.
+  TableFileInputCursor(File* input_file,
+                       const TableFileFooter& footer,
+                       const vector<int>& source_positions,
+                       const vector<int>& row_groups,
+                       Block* block,
+                       const BoundSingleSourceProjector* projector)
+      : BasicCursor(projector->result_schema()),
+        input_file_(input_file),
+        footer_(footer),
+        source_positions_(source_positions),
+        row_groups_(row_groups),
+        next_row_group_(0),
+        block_(block),
+        block_view_(block->schema()),
+        projector_(projector),
+        rows_pending_(0),
+        first_pending_row_(0) {}
+
+  virtual ResultView Next(rowcount_t max_row_count) {
+    PROPAGATE_ON_FAILURE(ThrowIfInterrupted());
+    if (rows_pending_ == 0) {
+      if (next_row_group_ == row_groups_.size()) return ResultView::EOS();
+      PROPAGATE_ON_FAILURE(ReadRowGroup(row_groups_[next_row_group_++]));
+    }
+    const rowcount_t row_count = min(max_row_count, rows_pending_);
+    block_view_.ResetFromSubRange(block_->view(), first_pending_row_,
+                                  row_count);
+    projector_->Project(block_view_, my_view());
+    my_view()->set_row_count(row_count);
+    first_pending_row_ += row_count;
+    rows_pending_ -= row_count;
+    return ResultView::Success(my_view());
+  }
+
+  virtual CursorId GetCursorId() const { return TABLE_FILE_INPUT; }
+
+ private:
+  FailureOrVoid ReadRowGroup(int index) {
+    const TableFileFooter::RowGroup& row_group = footer_.row_group(index);
+    const rowcount_t row_count = row_group.row_count();
+    block_->ResetArenas();
+    for (int i = 0; i < source_positions_.size(); ++i) {
+      const TableFileFooter::ColumnChunk& chunk =
+          row_group.column(source_positions_[i]);
+      if (!input_file_->Seek(chunk.offset()) ||
+          chunk.size() > kMaxFooterSize) {
+        THROW(NewCorruptedFileException("invalid column chunk."));
+      }
+      encoded_column_.resize(chunk.size());
+      if (chunk.size() > 0) {
+        PROPAGATE_ON_FAILURE(ReadBytes(input_file_.get(), chunk.size(),
+                                       &encoded_column_[0]));
+      }
+      PROPAGATE_ON_FAILURE(DecodeColumn(encoded_column_, row_count,
+                                        block_->mutable_column(i)));
+    }
+    rows_pending_ = row_count;
+    first_pending_row_ = 0;
+    return Success();
+  }
+
+  FileCloser input_file_;
+  const TableFileFooter footer_;
+  const vector<int> source_positions_;
+  const vector<int> row_groups_;
+  size_t next_row_group_;
+  std::unique_ptr<Block> block_;
+  View block_view_;
+  std::unique_ptr<const BoundSingleSourceProjector> projector_;
+  rowcount_t rows_pending_;
+  rowcount_t first_pending_row_;
+  // Buffer for ReadRowGroup().
+  string encoded_column_;
+
+  DISALLOW_COPY_AND_ASSIGN(TableFileInputCursor);
+};
+
+}  // namespace
+
+Sink* TableFileOutput(const TupleSchema& schema,
+                      File* output_file,
+                      Ownership file_ownership,
+                      rowcount_t row_group_row_count) {
+  return new TableFileSink(schema, output_file, file_ownership,
+                           row_group_row_count);
+}
+
+FailureOr<TupleSchema> ReadTableFileSchema(File* input_file) {
+  TableFileFooter footer;
+  PROPAGATE_ON_FAILURE(ReadFooter(input_file, &footer));
+  return SchemaFromFooter(footer);
+}
+
+FailureOrOwned<Cursor> TableFileInput(File* input_file,
+                                      const SingleSourceProjector& projector,
+                                      const TableFilePredicate& predicate,
+                                      BufferAllocator* allocator) {
+  CHECK_NOTNULL(allocator);
+  FileCloser file_closer(CHECK_NOTNULL(input_file));
+  TableFileFooter footer;
+  PROPAGATE_ON_FAILURE(ReadFooter(input_file, &footer));
+  FailureOr<TupleSchema> schema = SchemaFromFooter(footer);
+  PROPAGATE_ON_FAILURE(schema);
+  FailureOrOwned<const BoundSingleSourceProjector> bound_projector =
+      projector.Bind(schema.get());
+  PROPAGATE_ON_FAILURE(bound_projector);
+
+  // The row groups that may have rows in all the ranges.
+  vector<bool> skipped(footer.row_group_size(), false);
+  for (const TableFilePredicate::Range& range : predicate.ranges()) {
+    const int position =
+        schema.get().LookupAttributePosition(range.attribute_name);
+    if (position < 0) {
+      THROW(new Exception(ERROR_ATTRIBUTE_MISSING,
+                          StrCat("No attribute ", range.attribute_name,
+                                 " in the table file.")));
+    }
+    const DataType type = schema.get().attribute(position).type();
+    if ((!range.lower_bound.is_null() && range.lower_bound.type() != type) ||
+        (!range.upper_bound.is_null() && range.upper_bound.type() != type)) {
+      THROW(new Exception(ERROR_ATTRIBUTE_TYPE_MISMATCH,
+                          StrCat("The bounds of the range of ",
+                                 range.attribute_name,
+                                 " aren't of its type.")));
+    }
+    for (int i = 0; i < footer.row_group_size(); ++i) {
+      const TableFileFooter::RowGroup& row_group = footer.row_group(i);
+      if (!ColumnChunkMayMatch(row_group.column(position),
+                               row_group.row_count(), type, range)) {
+        skipped[i] = true;
+      }
+    }
+  }
+  vector<int> row_groups;
+  rowcount_t max_row_count = 0;
+  for (int i = 0; i < footer.row_group_size(); ++i) {
+    if (skipped[i]) continue;
+    row_groups.push_back(i);
+    max_row_count = max<rowcount_t>(max_row_count,
+                                    footer.row_group(i).row_count());
+  }
+
+  // Reads only the projected columns, into a block of their own.
+  vector<int> source_positions;
+  TupleSchema block_schema;
+  for (int i = 0; i < schema.get().attribute_count(); ++i) {
+    if (bound_projector->IsAttributeProjected(i)) {
+      source_positions.push_back(i);
+      block_schema.add_attribute(schema.get().attribute(i));
+    }
+  }
+  std::unique_ptr<BoundSingleSourceProjector> block_projector(
+      new BoundSingleSourceProjector(block_schema));
+  for (int i = 0; i < bound_projector->result_schema().attribute_count();
+       ++i) {
+    const int block_position =
+        std::lower_bound(source_positions.begin(), source_positions.end(),
+                         bound_projector->source_attribute_position(i)) -
+        source_positions.begin();
+    CHECK(block_projector->AddAs(
+        block_position,
+        bound_projector->result_schema().attribute(i).name()));
+  }
+  std::unique_ptr<Block> block(new Block(block_schema, allocator));
+  if (!block->Reallocate(max_row_count)) {
+    THROW(new Exception(ERROR_MEMORY_EXCEEDED,
+                        "Block allocation for TableFileInput failed."));
+  }
+  return Success(new TableFileInputCursor(
+      file_closer.release(), footer, source_positions, row_groups,
+      block.release(), block_projector.release()));
+}
+
+}  // namespace supersonic
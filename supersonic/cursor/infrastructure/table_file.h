@@ -0,0 +1,137 @@
+// Copyright 2012 Google Inc. All Rights Reserved.
+//
+// Licensed under the Apache License, Version 2.0 (the "License");
+// you may not use this file except in compliance with the License.
+// You may obtain a copy of the License at
+//
+//     http://www.apache.org/licenses/LICENSE-2.0
+//
+// Unless required by applicable law or agreed to in writing, software
+// distributed under the License is distributed on an "AS IS" BASIS,
+// WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+// See the License for the specific language governing permissions and
+// limitations under the License.
+//
+// A columnar file format for tables stored on disk, as opposed to the data
+// spilled by the operations (file_io.h). The rows are split into row groups,
+// whose columns are stored separately, with the lightweight encodings of
+// column_encoding.h. A footer holds the schema, and for every column of every
+// row group its position in the file and its statistics: the NULL count, and
+// the smallest and largest value (a zone map). Readers can thus read only the
+// columns they need, and skip the row groups whose values are out of the
+// ranges they're interested in.
+//
+// The layout of a file:
+//   "SUPT", format version (uint32), footer offset (uint64)
+//   column chunks
+//   footer size (uint64), footer (serialized TableFileFooter)
+// The integers are stored in host byte order.
+//
+// Example usage:
+//
+// Saves a cursor to a file, in row groups of 100000 rows:
+// File* file = File::OpenOrDie("file_name", "w");
+// std::unique_ptr<Sink> sink(
+//     TableFileOutput(cursor->schema(), file, TAKE_OWNERSHIP, 100000));
+// Writer writer(std::move(cursor));
+// ... writer.WriteAll(sink.get()), sink->Finalize() ...
+//
+// Reads the rows of January back, only the "time" and "value" columns:
+// TableFilePredicate predicate;
+// predicate.AddRange("time",
+//                    VariantDatum::Create<DATETIME>(january_start),
+//                    VariantDatum::Create<DATETIME>(january_end));
+// FailureOrOwned<Cursor> input(TableFileInput(
+//     File::OpenOrDie("file_name", "r"),
+//     ProjectNamedAttributes(...), predicate, HeapBufferAllocator::Get()));
+// The cursor returns the rows of the row groups that may have rows in the
+// range; a Filter on top of it has to select the rows in the range exactly.
+
+#ifndef SUPERSONIC_CURSOR_INFRASTRUCTURE_TABLE_FILE_H_
+#define SUPERSONIC_CURSOR_INFRASTRUCTURE_TABLE_FILE_H_
+
+#include <string>
+using std::string;
+#include <vector>
+using std::vector;
+
+#include "supersonic/utils/basictypes.h"
+#include "supersonic/utils/macros.h"
+#include "supersonic/base/exception/result.h"
+#include "supersonic/base/infrastructure/types.h"
+#include "supersonic/base/infrastructure/variant.h"
+
+class File;
+
+namespace supersonic {
+
+class BufferAllocator;
+class Cursor;
+class Sink;
+class SingleSourceProjector;
+class TupleSchema;
+
+// Creates a sink writing the views, of the schema, to a table file. The file
+// must be open for writing, and seekable: Finalize() writes the footer, and
+// then its offset at the beginning of the file. The rows are buffered, and
+// written in row groups of row_group_row_count rows (the last one can be
+// smaller); smaller row groups allow for finer skipping, larger ones are
+// encoded better. If Ownership == TAKE_OWNERSHIP, closes the file in
+// Finalize(). ENUM attributes are not supported.
+Sink* TableFileOutput(const TupleSchema& schema,
+                      File* output_file,
+                      Ownership file_ownership,
+                      rowcount_t row_group_row_count);
+
+// Ranges of the values of attributes, that let TableFileInput skip the row
+// groups with no rows in them. Copyable.
+class TableFilePredicate {
+ public:
+  TableFilePredicate() {}
+
+  // Restricts the values of the attribute to [lower_bound, upper_bound]. The
+  // bounds must be of the attribute's type; a NULL bound doesn't restrict the
+  // values. NULLs are never in the range.
+  TableFilePredicate* AddRange(const string& attribute_name,
+                               const VariantDatum& lower_bound,
+                               const VariantDatum& upper_bound) {
+    ranges_.push_back(Range(attribute_name, lower_bound, upper_bound));
+    return this;
+  }
+
+  struct Range {
+    Range(const string& attribute_name,
+          const VariantDatum& lower_bound,
+          const VariantDatum& upper_bound)
+        : attribute_name(attribute_name),
+          lower_bound(lower_bound),
+          upper_bound(upper_bound) {}
+    string attribute_name;
+    VariantDatum lower_bound;
+    VariantDatum upper_bound;
+  };
+
+  const vector<Range>& ranges() const { return ranges_; }
+
+ private:
+  vector<Range> ranges_;
+};
+
+// Creates a cursor reading a file written by TableFileOutput. Reads only the
+// columns of the attributes the projector selects, and only the row groups
+// that may have rows satisfying all the predicate's ranges; their rows are
+// returned whether they satisfy it or not. Takes ownership of the file, which
+// must be seekable. Fails if the file is not a valid table file, or if the
+// projector or the predicate don't match its schema.
+FailureOrOwned<Cursor> TableFileInput(File* input_file,
+                                      const SingleSourceProjector& projector,
+                                      const TableFilePredicate& predicate,
+                                      BufferAllocator* allocator);
+
+// Reads the schema of a table file. Doesn't take ownership of the file; reads
+// it from the beginning, and leaves it at an unspecified position.
+FailureOr<TupleSchema> ReadTableFileSchema(File* input_file);
+
+}  // namespace supersonic
+
+#endif  // SUPERSONIC_CURSOR_INFRASTRUCTURE_TABLE_FILE_H_
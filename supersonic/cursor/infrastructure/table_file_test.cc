@@ -0,0 +1,268 @@
+// Copyright 2012 Google Inc. All Rights Reserved.
+//
+// Licensed under the Apache License, Version 2.0 (the "License");
+// you may not use this file except in compliance with the License.
+// You may obtain a copy of the License at
+//
+//     http://www.apache.org/licenses/LICENSE-2.0
+//
+// Unless required by applicable law or agreed to in writing, software
+// distributed under the License is distributed on an "AS IS" BASIS,
+// WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+// See the License for the specific language governing permissions and
+// limitations under the License.
+//
+
+#include "supersonic/cursor/infrastructure/table_file.h"
+
+#include <memory>
+#include <string>
+using std::string;
+#include <vector>
+using std::vector;
+
+#include "supersonic/base/infrastructure/block.h"
+#include "supersonic/base/infrastructure/projector.h"
+#include "supersonic/base/infrastructure/tuple_schema.h"
+#include "supersonic/base/memory/memory.h"
+#include "supersonic/cursor/base/cursor.h"
+#include "supersonic/cursor/core/scan_view.h"
+#include "supersonic/cursor/infrastructure/writer.h"
+#include "supersonic/testing/block_builder.h"
+#include "supersonic/testing/comparators.h"
+#include "supersonic/utils/file.h"
+#include "supersonic/utils/file_util.h"
+#include "gtest/gtest.h"
+
+namespace supersonic {
+
+namespace {
+
+// Writes the view to a new table file, in row groups of row_group_row_count
+// rows. The file is unlinked right away; it's readable while open.
+File* WriteTableFile(const View& view, rowcount_t row_group_row_count) {
+  File* file = TempFile::Create("");
+  CHECK(file != NULL);
+  CHECK(file->Delete());
+  std::unique_ptr<Sink> sink(TableFileOutput(
+      view.schema(), file, DO_NOT_TAKE_OWNERSHIP, row_group_row_count));
+  // Several writes, not aligned with the row groups.
+  View part(view.schema());
+  for (rowcount_t offset = 0; offset < view.row_count(); offset += 70) {
+    part.ResetFromSubRange(view, offset,
+                           std::min<rowcount_t>(70, view.row_count() - offset));
+    EXPECT_TRUE(sink->Write(part).is_success());
+  }
+  EXPECT_TRUE(sink->Finalize().is_success());
+  return file;
+}
+
+FailureOrOwned<Cursor> ReadAll(File* file,
+                               const TableFilePredicate& predicate) {
+  return TableFileInput(file, *ProjectAllAttributes(), predicate,
+                        HeapBufferAllocator::Get());
+}
+
+// Rows with timestamps growing by 1000 every row, and every 7th value NULL.
+std::unique_ptr<Block> CreateTimeSeries(rowcount_t row_count) {
+  BlockBuilder<DATETIME, INT32, STRING> builder;
+  for (rowcount_t i = 0; i < row_count; ++i) {
+    if (i % 7 == 3) {
+      builder.AddRow(i * 1000, __, __);
+    } else {
+      builder.AddRow(i * 1000, i % 10, (i % 2 == 0) ? "even" : "odd");
+    }
+  }
+  return builder.Build();
+}
+
+TEST(TableFileTest, RoundTripAllTypes) {
+  BlockBuilder<INT32, INT64, UINT32, UINT64, FLOAT, DOUBLE, BOOL, DATE,
+               DATETIME, STRING, BINARY> builder;
+  for (int i = 0; i < 1000; ++i) {
+    if (i % 13 == 0) {
+      builder.AddRow(__, __, __, __, __, __, __, __, __, __, __);
+    } else {
+      builder.AddRow(-i, i * 1000000007LL, i, i * 3ULL, i * 0.5f, -i * 0.25,
+                     i % 3 == 0, 15000 + i, 1500000000000000LL + i,
+                     string(i % 9, 'a' + i % 26), "\x01\x02");
+    }
+  }
+  std::unique_ptr<Block> block(builder.Build());
+  File* file = WriteTableFile(block->view(), 128);
+  FailureOrOwned<Cursor> input(ReadAll(file, TableFilePredicate()));
+  ASSERT_TRUE(input.is_success());
+  EXPECT_CURSORS_EQUAL(BoundScanView(block->view()), input.move());
+}
+
+TEST(TableFileTest, EmptyTable) {
+  std::unique_ptr<Block> block(CreateTimeSeries(0));
+  File* file = WriteTableFile(block->view(), 100);
+  FailureOr<TupleSchema> schema = ReadTableFileSchema(file);
+  ASSERT_TRUE(schema.is_success());
+  EXPECT_TRUE(TupleSchema::AreEqual(block->schema(), schema.get(), true));
+  FailureOrOwned<Cursor> input(ReadAll(file, TableFilePredicate()));
+  ASSERT_TRUE(input.is_success());
+  EXPECT_CURSORS_EQUAL(BoundScanView(block->view()), input.move());
+}
+
+TEST(TableFileTest, ReadsSchema) {
+  std::unique_ptr<Block> block(CreateTimeSeries(10));
+  File* file = WriteTableFile(block->view(), 4);
+  FailureOr<TupleSchema> schema = ReadTableFileSchema(file);
+  ASSERT_TRUE(schema.is_success());
+  EXPECT_TRUE(TupleSchema::AreEqual(block->schema(), schema.get(), true));
+  EXPECT_FALSE(schema.get().attribute(0).is_nullable());
+  EXPECT_TRUE(schema.get().attribute(1).is_nullable());
+  file->Close();
+}
+
+TEST(TableFileTest, ProjectsColumns) {
+  std::unique_ptr<Block> block(CreateTimeSeries(300));
+  File* file = WriteTableFile(block->view(), 64);
+  std::unique_ptr<CompoundSingleSourceProjector> projector(
+      new CompoundSingleSourceProjector());
+  projector->add(ProjectNamedAttribute("col2"))
+           ->add(ProjectNamedAttributeAs("col0", "time"))
+           ->add(ProjectNamedAttributeAs("col2", "again"));
+  FailureOrOwned<Cursor> input(TableFileInput(
+      file, *projector, TableFilePredicate(), HeapBufferAllocator::Get()));
+  ASSERT_TRUE(input.is_success());
+  ASSERT_EQ(3, input->schema().attribute_count());
+  EXPECT_EQ("time", input->schema().attribute(1).name());
+
+  FailureOrOwned<const BoundSingleSourceProjector> bound =
+      projector->Bind(block->schema());
+  ASSERT_TRUE(bound.is_success());
+  View expected(bound->result_schema());
+  bound->Project(block->view(), &expected);
+  expected.set_row_count(block->view().row_count());
+  EXPECT_CURSORS_EQUAL(BoundScanView(expected), input.move());
+}
+
+TEST(TableFileTest, NoColumnsProjected) {
+  std::unique_ptr<Block> block(CreateTimeSeries(250));
+  File* file = WriteTableFile(block->view(), 100);
+  FailureOrOwned<Cursor> input(TableFileInput(
+      file, *ProjectAttributesAt(vector<int>()), TableFilePredicate(),
+      HeapBufferAllocator::Get()));
+  ASSERT_TRUE(input.is_success());
+  rowcount_t row_count = 0;
+  for (ResultView result = input->Next(Cursor::kDefaultRowCount);
+       result.has_data();
+       result = input->Next(Cursor::kDefaultRowCount)) {
+    row_count += result.view().row_count();
+  }
+  EXPECT_EQ(250, row_count);
+}
+
+TEST(TableFileTest, SkipsRowGroupsOutOfRange) {
+  std::unique_ptr<Block> block(CreateTimeSeries(1000));
+  File* file = WriteTableFile(block->view(), 100);
+  TableFilePredicate predicate;
+  predicate.AddRange("col0", VariantDatum::Create<DATETIME>(250000),
+                     VariantDatum::Create<DATETIME>(349999));
+  FailureOrOwned<Cursor> input(ReadAll(file, predicate));
+  ASSERT_TRUE(input.is_success());
+  // The row groups of rows 200-299 and 300-399, whole.
+  View expected(block->view());
+  expected.ResetFromSubRange(block->view(), 200, 200);
+  EXPECT_CURSORS_EQUAL(BoundScanView(expected), input.move());
+}
+
+TEST(TableFileTest, CombinesRanges) {
+  std::unique_ptr<Block> block(CreateTimeSeries(1000));
+  File* file = WriteTableFile(block->view(), 100);
+  TableFilePredicate predicate;
+  predicate.AddRange("col0", VariantDatum::Create<DATETIME>(250000),
+                     VariantDatum::CreateNull(DATETIME))
+           ->AddRange("col0", VariantDatum(),
+                      VariantDatum::Create<DATETIME>(150000));
+  FailureOrOwned<Cursor> input(ReadAll(file, predicate));
+  ASSERT_TRUE(input.is_success());
+  EXPECT_TRUE(input->Next(Cursor::kDefaultRowCount).is_eos());
+}
+
+TEST(TableFileTest, SkipsRowGroupsByStrings) {
+  BlockBuilder<STRING, INT32> builder;
+  const char* kCities[] = { "Amsterdam", "Berlin", "Warsaw", "Zurich" };
+  for (int i = 0; i < 400; ++i) {
+    builder.AddRow(kCities[i / 100], i);
+  }
+  std::unique_ptr<Block> block(builder.Build());
+  File* file = WriteTableFile(block->view(), 100);
+  TableFilePredicate predicate;
+  predicate.AddRange("col0", VariantDatum::Create<STRING>("C"),
+                     VariantDatum::Create<STRING>("Warsaw"));
+  FailureOrOwned<Cursor> input(ReadAll(file, predicate));
+  ASSERT_TRUE(input.is_success());
+  View expected(block->view());
+  expected.ResetFromSubRange(block->view(), 200, 100);
+  EXPECT_CURSORS_EQUAL(BoundScanView(expected), input.move());
+}
+
+TEST(TableFileTest, SkipsRowGroupsOfNulls) {
+  BlockBuilder<INT64> builder;
+  for (int i = 0; i < 300; ++i) {
+    if (i < 100 || i >= 200) {
+      builder.AddRow(__);
+    } else {
+      builder.AddRow(i);
+    }
+  }
+  std::unique_ptr<Block> block(builder.Build());
+  File* file = WriteTableFile(block->view(), 100);
+  TableFilePredicate predicate;
+  predicate.AddRange("col0", VariantDatum(), VariantDatum());
+  FailureOrOwned<Cursor> input(ReadAll(file, predicate));
+  ASSERT_TRUE(input.is_success());
+  View expected(block->view());
+  expected.ResetFromSubRange(block->view(), 100, 100);
+  EXPECT_CURSORS_EQUAL(BoundScanView(expected), input.move());
+}
+
+TEST(TableFileTest, InvalidPredicateFails) {
+  std::unique_ptr<Block> block(CreateTimeSeries(10));
+  TableFilePredicate missing;
+  missing.AddRange("no_such_column", VariantDatum::Create<INT32>(1),
+                   VariantDatum());
+  FailureOrOwned<Cursor> input(
+      ReadAll(WriteTableFile(block->view(), 5), missing));
+  ASSERT_TRUE(input.is_failure());
+  EXPECT_EQ(ERROR_ATTRIBUTE_MISSING, input.exception().return_code());
+
+  TableFilePredicate mismatched;
+  mismatched.AddRange("col0", VariantDatum::Create<INT64>(1), VariantDatum());
+  FailureOrOwned<Cursor> mismatched_input(
+      ReadAll(WriteTableFile(block->view(), 5), mismatched));
+  ASSERT_TRUE(mismatched_input.is_failure());
+  EXPECT_EQ(ERROR_ATTRIBUTE_TYPE_MISMATCH,
+            mismatched_input.exception().return_code());
+}
+
+TEST(TableFileTest, NotATableFileFails) {
+  File* file = TempFile::Create("");
+  ASSERT_TRUE(file != NULL);
+  ASSERT_TRUE(file->Delete());
+  const char kData[] = "definitely not a table file";
+  ASSERT_EQ(sizeof(kData), file->Write(kData, sizeof(kData)));
+  FailureOrOwned<Cursor> input(ReadAll(file, TableFilePredicate()));
+  ASSERT_TRUE(input.is_failure());
+  EXPECT_EQ(ERROR_GENERAL_IO_ERROR, input.exception().return_code());
+}
+
+TEST(TableFileTest, MismatchedViewFails) {
+  std::unique_ptr<Block> block(CreateTimeSeries(10));
+  std::unique_ptr<Block> other(BlockBuilder<STRING>().AddRow("x").Build());
+  File* file = TempFile::Create("");
+  ASSERT_TRUE(file != NULL);
+  ASSERT_TRUE(file->Delete());
+  std::unique_ptr<Sink> sink(
+      TableFileOutput(block->schema(), file, TAKE_OWNERSHIP, 100));
+  EXPECT_TRUE(sink->Write(other->view()).is_failure());
+  EXPECT_TRUE(sink->Finalize().is_success());
+}
+
+}  // namespace
+
+}  // namespace supersonic
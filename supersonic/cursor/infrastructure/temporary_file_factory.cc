@@ -0,0 +1,170 @@
+// Copyright 2012 Google Inc. All Rights Reserved.
+//
+// Licensed under the Apache License, Version 2.0 (the "License");
+// you may not use this file except in compliance with the License.
+// You may obtain a copy of the License at
+//
+//     http://www.apache.org/licenses/LICENSE-2.0
+//
+// Unless required by applicable law or agreed to in writing, software
+// distributed under the License is distributed on an "AS IS" BASIS,
+// WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+// See the License for the specific language governing permissions and
+// limitations under the License.
+//
+
+#include "supersonic/cursor/infrastructure/temporary_file_factory.h"
+
+#include <map>
+#include "supersonic/utils/std_namespace.h"
+#include <mutex>
+
+#include <glog/logging.h>
+#include "supersonic/utils/logging-inl.h"
+#include "supersonic/base/exception/exception.h"
+#include "supersonic/base/exception/exception_macros.h"
+#include "supersonic/utils/file.h"
+#include "supersonic/utils/file_util.h"
+#include "supersonic/utils/strings/join.h"
+#include "supersonic/utils/strings/strcat.h"
+
+namespace supersonic {
+
+const int64_t LocalTemporaryFileFactory::kNoDiskQuota;
+
+// Delegates to a file created by TempFile::Create, keeping the factory's
+// accounts: the size of the file (the farthest byte written), reserved in the
+// quota until the file is deleted, and the bytes written and read.
+class LocalTemporaryFileFactory::AccountedFile : public File {
+ public:
+  AccountedFile(File* file, LocalTemporaryFileFactory* factory)
+      : File(file->CreateFileName()),
+        file_(file),
+        factory_(factory),
+        position_(0),
+        size_(0) {}
+
+  virtual bool Exists() const { return file_->Exists(); }
+  virtual bool Open() { return file_->Open(); }
+
+  virtual bool Delete() {
+    if (!file_->Delete()) return false;
+    factory_->Release(size_);
+    size_ = 0;
+    return true;
+  }
+
+  virtual bool Close() {
+    const bool closed = file_->Close();
+    delete this;
+    return closed;
+  }
+
+  virtual int64_t Read(void* buffer, uint64_t length) {
+    const int64_t read = file_->Read(buffer, length);
+    if (read > 0) {
+      position_ += read;
+      factory_->bytes_read_.fetch_add(read);
+    }
+    return read;
+  }
+
+  virtual char* ReadLine(char* buffer, uint64_t max_length) {
+    char* line = file_->ReadLine(buffer, max_length);
+    if (line != NULL) {
+      const int64_t read = strlen(line);
+      position_ += read;
+      factory_->bytes_read_.fetch_add(read);
+    }
+    return line;
+  }
+
+  virtual int64_t Write(const void* buffer, uint64_t length) {
+    const int64_t growth = std::max<int64_t>(0, position_ + length - size_);
+    if (growth > 0 && !factory_->Reserve(growth)) {
+      LOG(WARNING) << "Temporary file disk quota of " << factory_->disk_quota()
+                   << " bytes exceeded, writing to " << CreateFileName();
+      return -1;
+    }
+    size_ += growth;
+    const int64_t written = file_->Write(buffer, length);
+    if (written > 0) {
+      position_ += written;
+      factory_->bytes_written_.fetch_add(written);
+    }
+    return written;
+  }
+
+  virtual bool Seek(int64_t position) {
+    if (!file_->Seek(position)) return false;
+    position_ = position;
+    return true;
+  }
+
+  virtual bool eof() { return file_->eof(); }
+
+ private:
+  File* const file_;
+  LocalTemporaryFileFactory* const factory_;
+  int64_t position_;
+  // Reserved in the factory's disk usage.
+  int64_t size_;
+
+  DISALLOW_COPY_AND_ASSIGN(AccountedFile);
+};
+
+LocalTemporaryFileFactory::LocalTemporaryFileFactory(
+    const vector<string>& directories,
+    int64_t disk_quota)
+    : directories_(directories),
+      disk_quota_(disk_quota),
+      next_directory_(0),
+      disk_usage_(0),
+      bytes_written_(0),
+      bytes_read_(0),
+      files_created_(0) {
+  CHECK(!directories_.empty());
+  CHECK_GE(disk_quota_, 0);
+}
+
+FailureOr<File*> LocalTemporaryFileFactory::CreateTemporaryFile() {
+  const size_t first = next_directory_.fetch_add(1) % directories_.size();
+  for (size_t i = 0; i < directories_.size(); ++i) {
+    const string& directory =
+        directories_[(first + i) % directories_.size()];
+    File* file = TempFile::Create(directory.c_str());
+    if (file != NULL) {
+      files_created_.fetch_add(1);
+      return Success(static_cast<File*>(new AccountedFile(file, this)));
+    }
+  }
+  THROW(new Exception(ERROR_TEMP_FILE_CREATION_ERROR,
+                      StrCat("Couldn't create temporary file in any of ",
+                             strings::Join(directories_, ", "))));
+}
+
+bool LocalTemporaryFileFactory::Reserve(int64_t size) {
+  int64_t usage = disk_usage_.load();
+  do {
+    if (size > disk_quota_ - usage) return false;
+  } while (!disk_usage_.compare_exchange_weak(usage, usage + size));
+  return true;
+}
+
+TemporaryFileFactory* DefaultTemporaryFileFactory(
+    StringPiece temporary_directory_prefix) {
+  static std::mutex* const mutex = new std::mutex;
+  static map<string, TemporaryFileFactory*>* const factories =
+      new map<string, TemporaryFileFactory*>;
+  std::lock_guard<std::mutex> lock(*mutex);
+  TemporaryFileFactory*& factory =
+      (*factories)[temporary_directory_prefix.ToString()];
+  if (factory == NULL) {
+    factory = new LocalTemporaryFileFactory(
+        { temporary_directory_prefix.ToString() },
+        LocalTemporaryFileFactory::kNoDiskQuota);
+  }
+  return factory;
+}
+
+}  // namespace supersonic
@@ -0,0 +1,118 @@
+// Copyright 2012 Google Inc. All Rights Reserved.
+//
+// Licensed under the Apache License, Version 2.0 (the "License");
+// you may not use this file except in compliance with the License.
+// You may obtain a copy of the License at
+//
+//     http://www.apache.org/licenses/LICENSE-2.0
+//
+// Unless required by applicable law or agreed to in writing, software
+// distributed under the License is distributed on an "AS IS" BASIS,
+// WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+// See the License for the specific language governing permissions and
+// limitations under the License.
+//
+// Where the operations that spill data to disk (sort, hybrid group
+// aggregation, hash join) put their temporary files.
+//
+// Example usage, spreading the files over two disks, with at most 100 GB of
+// them at a time:
+//
+// LocalTemporaryFileFactory factory({ "/disk1/tmp", "/disk2/tmp" },
+//                                   100LL << 30);
+// SortOptions options;
+// options.set_temporary_file_factory(&factory);
+// ... SortWithOptions(..., options, ...) ...
+// LOG(INFO) << factory.bytes_written() << " bytes spilled";
+
+#ifndef SUPERSONIC_CURSOR_INFRASTRUCTURE_TEMPORARY_FILE_FACTORY_H_
+#define SUPERSONIC_CURSOR_INFRASTRUCTURE_TEMPORARY_FILE_FACTORY_H_
+
+#include <atomic>
+#include <limits>
+#include "supersonic/utils/std_namespace.h"
+#include <string>
+using std::string;
+#include <vector>
+using std::vector;
+
+#include "supersonic/utils/integral_types.h"
+#include "supersonic/utils/macros.h"
+#include "supersonic/base/exception/result.h"
+#include "supersonic/utils/strings/stringpiece.h"
+
+class File;
+
+namespace supersonic {
+
+// Creates temporary files. Implementations must be thread-safe: the files of
+// many operations, possibly running on many threads, may be created, written
+// and read at once.
+class TemporaryFileFactory {
+ public:
+  virtual ~TemporaryFileFactory() {}
+
+  // Creates a new, empty file, open for reading and writing. The caller takes
+  // ownership of the file: it should Delete() and then Close() it when done.
+  virtual FailureOr<File*> CreateTemporaryFile() = 0;
+
+ protected:
+  TemporaryFileFactory() {}
+
+ private:
+  DISALLOW_COPY_AND_ASSIGN(TemporaryFileFactory);
+};
+
+// Creates the files in local directories, in turn (round-robin), to spread
+// them, and the I/O, over several disks. If a file can't be created in a
+// directory, tries the next ones. Bounds the total size of the files that
+// exist at a time: writes beyond the disk quota fail. Counts the bytes written
+// and read back.
+class LocalTemporaryFileFactory : public TemporaryFileFactory {
+ public:
+  static const int64_t kNoDiskQuota = std::numeric_limits<int64_t>::max();
+
+  // The directories are passed to TempFile::Create; an empty one means the
+  // default temporary directory. There must be at least one.
+  LocalTemporaryFileFactory(const vector<string>& directories,
+                            int64_t disk_quota);
+
+  virtual FailureOr<File*> CreateTemporaryFile();
+
+  // The total size of the files created and not deleted yet.
+  int64_t disk_usage() const { return disk_usage_.load(); }
+  int64_t disk_quota() const { return disk_quota_; }
+
+  // Totals since the factory was created.
+  int64_t bytes_written() const { return bytes_written_.load(); }
+  int64_t bytes_read() const { return bytes_read_.load(); }
+  int64_t files_created() const { return files_created_.load(); }
+
+ private:
+  class AccountedFile;
+
+  // Adds size to the disk usage; returns false, with the usage unchanged, if
+  // that would exceed the quota.
+  bool Reserve(int64_t size);
+  void Release(int64_t size) { disk_usage_.fetch_sub(size); }
+
+  const vector<string> directories_;
+  const int64_t disk_quota_;
+  std::atomic<uint64_t> next_directory_;
+  std::atomic<int64_t> disk_usage_;
+  std::atomic<int64_t> bytes_written_;
+  std::atomic<int64_t> bytes_read_;
+  std::atomic<int64_t> files_created_;
+
+  DISALLOW_COPY_AND_ASSIGN(LocalTemporaryFileFactory);
+};
+
+// Returns a process-wide factory creating the files in the directory, with no
+// disk quota, as the operations that take a temporary_directory_prefix use.
+// Created on first use, never destroyed.
+TemporaryFileFactory* DefaultTemporaryFileFactory(
+    StringPiece temporary_directory_prefix);
+
+}  // namespace supersonic
+
+#endif  // SUPERSONIC_CURSOR_INFRASTRUCTURE_TEMPORARY_FILE_FACTORY_H_
@@ -0,0 +1,194 @@
+// Copyright 2012 Google Inc. All Rights Reserved.
+//
+// Licensed under the Apache License, Version 2.0 (the "License");
+// you may not use this file except in compliance with the License.
+// You may obtain a copy of the License at
+//
+//     http://www.apache.org/licenses/LICENSE-2.0
+//
+// Unless required by applicable law or agreed to in writing, software
+// distributed under the License is distributed on an "AS IS" BASIS,
+// WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+// See the License for the specific language governing permissions and
+// limitations under the License.
+//
+
+#include "supersonic/cursor/infrastructure/temporary_file_factory.h"
+
+#include <stdlib.h>
+#include <unistd.h>
+
+#include <memory>
+#include <string>
+using std::string;
+#include <vector>
+using std::vector;
+
+#include "supersonic/base/infrastructure/block.h"
+#include "supersonic/base/memory/memory.h"
+#include "supersonic/cursor/base/cursor.h"
+#include "supersonic/cursor/core/scan_view.h"
+#include "supersonic/cursor/infrastructure/file_io.h"
+#include "supersonic/testing/block_builder.h"
+#include "supersonic/testing/comparators.h"
+#include "supersonic/utils/file.h"
+#include "supersonic/utils/file_util.h"
+#include "gtest/gtest.h"
+
+namespace supersonic {
+
+namespace {
+
+class TemporaryFileFactoryTest : public testing::Test {
+ protected:
+  virtual void SetUp() {
+    for (int i = 0; i < 2; ++i) {
+      char directory[] = "/tmp/temporary_file_factory_test.XXXXXX";
+      ASSERT_TRUE(mkdtemp(directory) != NULL);
+      directories_.push_back(directory);
+    }
+  }
+
+  virtual void TearDown() {
+    // Fails if the tests left any files behind.
+    for (const string& directory : directories_) {
+      EXPECT_EQ(0, rmdir(directory.c_str())) << directory;
+    }
+  }
+
+  // Returns true if the file is in the directory.
+  static bool IsIn(File* file, const string& directory) {
+    return file->CreateFileName().compare(0, directory.size() + 1,
+                                          directory + "/") == 0;
+  }
+
+  static void DeleteAndClose(File* file) {
+    EXPECT_TRUE(file->Delete());
+    EXPECT_TRUE(file->Close());
+  }
+
+  vector<string> directories_;
+};
+
+TEST_F(TemporaryFileFactoryTest, CreatesFilesRoundRobin) {
+  LocalTemporaryFileFactory factory(directories_,
+                                    LocalTemporaryFileFactory::kNoDiskQuota);
+  vector<File*> files;
+  for (int i = 0; i < 4; ++i) {
+    FailureOr<File*> file = factory.CreateTemporaryFile();
+    ASSERT_TRUE(file.is_success());
+    files.push_back(file.get());
+  }
+  EXPECT_EQ(4, factory.files_created());
+  EXPECT_TRUE(IsIn(files[0], directories_[0]));
+  EXPECT_TRUE(IsIn(files[1], directories_[1]));
+  EXPECT_TRUE(IsIn(files[2], directories_[0]));
+  EXPECT_TRUE(IsIn(files[3], directories_[1]));
+  for (File* file : files) DeleteAndClose(file);
+}
+
+TEST_F(TemporaryFileFactoryTest, SkipsMissingDirectory) {
+  LocalTemporaryFileFactory factory(
+      { directories_[0], directories_[1] + "/missing" },
+      LocalTemporaryFileFactory::kNoDiskQuota);
+  for (int i = 0; i < 2; ++i) {
+    FailureOr<File*> file = factory.CreateTemporaryFile();
+    ASSERT_TRUE(file.is_success());
+    EXPECT_TRUE(IsIn(file.get(), directories_[0]));
+    DeleteAndClose(file.get());
+  }
+}
+
+TEST_F(TemporaryFileFactoryTest, FailsWithoutAnyDirectory) {
+  LocalTemporaryFileFactory factory(
+      { directories_[0] + "/missing", directories_[1] + "/missing" },
+      LocalTemporaryFileFactory::kNoDiskQuota);
+  FailureOr<File*> file = factory.CreateTemporaryFile();
+  ASSERT_TRUE(file.is_failure());
+  EXPECT_EQ(ERROR_TEMP_FILE_CREATION_ERROR, file.exception().return_code());
+}
+
+TEST_F(TemporaryFileFactoryTest, CountsBytesAndDiskUsage) {
+  LocalTemporaryFileFactory factory(directories_,
+                                    LocalTemporaryFileFactory::kNoDiskQuota);
+  FailureOr<File*> file = factory.CreateTemporaryFile();
+  ASSERT_TRUE(file.is_success());
+  EXPECT_EQ(10, file.get()->Write("0123456789", 10));
+  EXPECT_EQ(10, factory.disk_usage());
+  // Overwriting doesn't grow the file.
+  ASSERT_TRUE(file.get()->Seek(5));
+  EXPECT_EQ(10, file.get()->Write("abcdefghij", 10));
+  EXPECT_EQ(15, factory.disk_usage());
+  EXPECT_EQ(20, factory.bytes_written());
+  ASSERT_TRUE(file.get()->Seek(0));
+  char buffer[15];
+  EXPECT_EQ(15, file.get()->Read(buffer, 15));
+  EXPECT_EQ("01234abcdefghij", string(buffer, 15));
+  EXPECT_EQ(15, factory.bytes_read());
+  DeleteAndClose(file.get());
+  EXPECT_EQ(0, factory.disk_usage());
+  EXPECT_EQ(20, factory.bytes_written());
+}
+
+TEST_F(TemporaryFileFactoryTest, WritesBeyondQuotaFail) {
+  LocalTemporaryFileFactory factory(directories_, 15);
+  FailureOr<File*> first = factory.CreateTemporaryFile();
+  FailureOr<File*> second = factory.CreateTemporaryFile();
+  ASSERT_TRUE(first.is_success());
+  ASSERT_TRUE(second.is_success());
+  EXPECT_EQ(10, first.get()->Write("0123456789", 10));
+  EXPECT_GT(0, second.get()->Write("0123456789", 10));
+  EXPECT_EQ(10, factory.disk_usage());
+  EXPECT_EQ(5, second.get()->Write("01234", 5));
+  EXPECT_EQ(15, factory.disk_usage());
+  // Deleting a file frees its space.
+  DeleteAndClose(first.get());
+  EXPECT_EQ(10, second.get()->Write("0123456789", 10));
+  EXPECT_EQ(15, factory.disk_usage());
+  DeleteAndClose(second.get());
+  EXPECT_EQ(0, factory.disk_usage());
+}
+
+TEST_F(TemporaryFileFactoryTest, SpillBeyondQuotaFails) {
+  std::unique_ptr<Block> block(
+      BlockBuilder<INT64, STRING>().AddRow(1, "foo").AddRow(2, "bar").Build());
+  LocalTemporaryFileFactory factory(directories_, 1 << 20);
+  {
+    FailureOrOwned<TemporaryFileBuffer> buffer =
+        TemporaryFileBuffer::Create(&factory, FILE_COMPRESSION_NONE);
+    ASSERT_TRUE(buffer.is_success());
+    ASSERT_TRUE(buffer->Write(block->view()).is_success());
+    FailureOrOwned<Cursor> input =
+        buffer->Read(block->schema(), HeapBufferAllocator::Get());
+    ASSERT_TRUE(input.is_success());
+    EXPECT_CURSORS_EQUAL(BoundScanView(block->view()), input.move());
+  }
+  EXPECT_EQ(0, factory.disk_usage());
+  EXPECT_LT(0, factory.bytes_written());
+  EXPECT_EQ(factory.bytes_written(), factory.bytes_read());
+
+  LocalTemporaryFileFactory small_factory(directories_, 8);
+  FailureOrOwned<TemporaryFileBuffer> buffer =
+      TemporaryFileBuffer::Create(&small_factory, FILE_COMPRESSION_NONE);
+  ASSERT_TRUE(buffer.is_success());
+  ASSERT_TRUE(buffer->Write(block->view()).is_success());
+  // The write-behind reports the failure when the data is read back.
+  FailureOrOwned<Cursor> input =
+      buffer->Read(block->schema(), HeapBufferAllocator::Get());
+  EXPECT_TRUE(input.is_failure());
+}
+
+TEST(DefaultTemporaryFileFactoryTest, SameFactoryForSamePrefix) {
+  EXPECT_EQ(DefaultTemporaryFileFactory(""), DefaultTemporaryFileFactory(""));
+  EXPECT_NE(DefaultTemporaryFileFactory(""),
+            DefaultTemporaryFileFactory("/tmp"));
+  FailureOr<File*> file =
+      DefaultTemporaryFileFactory("")->CreateTemporaryFile();
+  ASSERT_TRUE(file.is_success());
+  EXPECT_TRUE(file.get()->Delete());
+  EXPECT_TRUE(file.get()->Close());
+}
+
+}  // namespace
+
+}  // namespace supersonic
@@ -0,0 +1,175 @@
+// Copyright 2012 Google Inc. All Rights Reserved.
+//
+// Licensed under the Apache License, Version 2.0 (the "License");
+// you may not use this file except in compliance with the License.
+// You may obtain a copy of the License at
+//
+//     http://www.apache.org/licenses/LICENSE-2.0
+//
+// Unless required by applicable law or agreed to in writing, software
+// distributed under the License is distributed on an "AS IS" BASIS,
+// WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+// See the License for the specific language governing permissions and
+// limitations under the License.
+//
+
+#include "supersonic/cursor/infrastructure/thread_pool.h"
+
+#include <algorithm>
+#include <utility>
+
+#include <glog/logging.h>
+#include "supersonic/utils/logging-inl.h"
+
+namespace supersonic {
+
+namespace {
+
+// Identifies the pool and the worker that the current thread belongs to, so
+// that tasks scheduled from within a worker can be queued locally.
+thread_local const ThreadPool* current_pool = NULL;
+thread_local int current_worker_id = -1;
+
+// State of a single ParallelFor, shared with the helper tasks (which may start
+// after the ParallelFor has returned; they find no work left and quit).
+struct ParallelForState {
+  ParallelForState(int count, const std::function<void(int)>& body)
+      : count(count), next(0), in_flight(0), body(body) {}
+
+  std::mutex mutex;
+  std::condition_variable all_done;
+  const int count;
+  int next;
+  int in_flight;
+  const std::function<void(int)> body;
+};
+
+// Claims and runs the calls of the ParallelFor until none are left.
+void RunParallelForCalls(ParallelForState* state) {
+  std::unique_lock<std::mutex> lock(state->mutex);
+  while (state->next < state->count) {
+    const int index = state->next++;
+    ++state->in_flight;
+    lock.unlock();
+    state->body(index);
+    lock.lock();
+    --state->in_flight;
+  }
+  if (state->in_flight == 0) state->all_done.notify_all();
+}
+
+}  // namespace
+
+ThreadPool::ThreadPool(int num_threads)
+    : pending_tasks_(0),
+      shutting_down_(false),
+      next_queue_(0),
+      steal_count_(0) {
+  CHECK_GT(num_threads, 0);
+  for (int i = 0; i < num_threads; ++i) {
+    queues_.emplace_back(new WorkerQueue);
+  }
+  for (int i = 0; i < num_threads; ++i) {
+    threads_.emplace_back(&ThreadPool::WorkerLoop, this, i);
+  }
+}
+
+ThreadPool::~ThreadPool() {
+  {
+    std::lock_guard<std::mutex> lock(idle_mutex_);
+    shutting_down_ = true;
+  }
+  idle_condition_.notify_all();
+  for (std::thread& thread : threads_) {
+    thread.join();
+  }
+}
+
+int ThreadPool::DefaultNumThreads() {
+  const int hardware_threads = std::thread::hardware_concurrency();
+  return hardware_threads > 0 ? hardware_threads : 1;
+}
+
+void ThreadPool::Schedule(std::function<void()> task) {
+  if (current_pool == this) {
+    WorkerQueue* queue = queues_[current_worker_id].get();
+    std::lock_guard<std::mutex> lock(queue->mutex);
+    queue->tasks.push_front(std::move(task));
+  } else {
+    WorkerQueue* queue =
+        queues_[next_queue_.fetch_add(1, std::memory_order_relaxed) %
+                queues_.size()].get();
+    std::lock_guard<std::mutex> lock(queue->mutex);
+    queue->tasks.push_back(std::move(task));
+  }
+  {
+    std::lock_guard<std::mutex> lock(idle_mutex_);
+    ++pending_tasks_;
+  }
+  idle_condition_.notify_one();
+}
+
+bool ThreadPool::TakeTask(int worker_id, std::function<void()>* task) {
+  const int num_queues = queues_.size();
+  for (int i = 0; i < num_queues; ++i) {
+    const int victim = (worker_id + i) % num_queues;
+    WorkerQueue* queue = queues_[victim].get();
+    std::unique_lock<std::mutex> lock(queue->mutex);
+    if (queue->tasks.empty()) continue;
+    if (victim == worker_id) {
+      *task = std::move(queue->tasks.front());
+      queue->tasks.pop_front();
+    } else {
+      *task = std::move(queue->tasks.back());
+      queue->tasks.pop_back();
+      steal_count_.fetch_add(1, std::memory_order_relaxed);
+    }
+    lock.unlock();
+    // Note: the counter may become transiently negative, if the task was
+    // taken before Schedule() got to increment it.
+    std::lock_guard<std::mutex> idle_lock(idle_mutex_);
+    --pending_tasks_;
+    return true;
+  }
+  return false;
+}
+
+void ThreadPool::WorkerLoop(int worker_id) {
+  current_pool = this;
+  current_worker_id = worker_id;
+  std::function<void()> task;
+  while (true) {
+    if (TakeTask(worker_id, &task)) {
+      task();
+      task = nullptr;
+      continue;
+    }
+    std::unique_lock<std::mutex> lock(idle_mutex_);
+    idle_condition_.wait(lock, [this] {
+      return pending_tasks_ > 0 || shutting_down_;
+    });
+    if (pending_tasks_ <= 0 && shutting_down_) break;
+  }
+  current_pool = NULL;
+  current_worker_id = -1;
+}
+
+void ParallelFor(ThreadPool* thread_pool,
+                 int count,
+                 const std::function<void(int)>& body) {
+  if (thread_pool == NULL || count <= 1) {
+    for (int i = 0; i < count; ++i) body(i);
+    return;
+  }
+  std::shared_ptr<ParallelForState> state =
+      std::make_shared<ParallelForState>(count, body);
+  const int helper_count = std::min(count - 1, thread_pool->num_threads());
+  for (int i = 0; i < helper_count; ++i) {
+    thread_pool->Schedule([state] { RunParallelForCalls(state.get()); });
+  }
+  RunParallelForCalls(state.get());
+  std::unique_lock<std::mutex> lock(state->mutex);
+  state->all_done.wait(lock, [&state] { return state->in_flight == 0; });
+}
+
+}  // namespace supersonic
@@ -0,0 +1,112 @@
+// Copyright 2012 Google Inc. All Rights Reserved.
+//
+// Licensed under the Apache License, Version 2.0 (the "License");
+// you may not use this file except in compliance with the License.
+// You may obtain a copy of the License at
+//
+//     http://www.apache.org/licenses/LICENSE-2.0
+//
+// Unless required by applicable law or agreed to in writing, software
+// distributed under the License is distributed on an "AS IS" BASIS,
+// WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+// See the License for the specific language governing permissions and
+// limitations under the License.
+//
+// A fixed-size pool of worker threads with per-thread task queues and work
+// stealing. Used by the parallel cursors (see cursor/core/parallel.h).
+
+#ifndef SUPERSONIC_CURSOR_INFRASTRUCTURE_THREAD_POOL_H_
+#define SUPERSONIC_CURSOR_INFRASTRUCTURE_THREAD_POOL_H_
+
+#include <stdint.h>
+
+#include <atomic>
+#include <condition_variable>
+#include <deque>
+#include <functional>
+#include <memory>
+#include <mutex>
+#include <thread>
+#include <vector>
+
+#include "supersonic/utils/macros.h"
+
+namespace supersonic {
+
+// Runs scheduled tasks on a fixed number of threads. Every worker thread owns
+// a deque of tasks. A task scheduled from within a worker goes to the front of
+// that worker's own deque (it is likely to touch the data the worker has just
+// produced, which is still in cache); tasks scheduled from outside the pool are
+// distributed round-robin. Idle workers take tasks from the front of their own
+// deque, and, when it is empty, steal from the back of the other deques.
+//
+// Tasks should not block for long periods of time; a task waiting for another
+// task to complete may deadlock the pool. Long-running work is best expressed
+// as a task that does a bounded amount of work and then reschedules itself.
+//
+// All methods are thread-safe.
+class ThreadPool {
+ public:
+  // Starts num_threads worker threads. num_threads must be positive.
+  explicit ThreadPool(int num_threads);
+
+  // Runs all the tasks scheduled so far (including those scheduled by the
+  // tasks themselves) to completion, and joins the worker threads.
+  ~ThreadPool();
+
+  // Schedules the task to run on one of the worker threads.
+  void Schedule(std::function<void()> task);
+
+  int num_threads() const { return threads_.size(); }
+
+  // Number of tasks executed by a worker other than the one that they were
+  // queued on. For monitoring and testing.
+  int64_t steal_count() const {
+    return steal_count_.load(std::memory_order_relaxed);
+  }
+
+  // Returns a default number of threads for the machine; at least 1.
+  static int DefaultNumThreads();
+
+ private:
+  struct WorkerQueue {
+    std::mutex mutex;
+    std::deque<std::function<void()>> tasks;
+  };
+
+  void WorkerLoop(int worker_id);
+
+  // Takes a task from worker's own queue, or steals one from another queue.
+  // Returns false if all queues are empty.
+  bool TakeTask(int worker_id, std::function<void()>* task);
+
+  std::vector<std::unique_ptr<WorkerQueue>> queues_;
+  std::vector<std::thread> threads_;
+
+  // Guards the sleep / wake-up protocol of idle workers.
+  std::mutex idle_mutex_;
+  std::condition_variable idle_condition_;
+  // Number of tasks scheduled but not yet taken from the queues. Modified
+  // under idle_mutex_, so that idle workers don't miss wake-ups.
+  int64_t pending_tasks_;
+  bool shutting_down_;
+
+  std::atomic<size_t> next_queue_;
+  std::atomic<int64_t> steal_count_;
+
+  DISALLOW_COPY_AND_ASSIGN(ThreadPool);
+};
+
+// Calls body(0), ..., body(count - 1), in parallel on the calling thread and up
+// to (thread_pool->num_threads()) helper tasks scheduled on the pool. Returns
+// when all the calls have completed. The calling thread takes part in the work
+// and never waits for helpers that haven't started, so it is safe to call from
+// within a task running on the same pool. If the pool is NULL, the calls are
+// made on the calling thread, in order.
+void ParallelFor(ThreadPool* thread_pool,
+                 int count,
+                 const std::function<void(int)>& body);
+
+}  // namespace supersonic
+
+#endif  // SUPERSONIC_CURSOR_INFRASTRUCTURE_THREAD_POOL_H_
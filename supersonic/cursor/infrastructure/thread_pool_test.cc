@@ -0,0 +1,109 @@
+// Copyright 2012 Google Inc. All Rights Reserved.
+//
+// Licensed under the Apache License, Version 2.0 (the "License");
+// you may not use this file except in compliance with the License.
+// You may obtain a copy of the License at
+//
+//     http://www.apache.org/licenses/LICENSE-2.0
+//
+// Unless required by applicable law or agreed to in writing, software
+// distributed under the License is distributed on an "AS IS" BASIS,
+// WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+// See the License for the specific language governing permissions and
+// limitations under the License.
+//
+
+#include "supersonic/cursor/infrastructure/thread_pool.h"
+
+#include <atomic>
+#include <functional>
+#include <vector>
+
+#include "gtest/gtest.h"
+
+namespace supersonic {
+
+namespace {
+
+TEST(ThreadPoolTest, RunsAllTasksBeforeDestruction) {
+  std::atomic<int> counter(0);
+  {
+    ThreadPool thread_pool(4);
+    EXPECT_EQ(4, thread_pool.num_threads());
+    for (int i = 0; i < 1000; ++i) {
+      thread_pool.Schedule([&counter] { counter.fetch_add(1); });
+    }
+  }
+  EXPECT_EQ(1000, counter.load());
+}
+
+// Every task schedules two subtasks, until the given depth; the subtasks are
+// queued locally and can be stolen by the other workers.
+void Spawn(ThreadPool* thread_pool, std::atomic<int>* counter, int depth) {
+  counter->fetch_add(1);
+  if (depth == 0) return;
+  for (int i = 0; i < 2; ++i) {
+    thread_pool->Schedule([thread_pool, counter, depth] {
+      Spawn(thread_pool, counter, depth - 1);
+    });
+  }
+}
+
+TEST(ThreadPoolTest, TasksScheduleTasks) {
+  std::atomic<int> counter(0);
+  {
+    ThreadPool thread_pool(3);
+    thread_pool.Schedule([&thread_pool, &counter] {
+      Spawn(&thread_pool, &counter, 10);
+    });
+  }
+  EXPECT_EQ((1 << 11) - 1, counter.load());
+}
+
+TEST(ThreadPoolTest, SingleThread) {
+  int sum = 0;
+  {
+    ThreadPool thread_pool(1);
+    for (int i = 1; i <= 100; ++i) {
+      thread_pool.Schedule([&sum, i] { sum += i; });
+    }
+  }
+  EXPECT_EQ(5050, sum);
+}
+
+TEST(ThreadPoolTest, DefaultNumThreadsIsPositive) {
+  EXPECT_LT(0, ThreadPool::DefaultNumThreads());
+}
+
+TEST(ParallelForTest, CallsEveryIndexOnce) {
+  ThreadPool thread_pool(4);
+  std::vector<std::atomic<int>> calls(1000);
+  for (std::atomic<int>& count : calls) count.store(0);
+  ParallelFor(&thread_pool, calls.size(), [&calls](int i) {
+    calls[i].fetch_add(1);
+  });
+  for (const std::atomic<int>& count : calls) EXPECT_EQ(1, count.load());
+}
+
+TEST(ParallelForTest, WithoutPool) {
+  std::vector<int> order;
+  ParallelFor(NULL, 5, [&order](int i) { order.push_back(i); });
+  EXPECT_EQ(std::vector<int>({0, 1, 2, 3, 4}), order);
+}
+
+// The only thread of the pool is busy running the caller, so the helpers never
+// get to run before ParallelFor returns.
+TEST(ParallelForTest, FromWithinPoolTask) {
+  std::atomic<int> sum(0);
+  {
+    ThreadPool thread_pool(1);
+    thread_pool.Schedule([&thread_pool, &sum] {
+      ParallelFor(&thread_pool, 100, [&sum](int i) { sum.fetch_add(i); });
+    });
+  }
+  EXPECT_EQ(4950, sum.load());
+}
+
+}  // namespace
+
+}  // namespace supersonic
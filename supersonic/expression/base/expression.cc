@@ -23,6 +23,7 @@ using std::make_unique;
 #include "supersonic/utils/exception/failureor.h"
 #include "supersonic/base/exception/exception.h"
 #include "supersonic/base/exception/exception_macros.h"
+#include "supersonic/expression/infrastructure/bound_expression_optimizer.h"
 #include "supersonic/proto/supersonic.pb.h"
 #include "supersonic/utils/strings/join.h"
 
@@ -39,9 +40,25 @@ set<string> BoundExpression::referred_attribute_names() const {
 
 // ----------------- BoundExpressionTree ---------------------------------------
 
+const rowcount_t BoundExpressionTree::kFusedEvaluationRowCount;
+const int BoundExpressionTree::kMinFusedEvaluationDepth;
+
 FailureOrVoid BoundExpressionTree::Init(BufferAllocator* allocator,
                                         rowcount_t max_row_count) {
   PROPAGATE_ON_FAILURE(skip_vector_storage_.TryReallocate(max_row_count));
+  PROPAGATE_ON_FAILURE(EliminateCommonSubexpressions(
+      allocator, max_row_count, &root_, &common_subexpressions_));
+  if (root_->elementwise_depth() >= kMinFusedEvaluationDepth &&
+      max_row_count > kFusedEvaluationRowCount) {
+    fused_result_.reset(new Block(result_schema(), allocator));
+    if (!fused_result_->Reallocate(max_row_count)) {
+      THROW(new Exception(
+          ERROR_MEMORY_EXCEEDED,
+          StrCat("Couldn't allocate the result block for expression: ",
+                 result_schema().GetHumanReadableSpecification())));
+    }
+    fused_result_copier_.reset(new ViewCopier(result_schema(), true));
+  }
   return Success();
 }
 
@@ -70,10 +87,52 @@ EvaluationResult BoundExpressionTree::Evaluate(const View& input) {
     bit_pointer::FillWithFalse(skip_vector_storage_.view().column(i),
                                input.row_count());
   }
-  EvaluationResult result =
-      root_->DoEvaluate(input, skip_vector_storage_.view());
-  PROPAGATE_ON_FAILURE(result);
-  return result;
+  if (fused_result_ == nullptr ||
+      input.row_count() <= kFusedEvaluationRowCount ||
+      input.selection() != NULL) {
+    EvaluationResult result =
+        EvaluateRoot(input, skip_vector_storage_.view());
+    PROPAGATE_ON_FAILURE(result);
+    return result;
+  }
+  return EvaluateFused(input);
+}
+
+EvaluationResult BoundExpressionTree::EvaluateRoot(
+    const View& input, const BoolView& skip_vectors) {
+  for (const auto& common_subexpression : common_subexpressions_) {
+    common_subexpression->Invalidate();
+  }
+  return root_->DoEvaluate(input, skip_vectors);
+}
+
+EvaluationResult BoundExpressionTree::EvaluateFused(const View& input) {
+  fused_result_->ResetArenas();
+  const int column_count = skip_vector_storage_.column_count();
+  BoolView skip_vectors(column_count);
+  for (rowcount_t offset = 0; offset < input.row_count();
+       offset += kFusedEvaluationRowCount) {
+    const rowcount_t row_count =
+        std::min(kFusedEvaluationRowCount, input.row_count() - offset);
+    const View input_rows(input, offset, row_count);
+    for (int i = 0; i < column_count; ++i) {
+      skip_vectors.ResetColumn(
+          i, skip_vector_storage_.view().column(i) + offset);
+    }
+    skip_vectors.set_row_count(row_count);
+    EvaluationResult result = EvaluateRoot(input_rows, skip_vectors);
+    PROPAGATE_ON_FAILURE(result);
+    if (fused_result_copier_->Copy(row_count, result.get(), offset,
+                                   fused_result_.get()) < row_count) {
+      THROW(new Exception(
+          ERROR_MEMORY_EXCEEDED,
+          StrCat("Couldn't copy the result of expression: ",
+                 result_schema().GetHumanReadableSpecification())));
+    }
+  }
+  fused_result_view_.ResetFrom(fused_result_->view());
+  fused_result_view_.set_row_count(input.row_count());
+  return Success(fused_result_view_);
 }
 
 rowcount_t BoundExpressionTree::row_capacity() const {
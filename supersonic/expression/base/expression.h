@@ -19,8 +19,9 @@
 #define SUPERSONIC_EXPRESSION_BASE_EXPRESSION_H_
 
 #include <set>
-
 #include "supersonic/utils/std_namespace.h"
+#include <vector>
+using std::vector;
 
 #include "supersonic/utils/macros.h"
 #include "supersonic/base/exception/result.h"
@@ -28,10 +29,13 @@
 #include "supersonic/base/infrastructure/block.h"
 #include "supersonic/base/infrastructure/tuple_schema.h"
 #include "supersonic/base/infrastructure/types.h"
+#include "supersonic/base/infrastructure/view_copier.h"
+#include "supersonic/expression/proto/operators.pb.h"
 #include "supersonic/utils/linked_ptr.h"
 
 namespace supersonic {
 class BufferAllocator;
+class CommonSubexpression;
 
 // Result of expression evaluation. A thin wrapper over a view, exposed
 // as a const reference.
@@ -63,6 +67,44 @@ class BoundExpression {
   // Null, or other such no-input, no-state, no-randomness type).
   virtual bool is_constant() const { return false; }
 
+  // An expression is element-wise if each row of its result depends only on
+  // the same row of the input, so that evaluating it on consecutive sub-ranges
+  // of the input, one after another, gives the same results as evaluating it
+  // on the whole input at once. Returns how deeply element-wise computations
+  // nest in the expression: 0 for inputs and constants, and one more than its
+  // deepest argument for an element-wise function. Returns -1 if the
+  // expression, or any of its arguments, is not known to be element-wise.
+  virtual int elementwise_depth() const { return -1; }
+
+  // For compiling the expression into native code (see
+  // supersonic/expression/jit/jit_expressions.h). If the expression applies
+  // the operator to the results of its arguments, one-attribute expressions
+  // each, the way the column computers do, sets op and arguments and returns
+  // true. Returns false otherwise (the default).
+  virtual bool DescribeOperation(
+      OperatorId* op, vector<BoundExpression*>* arguments) const {
+    return false;
+  }
+
+  // Likewise. If the expression is an attribute of the input, returns its
+  // position in the input schema; returns -1 otherwise (the default).
+  virtual int input_attribute_position() const { return -1; }
+
+  // Returns true if evaluating the expression may fail (e.g. on a division by
+  // zero), or does more than compute its result (e.g. updates a state), so
+  // that it must not be evaluated on any rows other than those it is asked
+  // to. True unless the expression knows otherwise.
+  virtual bool can_fail() const { return true; }
+
+  // For rewriting bound trees (see
+  // supersonic/expression/infrastructure/bound_expression_optimizer.h).
+  // Appends the arguments the expression owns and evaluates on its own input,
+  // so that they can be replaced with equivalent expressions (of the same
+  // result schema). Appends nothing by default, which keeps the arguments of
+  // the expression out of the rewriting.
+  virtual void AppendMutableArguments(
+      vector<unique_ptr<BoundExpression>*>* arguments) {}
+
   // Returns a set of input schema attribute names that the expression depends
   // on. To be more formal: returns a minimal set of attributes names that had
   // to exist in the input tupleschema of the expression for successful
@@ -97,11 +139,23 @@ class BoundExpressionTree {
                                BufferAllocator* allocator)
       : root_(std::move(root)),
         skip_vector_storage_(root_->result_schema().attribute_count(),
-                             allocator) {}
+                             allocator),
+        fused_result_view_(root_->result_schema()) {}
 
   // Prepares the tree for usage, allocating the necessary memory.
   FailureOrVoid Init(BufferAllocator* allocator, rowcount_t max_row_count);
 
+  // Deep element-wise trees (see BoundExpression::elementwise_depth()) are
+  // evaluated this many rows at a time, so that the intermediate results of
+  // the nested expressions stay in L1 cache from the moment they are computed
+  // until the parent reads them, rather than being streamed through memory a
+  // full block at a time. The result is copied into a block of the tree's own.
+  static const rowcount_t kFusedEvaluationRowCount = 256;
+
+  // Trees shallower than that materialize too few intermediate results to make
+  // up for copying the result, and are evaluated in one go.
+  static const int kMinFusedEvaluationDepth = 3;
+
   const TupleSchema& result_schema() const { return root_->result_schema(); }
 
   // Causes the expression tree to be evaluated on the specified input view.
@@ -124,10 +178,26 @@ class BoundExpressionTree {
   };
 
  private:
+  // Evaluates the tree kFusedEvaluationRowCount rows at a time, into
+  // fused_result_.
+  EvaluationResult EvaluateFused(const View& input);
+
+  // Evaluates the root on the input, invalidating the results of the common
+  // subexpressions computed for the previous one.
+  EvaluationResult EvaluateRoot(const View& input,
+                                const BoolView& skip_vectors);
+
   // The encapsulated BoundExpression.
   std::unique_ptr<BoundExpression> root_;
+  // The subexpressions shared by several places in the tree (see
+  // bound_expression_optimizer.h).
+  vector<std::shared_ptr<CommonSubexpression>> common_subexpressions_;
   // Pre-allocated skip vectors for evaluation (one for each output column).
   BoolBlock skip_vector_storage_;
+  // For fused evaluation; NULL if the tree is evaluated in one go.
+  std::unique_ptr<Block> fused_result_;
+  std::unique_ptr<ViewCopier> fused_result_copier_;
+  View fused_result_view_;
 
   DISALLOW_COPY_AND_ASSIGN(BoundExpressionTree);
 };
@@ -15,6 +15,12 @@
 
 #include "supersonic/expression/core/arithmetic_expressions.h"
 
+#include <memory>
+
+#include "supersonic/base/infrastructure/block.h"
+#include "supersonic/base/memory/memory.h"
+#include "supersonic/expression/base/expression.h"
+#include "supersonic/expression/core/projecting_expressions.h"
 #include "supersonic/proto/supersonic.pb.h"
 #include "supersonic/testing/block_builder.h"
 #include "supersonic/testing/expression_test_helper.h"
@@ -231,4 +237,43 @@ TEST(BinaryExpressionTest, ModulusSignaling) {
       .Build(), &ModulusSignaling);
 }
 
+// Deep trees are evaluated a few rows at a time, see BoundExpressionTree.
+TEST(BinaryExpressionTest, DeepTreeOnLargeInput) {
+  const int kRowCount = 1000;
+  BlockBuilder<INT64, INT64, INT64> builder;
+  for (int i = 0; i < kRowCount; ++i) {
+    if (i % 7 == 0) {
+      builder.AddRow(__, i, 1);
+    } else {
+      builder.AddRow(i, 2, 1);
+    }
+  }
+  std::unique_ptr<Block> block(builder.Build());
+  std::unique_ptr<const Expression> expression(
+      Negate(Plus(Multiply(AttributeAt(0), AttributeAt(1)), AttributeAt(2))));
+  FailureOrOwned<BoundExpression> bound = expression->DoBind(
+      block->schema(), HeapBufferAllocator::Get(), kRowCount);
+  ASSERT_TRUE(bound.is_success());
+  EXPECT_LE(BoundExpressionTree::kMinFusedEvaluationDepth,
+            bound->elementwise_depth());
+
+  FailureOrOwned<BoundExpressionTree> tree = expression->Bind(
+      block->schema(), HeapBufferAllocator::Get(), kRowCount);
+  ASSERT_TRUE(tree.is_success());
+  EvaluationResult result = tree->Evaluate(block->view());
+  ASSERT_TRUE(result.is_success());
+  const View& view = result.get();
+  ASSERT_EQ(kRowCount, view.row_count());
+  const int64_t* data = view.column(0).typed_data<INT64>();
+  bool_const_ptr is_null = view.column(0).is_null();
+  for (int i = 0; i < kRowCount; ++i) {
+    if (i % 7 == 0) {
+      EXPECT_TRUE(is_null[i]) << i;
+    } else {
+      EXPECT_FALSE(is_null[i]) << i;
+      EXPECT_EQ(-(2 * i + 1), data[i]) << i;
+    }
+  }
+}
+
 }  // namespace supersonic
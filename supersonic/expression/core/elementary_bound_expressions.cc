@@ -13,7 +13,10 @@
 // limitations under the License.
 //
 
+#include <algorithm>
 #include "supersonic/utils/std_namespace.h"
+#include <vector>
+using std::vector;
 
 #include <glog/logging.h>
 #include "supersonic/utils/logging-inl.h"
@@ -30,7 +33,9 @@
 #include "supersonic/base/memory/memory.h"
 #include "supersonic/expression/base/expression.h"
 #include "supersonic/expression/core/elementary_bound_expressions.h"
+#include "supersonic/expression/core/projecting_bound_expressions.h"
 #include "supersonic/expression/infrastructure/basic_bound_expression.h"
+#include "supersonic/expression/infrastructure/bound_expression_optimizer.h"
 #include "supersonic/expression/infrastructure/expression_utils.h"
 #include "supersonic/expression/infrastructure/terminal_expressions.h"
 #include "supersonic/expression/proto/operators.pb.h"
@@ -99,6 +104,12 @@ class BoundIsNullExpression : public BoundUnaryExpression {
     return Success(*my_view());
   }
 
+  virtual int elementwise_depth() const {
+    return ElementwiseDepthOf({ argument() });
+  }
+
+  virtual bool can_fail() const { return argument()->can_fail(); }
+
  private:
   virtual FailureOrVoid PostInit() {
     PROPAGATE_ON_FAILURE_WITH_CONTEXT(
@@ -224,6 +235,14 @@ class BoundIfNullExpression : public BoundBinaryExpression {
     return Success(*my_view());
   }
 
+  virtual int elementwise_depth() const {
+    return ElementwiseDepthOf({ left(), right() });
+  }
+
+  virtual bool can_fail() const {
+    return left()->can_fail() || right()->can_fail();
+  }
+
  private:
   typedef typename TypeTraits<type>::cpp_type CppType;
 
@@ -503,6 +522,14 @@ class BoundBooleanBinaryExpression : public BoundBinaryExpression {
     return Success();
   }
 
+  virtual int elementwise_depth() const {
+    return ElementwiseDepthOf({ left(), right() });
+  }
+
+  virtual bool can_fail() const {
+    return left()->can_fail() || right()->can_fail();
+  }
+
  private:
   inline bool_ptr left_skip_vector() {
     return local_skip_vector_storage_.view().column(0);
@@ -982,6 +1009,14 @@ class BoundIfExpression : public BoundTernaryExpression {
     return Success(*my_view());
   }
 
+  virtual int elementwise_depth() const {
+    return ElementwiseDepthOf({ left_.get(), middle_.get(), right_.get() });
+  }
+
+  virtual bool can_fail() const {
+    return left_->can_fail() || middle_->can_fail() || right_->can_fail();
+  }
+
  private:
   typedef typename TypeTraits<output_type>::cpp_type CppType;
 
@@ -1109,6 +1144,52 @@ FailureOrOwned<BoundExpression> BoundIfInternal(
   return Success(result.move());
 }
 
+// What a boolean operator amounts to, given one of its arguments.
+enum BooleanSimplification {
+  NOT_SIMPLIFIED,
+  ALWAYS_FALSE,
+  ALWAYS_TRUE,
+  OTHER_ARGUMENT,
+};
+
+// Generic.
+template<OperatorId op>
+BooleanSimplification SimplifyBooleanBinary(bool value, bool is_left) {
+  return NOT_SIMPLIFIED;
+}
+
+template<>
+BooleanSimplification SimplifyBooleanBinary<OPERATOR_OR>(bool value,
+                                                         bool is_left) {
+  return value ? ALWAYS_TRUE : OTHER_ARGUMENT;
+}
+
+template<>
+BooleanSimplification SimplifyBooleanBinary<OPERATOR_AND>(bool value,
+                                                          bool is_left) {
+  return value ? OTHER_ARGUMENT : ALWAYS_FALSE;
+}
+
+// left ANDNOT right is (NOT left) AND right.
+template<>
+BooleanSimplification SimplifyBooleanBinary<OPERATOR_AND_NOT>(bool value,
+                                                              bool is_left) {
+  if (is_left) return value ? ALWAYS_FALSE : OTHER_ARGUMENT;
+  return value ? NOT_SIMPLIFIED : ALWAYS_FALSE;
+}
+
+// Returns true if the expression is the constant TRUE or FALSE (and not NULL),
+// setting value.
+bool GetBooleanConstant(BoundExpression* expression, bool* value) {
+  if (!expression->is_constant()) return false;
+  bool is_null;
+  FailureOr<bool> result =
+      GetConstantBoundExpressionValue<BOOL>(expression, &is_null);
+  if (result.is_failure() || is_null) return false;
+  *value = result.get();
+  return true;
+}
+
 template <OperatorId op>
 FailureOrOwned<BoundExpression> BoundBooleanBinary(
     unique_ptr<BoundExpression> left,
@@ -1125,6 +1206,44 @@ FailureOrOwned<BoundExpression> BoundBooleanBinary(
   string description = BinaryExpressionTraits<op>::FormatBoundDescription(
       left->result_schema().attribute(0).name(), BOOL,
       right->result_schema().attribute(0).name(), BOOL, BOOL);
+
+  // If one of the arguments is TRUE or FALSE, the operator is either constant
+  // or the other argument (renamed, so that the result keeps its name). If
+  // both are constant, the operator is resolved to a constant in
+  // InitBasicExpression.
+  BooleanSimplification simplification = NOT_SIMPLIFIED;
+  unique_ptr<BoundExpression>* other_argument = NULL;
+  bool value;
+  if (!right->is_constant() && GetBooleanConstant(left.get(), &value)) {
+    simplification = SimplifyBooleanBinary<op>(value, true);
+    other_argument = &right;
+  } else if (!left->is_constant() && GetBooleanConstant(right.get(), &value)) {
+    simplification = SimplifyBooleanBinary<op>(value, false);
+    other_argument = &left;
+  }
+  switch (simplification) {
+    case NOT_SIMPLIFIED:
+      break;
+    case ALWAYS_FALSE:
+    case ALWAYS_TRUE: {
+      TupleSchema empty_schema;
+      return ConstBool(simplification == ALWAYS_TRUE)->DoBind(
+          empty_schema, allocator, row_capacity);
+    }
+    case OTHER_ARGUMENT:
+      return BoundAlias(description, std::move(*other_argument), allocator,
+                        row_capacity);
+  }
+
+  // AND is commutative, and its right argument is only evaluated on the rows
+  // where the left one isn't FALSE, so the cheaper argument goes first.
+  // Unless either argument can fail or has a state, since it would then be
+  // evaluated on other rows than before.
+  if (op == OPERATOR_AND && !left->can_fail() && !right->can_fail() &&
+      EstimateEvaluationCost(right.get()) <
+          EstimateEvaluationCost(left.get())) {
+    std::swap(left, right);
+  }
   bool output_is_nullable =
       left->result_schema().attribute(0).is_nullable() ||
       right->result_schema().attribute(0).is_nullable();
@@ -1363,6 +1482,20 @@ FailureOrOwned<BoundExpression> BoundIfNulling(
 FailureOrOwned<BoundExpression> BoundNot(unique_ptr<BoundExpression> arg,
                                          BufferAllocator *allocator,
                                          rowcount_t max_row_count) {
+  // NOT(NOT(x)) is x, renamed.
+  OperatorId arg_op;
+  vector<BoundExpression*> arg_arguments;
+  if (arg->DescribeOperation(&arg_op, &arg_arguments) &&
+      arg_op == OPERATOR_NOT) {
+    vector<unique_ptr<BoundExpression>*> mutable_arguments;
+    arg->AppendMutableArguments(&mutable_arguments);
+    CHECK_EQ(1, mutable_arguments.size());
+    string description = UnaryExpressionTraits<OPERATOR_NOT>::
+        FormatBoundDescription(arg->result_schema().attribute(0).name(),
+                               BOOL, BOOL);
+    return BoundAlias(description, std::move(*mutable_arguments[0]),
+                      allocator, max_row_count);
+  }
   return AbstractBoundUnary<OPERATOR_NOT, BOOL, BOOL>(std::move(arg), allocator,
                                                       max_row_count);
 }
@@ -70,6 +70,16 @@ class BoundInputProjectionExpression : public BoundExpression {
 
   bool is_constant() const { return false; }
 
+  virtual int elementwise_depth() const { return 0; }
+
+  virtual bool can_fail() const { return false; }
+
+  virtual int input_attribute_position() const {
+    return projector_->result_schema().attribute_count() == 1
+        ? projector_->source_attribute_position(0)
+        : -1;
+  }
+
   virtual void CollectReferredAttributeNames(
       set<string>* referred_attribute_names) const {
     const TupleSchema& input_schema = projector_->source_schema();
@@ -228,6 +238,20 @@ class BoundProjectionExpression : public BoundExpression {
 
   bool is_constant() const { return false; }
 
+  virtual bool can_fail() const {
+    for (int i = 0; i < arguments_->size(); ++i) {
+      if (arguments_->get(i)->can_fail()) return true;
+    }
+    return false;
+  }
+
+  virtual void AppendMutableArguments(
+      vector<unique_ptr<BoundExpression>*>* arguments) {
+    for (int i = 0; i < arguments_->size(); ++i) {
+      arguments->push_back(&(*arguments_)[i]);
+    }
+  }
+
   // Ignores whether the input is projected or not (because the input attribute
   // is still required to exists in the input schema).
   virtual void CollectReferredAttributeNames(
@@ -15,6 +15,7 @@
 
 #include "supersonic/expression/infrastructure/basic_bound_expression.h"
 
+#include <algorithm>
 #include <memory>
 #include <string>
 namespace supersonic {using std::string; }
@@ -138,6 +139,17 @@ BoundTernaryExpression::BoundTernaryExpression(const TupleSchema& schema,
   CHECK_EQ(right_type, GetExpressionType(right_.get()));
 }
 
+int ElementwiseDepthOf(
+    std::initializer_list<const BoundExpression*> arguments) {
+  int depth = 0;
+  for (const BoundExpression* argument : arguments) {
+    const int argument_depth = argument->elementwise_depth();
+    if (argument_depth < 0) return -1;
+    depth = std::max(depth, argument_depth + 1);
+  }
+  return depth;
+}
+
 template<DataType data_type>
 FailureOr<typename TypeTraits<data_type>::hold_type>
     GetConstantBoundExpressionValue(
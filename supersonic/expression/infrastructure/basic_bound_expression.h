@@ -20,6 +20,7 @@
 
 #include <algorithm>
 #include "supersonic/utils/std_namespace.h"
+#include <initializer_list>
 #include <memory>
 #include <set>
 #include "supersonic/utils/std_namespace.h"
@@ -90,6 +91,8 @@ class BasicBoundNoArgumentExpression : public BasicBoundExpression {
   // - as we resolve to constant expressions this would cause an infinite loop.
   bool can_be_resolved() const { return false; }
 
+  virtual int elementwise_depth() const { return 0; }
+
   virtual void CollectReferredAttributeNames(
         set<string>* referred_attribute_names) const {}
 
@@ -103,16 +106,20 @@ class BasicBoundConstExpression : public BasicBoundNoArgumentExpression {
                                      BufferAllocator* const allocator)
       : BasicBoundNoArgumentExpression(result_schema, allocator) {}
 
-  // Returns a pre-initialized pointer.
+  // Returns a pre-initialized pointer. The column is marked constant, so that
+  // the column computers can read the value once rather than every row.
   virtual EvaluationResult DoEvaluate(const View& input,
                                       const BoolView& skip_vectors) {
     DCHECK_LE(input.row_count(), my_block()->row_capacity());
     my_view()->set_row_count(input.row_count());
+    my_view()->mutable_column(0)->set_is_constant(true);
     return Success(*my_view());
   }
 
   bool is_constant() const { return true; }
 
+  virtual bool can_fail() const { return false; }
+
  private:
   DISALLOW_COPY_AND_ASSIGN(BasicBoundConstExpression);
 };
@@ -138,11 +145,16 @@ class BoundUnaryExpression : public BasicBoundExpression {
     arg_->CollectReferredAttributeNames(referred_attribute_names);
   }
 
+  virtual void AppendMutableArguments(
+      vector<unique_ptr<BoundExpression>*>* arguments) {
+    arguments->push_back(&arg_);
+  }
+
  protected:
   BoundExpression* const argument() const { return arg_.get(); }
 
  private:
-  const std::unique_ptr<BoundExpression> arg_;
+  std::unique_ptr<BoundExpression> arg_;
   DISALLOW_COPY_AND_ASSIGN(BoundUnaryExpression);
 };
 
@@ -173,13 +185,19 @@ class BoundBinaryExpression : public BasicBoundExpression {
     right_->CollectReferredAttributeNames(referred_attribute_names);
   }
 
+  virtual void AppendMutableArguments(
+      vector<unique_ptr<BoundExpression>*>* arguments) {
+    arguments->push_back(&left_);
+    arguments->push_back(&right_);
+  }
+
  protected:
   BoundExpression* const left() const { return left_.get(); }
   BoundExpression* const right() const { return right_.get(); }
 
  private:
-  const unique_ptr<BoundExpression> left_;
-  const unique_ptr<BoundExpression> right_;
+  unique_ptr<BoundExpression> left_;
+  unique_ptr<BoundExpression> right_;
   DISALLOW_COPY_AND_ASSIGN(BoundBinaryExpression);
 };
 
@@ -215,16 +233,30 @@ class BoundTernaryExpression : public BasicBoundExpression {
     right_->CollectReferredAttributeNames(referred_attribute_names);
   }
 
+  virtual void AppendMutableArguments(
+      vector<unique_ptr<BoundExpression>*>* arguments) {
+    arguments->push_back(&left_);
+    arguments->push_back(&middle_);
+    arguments->push_back(&right_);
+  }
+
  protected:
-  const unique_ptr<BoundExpression> left_;
-  const unique_ptr<BoundExpression> middle_;
-  const unique_ptr<BoundExpression> right_;
+  unique_ptr<BoundExpression> left_;
+  unique_ptr<BoundExpression> middle_;
+  unique_ptr<BoundExpression> right_;
 
   DISALLOW_COPY_AND_ASSIGN(BoundTernaryExpression);
 };
 
 // Convenience functions.
 
+// Returns the elementwise_depth() of an element-wise function of the given
+// arguments: one more than the deepest of them, or -1 if any of them is not
+// element-wise. For the element-wise expressions to override
+// elementwise_depth() with.
+int ElementwiseDepthOf(
+    std::initializer_list<const BoundExpression*> arguments);
+
 // Takes a constant valued bound and resolves it into a single value.
 // is_null is a pointer to a boolean value which will be set true if the
 // evaluation is a success and evaluates to null.
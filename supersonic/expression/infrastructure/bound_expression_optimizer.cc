@@ -0,0 +1,322 @@
+// Copyright 2012 Google Inc. All Rights Reserved.
+//
+// Licensed under the Apache License, Version 2.0 (the "License");
+// you may not use this file except in compliance with the License.
+// You may obtain a copy of the License at
+//
+//     http://www.apache.org/licenses/LICENSE-2.0
+//
+// Unless required by applicable law or agreed to in writing, software
+// distributed under the License is distributed on an "AS IS" BASIS,
+// WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+// See the License for the specific language governing permissions and
+// limitations under the License.
+//
+
+#include "supersonic/expression/infrastructure/bound_expression_optimizer.h"
+
+#include <map>
+#include <memory>
+#include "supersonic/utils/std_namespace.h"
+#include <string>
+using std::string;
+
+#include <glog/logging.h>
+#include "supersonic/utils/logging-inl.h"
+#include "supersonic/base/exception/exception.h"
+#include "supersonic/base/exception/exception_macros.h"
+#include "supersonic/base/infrastructure/block.h"
+#include "supersonic/base/infrastructure/tuple_schema.h"
+#include "supersonic/expression/infrastructure/expression_utils.h"
+#include "supersonic/expression/vector/vector_logic.h"
+#include "supersonic/utils/strings/strcat.h"
+
+namespace supersonic {
+
+namespace {
+
+// The cost of an expression that hides its arguments, so that nothing is
+// known about it.
+const int kOpaqueExpressionCost = 16;
+
+// The cost of computing a STRING or BINARY value, relative to a fixed-size one.
+const int kVariableLengthResultCost = 4;
+
+// A place in the tree where a common subexpression appears.
+class BoundCommonSubexpression : public BoundExpression {
+ public:
+  explicit BoundCommonSubexpression(
+      std::shared_ptr<CommonSubexpression> common_subexpression)
+      : BoundExpression(common_subexpression->expression()->result_schema()),
+        common_subexpression_(std::move(common_subexpression)) {}
+
+  virtual EvaluationResult DoEvaluate(const View& input,
+                                      const BoolView& skip_vectors) {
+    CHECK_EQ(1, skip_vectors.column_count());
+    EvaluationResult result =
+        common_subexpression_->Evaluate(input, skip_vectors.column(0));
+    PROPAGATE_ON_FAILURE(result);
+    my_view()->ResetFrom(result.get());
+    my_view()->mutable_column(0)->ResetIsNull(skip_vectors.column(0));
+    return Success(*my_view());
+  }
+
+  virtual rowcount_t row_capacity() const {
+    return expression()->row_capacity();
+  }
+
+  virtual int elementwise_depth() const {
+    return expression()->elementwise_depth();
+  }
+
+  virtual bool can_fail() const { return expression()->can_fail(); }
+
+  virtual void CollectReferredAttributeNames(
+      set<string>* referred_attribute_names) const {
+    expression()->CollectReferredAttributeNames(referred_attribute_names);
+  }
+
+ private:
+  BoundExpression* expression() const {
+    return common_subexpression_->expression();
+  }
+
+  const std::shared_ptr<CommonSubexpression> common_subexpression_;
+  DISALLOW_COPY_AND_ASSIGN(BoundCommonSubexpression);
+};
+
+// Identifies the value of a constant expression; empty if it can't be
+// evaluated.
+string ConstantSignature(BoundExpression* expression) {
+  small_bool_array skip_array;
+  *(skip_array.mutable_data()) = false;
+  TupleSchema schema;
+  View view(schema);
+  view.set_row_count(1);
+  BoolView skip_vectors(skip_array.mutable_data());
+  skip_vectors.set_row_count(1);
+  EvaluationResult result = expression->DoEvaluate(view, skip_vectors);
+  if (result.is_failure() || result.get().row_count() != 1) return "";
+  const Column& column = result.get().column(0);
+  string signature = StrCat("#", column.type_info().name(), ":");
+  if (*(skip_array.mutable_data())) {
+    signature.append("NULL");
+  } else if (column.type_info().is_variable_length()) {
+    const StringPiece& value = column.variable_length_data()[0];
+    StrAppend(&signature, value.size(), ":");
+    signature.append(value.data(), value.size());
+  } else {
+    signature.append(static_cast<const char*>(column.data().raw()),
+                     column.type_info().size());
+  }
+  return signature;
+}
+
+typedef map<const BoundExpression*, string> SignatureMap;
+
+// Fills in the signatures of the expression and everything below it,
+// identifying what they compute. The signature is empty unless the
+// expression is an input attribute, a constant, or an operator on these (see
+// BoundExpression::DescribeOperation()), recursively. Returns the signature of
+// the expression.
+const string& CollectSignatures(BoundExpression* expression,
+                                SignatureMap* signatures) {
+  vector<unique_ptr<BoundExpression>*> arguments;
+  expression->AppendMutableArguments(&arguments);
+  vector<string> argument_signatures;
+  for (unique_ptr<BoundExpression>* argument : arguments) {
+    argument_signatures.push_back(
+        CollectSignatures(argument->get(), signatures));
+  }
+  string& signature = (*signatures)[expression];
+  OperatorId op;
+  vector<BoundExpression*> described_arguments;
+  if (expression->input_attribute_position() >= 0) {
+    signature = StrCat("$", expression->input_attribute_position());
+  } else if (expression->is_constant()) {
+    signature = ConstantSignature(expression);
+  } else if (expression->result_schema().attribute_count() == 1 &&
+             expression->DescribeOperation(&op, &described_arguments) &&
+             described_arguments.size() == arguments.size()) {
+    signature = StrCat(static_cast<int>(op), ":",
+                       static_cast<int>(GetExpressionType(expression)), "(");
+    for (int i = 0; i < arguments.size(); ++i) {
+      if (described_arguments[i] != arguments[i]->get() ||
+          argument_signatures[i].empty()) {
+        signature.clear();
+        break;
+      }
+      StrAppend(&signature, argument_signatures[i].size(), ":",
+                argument_signatures[i]);
+    }
+    if (!signature.empty()) signature.append(")");
+  }
+  return signature;
+}
+
+// Returns the signature of the expression if it is worth sharing; empty
+// otherwise. Variable-length results aren't shared, since evaluating the
+// expression again would reset the arenas holding the earlier ones.
+string SharingSignature(BoundExpression* expression,
+                        const SignatureMap& signatures) {
+  SignatureMap::const_iterator signature = signatures.find(expression);
+  if (signature == signatures.end() || signature->second.empty() ||
+      expression->input_attribute_position() >= 0 ||
+      expression->is_constant() ||
+      GetTypeInfo(GetExpressionType(expression)).is_variable_length()) {
+    return "";
+  }
+  return signature->second;
+}
+
+// Counts how many times each subexpression worth sharing appears in the tree,
+// not counting the subexpressions of its repetitions (which go away).
+void CountOccurrences(BoundExpression* expression,
+                      const SignatureMap& signatures,
+                      map<string, int>* occurrences) {
+  const string signature = SharingSignature(expression, signatures);
+  if (!signature.empty() && ++(*occurrences)[signature] > 1) return;
+  vector<unique_ptr<BoundExpression>*> arguments;
+  expression->AppendMutableArguments(&arguments);
+  for (unique_ptr<BoundExpression>* argument : arguments) {
+    CountOccurrences(argument->get(), signatures, occurrences);
+  }
+}
+
+class CommonSubexpressionEliminator {
+ public:
+  CommonSubexpressionEliminator(
+      BufferAllocator* allocator,
+      rowcount_t max_row_count,
+      const SignatureMap& signatures,
+      const map<string, int>& occurrences,
+      vector<std::shared_ptr<CommonSubexpression>>* common_subexpressions)
+      : allocator_(allocator),
+        max_row_count_(max_row_count),
+        signatures_(signatures),
+        occurrences_(occurrences),
+        common_subexpressions_(common_subexpressions) {}
+
+  // Visits the tree in the same order as CountOccurrences().
+  FailureOrVoid Rewrite(unique_ptr<BoundExpression>* expression) {
+    BoundExpression* const original = expression->get();
+    const string signature = SharingSignature(original, signatures_);
+    if (!signature.empty() && occurrences_.find(signature)->second > 1) {
+      std::shared_ptr<CommonSubexpression>& shared = shared_[signature];
+      if (shared != nullptr) {
+        // A repetition.
+        expression->reset(new BoundCommonSubexpression(shared));
+        return Success();
+      }
+      shared.reset(new CommonSubexpression(std::move(*expression),
+                                           allocator_));
+      PROPAGATE_ON_FAILURE(shared->Init(max_row_count_));
+      common_subexpressions_->push_back(shared);
+      expression->reset(new BoundCommonSubexpression(shared));
+    }
+    vector<unique_ptr<BoundExpression>*> arguments;
+    original->AppendMutableArguments(&arguments);
+    for (unique_ptr<BoundExpression>* argument : arguments) {
+      PROPAGATE_ON_FAILURE(Rewrite(argument));
+    }
+    return Success();
+  }
+
+ private:
+  BufferAllocator* const allocator_;
+  const rowcount_t max_row_count_;
+  const SignatureMap& signatures_;
+  const map<string, int>& occurrences_;
+  map<string, std::shared_ptr<CommonSubexpression>> shared_;
+  vector<std::shared_ptr<CommonSubexpression>>* const common_subexpressions_;
+  DISALLOW_COPY_AND_ASSIGN(CommonSubexpressionEliminator);
+};
+
+}  // namespace
+
+int EstimateEvaluationCost(BoundExpression* expression) {
+  if (expression->is_constant() ||
+      expression->input_attribute_position() >= 0) {
+    return 0;
+  }
+  vector<unique_ptr<BoundExpression>*> arguments;
+  expression->AppendMutableArguments(&arguments);
+  if (arguments.empty()) return kOpaqueExpressionCost;
+  int cost = 0;
+  const TupleSchema& schema = expression->result_schema();
+  for (int i = 0; i < schema.attribute_count(); ++i) {
+    cost += GetTypeInfo(schema.attribute(i).type()).is_variable_length()
+        ? kVariableLengthResultCost : 1;
+  }
+  for (unique_ptr<BoundExpression>* argument : arguments) {
+    cost += EstimateEvaluationCost(argument->get());
+  }
+  return cost;
+}
+
+CommonSubexpression::CommonSubexpression(
+    unique_ptr<BoundExpression> expression,
+    BufferAllocator* allocator)
+    : expression_(std::move(expression)),
+      skip_vector_storage_(3, allocator),
+      skip_vectors_(1),
+      is_valid_(false),
+      result_(expression_->result_schema()) {
+  CHECK_EQ(1, expression_->result_schema().attribute_count());
+}
+
+FailureOrVoid CommonSubexpression::Init(rowcount_t max_row_count) {
+  PROPAGATE_ON_FAILURE(skip_vector_storage_.TryReallocate(max_row_count));
+  return Success();
+}
+
+EvaluationResult CommonSubexpression::Evaluate(const View& input,
+                                               bool_ptr skip_vector) {
+  const rowcount_t row_count = input.row_count();
+  bool must_evaluate = !is_valid_;
+  if (!is_valid_) {
+    bit_pointer::FillFrom(requested_skip_vector(), skip_vector, row_count);
+  } else {
+    DCHECK_EQ(result_.row_count(), row_count);
+    vector_logic::AndNot(skip_vector, requested_skip_vector(), row_count,
+                         missing_rows());
+    if (bit_pointer::PopCount(missing_rows(), row_count) > 0) {
+      vector_logic::And(requested_skip_vector(), skip_vector, row_count,
+                        requested_skip_vector());
+      must_evaluate = true;
+    }
+  }
+  if (must_evaluate) {
+    is_valid_ = false;
+    bit_pointer::FillFrom(evaluated_skip_vector(), requested_skip_vector(),
+                          row_count);
+    skip_vectors_.ResetColumn(0, evaluated_skip_vector());
+    skip_vectors_.set_row_count(row_count);
+    EvaluationResult result = expression_->DoEvaluate(input, skip_vectors_);
+    PROPAGATE_ON_FAILURE(result);
+    result_.ResetFrom(result.get());
+    is_valid_ = true;
+  }
+  // The rows requested are a subset of those skipped now, so this only adds
+  // the NULLs in the result.
+  vector_logic::Or(skip_vector, evaluated_skip_vector(), row_count,
+                   skip_vector);
+  return Success(result_);
+}
+
+FailureOrVoid EliminateCommonSubexpressions(
+    BufferAllocator* allocator,
+    rowcount_t max_row_count,
+    unique_ptr<BoundExpression>* root,
+    vector<std::shared_ptr<CommonSubexpression>>* common_subexpressions) {
+  SignatureMap signatures;
+  CollectSignatures(root->get(), &signatures);
+  map<string, int> occurrences;
+  CountOccurrences(root->get(), signatures, &occurrences);
+  CommonSubexpressionEliminator eliminator(allocator, max_row_count,
+                                           signatures, occurrences,
+                                           common_subexpressions);
+  return eliminator.Rewrite(root);
+}
+
+}  // namespace supersonic
@@ -0,0 +1,111 @@
+// Copyright 2012 Google Inc. All Rights Reserved.
+//
+// Licensed under the Apache License, Version 2.0 (the "License");
+// you may not use this file except in compliance with the License.
+// You may obtain a copy of the License at
+//
+//     http://www.apache.org/licenses/LICENSE-2.0
+//
+// Unless required by applicable law or agreed to in writing, software
+// distributed under the License is distributed on an "AS IS" BASIS,
+// WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+// See the License for the specific language governing permissions and
+// limitations under the License.
+//
+// Bind-time rewriting of bound expression trees.
+//
+// Most of it happens as the tree is built, bottom-up: constant subtrees are
+// resolved to constants (see InitBasicExpression), and the boolean operators
+// simplify themselves when an argument is constant, and put the cheaper of
+// their arguments first (see elementary_bound_expressions.cc). What needs the
+// whole tree happens when the tree is created (see BoundExpressionTree):
+// identical subexpressions are evaluated once, their result shared by all the
+// places they appear in.
+
+#ifndef SUPERSONIC_EXPRESSION_INFRASTRUCTURE_BOUND_EXPRESSION_OPTIMIZER_H_
+#define SUPERSONIC_EXPRESSION_INFRASTRUCTURE_BOUND_EXPRESSION_OPTIMIZER_H_
+
+#include <memory>
+#include "supersonic/utils/std_namespace.h"
+#include <vector>
+using std::vector;
+
+#include "supersonic/utils/macros.h"
+#include "supersonic/base/exception/result.h"
+#include "supersonic/base/infrastructure/bit_pointers.h"
+#include "supersonic/base/infrastructure/types.h"
+#include "supersonic/expression/base/expression.h"
+
+namespace supersonic {
+
+class BufferAllocator;
+
+// A rough estimate of the cost of evaluating the expression, per row,
+// including its arguments, in units of a simple arithmetic operation. For
+// choosing which of two expressions to evaluate first; not meant to be
+// accurate.
+int EstimateEvaluationCost(BoundExpression* expression);
+
+// A subexpression shared by several places in a tree. Evaluated at most once
+// per evaluation of the tree, on all the rows needed at any of these places,
+// unless some place needs rows that the previous ones didn't; then it is
+// evaluated again on all of them (with the same results for the rows already
+// computed, since the subexpression is a pure function of its input).
+class CommonSubexpression {
+ public:
+  // Takes ownership of the expression.
+  CommonSubexpression(unique_ptr<BoundExpression> expression,
+                      BufferAllocator* allocator);
+
+  FailureOrVoid Init(rowcount_t max_row_count);
+
+  // Must be called whenever the tree is evaluated on another input.
+  void Invalidate() { is_valid_ = false; }
+
+  // Evaluates the expression, skipping the rows set in the skip vector, or
+  // returns its result if it has already been evaluated on all the rows that
+  // aren't. Sets the skip vector where the result is NULL, as
+  // BoundExpression::DoEvaluate does.
+  EvaluationResult Evaluate(const View& input, bool_ptr skip_vector);
+
+  BoundExpression* expression() const { return expression_.get(); }
+
+ private:
+  inline bool_ptr requested_skip_vector() {
+    return skip_vector_storage_.view().column(0);
+  }
+  inline bool_ptr evaluated_skip_vector() {
+    return skip_vector_storage_.view().column(1);
+  }
+  inline bool_ptr missing_rows() {
+    return skip_vector_storage_.view().column(2);
+  }
+
+  const unique_ptr<BoundExpression> expression_;
+  // The rows the expression was last evaluated on (as a skip vector), the skip
+  // vector it was evaluated with (that it has set where the result is NULL),
+  // and space for finding the rows it wasn't evaluated on.
+  BoolBlock skip_vector_storage_;
+  BoolView skip_vectors_;
+  bool is_valid_;
+  View result_;
+  DISALLOW_COPY_AND_ASSIGN(CommonSubexpression);
+};
+
+// Replaces every subexpression of the tree that appears in it more than once
+// with a reference to a CommonSubexpression, appended to
+// common_subexpressions, which the caller must invalidate before each
+// evaluation of the tree. The subexpressions considered are the operators that
+// describe themselves (see BoundExpression::DescribeOperation()), on input
+// attributes and constants only; subtrees of expressions that don't expose
+// their arguments (see BoundExpression::AppendMutableArguments()) are left
+// alone.
+FailureOrVoid EliminateCommonSubexpressions(
+    BufferAllocator* allocator,
+    rowcount_t max_row_count,
+    unique_ptr<BoundExpression>* root,
+    vector<std::shared_ptr<CommonSubexpression>>* common_subexpressions);
+
+}  // namespace supersonic
+
+#endif  // SUPERSONIC_EXPRESSION_INFRASTRUCTURE_BOUND_EXPRESSION_OPTIMIZER_H_
@@ -0,0 +1,252 @@
+// Copyright 2012 Google Inc. All Rights Reserved.
+//
+// Licensed under the Apache License, Version 2.0 (the "License");
+// you may not use this file except in compliance with the License.
+// You may obtain a copy of the License at
+//
+//     http://www.apache.org/licenses/LICENSE-2.0
+//
+// Unless required by applicable law or agreed to in writing, software
+// distributed under the License is distributed on an "AS IS" BASIS,
+// WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+// See the License for the specific language governing permissions and
+// limitations under the License.
+//
+
+#include "supersonic/expression/infrastructure/bound_expression_optimizer.h"
+
+#include <functional>
+#include <memory>
+#include <vector>
+using std::vector;
+
+#include "supersonic/base/infrastructure/block.h"
+#include "supersonic/base/memory/memory.h"
+#include "supersonic/expression/base/expression.h"
+#include "supersonic/expression/core/arithmetic_expressions.h"
+#include "supersonic/expression/core/comparison_expressions.h"
+#include "supersonic/expression/core/elementary_expressions.h"
+#include "supersonic/expression/core/projecting_expressions.h"
+#include "supersonic/expression/infrastructure/terminal_expressions.h"
+#include "supersonic/testing/block_builder.h"
+#include "supersonic/testing/comparators.h"
+#include "gtest/gtest.h"
+
+namespace supersonic {
+
+namespace {
+
+class BoundExpressionOptimizerTest : public testing::Test {
+ protected:
+  virtual void SetUp() {
+    BlockBuilder<INT64, INT64, BOOL> builder;
+    for (int i = 0; i < 1000; ++i) {
+      if (i % 7 == 0) {
+        builder.AddRow(__, i % 13 - 6, i % 3 == 0);
+      } else if (i % 11 == 0) {
+        builder.AddRow(i, __, __);
+      } else {
+        builder.AddRow(i - 500, i % 13 - 6, i % 5 == 0);
+      }
+    }
+    block_ = builder.Build();
+  }
+
+  unique_ptr<BoundExpression> DoBind(unique_ptr<const Expression> expression) {
+    FailureOrOwned<BoundExpression> bound = expression->DoBind(
+        block_->schema(), HeapBufferAllocator::Get(), 1000);
+    CHECK(bound.is_success());
+    return bound.move();
+  }
+
+  unique_ptr<BoundExpressionTree> Bind(
+      unique_ptr<const Expression> expression) {
+    FailureOrOwned<BoundExpressionTree> bound = expression->Bind(
+        block_->schema(), HeapBufferAllocator::Get(), 1000);
+    CHECK(bound.is_success());
+    return bound.move();
+  }
+
+  // Expects each of the attributes computed by the compound expression to be
+  // the same as the corresponding expression evaluated on its own, i.e.
+  // without sharing anything with the other ones.
+  void ExpectSameAsUnshared(
+      unique_ptr<const Expression> compound,
+      const vector<std::function<unique_ptr<const Expression>()>>& parts) {
+    unique_ptr<BoundExpressionTree> shared = Bind(std::move(compound));
+    // Also on a view that doesn't start at the beginning of the block.
+    for (int offset : { 0, 3 }) {
+      View input(block_->view(), offset, block_->view().row_count() - offset);
+      EvaluationResult result = shared->Evaluate(input);
+      ASSERT_TRUE(result.is_success());
+      ASSERT_EQ(parts.size(), result.get().column_count());
+      for (int i = 0; i < parts.size(); ++i) {
+        const Column& column = result.get().column(i);
+        unique_ptr<BoundExpressionTree> unshared =
+            Bind(Alias(column.attribute().name(), parts[i]()));
+        EvaluationResult expected = unshared->Evaluate(input);
+        ASSERT_TRUE(expected.is_success());
+        EXPECT_VIEWS_EQUAL(expected.get(), View(column, input.row_count()));
+      }
+    }
+  }
+
+  unique_ptr<Block> block_;
+};
+
+TEST_F(BoundExpressionOptimizerTest, EstimatesCostFromTheTreeSize) {
+  EXPECT_EQ(0, EstimateEvaluationCost(DoBind(AttributeAt(0)).get()));
+  EXPECT_EQ(0, EstimateEvaluationCost(DoBind(ConstInt64(3)).get()));
+  const int sum_cost = EstimateEvaluationCost(
+      DoBind(Plus(AttributeAt(0), AttributeAt(1))).get());
+  EXPECT_LT(0, sum_cost);
+  EXPECT_LT(sum_cost, EstimateEvaluationCost(
+      DoBind(Multiply(Plus(AttributeAt(0), AttributeAt(1)),
+                      AttributeAt(0))).get()));
+}
+
+TEST_F(BoundExpressionOptimizerTest, SharesRepeatedSubexpressions) {
+  unique_ptr<BoundExpressionTree> tree = Bind(unique_ptr<const Expression>(
+      (new CompoundExpression)
+          ->AddAs("x", Multiply(AttributeAt(0), AttributeAt(1)))
+          ->AddAs("y", Multiply(AttributeAt(0), AttributeAt(1)))));
+  EvaluationResult result = tree->Evaluate(block_->view());
+  ASSERT_TRUE(result.is_success());
+  EXPECT_EQ(result.get().column(0).data().raw(),
+            result.get().column(1).data().raw());
+  EXPECT_EQ("x", result.get().column(0).attribute().name());
+  EXPECT_EQ("y", result.get().column(1).attribute().name());
+}
+
+TEST_F(BoundExpressionOptimizerTest, DoesNotShareDifferentSubexpressions) {
+  unique_ptr<BoundExpressionTree> tree = Bind(unique_ptr<const Expression>(
+      (new CompoundExpression)
+          ->AddAs("x", Multiply(AttributeAt(0), AttributeAt(1)))
+          ->AddAs("y", Multiply(AttributeAt(1), AttributeAt(0)))
+          ->AddAs("z", Multiply(AttributeAt(0), ConstInt64(1)))));
+  EvaluationResult result = tree->Evaluate(block_->view());
+  ASSERT_TRUE(result.is_success());
+  EXPECT_NE(result.get().column(0).data().raw(),
+            result.get().column(1).data().raw());
+  EXPECT_NE(result.get().column(0).data().raw(),
+            result.get().column(2).data().raw());
+}
+
+TEST_F(BoundExpressionOptimizerTest, SharedOnDifferentRows) {
+  // The product is needed first where col1 > 2, then wherever the results are
+  // NULL, then everywhere.
+  ExpectSameAsUnshared(
+      unique_ptr<const Expression>(
+          (new CompoundExpression)
+              ->AddAs("x", If(Greater(AttributeAt(1), ConstInt64(2)),
+                              Multiply(AttributeAt(0), AttributeAt(1)),
+                              ConstInt64(0)))
+              ->AddAs("y", IfNull(Multiply(AttributeAt(0), AttributeAt(1)),
+                                  Negate(AttributeAt(0))))
+              ->AddAs("z", Multiply(AttributeAt(0), AttributeAt(1)))),
+      { []() {
+          return If(Greater(AttributeAt(1), ConstInt64(2)),
+                    Multiply(AttributeAt(0), AttributeAt(1)),
+                    ConstInt64(0));
+        },
+        []() {
+          return IfNull(Multiply(AttributeAt(0), AttributeAt(1)),
+                        Negate(AttributeAt(0)));
+        },
+        []() { return Multiply(AttributeAt(0), AttributeAt(1)); } });
+}
+
+TEST_F(BoundExpressionOptimizerTest, SharedOnlyOnRowsGuarded) {
+  // Neither of the places the division appears in needs it where col1 is 0, so
+  // it mustn't fail there when shared either.
+  ExpectSameAsUnshared(
+      unique_ptr<const Expression>(
+          (new CompoundExpression)
+              ->AddAs("x", If(Greater(AttributeAt(1), ConstInt64(0)),
+                              DivideSignaling(AttributeAt(0), AttributeAt(1)),
+                              ConstDouble(0)))
+              ->AddAs("y", If(Less(AttributeAt(1), ConstInt64(0)),
+                              DivideSignaling(AttributeAt(0), AttributeAt(1)),
+                              ConstDouble(1)))),
+      { []() {
+          return If(Greater(AttributeAt(1), ConstInt64(0)),
+                    DivideSignaling(AttributeAt(0), AttributeAt(1)),
+                    ConstDouble(0));
+        },
+        []() {
+          return If(Less(AttributeAt(1), ConstInt64(0)),
+                    DivideSignaling(AttributeAt(0), AttributeAt(1)),
+                    ConstDouble(1));
+        } });
+}
+
+TEST_F(BoundExpressionOptimizerTest, SimplifiesBooleanOperatorsOnConstants) {
+  const rowcount_t row_count = block_->view().row_count();
+  const Column& attribute = block_->view().column(2);
+  for (unique_ptr<const Expression> (*op)(unique_ptr<const Expression>,
+                                          unique_ptr<const Expression>) :
+           { &And, &Or }) {
+    for (bool value : { false, true }) {
+      for (bool left : { false, true }) {
+        unique_ptr<BoundExpressionTree> simplified = Bind(
+            left ? op(ConstBool(value), AttributeAt(2))
+                 : op(AttributeAt(2), ConstBool(value)));
+        EvaluationResult result = simplified->Evaluate(block_->view());
+        ASSERT_TRUE(result.is_success());
+        const Column& column = result.get().column(0);
+        if (value == (op == &Or)) {
+          for (int i = 0; i < row_count; ++i) {
+            EXPECT_FALSE(column.is_null() != NULL && column.is_null()[i]);
+            EXPECT_EQ(value, column.typed_data<BOOL>()[i]);
+          }
+        } else {
+          // Named as if it weren't simplified.
+          const string& name = column.attribute().name();
+          EXPECT_TRUE(name.find(" AND ") != string::npos ||
+                      name.find(" OR ") != string::npos) << name;
+          EXPECT_COLUMNS_EQUAL(attribute, column, row_count);
+        }
+      }
+    }
+  }
+}
+
+TEST_F(BoundExpressionOptimizerTest, SimplifiesDoubleNegation) {
+  unique_ptr<BoundExpressionTree> tree = Bind(Not(Not(AttributeAt(2))));
+  EvaluationResult result = tree->Evaluate(block_->view());
+  ASSERT_TRUE(result.is_success());
+  EXPECT_EQ("(NOT (NOT col2))", result.get().column(0).attribute().name());
+  EXPECT_COLUMNS_EQUAL(block_->view().column(2), result.get().column(0),
+                       block_->view().row_count());
+}
+
+TEST_F(BoundExpressionOptimizerTest, AndEvaluatesCheaperArgumentFirst) {
+  // Same results whichever argument is evaluated first.
+  unique_ptr<BoundExpressionTree> tree = Bind(
+      And(Less(Plus(AttributeAt(0), AttributeAt(1)), ConstInt64(100)),
+          AttributeAt(2)));
+  EvaluationResult result = tree->Evaluate(block_->view());
+  ASSERT_TRUE(result.is_success());
+  const View& input = block_->view();
+  const Column& column = result.get().column(0);
+  for (int i = 0; i < input.row_count(); ++i) {
+    const bool left_is_null =
+        input.column(0).is_null()[i] || input.column(1).is_null()[i];
+    const bool left = !left_is_null &&
+        input.column(0).typed_data<INT64>()[i] +
+        input.column(1).typed_data<INT64>()[i] < 100;
+    const bool right_is_null = input.column(2).is_null()[i];
+    const bool right = !right_is_null && input.column(2).typed_data<BOOL>()[i];
+    const bool is_false = (!left_is_null && !left) ||
+                          (!right_is_null && !right);
+    const bool is_null = !is_false && (left_is_null || right_is_null);
+    ASSERT_EQ(is_null, column.is_null()[i]) << "row " << i;
+    if (!is_null) {
+      EXPECT_EQ(!is_false, column.typed_data<BOOL>()[i]) << "row " << i;
+    }
+  }
+}
+
+}  // namespace
+
+}  // namespace supersonic
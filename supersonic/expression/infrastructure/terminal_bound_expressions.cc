@@ -53,6 +53,7 @@ class BoundNullExpression : public BasicBoundNoArgumentExpression {
 
   virtual bool is_constant() const { return true; }
   virtual bool can_be_resolved() const { return false; }
+  virtual bool can_fail() const { return false; }
   virtual rowcount_t row_capacity() const {
     return std::numeric_limits<rowcount_t>::max();
   }
@@ -0,0 +1,745 @@
+// Copyright 2012 Google Inc. All Rights Reserved.
+//
+// Licensed under the Apache License, Version 2.0 (the "License");
+// you may not use this file except in compliance with the License.
+// You may obtain a copy of the License at
+//
+//     http://www.apache.org/licenses/LICENSE-2.0
+//
+// Unless required by applicable law or agreed to in writing, software
+// distributed under the License is distributed on an "AS IS" BASIS,
+// WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+// See the License for the specific language governing permissions and
+// limitations under the License.
+//
+
+#include "supersonic/expression/jit/jit_expressions.h"
+
+#include <string.h>
+
+#include <algorithm>
+#include <map>
+#include <memory>
+#include <mutex>
+#include <set>
+#include "supersonic/utils/std_namespace.h"
+#include <string>
+using std::string;
+#include <vector>
+using std::vector;
+
+#include <glog/logging.h>
+#include "supersonic/utils/logging-inl.h"
+#include "supersonic/utils/macros.h"
+#include "supersonic/base/exception/exception.h"
+#include "supersonic/base/exception/exception_macros.h"
+#include "supersonic/base/infrastructure/block.h"
+#include "supersonic/base/infrastructure/types_infrastructure.h"
+#include "supersonic/expression/infrastructure/basic_bound_expression.h"
+#include "supersonic/expression/infrastructure/expression_utils.h"
+#include "supersonic/expression/proto/operators.pb.h"
+#include "supersonic/expression/vector/vector_logic.h"
+#include "supersonic/utils/strings/strcat.h"
+
+#include "llvm/ExecutionEngine/Orc/JITTargetMachineBuilder.h"
+#include "llvm/ExecutionEngine/Orc/LLJIT.h"
+#include "llvm/ExecutionEngine/Orc/ThreadSafeModule.h"
+#include "llvm/IR/IRBuilder.h"
+#include "llvm/IR/LLVMContext.h"
+#include "llvm/IR/Module.h"
+#include "llvm/IR/Verifier.h"
+#include "llvm/Passes/PassBuilder.h"
+#include "llvm/Support/TargetSelect.h"
+#include "llvm/Support/raw_ostream.h"
+#include "llvm/Target/TargetMachine.h"
+
+namespace supersonic {
+
+namespace {
+
+// The compiled code. Computes row_count rows of the result from the data of
+// the columns read (see JitPlan).
+typedef void (*JitFunction)(const void* const* columns,
+                            void* result,
+                            int64_t row_count);
+
+bool IsSupportedType(DataType type) {
+  switch (type) {
+    case INT32:
+    case INT64:
+    case UINT32:
+    case UINT64:
+    case FLOAT:
+    case DOUBLE:
+    case BOOL:
+      return true;
+    default:
+      return false;
+  }
+}
+
+bool IsFloatingPoint(DataType type) { return type == FLOAT || type == DOUBLE; }
+
+bool IsSigned(DataType type) {
+  return type == INT32 || type == INT64 || IsFloatingPoint(type);
+}
+
+// Whether the code generator implements the operator, for the types given.
+// Assumes the types are supported.
+bool IsSupportedOperation(OperatorId op,
+                          DataType result_type,
+                          const vector<DataType>& argument_types) {
+  switch (op) {
+    case OPERATOR_ADD:
+    case OPERATOR_SUBTRACT:
+    case OPERATOR_MULTIPLY:
+      return argument_types.size() == 2 && result_type != BOOL &&
+          argument_types[0] == result_type && argument_types[1] == result_type;
+    case OPERATOR_NEGATE:
+      return argument_types.size() == 1 && IsSigned(result_type) &&
+          argument_types[0] == result_type;
+    case OPERATOR_EQUAL:
+    case OPERATOR_NOT_EQUAL:
+    case OPERATOR_LESS:
+    case OPERATOR_LESS_OR_EQUAL:
+      return argument_types.size() == 2 && result_type == BOOL &&
+          argument_types[0] == argument_types[1];
+    case OPERATOR_CAST_QUIET:
+      return argument_types.size() == 1;
+    default:
+      return false;
+  }
+}
+
+// A node of the compiled part of the tree.
+struct JitNode {
+  enum Kind {
+    COLUMN,     // Reads a column (see JitPlan).
+    CONSTANT,
+    OPERATION,  // Applies op to the arguments.
+  };
+
+  JitNode(Kind kind, DataType type)
+      : kind(kind),
+        type(type),
+        column(-1),
+        op(OPERATOR_ADD),
+        integer_value(0),
+        floating_point_value(0) {}
+
+  const Kind kind;
+  const DataType type;
+  int column;
+  OperatorId op;
+  vector<unique_ptr<JitNode>> arguments;
+  // The value of an integer (or BOOL) or floating point constant.
+  int64_t integer_value;
+  double floating_point_value;
+};
+
+// A column the compiled code reads: either an attribute of the input, or the
+// result of a subexpression that is evaluated as usual.
+struct JitColumn {
+  JitColumn(int input_position, BoundExpression* expression, DataType type)
+      : input_position(input_position),
+        expression(expression),
+        type(type) {}
+
+  int input_position;
+  // Not owned. NULL for an input attribute.
+  BoundExpression* expression;
+  DataType type;
+};
+
+template<DataType type>
+bool GetConstantValue(BoundExpression* expression, JitNode* node) {
+  bool is_null;
+  FailureOr<typename TypeTraits<type>::hold_type> value =
+      GetConstantBoundExpressionValue<type>(expression, &is_null);
+  if (value.is_failure() || is_null) return false;
+  if (TypeTraits<type>::is_floating_point) {
+    node->floating_point_value = value.get();
+  } else {
+    node->integer_value = static_cast<int64_t>(value.get());
+  }
+  return true;
+}
+
+// The part of a bound expression tree to compile, and the columns it reads.
+class JitPlan {
+ public:
+  // Returns NULL if the root isn't one of the operators supported.
+  static unique_ptr<JitPlan> Create(BoundExpression* root) {
+    unique_ptr<JitPlan> plan(new JitPlan);
+    if (!plan->IsCompilable(root)) return nullptr;
+    plan->root_ = plan->CreateNode(root);
+    return plan;
+  }
+
+  const JitNode& root() const { return *root_; }
+  const vector<JitColumn>& columns() const { return columns_; }
+
+  // Identifies the compiled code: the plans with the same signature compile
+  // to the same function.
+  const string& signature() const { return signature_; }
+
+ private:
+  JitPlan() {}
+
+  // Returns true if the expression can be compiled as an operation, assuming
+  // its arguments are at least read as columns.
+  bool IsCompilable(const BoundExpression* expression) const {
+    OperatorId op;
+    vector<BoundExpression*> arguments;
+    if (expression->result_schema().attribute_count() != 1 ||
+        !IsSupportedType(GetExpressionType(expression)) ||
+        !expression->DescribeOperation(&op, &arguments)) {
+      return false;
+    }
+    vector<DataType> argument_types;
+    for (const BoundExpression* argument : arguments) {
+      if (argument->result_schema().attribute_count() != 1 ||
+          !IsSupportedType(GetExpressionType(argument))) {
+        return false;
+      }
+      argument_types.push_back(GetExpressionType(argument));
+    }
+    return IsSupportedOperation(op, GetExpressionType(expression),
+                                argument_types);
+  }
+
+  // Appends to the signature.
+  unique_ptr<JitNode> CreateNode(BoundExpression* expression) {
+    const DataType type = GetExpressionType(expression);
+    const string& type_name = GetTypeInfo(type).name();
+    const int input_position = expression->input_attribute_position();
+    if (input_position >= 0) {
+      return CreateColumn(JitColumn(input_position, NULL, type));
+    }
+    if (expression->is_constant()) {
+      unique_ptr<JitNode> node(new JitNode(JitNode::CONSTANT, type));
+      if (GetConstant(expression, node.get())) {
+        if (IsFloatingPoint(type)) {
+          uint64_t bits;
+          memcpy(&bits, &node->floating_point_value, sizeof(bits));
+          StrAppend(&signature_, type_name, ":", bits, "f");
+        } else {
+          StrAppend(&signature_, type_name, ":", node->integer_value);
+        }
+        return node;
+      }
+    }
+    if (!IsCompilable(expression)) {
+      return CreateColumn(JitColumn(-1, expression, type));
+    }
+    unique_ptr<JitNode> node(new JitNode(JitNode::OPERATION, type));
+    vector<BoundExpression*> arguments;
+    CHECK(expression->DescribeOperation(&node->op, &arguments));
+    StrAppend(&signature_, OperatorId_Name(node->op), ":", type_name, "(");
+    for (int i = 0; i < arguments.size(); ++i) {
+      if (i > 0) signature_ += ",";
+      node->arguments.push_back(CreateNode(arguments[i]));
+    }
+    signature_ += ")";
+    return node;
+  }
+
+  // Reads each input attribute once, however many times it's referred to.
+  unique_ptr<JitNode> CreateColumn(const JitColumn& column) {
+    unique_ptr<JitNode> node(new JitNode(JitNode::COLUMN, column.type));
+    node->column = columns_.size();
+    if (column.expression == NULL) {
+      for (int i = 0; i < columns_.size(); ++i) {
+        if (columns_[i].expression == NULL &&
+            columns_[i].input_position == column.input_position) {
+          node->column = i;
+        }
+      }
+    }
+    if (node->column == columns_.size()) columns_.push_back(column);
+    StrAppend(&signature_, "$", node->column, ":",
+              GetTypeInfo(column.type).name());
+    return node;
+  }
+
+  static bool GetConstant(BoundExpression* expression, JitNode* node) {
+    switch (node->type) {
+      case INT32:  return GetConstantValue<INT32>(expression, node);
+      case INT64:  return GetConstantValue<INT64>(expression, node);
+      case UINT32: return GetConstantValue<UINT32>(expression, node);
+      case UINT64: return GetConstantValue<UINT64>(expression, node);
+      case FLOAT:  return GetConstantValue<FLOAT>(expression, node);
+      case DOUBLE: return GetConstantValue<DOUBLE>(expression, node);
+      case BOOL:   return GetConstantValue<BOOL>(expression, node);
+      default:     return false;
+    }
+  }
+
+  unique_ptr<JitNode> root_;
+  vector<JitColumn> columns_;
+  string signature_;
+
+  DISALLOW_COPY_AND_ASSIGN(JitPlan);
+};
+
+// Generates the IR of the loop computing a plan's root.
+class JitCodeGenerator {
+ public:
+  JitCodeGenerator(const JitPlan& plan, llvm::Module* module)
+      : plan_(plan),
+        module_(module),
+        builder_(module->getContext()) {}
+
+  llvm::Function* Generate(const string& name) {
+    llvm::Type* column_pointer = builder_.getInt8PtrTy();
+    llvm::FunctionType* type = llvm::FunctionType::get(
+        builder_.getVoidTy(),
+        { llvm::PointerType::getUnqual(column_pointer), column_pointer,
+          builder_.getInt64Ty() },
+        false);
+    llvm::Function* function = llvm::Function::Create(
+        type, llvm::Function::ExternalLinkage, name, module_);
+    function->addParamAttr(0, llvm::Attribute::ReadOnly);
+    function->addParamAttr(1, llvm::Attribute::NoAlias);
+    llvm::Argument* columns = function->getArg(0);
+    llvm::Argument* result = function->getArg(1);
+    llvm::Argument* row_count = function->getArg(2);
+
+    llvm::LLVMContext& context = module_->getContext();
+    llvm::BasicBlock* entry =
+        llvm::BasicBlock::Create(context, "entry", function);
+    llvm::BasicBlock* loop =
+        llvm::BasicBlock::Create(context, "loop", function);
+    llvm::BasicBlock* exit =
+        llvm::BasicBlock::Create(context, "exit", function);
+
+    builder_.SetInsertPoint(entry);
+    for (int i = 0; i < plan_.columns().size(); ++i) {
+      llvm::Value* data = builder_.CreateLoad(
+          column_pointer,
+          builder_.CreateConstInBoundsGEP1_64(column_pointer, columns, i));
+      column_data_.push_back(builder_.CreateBitCast(
+          data, PointerType(plan_.columns()[i].type)));
+    }
+    llvm::Value* result_data =
+        builder_.CreateBitCast(result, PointerType(plan_.root().type));
+    builder_.CreateCondBr(
+        builder_.CreateICmpSGT(row_count, builder_.getInt64(0)), loop, exit);
+
+    builder_.SetInsertPoint(loop);
+    llvm::PHINode* row = builder_.CreatePHI(builder_.getInt64Ty(), 2);
+    row->addIncoming(builder_.getInt64(0), entry);
+    row_ = row;
+    builder_.CreateStore(
+        Generate(plan_.root()),
+        builder_.CreateInBoundsGEP(Type(plan_.root().type), result_data, row));
+    llvm::Value* next_row = builder_.CreateAdd(row, builder_.getInt64(1));
+    row->addIncoming(next_row, loop);
+    builder_.CreateCondBr(builder_.CreateICmpSLT(next_row, row_count),
+                          loop, exit);
+
+    builder_.SetInsertPoint(exit);
+    builder_.CreateRetVoid();
+    return function;
+  }
+
+ private:
+  llvm::Type* Type(DataType type) {
+    switch (type) {
+      case INT32:
+      case UINT32: return builder_.getInt32Ty();
+      case INT64:
+      case UINT64: return builder_.getInt64Ty();
+      case FLOAT:  return builder_.getFloatTy();
+      case DOUBLE: return builder_.getDoubleTy();
+      case BOOL:   return builder_.getInt8Ty();
+      default:     LOG(FATAL) << "Unsupported type " << type;
+    }
+  }
+
+  llvm::Type* PointerType(DataType type) {
+    return llvm::PointerType::getUnqual(Type(type));
+  }
+
+  llvm::Value* Generate(const JitNode& node) {
+    switch (node.kind) {
+      case JitNode::COLUMN:
+        return builder_.CreateLoad(
+            Type(node.type),
+            builder_.CreateInBoundsGEP(Type(node.type),
+                                       column_data_[node.column], row_));
+      case JitNode::CONSTANT:
+        if (IsFloatingPoint(node.type)) {
+          return llvm::ConstantFP::get(Type(node.type),
+                                       node.floating_point_value);
+        }
+        return llvm::ConstantInt::get(Type(node.type), node.integer_value,
+                                      IsSigned(node.type));
+      case JitNode::OPERATION:
+        return GenerateOperation(node);
+    }
+    LOG(FATAL) << "Unknown node kind " << node.kind;
+  }
+
+  // Matches the operators in base/infrastructure/operators.h.
+  llvm::Value* GenerateOperation(const JitNode& node) {
+    vector<llvm::Value*> arguments;
+    for (const unique_ptr<JitNode>& argument : node.arguments) {
+      arguments.push_back(Generate(*argument));
+    }
+    const DataType argument_type = node.arguments[0]->type;
+    const bool floating_point = IsFloatingPoint(argument_type);
+    const bool is_signed = IsSigned(argument_type);
+    switch (node.op) {
+      case OPERATOR_ADD:
+        return floating_point
+            ? builder_.CreateFAdd(arguments[0], arguments[1])
+            : builder_.CreateAdd(arguments[0], arguments[1]);
+      case OPERATOR_SUBTRACT:
+        return floating_point
+            ? builder_.CreateFSub(arguments[0], arguments[1])
+            : builder_.CreateSub(arguments[0], arguments[1]);
+      case OPERATOR_MULTIPLY:
+        return floating_point
+            ? builder_.CreateFMul(arguments[0], arguments[1])
+            : builder_.CreateMul(arguments[0], arguments[1]);
+      case OPERATOR_NEGATE:
+        return floating_point
+            ? builder_.CreateFNeg(arguments[0])
+            : builder_.CreateNeg(arguments[0]);
+      case OPERATOR_EQUAL:
+        return ToBool(floating_point
+            ? builder_.CreateFCmpOEQ(arguments[0], arguments[1])
+            : builder_.CreateICmpEQ(arguments[0], arguments[1]));
+      case OPERATOR_NOT_EQUAL:
+        // !(a == b), so true if either is NaN.
+        return ToBool(floating_point
+            ? builder_.CreateFCmpUNE(arguments[0], arguments[1])
+            : builder_.CreateICmpNE(arguments[0], arguments[1]));
+      case OPERATOR_LESS:
+        return ToBool(floating_point
+            ? builder_.CreateFCmpOLT(arguments[0], arguments[1])
+            : is_signed
+                ? builder_.CreateICmpSLT(arguments[0], arguments[1])
+                : builder_.CreateICmpULT(arguments[0], arguments[1]));
+      case OPERATOR_LESS_OR_EQUAL:
+        // !(b < a), so true if either is NaN.
+        return ToBool(floating_point
+            ? builder_.CreateFCmpULE(arguments[0], arguments[1])
+            : is_signed
+                ? builder_.CreateICmpSLE(arguments[0], arguments[1])
+                : builder_.CreateICmpULE(arguments[0], arguments[1]));
+      case OPERATOR_CAST_QUIET:
+        return Cast(arguments[0], argument_type, node.type);
+      default:
+        LOG(FATAL) << "Unsupported operator " << OperatorId_Name(node.op);
+    }
+  }
+
+  llvm::Value* ToBool(llvm::Value* condition) {
+    return builder_.CreateZExt(condition, builder_.getInt8Ty());
+  }
+
+  // As static_cast does.
+  llvm::Value* Cast(llvm::Value* value, DataType from, DataType to) {
+    if (from == to) return value;
+    if (to == BOOL) {
+      return ToBool(IsFloatingPoint(from)
+          ? builder_.CreateFCmpUNE(value, llvm::ConstantFP::get(Type(from), 0))
+          : builder_.CreateICmpNE(value, llvm::ConstantInt::get(Type(from),
+                                                                0)));
+    }
+    if (IsFloatingPoint(from) && IsFloatingPoint(to)) {
+      return builder_.CreateFPCast(value, Type(to));
+    }
+    if (IsFloatingPoint(to)) {
+      return IsSigned(from)
+          ? builder_.CreateSIToFP(value, Type(to))
+          : builder_.CreateUIToFP(value, Type(to));
+    }
+    if (IsFloatingPoint(from)) {
+      return IsSigned(to)
+          ? builder_.CreateFPToSI(value, Type(to))
+          : builder_.CreateFPToUI(value, Type(to));
+    }
+    return builder_.CreateIntCast(value, Type(to), IsSigned(from));
+  }
+
+  const JitPlan& plan_;
+  llvm::Module* const module_;
+  llvm::IRBuilder<> builder_;
+  vector<llvm::Value*> column_data_;
+  llvm::Value* row_;
+
+  DISALLOW_COPY_AND_ASSIGN(JitCodeGenerator);
+};
+
+string ToString(llvm::Error error) {
+  string message;
+  llvm::raw_string_ostream stream(message);
+  stream << error;
+  return stream.str();
+}
+
+// Compiles the plans, and keeps the machine code, for the life of the process.
+// Thread-safe.
+class JitEngine {
+ public:
+  static JitEngine* Get() {
+    static JitEngine* const engine = new JitEngine;
+    return engine;
+  }
+
+  // Returns the function computing the plan's root, compiling it unless a
+  // plan with the same signature has been compiled before.
+  FailureOr<JitFunction> GetFunction(const JitPlan& plan) {
+    std::lock_guard<std::mutex> lock(mutex_);
+    if (jit_ == nullptr) {
+      THROW(new Exception(ERROR_NOT_IMPLEMENTED,
+                          StrCat("Couldn't create the JIT: ", error_)));
+    }
+    JitFunction& function = functions_[plan.signature()];
+    if (function == NULL) {
+      FailureOr<JitFunction> compiled = Compile(plan);
+      if (compiled.is_failure()) functions_.erase(plan.signature());
+      PROPAGATE_ON_FAILURE(compiled);
+      function = compiled.get();
+    }
+    return Success(function);
+  }
+
+ private:
+  JitEngine() {
+    llvm::InitializeNativeTarget();
+    llvm::InitializeNativeTargetAsmPrinter();
+    llvm::Expected<llvm::orc::JITTargetMachineBuilder> target_machine_builder =
+        llvm::orc::JITTargetMachineBuilder::detectHost();
+    if (!target_machine_builder) {
+      error_ = ToString(target_machine_builder.takeError());
+      return;
+    }
+    target_machine_builder->setCodeGenOptLevel(llvm::CodeGenOpt::Aggressive);
+    llvm::Expected<std::unique_ptr<llvm::TargetMachine>> target_machine =
+        target_machine_builder->createTargetMachine();
+    if (!target_machine) {
+      error_ = ToString(target_machine.takeError());
+      return;
+    }
+    target_machine_ = std::move(*target_machine);
+    llvm::Expected<std::unique_ptr<llvm::orc::LLJIT>> jit =
+        llvm::orc::LLJITBuilder()
+            .setJITTargetMachineBuilder(std::move(*target_machine_builder))
+            .create();
+    if (!jit) {
+      error_ = ToString(jit.takeError());
+      return;
+    }
+    jit_ = std::move(*jit);
+  }
+
+  FailureOr<JitFunction> Compile(const JitPlan& plan) {
+    std::unique_ptr<llvm::LLVMContext> context(new llvm::LLVMContext);
+    std::unique_ptr<llvm::Module> module(
+        new llvm::Module("supersonic_jit", *context));
+    module->setDataLayout(jit_->getDataLayout());
+    module->setTargetTriple(jit_->getTargetTriple().str());
+    const string name = StrCat("supersonic_jit_", functions_.size());
+    llvm::Function* function = JitCodeGenerator(plan, module.get())
+        .Generate(name);
+    string errors;
+    llvm::raw_string_ostream error_stream(errors);
+    if (llvm::verifyFunction(*function, &error_stream)) {
+      THROW(new Exception(
+          ERROR_UNKNOWN_ERROR,
+          StrCat("Invalid code generated for ", plan.signature(), ": ",
+                 error_stream.str())));
+    }
+    Optimize(module.get());
+    llvm::Error error = jit_->addIRModule(llvm::orc::ThreadSafeModule(
+        std::move(module), std::move(context)));
+    if (error) {
+      THROW(new Exception(ERROR_UNKNOWN_ERROR,
+                          StrCat("Couldn't compile ", plan.signature(), ": ",
+                                 ToString(std::move(error)))));
+    }
+    auto symbol = jit_->lookup(name);
+    if (!symbol) {
+      THROW(new Exception(ERROR_UNKNOWN_ERROR,
+                          StrCat("Couldn't compile ", plan.signature(), ": ",
+                                 ToString(symbol.takeError()))));
+    }
+#if LLVM_VERSION_MAJOR >= 15
+    return Success(symbol->toPtr<JitFunction>());
+#else
+    return Success(reinterpret_cast<JitFunction>(symbol->getAddress()));
+#endif
+  }
+
+  // With the usual -O3 pipeline, vectorizing the loop for the host.
+  void Optimize(llvm::Module* module) {
+    llvm::LoopAnalysisManager loop_analysis_manager;
+    llvm::FunctionAnalysisManager function_analysis_manager;
+    llvm::CGSCCAnalysisManager cgscc_analysis_manager;
+    llvm::ModuleAnalysisManager module_analysis_manager;
+    llvm::PassBuilder pass_builder(target_machine_.get());
+    pass_builder.registerModuleAnalyses(module_analysis_manager);
+    pass_builder.registerCGSCCAnalyses(cgscc_analysis_manager);
+    pass_builder.registerFunctionAnalyses(function_analysis_manager);
+    pass_builder.registerLoopAnalyses(loop_analysis_manager);
+    pass_builder.crossRegisterProxies(
+        loop_analysis_manager, function_analysis_manager,
+        cgscc_analysis_manager, module_analysis_manager);
+    pass_builder.buildPerModuleDefaultPipeline(llvm::OptimizationLevel::O3)
+        .run(*module, module_analysis_manager);
+  }
+
+  std::mutex mutex_;
+  map<string, JitFunction> functions_;
+  std::unique_ptr<llvm::TargetMachine> target_machine_;
+  std::unique_ptr<llvm::orc::LLJIT> jit_;
+  // Why the JIT couldn't be created, if it couldn't.
+  string error_;
+
+  DISALLOW_COPY_AND_ASSIGN(JitEngine);
+};
+
+// Runs the compiled code, after evaluating the subexpressions it reads.
+class BoundJitExpression : public BasicBoundExpression {
+ public:
+  BoundJitExpression(unique_ptr<BoundExpression> argument,
+                     unique_ptr<JitPlan> plan,
+                     JitFunction function,
+                     BufferAllocator* allocator)
+      : BasicBoundExpression(argument->result_schema(), allocator),
+        argument_(std::move(argument)),
+        plan_(std::move(plan)),
+        function_(function),
+        column_data_(plan_->columns().size()) {}
+
+  virtual rowcount_t row_capacity() const {
+    return std::min(my_const_block()->row_capacity(),
+                    argument_->row_capacity());
+  }
+
+  virtual bool can_be_resolved() const { return false; }
+
+  // The compiled part materializes no intermediate results.
+  virtual int elementwise_depth() const {
+    int depth = 1;
+    for (const JitColumn& column : plan_->columns()) {
+      if (column.expression == NULL) continue;
+      const int column_depth = column.expression->elementwise_depth();
+      if (column_depth < 0) return -1;
+      depth = std::max(depth, column_depth + 1);
+    }
+    return depth;
+  }
+
+  virtual void CollectReferredAttributeNames(
+      set<string>* referred_attribute_names) const {
+    argument_->CollectReferredAttributeNames(referred_attribute_names);
+  }
+
+  virtual EvaluationResult DoEvaluate(const View& input,
+                                      const BoolView& skip_vectors) {
+    CHECK_EQ(1, skip_vectors.column_count());
+    bool_ptr skip_vector = skip_vectors.column(0);
+    const rowcount_t row_count = input.row_count();
+    const vector<JitColumn>& columns = plan_->columns();
+    // The operators compiled have viral NULLs: the result is NULL where any of
+    // the columns read is. The input attributes go first, so that the
+    // subexpressions skip (at least) the rows they would skip if the operators
+    // were interpreted.
+    for (int i = 0; i < columns.size(); ++i) {
+      if (columns[i].expression != NULL) continue;
+      const Column& column = input.column(columns[i].input_position);
+      column_data_[i] = column.data().raw();
+      if (column.is_null() != NULL) {
+        vector_logic::Or(skip_vector, column.is_null(), row_count,
+                         skip_vector);
+      }
+    }
+    for (int i = 0; i < columns.size(); ++i) {
+      if (columns[i].expression == NULL) continue;
+      EvaluationResult result =
+          columns[i].expression->DoEvaluate(input, skip_vectors);
+      PROPAGATE_ON_FAILURE(result);
+      const Column& column = result.get().column(0);
+      column_data_[i] = column.data().raw();
+      if (column.is_null() != NULL) {
+        vector_logic::Or(skip_vector, column.is_null(), row_count,
+                         skip_vector);
+      }
+    }
+    function_(column_data_.data(),
+              my_block()->mutable_column(0)->mutable_data(),
+              row_count);
+    my_view()->set_row_count(row_count);
+    my_view()->mutable_column(0)->ResetIsNull(skip_vector);
+    return Success(*my_view());
+  }
+
+ private:
+  // Owns the subexpressions evaluated as usual.
+  const unique_ptr<BoundExpression> argument_;
+  const unique_ptr<JitPlan> plan_;
+  const JitFunction function_;
+  // Of the plan's columns, for the current evaluation.
+  vector<const void*> column_data_;
+
+  DISALLOW_COPY_AND_ASSIGN(BoundJitExpression);
+};
+
+class JitCompiledExpression : public Expression {
+ public:
+  explicit JitCompiledExpression(unique_ptr<const Expression> argument)
+      : argument_(std::move(argument)) {}
+
+  virtual FailureOrOwned<BoundExpression> DoBind(
+      const TupleSchema& input_schema,
+      BufferAllocator* allocator,
+      rowcount_t max_row_count) const {
+    FailureOrOwned<BoundExpression> bound_argument =
+        argument_->DoBind(input_schema, allocator, max_row_count);
+    PROPAGATE_ON_FAILURE(bound_argument);
+    return BoundJitCompiled(bound_argument.move(), allocator, max_row_count);
+  }
+
+  virtual string ToString(bool verbose) const {
+    return argument_->ToString(verbose);
+  }
+
+ private:
+  const unique_ptr<const Expression> argument_;
+
+  DISALLOW_COPY_AND_ASSIGN(JitCompiledExpression);
+};
+
+}  // namespace
+
+unique_ptr<const Expression> JitCompiled(
+    unique_ptr<const Expression> argument) {
+  return make_unique<JitCompiledExpression>(std::move(argument));
+}
+
+FailureOrOwned<BoundExpression> BoundJitCompiled(
+    unique_ptr<BoundExpression> argument,
+    BufferAllocator* allocator,
+    rowcount_t max_row_count) {
+  unique_ptr<JitPlan> plan = JitPlan::Create(argument.get());
+  if (plan == nullptr) return Success(std::move(argument));
+  FailureOr<JitFunction> function = JitEngine::Get()->GetFunction(*plan);
+  if (function.is_failure()) {
+    LOG(WARNING) << "Interpreting "
+                 << GetExpressionName(argument.get()) << ": "
+                 << function.exception().message();
+    return Success(std::move(argument));
+  }
+  return InitBasicExpression(
+      max_row_count,
+      make_unique<BoundJitExpression>(std::move(argument), std::move(plan),
+                                      function.get(), allocator),
+      allocator);
+}
+
+}  // namespace supersonic
@@ -0,0 +1,66 @@
+// Copyright 2012 Google Inc. All Rights Reserved.
+//
+// Licensed under the Apache License, Version 2.0 (the "License");
+// you may not use this file except in compliance with the License.
+// You may obtain a copy of the License at
+//
+//     http://www.apache.org/licenses/LICENSE-2.0
+//
+// Unless required by applicable law or agreed to in writing, software
+// distributed under the License is distributed on an "AS IS" BASIS,
+// WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+// See the License for the specific language governing permissions and
+// limitations under the License.
+//
+// Compiling expressions into native code, with LLVM. Optional: built into the
+// supersonic_jit library with -DSUPERSONIC_ENABLE_JIT=ON.
+//
+// The arithmetic (+, -, *, unary -), the comparisons and the casts between the
+// numeric types (and BOOL) of a bound expression tree are compiled into a
+// single loop over the input, computing the result without materializing the
+// intermediate ones. The rest of the tree (e.g. regexps, stateful or string
+// expressions, IF, AND) is evaluated as usual, and its results read by the
+// loop. NULLs and skip vectors are handled as in the interpreted expressions:
+// the operators compiled have viral NULLs, so the result is NULL wherever any
+// of the input attributes or the interpreted subexpressions read by the loop
+// is.
+//
+// Compilation takes milliseconds, so it pays off for expressions evaluated on
+// many blocks. The machine code is cached, keyed by the structure of the
+// compiled part of the tree (including the types and the constants), and
+// reused by all the expressions that share it, for the life of the process.
+//
+// Example usage:
+//
+// Compute(JitCompiled(Less(Plus(AttributeAt(0), AttributeAt(1)),
+//                          ConstInt64(100))),
+//         input);
+
+#ifndef SUPERSONIC_EXPRESSION_JIT_JIT_EXPRESSIONS_H_
+#define SUPERSONIC_EXPRESSION_JIT_JIT_EXPRESSIONS_H_
+
+#include "supersonic/utils/std_namespace.h"
+#include "supersonic/base/exception/result.h"
+#include "supersonic/base/infrastructure/types.h"
+#include "supersonic/expression/base/expression.h"
+
+namespace supersonic {
+
+class BufferAllocator;
+
+// Same as the argument, with as much of it as possible compiled into native
+// code (see above). The result attributes have the same names as those of the
+// argument.
+unique_ptr<const Expression> JitCompiled(unique_ptr<const Expression> argument);
+
+// Compiles what it can of the bound expression. Returns the argument itself if
+// there is nothing to compile, i.e. unless the root is one of the operators
+// supported, or if the machine code couldn't be generated (logging a warning).
+FailureOrOwned<BoundExpression> BoundJitCompiled(
+    unique_ptr<BoundExpression> argument,
+    BufferAllocator* allocator,
+    rowcount_t max_row_count);
+
+}  // namespace supersonic
+
+#endif  // SUPERSONIC_EXPRESSION_JIT_JIT_EXPRESSIONS_H_
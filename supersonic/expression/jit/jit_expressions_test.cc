@@ -0,0 +1,144 @@
+// Copyright 2012 Google Inc. All Rights Reserved.
+//
+// Licensed under the Apache License, Version 2.0 (the "License");
+// you may not use this file except in compliance with the License.
+// You may obtain a copy of the License at
+//
+//     http://www.apache.org/licenses/LICENSE-2.0
+//
+// Unless required by applicable law or agreed to in writing, software
+// distributed under the License is distributed on an "AS IS" BASIS,
+// WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+// See the License for the specific language governing permissions and
+// limitations under the License.
+//
+
+#include "supersonic/expression/jit/jit_expressions.h"
+
+#include <functional>
+#include <memory>
+#include <vector>
+using std::vector;
+
+#include "supersonic/base/infrastructure/block.h"
+#include "supersonic/base/memory/memory.h"
+#include "supersonic/expression/base/expression.h"
+#include "supersonic/expression/core/arithmetic_expressions.h"
+#include "supersonic/expression/core/comparison_expressions.h"
+#include "supersonic/expression/core/elementary_expressions.h"
+#include "supersonic/expression/core/projecting_expressions.h"
+#include "supersonic/expression/infrastructure/terminal_expressions.h"
+#include "supersonic/testing/block_builder.h"
+#include "supersonic/testing/comparators.h"
+#include "gtest/gtest.h"
+
+namespace supersonic {
+
+namespace {
+
+typedef std::function<unique_ptr<const Expression>()> ExpressionFactory;
+
+class JitExpressionsTest : public testing::Test {
+ protected:
+  virtual void SetUp() {
+    BlockBuilder<INT64, INT64, INT32, DOUBLE> builder;
+    for (int i = 0; i < 1000; ++i) {
+      if (i % 7 == 0) {
+        builder.AddRow(__, i % 13, i, i / 4.);
+      } else if (i % 11 == 0) {
+        builder.AddRow(i, __, -i, __);
+      } else {
+        builder.AddRow(i - 500, i % 13, i % 100, (i - 300) / 8.);
+      }
+    }
+    block_ = builder.Build();
+  }
+
+  // Returns true if the bound expression is compiled.
+  bool IsCompiled(const ExpressionFactory& factory) {
+    FailureOrOwned<BoundExpression> bound = JitCompiled(factory())->DoBind(
+        block_->schema(), HeapBufferAllocator::Get(), 1000);
+    CHECK(bound.is_success());
+    OperatorId op;
+    vector<BoundExpression*> arguments;
+    return !bound->DescribeOperation(&op, &arguments);
+  }
+
+  // Expects the same results, compiled as interpreted.
+  void ExpectSameAsInterpreted(const ExpressionFactory& factory) {
+    FailureOrOwned<BoundExpressionTree> interpreted = factory()->Bind(
+        block_->schema(), HeapBufferAllocator::Get(), 1000);
+    ASSERT_TRUE(interpreted.is_success());
+    FailureOrOwned<BoundExpressionTree> compiled = JitCompiled(factory())->Bind(
+        block_->schema(), HeapBufferAllocator::Get(), 1000);
+    ASSERT_TRUE(compiled.is_success());
+    // Also on a view that doesn't start at the beginning of the block.
+    for (int offset : { 0, 3 }) {
+      View input(block_->view(), offset, block_->view().row_count() - offset);
+      EvaluationResult expected = interpreted->Evaluate(input);
+      ASSERT_TRUE(expected.is_success());
+      EvaluationResult result = compiled->Evaluate(input);
+      ASSERT_TRUE(result.is_success());
+      EXPECT_VIEWS_EQUAL(expected.get(), result.get());
+    }
+  }
+
+  unique_ptr<Block> block_;
+};
+
+TEST_F(JitExpressionsTest, Arithmetic) {
+  ExpressionFactory factory = []() {
+    return Negate(Minus(Multiply(AttributeAt(0), AttributeAt(1)),
+                        Plus(AttributeAt(0), ConstInt64(17))));
+  };
+  EXPECT_TRUE(IsCompiled(factory));
+  ExpectSameAsInterpreted(factory);
+}
+
+TEST_F(JitExpressionsTest, Comparisons) {
+  ExpectSameAsInterpreted([]() {
+    return Less(Plus(AttributeAt(0), AttributeAt(1)), ConstInt64(100));
+  });
+  ExpectSameAsInterpreted([]() {
+    return LessOrEqual(AttributeAt(1), AttributeAt(0));
+  });
+  ExpectSameAsInterpreted([]() {
+    return Greater(AttributeAt(3), ConstDouble(12.5));
+  });
+  ExpectSameAsInterpreted([]() {
+    return NotEqual(AttributeAt(2), ConstInt32(5));
+  });
+}
+
+TEST_F(JitExpressionsTest, CastsAcrossTypes) {
+  ExpressionFactory factory = []() {
+    return Multiply(Plus(AttributeAt(2), AttributeAt(3)), AttributeAt(0));
+  };
+  EXPECT_TRUE(IsCompiled(factory));
+  ExpectSameAsInterpreted(factory);
+  ExpectSameAsInterpreted([]() {
+    return CastTo(INT32, Plus(AttributeAt(0), AttributeAt(1)));
+  });
+}
+
+TEST_F(JitExpressionsTest, InterpretsUnsupportedSubexpressions) {
+  ExpressionFactory factory = []() {
+    return Plus(Multiply(AttributeAt(0),
+                         IfNull(AttributeAt(1), ConstInt64(-1))),
+                DivideQuiet(AttributeAt(1), AttributeAt(3)));
+  };
+  EXPECT_TRUE(IsCompiled(factory));
+  ExpectSameAsInterpreted(factory);
+}
+
+TEST_F(JitExpressionsTest, LeavesUnsupportedRootInterpreted) {
+  ExpressionFactory factory = []() {
+    return DivideSignaling(Plus(AttributeAt(0), ConstInt64(1)),
+                           AttributeAt(1));
+  };
+  EXPECT_FALSE(IsCompiled(factory));
+}
+
+}  // namespace
+
+}  // namespace supersonic
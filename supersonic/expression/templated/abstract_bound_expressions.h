@@ -76,8 +76,21 @@ class AbstractBoundUnaryExpression : public BoundUnaryExpression {
     return Success(*my_view());
   }
 
- private:
+  virtual int elementwise_depth() const {
+    return ElementwiseDepthOf({ argument() });
+  }
 
+  virtual bool can_fail() const {
+    return UnaryExpressionTraits<op>::can_fail || argument()->can_fail();
+  }
+
+  virtual bool DescribeOperation(
+      OperatorId* described_op,
+      vector<BoundExpression*>* arguments) const {
+    *described_op = op;
+    *arguments = { argument() };
+    return true;
+  }
 
  private:
   typedef typename TypeTraits<input_type>::cpp_type CppFrom;
@@ -147,6 +160,23 @@ class AbstractBoundBinaryExpression : public BoundBinaryExpression {
     return Success(*my_view());
   }
 
+  virtual int elementwise_depth() const {
+    return ElementwiseDepthOf({ left(), right() });
+  }
+
+  virtual bool can_fail() const {
+    return BinaryExpressionTraits<op>::can_fail || left()->can_fail() ||
+        right()->can_fail();
+  }
+
+  virtual bool DescribeOperation(
+      OperatorId* described_op,
+      vector<BoundExpression*>* arguments) const {
+    *described_op = op;
+    *arguments = { left(), right() };
+    return true;
+  }
+
  private:
   ColumnBinaryComputer<
       op, left_type, right_type, output_type> column_operator_;
@@ -230,6 +260,23 @@ class AbstractBoundTernaryExpression : public BoundTernaryExpression {
     return Success(*my_view());
   }
 
+  virtual int elementwise_depth() const {
+    return ElementwiseDepthOf({ left_.get(), middle_.get(), right_.get() });
+  }
+
+  virtual bool can_fail() const {
+    return TernaryExpressionTraits<op>::can_fail || left_->can_fail() ||
+        middle_->can_fail() || right_->can_fail();
+  }
+
+  virtual bool DescribeOperation(
+      OperatorId* described_op,
+      vector<BoundExpression*>* arguments) const {
+    *described_op = op;
+    *arguments = { left_.get(), middle_.get(), right_.get() };
+    return true;
+  }
+
  private:
   ColumnTernaryComputer<op, left_type, middle_type, right_type, output_type,
       TernaryExpressionTraits<op>::needs_allocator> column_operator_;
@@ -76,6 +76,8 @@ class BoundProjectingCastExpression : public BoundExpression {
 
   virtual bool is_constant() const { return child_->is_constant(); }
 
+  virtual bool can_fail() const { return child_->can_fail(); }
+
   virtual void CollectReferredAttributeNames(
       set<string>* referred_attribute_names) const {
     child_->CollectReferredAttributeNames(referred_attribute_names);
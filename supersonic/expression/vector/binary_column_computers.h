@@ -182,22 +182,43 @@ struct ColumnBinaryComputer {
                            size_t row_count,
                            OwnedColumn* const output,
                            bool_ptr skip_vector) const {
+    // Run CheckAndNull - check for failures, fill out the result_is_null field.
+    binary_column_computers::CheckAndNull<op, left_type, right_type,
+        result_type> check_and_null;
+    PROPAGATE_ON_FAILURE(check_and_null(left, right, skip_vector, row_count));
+
+    // A constant input (e.g. a literal) is read once, rather than for every
+    // row.
+    if (right.is_constant() && !left.is_constant()) {
+      return Compute<DirectIndexResolver, ConstantIndexResolver>(
+          left, right, row_count, output, skip_vector);
+    }
+    if (left.is_constant() && !right.is_constant()) {
+      return Compute<ConstantIndexResolver, DirectIndexResolver>(
+          left, right, row_count, output, skip_vector);
+    }
+    return Compute<DirectIndexResolver, DirectIndexResolver>(
+        left, right, row_count, output, skip_vector);
+  }
+
+ private:
+  template<typename LeftIndexResolver, typename RightIndexResolver>
+  FailureOrVoid Compute(const Column& left,
+                        const Column& right,
+                        size_t row_count,
+                        OwnedColumn* const output,
+                        bool_ptr skip_vector) const {
     // Convenience shorthands.
     const LeftCppType* left_data = left.typed_data<left_type>();
     const RightCppType* right_data = right.typed_data<right_type>();
     ResultCppType* result_data = output->mutable_typed_data<result_type>();
     Arena* arena = output->arena();
 
-    // Run CheckAndNull - check for failures, fill out the result_is_null field.
-    binary_column_computers::CheckAndNull<op, left_type, right_type,
-        result_type> check_and_null;
-    PROPAGATE_ON_FAILURE(check_and_null(left, right, skip_vector, row_count));
-
     // We use the same VectorBinaryPrimitive in both branches of the if - the
     // one appropriate for our operation - but in the second case we pass
     // one more argument to the operator() of the primitive - the
     // skip vector boolean array.
-    VectorBinaryPrimitive<op, DirectIndexResolver, DirectIndexResolver,
+    VectorBinaryPrimitive<op, LeftIndexResolver, RightIndexResolver,
         result_type, left_type, right_type,
         BinaryExpressionTraits<op>::needs_allocator> column_operator;
 
@@ -231,4 +231,46 @@ TEST_F(BinaryColumnComputersTest, SelectiveCalculation) {
   }
 }
 
+TEST_F(BinaryColumnComputersTest, ConstantRightCalculation) {
+  BinaryComputersTestBlockWrapper block(6);
+  for (int i = 0; i < 5; ++i) {
+    block.left()[i] = i;
+    block.right()[i] = 2.;
+    block.output()[i] = 0.;
+    block.skip_vector()[i] = (i == 3);
+  }
+  View right(block.right_column(), 5);
+  right.mutable_column(0)->set_is_constant(true);
+
+  ColumnBinaryComputer<OPERATOR_DIVIDE_SIGNALING, DOUBLE, DOUBLE, DOUBLE> op;
+  FailureOrVoid result = op(block.left_column(), right.column(0), 5,
+                            block.output_column(), block.skip_vector());
+
+  EXPECT_TRUE(result.is_success());
+  for (int i = 0; i < 5; ++i) {
+    if (i != 3) EXPECT_EQ(i / 2., block.output()[i]);
+  }
+}
+
+TEST_F(BinaryColumnComputersTest, ConstantLeftCalculation) {
+  BinaryComputersTestBlockWrapper block(6);
+  for (int i = 0; i < 5; ++i) {
+    block.left()[i] = 3.;
+    block.right()[i] = i;
+    block.output()[i] = 0.;
+    block.skip_vector()[i] = false;
+  }
+  View left(block.left_column(), 5);
+  left.mutable_column(0)->set_is_constant(true);
+
+  ColumnBinaryComputer<OPERATOR_SUBTRACT, DOUBLE, DOUBLE, DOUBLE> op;
+  FailureOrVoid result = op(left.column(0), block.right_column(), 5,
+                            block.output_column(), block.skip_vector());
+
+  EXPECT_TRUE(result.is_success());
+  for (int i = 0; i < 5; ++i) {
+    EXPECT_EQ(3. - i, block.output()[i]);
+  }
+}
+
 }  // namespace supersonic
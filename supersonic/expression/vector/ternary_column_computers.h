@@ -216,6 +216,11 @@ struct ColumnTernaryComputer<op, left_type, middle_type, right_type,
 
     // Actual evaluation.
     typename TernaryExpressionTraits<op>::basic_operator my_operator;
+    // Constant (broadcast) inputs are not walked over, but read in place, so
+    // that they stay in registers.
+    const int left_step = left.is_constant() ? 0 : 1;
+    const int middle_step = middle.is_constant() ? 0 : 1;
+    const int right_step = right.is_constant() ? 0 : 1;
     if (!SelectivityIsGreaterThan(
             skip_vector, row_count,
             TernaryExpressionTraits<op>::selectivity_threshold)
@@ -223,8 +228,10 @@ struct ColumnTernaryComputer<op, left_type, middle_type, right_type,
         && !TypeTraits<middle_type>::is_variable_length
         && !TypeTraits<right_type>::is_variable_length) {
       for (int i = 0; i < row_count; ++i) {
-        *result_data++ = my_operator(*left_data++, *middle_data++,
-                                     *right_data++);
+        *result_data++ = my_operator(*left_data, *middle_data, *right_data);
+        left_data += left_step;
+        middle_data += middle_step;
+        right_data += right_step;
       }
     } else {
       for (int i = 0; i < row_count; ++i) {
@@ -233,9 +240,9 @@ struct ColumnTernaryComputer<op, left_type, middle_type, right_type,
         }
         ++result_data;
         ++skip_vector;
-        ++left_data;
-        ++middle_data;
-        ++right_data;
+        left_data += left_step;
+        middle_data += middle_step;
+        right_data += right_step;
       }
     }
     return Success();
@@ -273,6 +280,11 @@ struct ColumnTernaryComputer<op, left_type, middle_type, right_type,
 
     // Actual evaluation.
     typename TernaryExpressionTraits<op>::basic_operator my_operator;
+    // Constant (broadcast) inputs are not walked over, but read in place, so
+    // that they stay in registers.
+    const int left_step = left.is_constant() ? 0 : 1;
+    const int middle_step = middle.is_constant() ? 0 : 1;
+    const int right_step = right.is_constant() ? 0 : 1;
     if (!SelectivityIsGreaterThan(
         skip_vector, row_count,
         TernaryExpressionTraits<op>::selectivity_threshold)
@@ -280,8 +292,11 @@ struct ColumnTernaryComputer<op, left_type, middle_type, right_type,
         && !TypeTraits<middle_type>::is_variable_length
         && !TypeTraits<right_type>::is_variable_length) {
       for (int i = 0; i < row_count; ++i) {
-        *result_data++ = my_operator(*left_data++, *middle_data++,
-                                     *right_data++, arena);
+        *result_data++ = my_operator(*left_data, *middle_data, *right_data,
+                                     arena);
+        left_data += left_step;
+        middle_data += middle_step;
+        right_data += right_step;
       }
     } else {
       for (int i = 0; i < row_count; ++i) {
@@ -291,9 +306,9 @@ struct ColumnTernaryComputer<op, left_type, middle_type, right_type,
         }
         ++result_data;
         ++skip_vector;
-        ++left_data;
-        ++middle_data;
-        ++right_data;
+        left_data += left_step;
+        middle_data += middle_step;
+        right_data += right_step;
       }
     }
     return Success();
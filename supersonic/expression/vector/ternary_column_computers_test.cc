@@ -373,6 +373,58 @@ TEST(TernaryColumnComputersTest, AllocatingNullCalculation) {
   }
 }
 
+// Only the first row of a constant column is read; the others are set to
+// something else to check that.
+TEST(TernaryColumnComputersTest, ConstantInputsNonSelectiveCalculation) {
+  TernaryComputersTestBlockWrapper block(6);
+  for (int i = 0; i < 5; ++i) {
+    block.left()[i] = (i == 0) ? 1. : 100.;
+    block.middle()[i] = i;
+    block.right()[i] = (i == 0) ? 2. : 100.;
+    block.skip_vector()[i] = (i > 3);
+    block.output()[i] = 0.;
+  }
+  View left(block.left_column(), 5);
+  left.mutable_column(0)->set_is_constant(true);
+  View right(block.right_column(), 5);
+  right.mutable_column(0)->set_is_constant(true);
+
+  ColumnTernaryComputer<OPERATOR_TERNARY_NO_CHECK, DOUBLE, DOUBLE, DOUBLE,
+      DOUBLE, false> op;
+  FailureOrVoid result = op(left.column(0), block.middle_column(),
+                            right.column(0), 5, block.output_column(),
+                            block.skip_vector());
+
+  EXPECT_TRUE(result.is_success());
+  for (int i = 0; i < 5; ++i) {
+    EXPECT_EQ(3. + i, block.output()[i]);
+  }
+}
+
+TEST(TernaryColumnComputersTest, ConstantInputSelectiveCalculation) {
+  TernaryComputersTestBlockWrapper block(6);
+  for (int i = 0; i < 5; ++i) {
+    block.left()[i] = 1.;
+    block.middle()[i] = (i == 0) ? 2. : 100.;
+    block.right()[i] = i;
+    block.skip_vector()[i] = (i == 2);
+    block.output()[i] = 0.;
+  }
+  View middle(block.middle_column(), 5);
+  middle.mutable_column(0)->set_is_constant(true);
+
+  ColumnTernaryComputer<OPERATOR_TERNARY_FULL_CHECK, DOUBLE, DOUBLE, DOUBLE,
+      DOUBLE, false> op;
+  FailureOrVoid result = op(block.left_column(), middle.column(0),
+                            block.right_column(), 5, block.output_column(),
+                            block.skip_vector());
+
+  EXPECT_TRUE(result.is_success());
+  for (int i = 0; i < 5; ++i) {
+    EXPECT_EQ((i == 2) ? 0. : 3. + i, block.output()[i]);
+  }
+}
+
 }  // namespace ternary_column_computers
 
 }  // namespace supersonic
@@ -64,6 +64,14 @@ struct IndirectIndexResolver {
   }
 };
 
+// Reads the first value for every index; for constant (broadcast) inputs.
+struct ConstantIndexResolver {
+  index_t operator()(const index_t* const indirection,
+                     const index_t index) const {
+    return 0;
+  }
+};
+
 // ================ Vectorized wrappers for the operations =====================
 
 // ---------------------- VectorBinaryOperation --------------------------------
@@ -389,6 +397,99 @@ struct VectorBinaryPrimitive<operation_type,
   }
 };
 
+// Specializations for a column and a constant (the column-op-scalar and
+// scalar-op-column cases). The constant is read once, so it can stay in a
+// register, and the loop is left to the compiler to vectorize.
+template<OperatorId operation_type,
+         DataType result_type, DataType left_type, DataType right_type>
+struct VectorBinaryPrimitive<operation_type,
+                             DirectIndexResolver, ConstantIndexResolver,
+                             result_type, left_type, right_type, false> {
+  typedef typename TypeTraits<result_type>::cpp_type ResultCppType;
+  typedef typename TypeTraits<left_type>::cpp_type LeftCppType;
+  typedef typename TypeTraits<right_type>::cpp_type RightCppType;
+
+  typedef typename BinaryExpressionTraits<operation_type>::basic_operator
+      Operator;
+
+  // Returns true if operation has been successful.
+  bool operator()(const LeftCppType* left, const RightCppType* right,
+                  const index_t* indirection_left,
+                  const index_t* indirection_right,
+                  const index_t size,
+                  ResultCppType* result,
+                  Arena* arena) const {
+    Operator operation;
+    const RightCppType right_value = *right;
+    for (index_t i = 0; i < size; ++i) {
+      result[i] = operation(left[i], right_value);
+    }
+    return true;
+  }
+
+  // Returns true if operation has been successful.
+  bool operator()(const LeftCppType* left, const RightCppType* right,
+                  const index_t* indirection_left,
+                  const index_t* indirection_right,
+                  const index_t size,
+                  bool_const_ptr skip_list,
+                  ResultCppType* result,
+                  Arena* arena) const {
+    Operator operation;
+    const RightCppType right_value = *right;
+    for (index_t i = 0; i < size; ++i) {
+      if (!*skip_list) result[i] = operation(left[i], right_value);
+      ++skip_list;
+    }
+    return true;
+  }
+};
+
+template<OperatorId operation_type,
+         DataType result_type, DataType left_type, DataType right_type>
+struct VectorBinaryPrimitive<operation_type,
+                             ConstantIndexResolver, DirectIndexResolver,
+                             result_type, left_type, right_type, false> {
+  typedef typename TypeTraits<result_type>::cpp_type ResultCppType;
+  typedef typename TypeTraits<left_type>::cpp_type LeftCppType;
+  typedef typename TypeTraits<right_type>::cpp_type RightCppType;
+
+  typedef typename BinaryExpressionTraits<operation_type>::basic_operator
+      Operator;
+
+  // Returns true if operation has been successful.
+  bool operator()(const LeftCppType* left, const RightCppType* right,
+                  const index_t* indirection_left,
+                  const index_t* indirection_right,
+                  const index_t size,
+                  ResultCppType* result,
+                  Arena* arena) const {
+    Operator operation;
+    const LeftCppType left_value = *left;
+    for (index_t i = 0; i < size; ++i) {
+      result[i] = operation(left_value, right[i]);
+    }
+    return true;
+  }
+
+  // Returns true if operation has been successful.
+  bool operator()(const LeftCppType* left, const RightCppType* right,
+                  const index_t* indirection_left,
+                  const index_t* indirection_right,
+                  const index_t size,
+                  bool_const_ptr skip_list,
+                  ResultCppType* result,
+                  Arena* arena) const {
+    Operator operation;
+    const LeftCppType left_value = *left;
+    for (index_t i = 0; i < size; ++i) {
+      if (!*skip_list) result[i] = operation(left_value, right[i]);
+      ++skip_list;
+    }
+    return true;
+  }
+};
+
 // --------------------- VectorUnaryPrimitive ---------------------------------
 template <OperatorId operation_type, typename IndexResolver,
           DataType result_type, DataType input_type>
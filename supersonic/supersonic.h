@@ -39,6 +39,7 @@
 #include "supersonic/cursor/core/hash_join.h"  // IWYU pragma: keep
 #include "supersonic/cursor/core/limit.h"  // IWYU pragma: keep
 #include "supersonic/cursor/core/ownership_taker.h"  // IWYU pragma: keep
+#include "supersonic/cursor/core/parallel.h"  // IWYU pragma: keep
 #include "supersonic/cursor/core/project.h"  // IWYU pragma: keep
 #include "supersonic/cursor/core/sort.h"  // IWYU pragma: keep
 #include "supersonic/cursor/core/scan_view.h"  // IWYU pragma: keep
@@ -30,6 +30,7 @@
 #include "supersonic/cursor/core/sort.h"
 #include "supersonic/cursor/infrastructure/basic_cursor.h"
 #include "supersonic/cursor/infrastructure/ordering.h"
+#include "supersonic/cursor/infrastructure/temporary_file_factory.h"
 #include "supersonic/testing/comparators.h"
 #include "gtest/gtest.h"
 #include "supersonic/utils/random.h"
@@ -50,7 +51,8 @@ unique_ptr<Cursor> Sort(unique_ptr<Cursor> input) {
       std::move(bound_sort_order),
       std::move(bound_result_projector),
       1 << 19,  // 0.5 MB
-      "",
+      DefaultTemporaryFileFactory(""),
+      FILE_COMPRESSION_NONE,
       HeapBufferAllocator::Get(),
       std::move(input)));
 }